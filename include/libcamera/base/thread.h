@@ -8,6 +8,7 @@
 #pragma once
 
 #include <memory>
+#include <sched.h>
 #include <sys/types.h>
 #include <thread>
 
@@ -15,6 +16,7 @@
 
 #include <libcamera/base/message.h>
 #include <libcamera/base/signal.h>
+#include <libcamera/base/span.h>
 #include <libcamera/base/utils.h>
 
 namespace libcamera {
@@ -37,6 +39,9 @@ public:
 
 	bool isRunning();
 
+	int setThreadAffinity(const Span<const unsigned int> &cpus);
+	int setThreadPriority(int priority);
+
 	Signal<> finished;
 
 	static Thread *current();
@@ -54,6 +59,9 @@ private:
 	void startThread();
 	void finishThread();
 
+	int setThreadAffinityInternal(const cpu_set_t &cpuset);
+	int setThreadPriorityInternal(int priority);
+
 	void postMessage(std::unique_ptr<Message> msg, Object *receiver);
 	void removeMessages(Object *receiver);
 
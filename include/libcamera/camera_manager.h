@@ -15,6 +15,7 @@
 #include <libcamera/base/class.h>
 #include <libcamera/base/object.h>
 #include <libcamera/base/signal.h>
+#include <libcamera/base/span.h>
 
 namespace libcamera {
 
@@ -24,9 +25,17 @@ class CameraManager : public Object, public Extensible
 {
 	LIBCAMERA_DECLARE_PRIVATE()
 public:
+	enum class ThreadingModel {
+		Shared,
+		PerPipelineHandler,
+	};
+
 	CameraManager();
 	~CameraManager();
 
+	int setThreadingModel(ThreadingModel model);
+	ThreadingModel threadingModel() const;
+
 	int start();
 	void stop();
 
@@ -38,6 +47,10 @@ public:
 		       const std::vector<dev_t> &devnums);
 	void removeCamera(std::shared_ptr<Camera> camera);
 
+	int setThreadAffinity(std::shared_ptr<Camera> camera,
+			      const Span<const unsigned int> &cpus);
+	int setThreadPriority(std::shared_ptr<Camera> camera, int priority);
+
 	static const std::string &version() { return version_; }
 
 	Signal<std::shared_ptr<Camera>> cameraAdded;
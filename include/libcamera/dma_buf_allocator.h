@@ -0,0 +1,58 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2022, Google Inc.
+ *
+ * dma_buf_allocator.h - dma-buf allocator with buffer pool
+ */
+
+#pragma once
+
+#include <memory>
+#include <stddef.h>
+#include <vector>
+
+#include <libcamera/base/class.h>
+#include <libcamera/base/flags.h>
+#include <libcamera/base/unique_fd.h>
+
+namespace libcamera {
+
+class FrameBuffer;
+
+class DmaBufAllocator : public Extensible
+{
+	LIBCAMERA_DECLARE_PRIVATE()
+
+public:
+	enum class DmaBufAllocatorFlag {
+		CmaHeap = 1 << 0,
+		SystemHeap = 1 << 1,
+		UDmaBuf = 1 << 2,
+	};
+
+	using DmaBufAllocatorFlags = Flags<DmaBufAllocatorFlag>;
+
+	DmaBufAllocator(DmaBufAllocatorFlags type = DmaBufAllocatorFlag::CmaHeap);
+	~DmaBufAllocator();
+
+	bool isValid() const;
+
+	UniqueFD alloc(const char *name, size_t size);
+	void release(UniqueFD fd);
+
+	int exportBuffers(unsigned int count,
+			  const std::vector<unsigned int> &planeSizes,
+			  std::vector<std::unique_ptr<FrameBuffer>> *buffers);
+	void recycle(std::unique_ptr<FrameBuffer> buffer);
+
+	void setPoolLimit(size_t bytes);
+	size_t pooledBytes() const;
+	void trim();
+
+private:
+	LIBCAMERA_DISABLE_COPY_AND_MOVE(DmaBufAllocator)
+};
+
+LIBCAMERA_FLAGS_ENABLE_OPERATORS(DmaBufAllocator::DmaBufAllocatorFlag)
+
+} /* namespace libcamera */
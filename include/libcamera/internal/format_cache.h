@@ -0,0 +1,50 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2022, Google Inc.
+ *
+ * format_cache.h - Persistent cache of device formats
+ */
+
+#pragma once
+
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <libcamera/base/class.h>
+
+#include <libcamera/geometry.h>
+
+namespace libcamera {
+
+class MediaDevice;
+
+class FormatCache
+{
+public:
+	using Formats = std::map<unsigned int, std::vector<SizeRange>>;
+
+	static std::unique_ptr<FormatCache> create(const MediaDevice *media);
+
+	bool lookup(const std::string &entity, unsigned int pad,
+		    Formats *formats) const;
+	void store(const std::string &entity, unsigned int pad,
+		   const Formats &formats);
+
+private:
+	LIBCAMERA_DISABLE_COPY_AND_MOVE(FormatCache)
+
+	FormatCache(const std::string &path, const std::string &key);
+
+	int load();
+	int save() const;
+
+	std::string path_;
+	std::string key_;
+
+	std::map<std::pair<std::string, unsigned int>, Formats> formats_;
+};
+
+} /* namespace libcamera */
@@ -7,14 +7,18 @@
 
 #pragma once
 
+#include <array>
 #include <memory>
 #include <utility>
 
 #include <libcamera/base/class.h>
+#include <libcamera/base/mutex.h>
 
 #include <libcamera/fence.h>
 #include <libcamera/framebuffer.h>
 
+#include "libcamera/internal/mapped_framebuffer.h"
+
 namespace libcamera {
 
 class FrameBuffer::Private : public Extensible::Private
@@ -35,6 +39,8 @@ public:
 
 	FrameMetadata &metadata() { return metadata_; }
 
+	MappedFrameBuffer *mapping(MappedFrameBuffer::MapFlags flags) const;
+
 private:
 	std::vector<Plane> planes_;
 	FrameMetadata metadata_;
@@ -43,6 +49,10 @@ private:
 	std::unique_ptr<Fence> fence_;
 	Request *request_;
 	bool isContiguous_;
+
+	mutable Mutex mappingLock_;
+	mutable std::array<std::unique_ptr<MappedFrameBuffer>, 3> mappings_
+		LIBCAMERA_TSA_GUARDED_BY(mappingLock_);
 };
 
 } /* namespace libcamera */
@@ -12,6 +12,8 @@
 
 #include <libcamera/base/class.h>
 #include <libcamera/base/flags.h>
+#include <libcamera/base/mutex.h>
+#include <libcamera/base/shared_fd.h>
 #include <libcamera/base/span.h>
 
 #include <libcamera/framebuffer.h>
@@ -55,6 +57,27 @@ public:
 	using MapFlags = Flags<MapFlag>;
 
 	MappedFrameBuffer(const FrameBuffer *buffer, MapFlags flags);
+
+	MappedFrameBuffer(MappedFrameBuffer &&other);
+	MappedFrameBuffer &operator=(MappedFrameBuffer &&other);
+
+	int beginAccess(MapFlags access);
+	int beginAccess(unsigned int plane, MapFlags access);
+	int endAccess();
+	int endAccess(unsigned int plane);
+
+private:
+	struct DmaBuf {
+		SharedFD fd;
+		MapFlags access;
+		unsigned int users;
+	};
+
+	static int sync(const SharedFD &fd, MapFlags access, unsigned int flags);
+
+	Mutex accessLock_;
+	std::vector<DmaBuf> dmabufs_ LIBCAMERA_TSA_GUARDED_BY(accessLock_);
+	std::vector<unsigned int> planeDmaBufs_;
 };
 
 LIBCAMERA_FLAGS_ENABLE_OPERATORS(MappedFrameBuffer::MapFlag)
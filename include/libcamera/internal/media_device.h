@@ -8,6 +8,7 @@
 #pragma once
 
 #include <map>
+#include <memory>
 #include <sstream>
 #include <string>
 #include <vector>
@@ -22,6 +23,8 @@
 
 namespace libcamera {
 
+class FormatCache;
+
 class MediaDevice : protected Loggable
 {
 public:
@@ -41,9 +44,13 @@ public:
 	const std::string &driver() const { return driver_; }
 	const std::string &deviceNode() const { return deviceNode_; }
 	const std::string &model() const { return model_; }
+	const std::string &busInfo() const { return busInfo_; }
 	unsigned int version() const { return version_; }
+	unsigned int driverVersion() const { return driverVersion_; }
 	unsigned int hwRevision() const { return hwRevision_; }
 
+	FormatCache *formatCache() const;
+
 	const std::vector<MediaEntity *> &entities() const { return entities_; }
 	MediaEntity *getEntityByName(const std::string &name) const;
 
@@ -80,9 +87,14 @@ private:
 	std::string driver_;
 	std::string deviceNode_;
 	std::string model_;
+	std::string busInfo_;
 	unsigned int version_;
+	unsigned int driverVersion_;
 	unsigned int hwRevision_;
 
+	mutable std::unique_ptr<FormatCache> formatCache_;
+	mutable bool formatCacheInitialized_;
+
 	UniqueFD fd_;
 	bool valid_;
 	bool acquired_;
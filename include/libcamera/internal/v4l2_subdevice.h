@@ -80,6 +80,7 @@ public:
 			 Rectangle *rect);
 
 	Formats formats(unsigned int pad);
+	Formats cachedFormats(unsigned int pad);
 
 	int getFormat(unsigned int pad, V4L2SubdeviceFormat *format,
 		      Whence whence = ActiveFormat);
@@ -104,6 +105,7 @@ private:
 	std::optional<ColorSpace>
 	toColorSpace(const v4l2_mbus_framefmt &format) const;
 
+	Formats enumPadFormats(unsigned int pad);
 	std::vector<unsigned int> enumPadCodes(unsigned int pad);
 	std::vector<SizeRange> enumPadSizes(unsigned int pad,
 					    unsigned int code);
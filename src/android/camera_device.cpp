@@ -10,6 +10,7 @@
 #include <algorithm>
 #include <fstream>
 #include <set>
+#include <sstream>
 #include <sys/mman.h>
 #include <unistd.h>
 #include <vector>
@@ -247,7 +248,10 @@ bool validateCropRotate(const camera3_stream_configuration_t &streamList)
 
 CameraDevice::CameraDevice(unsigned int id, std::shared_ptr<Camera> camera)
 	: id_(id), state_(State::Stopped), camera_(std::move(camera)),
-	  facing_(CAMERA_FACING_FRONT), orientation_(0)
+	  resultEntryCapacity_(0), resultDataCapacity_(0),
+	  facing_(CAMERA_FACING_FRONT), orientation_(0),
+	  postProcessorWorkers_(1),
+	  scalingQuality_(CameraConfigData::ScalingQuality::Balanced)
 {
 	camera_->requestCompleted.connect(this, &CameraDevice::requestComplete);
 
@@ -375,6 +379,11 @@ int CameraDevice::initialize(const CameraConfigData *cameraConfigData)
 		orientation_ = 0;
 	}
 
+	if (cameraConfigData) {
+		postProcessorWorkers_ = cameraConfigData->postProcessorWorkers;
+		scalingQuality_ = cameraConfigData->scalingQuality;
+	}
+
 	return capabilities_.initialize(camera_, orientation_, facing_);
 }
 
@@ -429,6 +438,78 @@ void CameraDevice::flush()
 	state_ = State::Stopped;
 }
 
+/**
+ * \brief Dump the camera device state and statistics
+ * \param[in] fd The file descriptor to write to
+ *
+ * Write the camera state, the number of capture requests in flight, the
+ * post-processing statistics of each stream, and the latency statistics of the
+ * capture requests to \a fd. This implements the camera3 dump() operation,
+ * used by the dumpsys tool.
+ */
+void CameraDevice::dump(int fd)
+{
+	std::ostringstream out;
+
+	out << "Camera " << id_ << " '" << camera_->id() << "'" << std::endl;
+
+	{
+		MutexLocker stateLock(stateMutex_);
+
+		static const char *const states[] = { "Stopped", "Flushing", "Running" };
+		out << "  State: " << states[static_cast<unsigned int>(state_)]
+		    << std::endl;
+
+		MutexLocker descriptorsLock(descriptorsMutex_);
+		out << "  Requests in flight: " << descriptors_.size() << std::endl;
+
+		for (const CameraStream &stream : streams_) {
+			static const char *const types[] = { "direct", "internal", "mapped" };
+			const camera3_stream_t *camera3Stream = stream.camera3Stream();
+
+			out << "  Stream " << camera3Stream->width << "x"
+			    << camera3Stream->height << "["
+			    << utils::hex(camera3Stream->format) << "] ("
+			    << types[static_cast<unsigned int>(stream.type())] << ")";
+
+			if (stream.type() != CameraStream::Type::Direct) {
+				CameraStream::PostProcessorStats ppStats =
+					stream.postProcessorStats();
+
+				out << ": " << ppStats.workers << " workers, "
+				    << ppStats.processed << " processed, queue depth "
+				    << ppStats.queueDepth << " (max "
+				    << ppStats.maxQueueDepth << "), in flight "
+				    << ppStats.inFlight << " (max "
+				    << ppStats.maxInFlight << "), "
+				    << ppStats.reordered << " reordered";
+			}
+
+			out << std::endl;
+		}
+	}
+
+	stats_.dump(out);
+
+	const std::string str = out.str();
+	const char *data = str.data();
+	size_t remaining = str.size();
+
+	while (remaining) {
+		ssize_t ret = write(fd, data, remaining);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+
+			LOG(HAL, Error) << "Failed to write dump: " << strerror(errno);
+			return;
+		}
+
+		data += ret;
+		remaining -= ret;
+	}
+}
+
 void CameraDevice::stop()
 {
 	MutexLocker stateLock(stateMutex_);
@@ -548,12 +629,13 @@ int CameraDevice::configureStreams(camera3_stream_configuration_t *stream_list)
 	}
 
 	/*
-	 * Clear and remove any existing configuration from previous calls, and
-	 * ensure the required entries are available without further
-	 * reallocation.
+	 * Create the streams in a local vector, published in streams_ once
+	 * configured, as streams_ is read by dump() concurrently. Reserve the
+	 * required entries to avoid further reallocation, as the camera3
+	 * streams store pointers to the CameraStream instances.
 	 */
-	streams_.clear();
-	streams_.reserve(stream_list->num_streams);
+	std::vector<CameraStream> streams;
+	streams.reserve(stream_list->num_streams);
 
 	std::vector<Camera3StreamConfig> streamConfigs;
 	streamConfigs.reserve(stream_list->num_streams);
@@ -710,10 +792,10 @@ int CameraDevice::configureStreams(camera3_stream_configuration_t *stream_list)
 
 		CameraStream *sourceStream = nullptr;
 		for (auto &stream : streamConfig.streams) {
-			streams_.emplace_back(this, config.get(), stream.type,
-					      stream.stream, sourceStream,
-					      config->size() - 1);
-			stream.stream->priv = static_cast<void *>(&streams_.back());
+			streams.emplace_back(this, config.get(), stream.type,
+					     stream.stream, sourceStream,
+					     config->size() - 1);
+			stream.stream->priv = static_cast<void *>(&streams.back());
 
 			/*
 			 * The streamConfig.streams vector contains as its first
@@ -724,7 +806,7 @@ int CameraDevice::configureStreams(camera3_stream_configuration_t *stream_list)
 			 * streams.
 			 */
 			if (stream.type == CameraStream::Type::Direct)
-				sourceStream = &streams_.back();
+				sourceStream = &streams.back();
 		}
 	}
 
@@ -759,7 +841,7 @@ int CameraDevice::configureStreams(camera3_stream_configuration_t *stream_list)
 	 * StreamConfiguration and set the number of required buffers in
 	 * the Android camera3_stream_t.
 	 */
-	for (CameraStream &cameraStream : streams_) {
+	for (CameraStream &cameraStream : streams) {
 		ret = cameraStream.configure();
 		if (ret) {
 			LOG(HAL, Error) << "Failed to configure camera stream";
@@ -767,6 +849,16 @@ int CameraDevice::configureStreams(camera3_stream_configuration_t *stream_list)
 		}
 	}
 
+	/* Moving the vector preserves the addresses of its elements. */
+	{
+		MutexLocker stateLock(stateMutex_);
+		streams_ = std::move(streams);
+	}
+
+	ret = createResultMetadataTemplate();
+	if (ret)
+		return ret;
+
 	config_ = std::move(config);
 	return 0;
 }
@@ -1118,6 +1210,8 @@ int CameraDevice::processCaptureRequest(camera3_capture_request_t *camera3Reques
 
 	Request *request = descriptor->request_.get();
 
+	descriptor->timestamps_.queued = utils::clock::now();
+
 	{
 		MutexLocker descriptorsLock(descriptorsMutex_);
 		descriptors_.push(std::move(descriptor));
@@ -1133,6 +1227,8 @@ void CameraDevice::requestComplete(Request *request)
 	Camera3RequestDescriptor *descriptor =
 		reinterpret_cast<Camera3RequestDescriptor *>(request->cookie());
 
+	descriptor->timestamps_.completed = utils::clock::now();
+
 	/*
 	 * Prepare the capture result for the Android camera stack.
 	 *
@@ -1207,6 +1303,8 @@ void CameraDevice::requestComplete(Request *request)
 		descriptor->resultMetadata_ = std::make_unique<CameraMetadata>(0, 0);
 	}
 
+	descriptor->timestamps_.metadata = utils::clock::now();
+
 	/* Handle post-processing. */
 	MutexLocker locker(descriptor->streamsProcessMutex_);
 
@@ -1267,6 +1365,7 @@ void CameraDevice::completeDescriptor(Camera3RequestDescriptor *descriptor)
 {
 	MutexLocker lock(descriptorsMutex_);
 	descriptor->complete_ = true;
+	descriptor->timestamps_.processed = utils::clock::now();
 
 	sendCaptureResults();
 }
@@ -1324,7 +1423,12 @@ void CameraDevice::sendCaptureResults()
 		if (descriptor->status_ == Camera3RequestDescriptor::Status::Success)
 			captureResult.partial_result = 1;
 
+		stats_.record(*descriptor);
+
 		callbacks_->process_capture_result(callbacks_, &captureResult);
+
+		/* The framework has copied the result metadata, reuse it. */
+		recycleResultMetadata(std::move(descriptor->resultMetadata_));
 	}
 }
 
@@ -1411,158 +1515,250 @@ void CameraDevice::notifyError(uint32_t frameNumber, camera3_stream_t *stream,
 }
 
 /*
- * Produce a set of fixed result metadata.
+ * Create the result metadata template for the current configuration.
+ *
+ * The template contains the result metadata entries whose value doesn't depend
+ * on the request, as well as the per-request entries that are always reported,
+ * initialized to default values. The entry and data capacities of the result
+ * metadata packs are computed to additionally hold the entries only reported
+ * when available, and the JPEG entries set by the post-processor of each JPEG
+ * stream. Result metadata packs are then filled by copying the template and
+ * updating the per-request values in place, without any memory allocation.
  */
-std::unique_ptr<CameraMetadata>
-CameraDevice::getResultMetadata(const Camera3RequestDescriptor &descriptor) const
+int CameraDevice::createResultMetadataTemplate()
 {
-	const ControlList &metadata = descriptor.request_->metadata();
-	const CameraMetadata &settings = descriptor.settings_;
-	camera_metadata_ro_entry_t entry;
-	bool found;
-
-	/*
-	 * \todo Keep this in sync with the actual number of entries.
-	 * Currently: 40 entries, 156 bytes
-	 *
-	 * Reserve more space for the JPEG metadata set by the post-processor.
-	 * Currently:
-	 * ANDROID_JPEG_GPS_COORDINATES (double x 3) = 24 bytes
-	 * ANDROID_JPEG_GPS_PROCESSING_METHOD (byte x 32) = 32 bytes
-	 * ANDROID_JPEG_GPS_TIMESTAMP (int64) = 8 bytes
-	 * ANDROID_JPEG_SIZE (int32_t) = 4 bytes
-	 * ANDROID_JPEG_QUALITY (byte) = 1 byte
-	 * ANDROID_JPEG_ORIENTATION (int32_t) = 4 bytes
-	 * ANDROID_JPEG_THUMBNAIL_QUALITY (byte) = 1 byte
-	 * ANDROID_JPEG_THUMBNAIL_SIZE (int32 x 2) = 8 bytes
-	 * Total bytes for JPEG metadata: 82
-	 */
-	std::unique_ptr<CameraMetadata> resultMetadata =
-		std::make_unique<CameraMetadata>(88, 166);
-	if (!resultMetadata->isValid()) {
-		LOG(HAL, Error) << "Failed to allocate result metadata";
-		return nullptr;
-	}
-
 	/*
 	 * \todo The value of the results metadata copied from the settings
 	 * will have to be passed to the libcamera::Camera and extracted
 	 * from libcamera::Request::metadata.
 	 */
+	auto resultTemplate = std::make_unique<CameraMetadata>(32, 16);
+	if (!resultTemplate->isValid()) {
+		LOG(HAL, Error) << "Failed to allocate result metadata template";
+		return -ENOMEM;
+	}
 
 	uint8_t value = ANDROID_COLOR_CORRECTION_ABERRATION_MODE_OFF;
-	resultMetadata->addEntry(ANDROID_COLOR_CORRECTION_ABERRATION_MODE,
+	resultTemplate->addEntry(ANDROID_COLOR_CORRECTION_ABERRATION_MODE,
 				 value);
 
 	value = ANDROID_CONTROL_AE_ANTIBANDING_MODE_OFF;
-	resultMetadata->addEntry(ANDROID_CONTROL_AE_ANTIBANDING_MODE, value);
+	resultTemplate->addEntry(ANDROID_CONTROL_AE_ANTIBANDING_MODE, value);
 
 	int32_t value32 = 0;
-	resultMetadata->addEntry(ANDROID_CONTROL_AE_EXPOSURE_COMPENSATION,
+	resultTemplate->addEntry(ANDROID_CONTROL_AE_EXPOSURE_COMPENSATION,
 				 value32);
 
 	value = ANDROID_CONTROL_AE_LOCK_OFF;
-	resultMetadata->addEntry(ANDROID_CONTROL_AE_LOCK, value);
+	resultTemplate->addEntry(ANDROID_CONTROL_AE_LOCK, value);
 
 	value = ANDROID_CONTROL_AE_MODE_ON;
-	resultMetadata->addEntry(ANDROID_CONTROL_AE_MODE, value);
+	resultTemplate->addEntry(ANDROID_CONTROL_AE_MODE, value);
 
-	if (settings.getEntry(ANDROID_CONTROL_AE_TARGET_FPS_RANGE, &entry))
-		/*
-		 * \todo Retrieve the AE FPS range from the libcamera metadata.
-		 * As libcamera does not support that control, as a temporary
-		 * workaround return what the framework asked.
-		 */
-		resultMetadata->addEntry(ANDROID_CONTROL_AE_TARGET_FPS_RANGE,
-					 entry.data.i32, 2);
-
-	found = settings.getEntry(ANDROID_CONTROL_AE_PRECAPTURE_TRIGGER, &entry);
-	value = found ? *entry.data.u8 :
-			(uint8_t)ANDROID_CONTROL_AE_PRECAPTURE_TRIGGER_IDLE;
-	resultMetadata->addEntry(ANDROID_CONTROL_AE_PRECAPTURE_TRIGGER, value);
+	/* Updated with the value of the request settings. */
+	value = ANDROID_CONTROL_AE_PRECAPTURE_TRIGGER_IDLE;
+	resultTemplate->addEntry(ANDROID_CONTROL_AE_PRECAPTURE_TRIGGER, value);
 
 	value = ANDROID_CONTROL_AE_STATE_CONVERGED;
-	resultMetadata->addEntry(ANDROID_CONTROL_AE_STATE, value);
+	resultTemplate->addEntry(ANDROID_CONTROL_AE_STATE, value);
 
 	value = ANDROID_CONTROL_AF_MODE_OFF;
-	resultMetadata->addEntry(ANDROID_CONTROL_AF_MODE, value);
+	resultTemplate->addEntry(ANDROID_CONTROL_AF_MODE, value);
 
 	value = ANDROID_CONTROL_AF_STATE_INACTIVE;
-	resultMetadata->addEntry(ANDROID_CONTROL_AF_STATE, value);
+	resultTemplate->addEntry(ANDROID_CONTROL_AF_STATE, value);
 
 	value = ANDROID_CONTROL_AF_TRIGGER_IDLE;
-	resultMetadata->addEntry(ANDROID_CONTROL_AF_TRIGGER, value);
+	resultTemplate->addEntry(ANDROID_CONTROL_AF_TRIGGER, value);
 
 	value = ANDROID_CONTROL_AWB_MODE_AUTO;
-	resultMetadata->addEntry(ANDROID_CONTROL_AWB_MODE, value);
+	resultTemplate->addEntry(ANDROID_CONTROL_AWB_MODE, value);
 
 	value = ANDROID_CONTROL_AWB_LOCK_OFF;
-	resultMetadata->addEntry(ANDROID_CONTROL_AWB_LOCK, value);
+	resultTemplate->addEntry(ANDROID_CONTROL_AWB_LOCK, value);
 
 	value = ANDROID_CONTROL_AWB_STATE_CONVERGED;
-	resultMetadata->addEntry(ANDROID_CONTROL_AWB_STATE, value);
+	resultTemplate->addEntry(ANDROID_CONTROL_AWB_STATE, value);
 
 	value = ANDROID_CONTROL_CAPTURE_INTENT_PREVIEW;
-	resultMetadata->addEntry(ANDROID_CONTROL_CAPTURE_INTENT, value);
+	resultTemplate->addEntry(ANDROID_CONTROL_CAPTURE_INTENT, value);
 
 	value = ANDROID_CONTROL_EFFECT_MODE_OFF;
-	resultMetadata->addEntry(ANDROID_CONTROL_EFFECT_MODE, value);
+	resultTemplate->addEntry(ANDROID_CONTROL_EFFECT_MODE, value);
 
 	value = ANDROID_CONTROL_MODE_AUTO;
-	resultMetadata->addEntry(ANDROID_CONTROL_MODE, value);
+	resultTemplate->addEntry(ANDROID_CONTROL_MODE, value);
 
 	value = ANDROID_CONTROL_SCENE_MODE_DISABLED;
-	resultMetadata->addEntry(ANDROID_CONTROL_SCENE_MODE, value);
+	resultTemplate->addEntry(ANDROID_CONTROL_SCENE_MODE, value);
 
 	value = ANDROID_CONTROL_VIDEO_STABILIZATION_MODE_OFF;
-	resultMetadata->addEntry(ANDROID_CONTROL_VIDEO_STABILIZATION_MODE, value);
+	resultTemplate->addEntry(ANDROID_CONTROL_VIDEO_STABILIZATION_MODE, value);
 
 	value = ANDROID_FLASH_MODE_OFF;
-	resultMetadata->addEntry(ANDROID_FLASH_MODE, value);
+	resultTemplate->addEntry(ANDROID_FLASH_MODE, value);
 
 	value = ANDROID_FLASH_STATE_UNAVAILABLE;
-	resultMetadata->addEntry(ANDROID_FLASH_STATE, value);
-
-	if (settings.getEntry(ANDROID_LENS_APERTURE, &entry))
-		resultMetadata->addEntry(ANDROID_LENS_APERTURE, entry.data.f, 1);
+	resultTemplate->addEntry(ANDROID_FLASH_STATE, value);
 
 	float focal_length = 1.0;
-	resultMetadata->addEntry(ANDROID_LENS_FOCAL_LENGTH, focal_length);
+	resultTemplate->addEntry(ANDROID_LENS_FOCAL_LENGTH, focal_length);
 
 	value = ANDROID_LENS_STATE_STATIONARY;
-	resultMetadata->addEntry(ANDROID_LENS_STATE, value);
+	resultTemplate->addEntry(ANDROID_LENS_STATE, value);
 
 	value = ANDROID_LENS_OPTICAL_STABILIZATION_MODE_OFF;
-	resultMetadata->addEntry(ANDROID_LENS_OPTICAL_STABILIZATION_MODE,
+	resultTemplate->addEntry(ANDROID_LENS_OPTICAL_STABILIZATION_MODE,
 				 value);
 
+	/* Updated with the value reported by libcamera, if any. */
 	value32 = ANDROID_SENSOR_TEST_PATTERN_MODE_OFF;
-	resultMetadata->addEntry(ANDROID_SENSOR_TEST_PATTERN_MODE, value32);
+	resultTemplate->addEntry(ANDROID_SENSOR_TEST_PATTERN_MODE, value32);
 
 	value = ANDROID_STATISTICS_FACE_DETECT_MODE_OFF;
-	resultMetadata->addEntry(ANDROID_STATISTICS_FACE_DETECT_MODE, value);
+	resultTemplate->addEntry(ANDROID_STATISTICS_FACE_DETECT_MODE, value);
 
 	value = ANDROID_STATISTICS_LENS_SHADING_MAP_MODE_OFF;
-	resultMetadata->addEntry(ANDROID_STATISTICS_LENS_SHADING_MAP_MODE,
+	resultTemplate->addEntry(ANDROID_STATISTICS_LENS_SHADING_MAP_MODE,
 				 value);
 
 	value = ANDROID_STATISTICS_HOT_PIXEL_MAP_MODE_OFF;
-	resultMetadata->addEntry(ANDROID_STATISTICS_HOT_PIXEL_MAP_MODE, value);
+	resultTemplate->addEntry(ANDROID_STATISTICS_HOT_PIXEL_MAP_MODE, value);
 
 	value = ANDROID_STATISTICS_SCENE_FLICKER_NONE;
-	resultMetadata->addEntry(ANDROID_STATISTICS_SCENE_FLICKER, value);
+	resultTemplate->addEntry(ANDROID_STATISTICS_SCENE_FLICKER, value);
 
 	value = ANDROID_NOISE_REDUCTION_MODE_OFF;
-	resultMetadata->addEntry(ANDROID_NOISE_REDUCTION_MODE, value);
+	resultTemplate->addEntry(ANDROID_NOISE_REDUCTION_MODE, value);
 
 	/* 33.3 msec */
 	const int64_t rolling_shutter_skew = 33300000;
-	resultMetadata->addEntry(ANDROID_SENSOR_ROLLING_SHUTTER_SKEW,
+	resultTemplate->addEntry(ANDROID_SENSOR_ROLLING_SHUTTER_SKEW,
 				 rolling_shutter_skew);
 
+	/* Updated with the value reported by libcamera. */
+	const int64_t timestamp = 0;
+	resultTemplate->addEntry(ANDROID_SENSOR_TIMESTAMP, timestamp);
+
+	if (!resultTemplate->isValid()) {
+		LOG(HAL, Error) << "Failed to construct result metadata template";
+		return -ENOMEM;
+	}
+
+	/*
+	 * Reserve space for the entries reported only when available, and for
+	 * the JPEG entries set by the post-processor of each JPEG stream. The
+	 * GPS processing method is reserved with the 32 bytes size the camera
+	 * framework uses.
+	 */
+	std::vector<std::pair<uint32_t, size_t>> optionalEntries = {
+		{ ANDROID_CONTROL_AE_TARGET_FPS_RANGE, 2 },
+		{ ANDROID_LENS_APERTURE, 1 },
+		{ ANDROID_REQUEST_PIPELINE_DEPTH, 1 },
+		{ ANDROID_SENSOR_EXPOSURE_TIME, 1 },
+		{ ANDROID_SENSOR_FRAME_DURATION, 1 },
+		{ ANDROID_SCALER_CROP_REGION, 4 },
+	};
+
+	for (const CameraStream &stream : streams_) {
+		if (stream.camera3Stream()->format != HAL_PIXEL_FORMAT_BLOB)
+			continue;
+
+		optionalEntries.insert(optionalEntries.end(), {
+			{ ANDROID_JPEG_GPS_COORDINATES, 3 },
+			{ ANDROID_JPEG_GPS_PROCESSING_METHOD, 32 },
+			{ ANDROID_JPEG_GPS_TIMESTAMP, 1 },
+			{ ANDROID_JPEG_SIZE, 1 },
+			{ ANDROID_JPEG_QUALITY, 1 },
+			{ ANDROID_JPEG_ORIENTATION, 1 },
+			{ ANDROID_JPEG_THUMBNAIL_QUALITY, 1 },
+			{ ANDROID_JPEG_THUMBNAIL_SIZE, 2 },
+		});
+	}
+
+	auto [entryCount, dataCount] = resultTemplate->usage();
+
+	for (const auto &[tag, count] : optionalEntries) {
+		int type = get_camera_metadata_tag_type(tag);
+
+		entryCount++;
+		dataCount += calculate_camera_metadata_entry_data_size(type, count);
+	}
+
+	LOG(HAL, Debug)
+		<< "Result metadata capacity: " << entryCount << " entries and "
+		<< dataCount << " bytes";
+
+	MutexLocker locker(resultMetadataMutex_);
+
+	resultMetadataTemplate_ = std::move(resultTemplate);
+	resultEntryCapacity_ = entryCount;
+	resultDataCapacity_ = dataCount;
+
+	/* Drop the metadata packs sized for the previous configuration. */
+	resultMetadataPool_.clear();
+
+	return 0;
+}
+
+/*
+ * Produce the result metadata for a completed request.
+ *
+ * The result metadata pack is taken from the pool of recycled packs if
+ * available, and filled from the template created at configuration time.
+ */
+std::unique_ptr<CameraMetadata>
+CameraDevice::getResultMetadata(const Camera3RequestDescriptor &descriptor)
+{
+	const ControlList &metadata = descriptor.request_->metadata();
+	const CameraMetadata &settings = descriptor.settings_;
+	std::unique_ptr<CameraMetadata> resultMetadata;
+	camera_metadata_ro_entry_t entry;
+	bool found;
+
+	{
+		MutexLocker locker(resultMetadataMutex_);
+
+		if (!resultMetadataTemplate_) {
+			LOG(HAL, Error) << "No result metadata template";
+			return nullptr;
+		}
+
+		if (!resultMetadataPool_.empty()) {
+			resultMetadata = std::move(resultMetadataPool_.back());
+			resultMetadataPool_.pop_back();
+		} else {
+			resultMetadata =
+				std::make_unique<CameraMetadata>(resultEntryCapacity_,
+								 resultDataCapacity_);
+		}
+
+		if (!resultMetadata->copyFrom(*resultMetadataTemplate_)) {
+			LOG(HAL, Error) << "Failed to allocate result metadata";
+			return nullptr;
+		}
+	}
+
+	if (settings.getEntry(ANDROID_CONTROL_AE_TARGET_FPS_RANGE, &entry))
+		/*
+		 * \todo Retrieve the AE FPS range from the libcamera metadata.
+		 * As libcamera does not support that control, as a temporary
+		 * workaround return what the framework asked.
+		 */
+		resultMetadata->addEntry(ANDROID_CONTROL_AE_TARGET_FPS_RANGE,
+					 entry.data.i32, 2);
+
+	found = settings.getEntry(ANDROID_CONTROL_AE_PRECAPTURE_TRIGGER, &entry);
+	uint8_t value = found ? *entry.data.u8 :
+			(uint8_t)ANDROID_CONTROL_AE_PRECAPTURE_TRIGGER_IDLE;
+	resultMetadata->updateEntry(ANDROID_CONTROL_AE_PRECAPTURE_TRIGGER, value);
+
+	if (settings.getEntry(ANDROID_LENS_APERTURE, &entry))
+		resultMetadata->addEntry(ANDROID_LENS_APERTURE, entry.data.f, 1);
+
 	/* Add metadata tags reported by libcamera. */
 	const int64_t timestamp = metadata.get(controls::SensorTimestamp).value_or(0);
-	resultMetadata->addEntry(ANDROID_SENSOR_TIMESTAMP, timestamp);
+	resultMetadata->updateEntry(ANDROID_SENSOR_TIMESTAMP, timestamp);
 
 	const auto &pipelineDepth = metadata.get(controls::draft::PipelineDepth);
 	if (pipelineDepth)
@@ -1591,8 +1787,8 @@ CameraDevice::getResultMetadata(const Camera3RequestDescriptor &descriptor) cons
 
 	const auto &testPatternMode = metadata.get(controls::draft::TestPatternMode);
 	if (testPatternMode)
-		resultMetadata->addEntry(ANDROID_SENSOR_TEST_PATTERN_MODE,
-					 *testPatternMode);
+		resultMetadata->updateEntry(ANDROID_SENSOR_TEST_PATTERN_MODE,
+					    *testPatternMode);
 
 	/*
 	 * Return the result metadata pack even is not valid: get() will return
@@ -1611,3 +1807,24 @@ CameraDevice::getResultMetadata(const Camera3RequestDescriptor &descriptor) cons
 
 	return resultMetadata;
 }
+
+/*
+ * Return a result metadata pack to the pool once the capture result has been
+ * sent to the camera framework, for reuse by the next requests. Packs that
+ * can't hold the result metadata of the current configuration are freed.
+ */
+void CameraDevice::recycleResultMetadata(std::unique_ptr<CameraMetadata> metadata)
+{
+	if (!metadata || !metadata->isValid())
+		return;
+
+	auto [entryCapacity, dataCapacity] = metadata->capacity();
+
+	MutexLocker locker(resultMetadataMutex_);
+
+	if (entryCapacity < resultEntryCapacity_ ||
+	    dataCapacity < resultDataCapacity_)
+		return;
+
+	resultMetadataPool_.push_back(std::move(metadata));
+}
@@ -27,12 +27,13 @@
 #include <libcamera/stream.h>
 
 #include "camera_capabilities.h"
+#include "camera_hal_config.h"
 #include "camera_metadata.h"
+#include "camera_stats.h"
 #include "camera_stream.h"
 #include "jpeg/encoder.h"
 
 class Camera3RequestDescriptor;
-struct CameraConfigData;
 
 class CameraDevice : protected libcamera::Loggable
 {
@@ -46,6 +47,7 @@ public:
 	int open(const hw_module_t *hardwareModule);
 	void close();
 	void flush();
+	void dump(int fd);
 
 	unsigned int id() const { return id_; }
 	camera3_device_t *camera3Device() { return &camera3Device_; }
@@ -56,6 +58,8 @@ public:
 	const std::string &model() const { return model_; }
 	int facing() const { return facing_; }
 	int orientation() const { return orientation_; }
+	unsigned int postProcessorWorkers() const { return postProcessorWorkers_; }
+	CameraConfigData::ScalingQuality scalingQuality() const { return scalingQuality_; }
 	unsigned int maxJpegBufferSize() const;
 
 	void setCallbacks(const camera3_callback_ops_t *callbacks);
@@ -98,8 +102,10 @@ private:
 	void sendCaptureResults() LIBCAMERA_TSA_REQUIRES(descriptorsMutex_);
 	void setBufferStatus(Camera3RequestDescriptor::StreamBuffer &buffer,
 			     Camera3RequestDescriptor::Status status);
+	int createResultMetadataTemplate();
 	std::unique_ptr<CameraMetadata> getResultMetadata(
-		const Camera3RequestDescriptor &descriptor) const;
+		const Camera3RequestDescriptor &descriptor);
+	void recycleResultMetadata(std::unique_ptr<CameraMetadata> metadata);
 
 	unsigned int id_;
 	camera3_device_t camera3Device_;
@@ -114,17 +120,31 @@ private:
 	std::map<unsigned int, std::unique_ptr<CameraMetadata>> requestTemplates_;
 	const camera3_callback_ops_t *callbacks_;
 
+	/* Modified with stateMutex_ held, as it is read by dump(). */
 	std::vector<CameraStream> streams_;
 
 	libcamera::Mutex descriptorsMutex_ LIBCAMERA_TSA_ACQUIRED_AFTER(stateMutex_);
 	std::queue<std::unique_ptr<Camera3RequestDescriptor>> descriptors_
 		LIBCAMERA_TSA_GUARDED_BY(descriptorsMutex_);
 
+	libcamera::Mutex resultMetadataMutex_
+		LIBCAMERA_TSA_ACQUIRED_AFTER(descriptorsMutex_);
+	std::unique_ptr<CameraMetadata> resultMetadataTemplate_
+		LIBCAMERA_TSA_GUARDED_BY(resultMetadataMutex_);
+	std::vector<std::unique_ptr<CameraMetadata>> resultMetadataPool_
+		LIBCAMERA_TSA_GUARDED_BY(resultMetadataMutex_);
+	size_t resultEntryCapacity_ LIBCAMERA_TSA_GUARDED_BY(resultMetadataMutex_);
+	size_t resultDataCapacity_ LIBCAMERA_TSA_GUARDED_BY(resultMetadataMutex_);
+
 	std::string maker_;
 	std::string model_;
 
 	int facing_;
 	int orientation_;
+	unsigned int postProcessorWorkers_;
+	CameraConfigData::ScalingQuality scalingQuality_;
 
 	CameraMetadata lastSettings_;
+
+	CameraStats stats_;
 };
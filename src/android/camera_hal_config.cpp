@@ -33,6 +33,10 @@ private:
 	int parseCameraConfigData(const std::string &cameraId, const YamlObject &);
 	int parseLocation(const YamlObject &, CameraConfigData &cameraConfigData);
 	int parseRotation(const YamlObject &, CameraConfigData &cameraConfigData);
+	int parsePostProcessorWorkers(const YamlObject &,
+				      CameraConfigData &cameraConfigData);
+	int parseScalingQuality(const YamlObject &,
+				CameraConfigData &cameraConfigData);
 
 	std::map<std::string, CameraConfigData> *cameras_;
 };
@@ -55,6 +59,8 @@ int CameraHalConfig::Private::parseConfigFile(File &file,
 	 *   "camera0 id":
 	 *     location: value
 	 *     rotation: value
+	 *     post_processor_workers: value (optional)
+	 *     scaling_quality: value (optional)
 	 *     ...
 	 *
 	 *   "camera1 id":
@@ -106,6 +112,14 @@ int CameraHalConfig::Private::parseCameraConfigData(const std::string &cameraId,
 	if (parseRotation(cameraObject, cameraConfigData))
 		return -EINVAL;
 
+	/* Parse property "post_processor_workers" */
+	if (parsePostProcessorWorkers(cameraObject, cameraConfigData))
+		return -EINVAL;
+
+	/* Parse property "scaling_quality" */
+	if (parseScalingQuality(cameraObject, cameraConfigData))
+		return -EINVAL;
+
 	return 0;
 }
 
@@ -145,6 +159,49 @@ int CameraHalConfig::Private::parseRotation(const YamlObject &cameraObject,
 	return 0;
 }
 
+int CameraHalConfig::Private::parsePostProcessorWorkers(const YamlObject &cameraObject,
+							CameraConfigData &cameraConfigData)
+{
+	/* The number of post-processing workers per stream is optional. */
+	if (!cameraObject.contains("post_processor_workers"))
+		return 0;
+
+	int32_t workers = cameraObject["post_processor_workers"].get<int32_t>(0);
+
+	if (workers < 1 || workers > 16) {
+		LOG(HALConfig, Error)
+			<< "Invalid number of post-processor workers: " << workers;
+		return -EINVAL;
+	}
+
+	cameraConfigData.postProcessorWorkers = workers;
+	return 0;
+}
+
+int CameraHalConfig::Private::parseScalingQuality(const YamlObject &cameraObject,
+						  CameraConfigData &cameraConfigData)
+{
+	/* The quality of software scaling is optional. */
+	if (!cameraObject.contains("scaling_quality"))
+		return 0;
+
+	std::string quality = cameraObject["scaling_quality"].get<std::string>("");
+
+	if (quality == "fast")
+		cameraConfigData.scalingQuality = CameraConfigData::ScalingQuality::Fast;
+	else if (quality == "balanced")
+		cameraConfigData.scalingQuality = CameraConfigData::ScalingQuality::Balanced;
+	else if (quality == "best")
+		cameraConfigData.scalingQuality = CameraConfigData::ScalingQuality::Best;
+	else {
+		LOG(HALConfig, Error)
+			<< "Unknown scaling quality: " << quality;
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
 CameraHalConfig::CameraHalConfig()
 	: Extensible(std::make_unique<Private>()), exists_(false), valid_(false)
 {
@@ -188,7 +245,8 @@ int CameraHalConfig::parseConfigurationFile()
 		const CameraConfigData &camera = c.second;
 		LOG(HALConfig, Debug) << "'" << cameraId << "' "
 				      << "(" << camera.facing << ")["
-				      << camera.rotation << "]";
+				      << camera.rotation << "] "
+				      << camera.postProcessorWorkers << " workers";
 	}
 
 	return 0;
@@ -13,8 +13,16 @@
 #include <libcamera/base/class.h>
 
 struct CameraConfigData {
+	enum class ScalingQuality {
+		Fast,
+		Balanced,
+		Best,
+	};
+
 	int facing = -1;
 	int rotation = -1;
+	unsigned int postProcessorWorkers = 1;
+	ScalingQuality scalingQuality = ScalingQuality::Balanced;
 };
 
 class CameraHalConfig final : public libcamera::Extensible
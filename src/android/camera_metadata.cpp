@@ -57,6 +57,56 @@ CameraMetadata &CameraMetadata::operator=(const CameraMetadata &other)
 	return *this;
 }
 
+/*
+ * \brief Replace the metadata content with a copy of \a other
+ * \param[in] other The metadata pack to copy
+ *
+ * Copy all entries of \a other, reusing the current storage when its entry and
+ * data capacities are large enough to hold them. The capacity of the container
+ * is preserved, which allows entries to be added to the copy without any
+ * memory allocation. This is used to fill per-request metadata packs from a
+ * template without reallocating them.
+ *
+ * \return True if the copy was successful, false otherwise
+ */
+bool CameraMetadata::copyFrom(const CameraMetadata &other)
+{
+	if (this == &other)
+		return valid_;
+
+	const camera_metadata_t *src = other.getMetadata();
+	if (!src) {
+		valid_ = false;
+		return false;
+	}
+
+	resized_ = false;
+
+	size_t entryCount = get_camera_metadata_entry_count(src);
+	size_t dataCount = get_camera_metadata_data_count(src);
+
+	if (!metadata_ ||
+	    get_camera_metadata_entry_capacity(metadata_) < entryCount ||
+	    get_camera_metadata_data_capacity(metadata_) < dataCount) {
+		*this = other;
+		return valid_;
+	}
+
+	size_t entryCapacity = get_camera_metadata_entry_capacity(metadata_);
+	size_t dataCapacity = get_camera_metadata_data_capacity(metadata_);
+
+	/* Reset the container in place, then append the source entries. */
+	if (!place_camera_metadata(metadata_, get_camera_metadata_size(metadata_),
+				   entryCapacity, dataCapacity)) {
+		valid_ = false;
+		return false;
+	}
+
+	valid_ = !append_camera_metadata(metadata_, src);
+
+	return valid_;
+}
+
 std::tuple<size_t, size_t> CameraMetadata::usage() const
 {
 	size_t currentEntryCount = get_camera_metadata_entry_count(metadata_);
@@ -65,6 +115,14 @@ std::tuple<size_t, size_t> CameraMetadata::usage() const
 	return { currentEntryCount, currentDataCount };
 }
 
+std::tuple<size_t, size_t> CameraMetadata::capacity() const
+{
+	size_t entryCapacity = get_camera_metadata_entry_capacity(metadata_);
+	size_t dataCapacity = get_camera_metadata_data_capacity(metadata_);
+
+	return { entryCapacity, dataCapacity };
+}
+
 bool CameraMetadata::getEntry(uint32_t tag, camera_metadata_ro_entry_t *entry) const
 {
 	if (find_camera_metadata_ro_entry(metadata_, tag, entry))
@@ -23,7 +23,10 @@ public:
 
 	CameraMetadata &operator=(const CameraMetadata &other);
 
+	bool copyFrom(const CameraMetadata &other);
+
 	std::tuple<size_t, size_t> usage() const;
+	std::tuple<size_t, size_t> capacity() const;
 	bool resized() const { return resized_; }
 
 	bool isValid() const { return valid_; }
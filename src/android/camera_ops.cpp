@@ -61,9 +61,13 @@ static int hal_dev_process_capture_request(const struct camera3_device *dev,
 	return camera->processCaptureRequest(request);
 }
 
-static void hal_dev_dump([[maybe_unused]] const struct camera3_device *dev,
-			 [[maybe_unused]] int fd)
+static void hal_dev_dump(const struct camera3_device *dev, int fd)
 {
+	if (!dev)
+		return;
+
+	CameraDevice *camera = reinterpret_cast<CameraDevice *>(dev->priv);
+	camera->dump(fd);
 }
 
 static int hal_dev_flush(const struct camera3_device *dev)
@@ -111,6 +111,8 @@ using namespace libcamera;
 Camera3RequestDescriptor::Camera3RequestDescriptor(
 	Camera *camera, const camera3_capture_request_t *camera3Request)
 {
+	timestamps_.received = utils::clock::now();
+
 	frameNumber_ = camera3Request->frame_number;
 
 	/* Copy the camera3 request stream information for later access. */
@@ -175,6 +177,9 @@ Camera3RequestDescriptor::~Camera3RequestDescriptor() = default;
  * \var Camera3RequestDescriptor::StreamBuffer::dstBuffer
  * \brief Pointer to the destination frame buffer used for post-processing
  *
+ * \var Camera3RequestDescriptor::StreamBuffer::fenceWait
+ * \brief Time spent waiting on the acquire fence before post-processing
+ *
  * \var Camera3RequestDescriptor::StreamBuffer::request
  * \brief Back pointer to the Camera3RequestDescriptor to which the StreamBuffer belongs
  */
@@ -14,6 +14,7 @@
 #include <libcamera/base/class.h>
 #include <libcamera/base/mutex.h>
 #include <libcamera/base/unique_fd.h>
+#include <libcamera/base/utils.h>
 
 #include <libcamera/camera.h>
 #include <libcamera/framebuffer.h>
@@ -33,6 +34,15 @@ public:
 		Error,
 	};
 
+	/* Time points of the request processing stages, for statistics. */
+	struct Timestamps {
+		libcamera::utils::time_point received;
+		libcamera::utils::time_point queued;
+		libcamera::utils::time_point completed;
+		libcamera::utils::time_point metadata;
+		libcamera::utils::time_point processed;
+	};
+
 	struct StreamBuffer {
 		StreamBuffer(CameraStream *stream,
 			     const camera3_stream_buffer_t &buffer,
@@ -50,6 +60,7 @@ public:
 		libcamera::FrameBuffer *internalBuffer = nullptr;
 		const libcamera::FrameBuffer *srcBuffer = nullptr;
 		std::unique_ptr<CameraBuffer> dstBuffer;
+		libcamera::utils::duration fenceWait{};
 		Camera3RequestDescriptor *request;
 
 	private:
@@ -78,6 +89,8 @@ public:
 	bool complete_ = false;
 	Status status_ = Status::Success;
 
+	Timestamps timestamps_;
+
 private:
 	LIBCAMERA_DISABLE_COPY(Camera3RequestDescriptor)
 };
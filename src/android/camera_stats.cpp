@@ -0,0 +1,229 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2022, Google Inc.
+ *
+ * camera_stats.cpp - Camera HAL request latency statistics
+ */
+
+#include "camera_stats.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+
+#include "libcamera/internal/tracepoints.h"
+
+#include "camera_request.h"
+
+using namespace libcamera;
+
+/*
+ * \class CameraStats
+ * \brief Collect latency statistics of the capture requests of a camera
+ *
+ * Camera3RequestDescriptor instances record timestamps when going through the
+ * HAL processing stages. When a capture result is sent to the framework, the
+ * duration of each stage is computed and accumulated in a per-stage histogram,
+ * and optionally emitted as a tracepoint. The histograms are summarised as
+ * percentiles in the HAL dump output.
+ *
+ * The stages are:
+ *
+ * - Queueing: from the reception of the capture request to queueing the
+ *   libcamera request
+ * - Capture: from queueing the libcamera request to its completion
+ * - Metadata: generation of the result metadata
+ * - FenceWait: wait on the acquire fences of post-processed streams
+ * - PostProcessing: from the generation of the result metadata to the
+ *   completion of all post-processed streams, including fence waits
+ * - Delivery: from the completion of the request to sending the result to the
+ *   framework, when waiting for earlier requests to complete
+ * - Total: from the reception of the capture request to sending the result
+ *
+ * Durations are recorded in microseconds. Failed requests are only counted.
+ */
+
+/*
+ * The histograms use 16 linear sub-buckets per power of two, which bounds the
+ * relative error of the reported percentiles to 1/16, and covers durations up
+ * to 2^kMaxExponent microseconds.
+ */
+namespace {
+
+constexpr unsigned int kSubBucketBits = 4;
+constexpr unsigned int kSubBuckets = 1 << kSubBucketBits;
+constexpr unsigned int kMaxExponent = 40;
+constexpr unsigned int kBuckets = (kMaxExponent - kSubBucketBits + 2) * kSubBuckets;
+
+} /* namespace */
+
+CameraStats::Histogram::Histogram()
+	: buckets_(kBuckets)
+{
+	reset();
+}
+
+unsigned int CameraStats::Histogram::bucket(uint64_t value)
+{
+	if (value < kSubBuckets)
+		return value;
+
+	unsigned int exponent = 63 - __builtin_clzll(value);
+	if (exponent > kMaxExponent)
+		return kBuckets - 1;
+
+	unsigned int shift = exponent - kSubBucketBits;
+	unsigned int subBucket = (value >> shift) & (kSubBuckets - 1);
+
+	return (shift + 1) * kSubBuckets + subBucket;
+}
+
+uint64_t CameraStats::Histogram::bucketValue(unsigned int bucket)
+{
+	if (bucket < kSubBuckets)
+		return bucket;
+
+	unsigned int shift = bucket / kSubBuckets - 1;
+	unsigned int subBucket = bucket % kSubBuckets;
+
+	return static_cast<uint64_t>(kSubBuckets + subBucket) << shift;
+}
+
+void CameraStats::Histogram::add(uint64_t value)
+{
+	buckets_[bucket(value)]++;
+	count_++;
+	sum_ += value;
+	min_ = std::min(min_, value);
+	max_ = std::max(max_, value);
+}
+
+void CameraStats::Histogram::reset()
+{
+	std::fill(buckets_.begin(), buckets_.end(), 0);
+	count_ = 0;
+	sum_ = 0;
+	min_ = UINT64_MAX;
+	max_ = 0;
+}
+
+/*
+ * Return the lower bound of the bucket containing the given percentile,
+ * clamped to the recorded minimum and maximum values.
+ */
+uint64_t CameraStats::Histogram::percentile(unsigned int percent) const
+{
+	if (!count_)
+		return 0;
+
+	uint64_t rank = std::max<uint64_t>((count_ * percent + 99) / 100, 1);
+	uint64_t cumulative = 0;
+
+	for (unsigned int i = 0; i < buckets_.size(); ++i) {
+		cumulative += buckets_[i];
+		if (cumulative >= rank)
+			return std::clamp(bucketValue(i), min_, max_);
+	}
+
+	return max_;
+}
+
+CameraStats::CameraStats()
+	: errors_(0)
+{
+}
+
+void CameraStats::record(const Camera3RequestDescriptor &descriptor)
+{
+	const Camera3RequestDescriptor::Timestamps &ts = descriptor.timestamps_;
+	const utils::time_point sent = utils::clock::now();
+
+	if (descriptor.status_ != Camera3RequestDescriptor::Status::Success ||
+	    ts.metadata == utils::time_point{}) {
+		MutexLocker locker(mutex_);
+		errors_++;
+		return;
+	}
+
+	auto us = [](utils::duration d) -> uint64_t {
+		return std::chrono::duration_cast<std::chrono::microseconds>(d).count();
+	};
+
+	/*
+	 * The streams of a request are post-processed concurrently, each
+	 * recording its own fence wait time. Account for the total.
+	 */
+	utils::duration fenceWait{};
+	for (const Camera3RequestDescriptor::StreamBuffer &buffer : descriptor.buffers_)
+		fenceWait += buffer.fenceWait;
+
+	std::array<uint64_t, StageCount> durations;
+	durations[Queueing] = us(ts.queued - ts.received);
+	durations[Capture] = us(ts.completed - ts.queued);
+	durations[Metadata] = us(ts.metadata - ts.completed);
+	durations[FenceWait] = us(fenceWait);
+	durations[PostProcessing] = us(ts.processed - ts.metadata);
+	durations[Delivery] = us(sent - ts.processed);
+	durations[Total] = us(sent - ts.received);
+
+	LIBCAMERA_TRACEPOINT(android_request_complete, descriptor.frameNumber_,
+			     durations[Queueing], durations[Capture],
+			     durations[Metadata], durations[FenceWait],
+			     durations[PostProcessing], durations[Delivery]);
+
+	MutexLocker locker(mutex_);
+
+	for (unsigned int i = 0; i < StageCount; ++i)
+		histograms_[i].add(durations[i]);
+}
+
+void CameraStats::reset()
+{
+	MutexLocker locker(mutex_);
+
+	for (Histogram &histogram : histograms_)
+		histogram.reset();
+	errors_ = 0;
+}
+
+void CameraStats::dump(std::ostream &out) const
+{
+	MutexLocker locker(mutex_);
+
+	out << "  Requests: " << histograms_[Total].count() << " completed, "
+	    << errors_ << " failed" << std::endl;
+	out << "  Latency (us)      count      min      p50      p90      p99"
+	    << "      max     mean" << std::endl;
+
+	for (unsigned int i = 0; i < StageCount; ++i) {
+		const Histogram &histogram = histograms_[i];
+
+		out << "    " << std::left << std::setw(15)
+		    << stageName(static_cast<Stage>(i)) << std::right
+		    << std::setw(8) << histogram.count()
+		    << std::setw(9) << histogram.min()
+		    << std::setw(9) << histogram.percentile(50)
+		    << std::setw(9) << histogram.percentile(90)
+		    << std::setw(9) << histogram.percentile(99)
+		    << std::setw(9) << histogram.max()
+		    << std::setw(9) << histogram.mean() << std::endl;
+	}
+}
+
+const char *CameraStats::stageName(Stage stage)
+{
+	static const char *const names[] = {
+		"Queueing",
+		"Capture",
+		"Metadata",
+		"FenceWait",
+		"PostProcessing",
+		"Delivery",
+		"Total",
+	};
+
+	if (stage >= StageCount)
+		return "Unknown";
+
+	return names[stage];
+}
@@ -0,0 +1,70 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2022, Google Inc.
+ *
+ * camera_stats.h - Camera HAL request latency statistics
+ */
+
+#pragma once
+
+#include <array>
+#include <ostream>
+#include <stdint.h>
+#include <vector>
+
+#include <libcamera/base/mutex.h>
+
+class Camera3RequestDescriptor;
+
+class CameraStats
+{
+public:
+	enum Stage {
+		Queueing,
+		Capture,
+		Metadata,
+		FenceWait,
+		PostProcessing,
+		Delivery,
+		Total,
+		StageCount,
+	};
+
+	CameraStats();
+
+	void record(const Camera3RequestDescriptor &descriptor);
+	void reset();
+	void dump(std::ostream &out) const;
+
+	static const char *stageName(Stage stage);
+
+private:
+	class Histogram
+	{
+	public:
+		Histogram();
+
+		void add(uint64_t value);
+		void reset();
+
+		uint64_t count() const { return count_; }
+		uint64_t min() const { return count_ ? min_ : 0; }
+		uint64_t max() const { return max_; }
+		uint64_t mean() const { return count_ ? sum_ / count_ : 0; }
+		uint64_t percentile(unsigned int percent) const;
+
+	private:
+		static unsigned int bucket(uint64_t value);
+		static uint64_t bucketValue(unsigned int bucket);
+
+		std::vector<uint32_t> buckets_;
+		uint64_t count_;
+		uint64_t sum_;
+		uint64_t min_;
+		uint64_t max_;
+	};
+
+	mutable libcamera::Mutex mutex_;
+	std::array<Histogram, StageCount> histograms_ LIBCAMERA_TSA_GUARDED_BY(mutex_);
+	uint64_t errors_ LIBCAMERA_TSA_GUARDED_BY(mutex_);
+};
@@ -7,6 +7,7 @@
 
 #include "camera_stream.h"
 
+#include <algorithm>
 #include <errno.h>
 #include <string.h>
 #include <sys/mman.h>
@@ -92,26 +93,40 @@ int CameraStream::configure()
 		output.size.width = camera3Stream_->width;
 		output.size.height = camera3Stream_->height;
 
-		switch (outFormat) {
-		case formats::NV12:
-			postProcessor_ = std::make_unique<PostProcessorYuv>();
-			break;
+		/*
+		 * Create one post-processor per worker. Post-processed buffers
+		 * are completed in the order they have been queued, regardless
+		 * of the worker that processed them.
+		 */
+		queue_ = std::make_unique<PostProcessorQueue>();
 
-		case formats::MJPEG:
-			postProcessor_ = std::make_unique<PostProcessorJpeg>(cameraDevice_);
-			break;
+		for (unsigned int i = 0; i < cameraDevice_->postProcessorWorkers(); ++i) {
+			std::unique_ptr<PostProcessor> postProcessor;
 
-		default:
-			LOG(HAL, Error) << "Unsupported format: " << outFormat;
-			return -EINVAL;
-		}
+			switch (outFormat) {
+			case formats::NV12:
+				postProcessor = std::make_unique<PostProcessorYuv>(
+					cameraDevice_->scalingQuality());
+				break;
 
-		int ret = postProcessor_->configure(configuration(), output);
-		if (ret)
-			return ret;
+			case formats::MJPEG:
+				postProcessor = std::make_unique<PostProcessorJpeg>(cameraDevice_);
+				break;
+
+			default:
+				LOG(HAL, Error) << "Unsupported format: " << outFormat;
+				return -EINVAL;
+			}
+
+			int ret = postProcessor->configure(configuration(), output);
+			if (ret)
+				return ret;
 
-		worker_ = std::make_unique<PostProcessorWorker>(postProcessor_.get());
-		postProcessor_->processComplete.connect(
+			queue_->addWorker(postProcessor.get());
+			postProcessors_.push_back(std::move(postProcessor));
+		}
+
+		queue_->processComplete.connect(
 			this, [&](Camera3RequestDescriptor::StreamBuffer *streamBuffer,
 				  PostProcessor::Status status) {
 				Camera3RequestDescriptor::Status bufferStatus;
@@ -125,7 +140,7 @@ int CameraStream::configure()
 									bufferStatus);
 			});
 
-		worker_->start();
+		queue_->start();
 	}
 
 	allocator_ = std::make_unique<PlatformFrameBufferAllocator>(cameraDevice_);
@@ -171,7 +186,9 @@ int CameraStream::process(Camera3RequestDescriptor::StreamBuffer *streamBuffer)
 
 	/* Handle waiting on fences on the destination buffer. */
 	if (streamBuffer->fence.isValid()) {
+		utils::time_point start = utils::clock::now();
 		int ret = waitFence(streamBuffer->fence.get());
+		streamBuffer->fenceWait = utils::clock::now() - start;
 		if (ret < 0) {
 			LOG(HAL, Error) << "Failed waiting for fence: "
 					<< streamBuffer->fence.get() << ": "
@@ -191,17 +208,37 @@ int CameraStream::process(Camera3RequestDescriptor::StreamBuffer *streamBuffer)
 		return -EINVAL;
 	}
 
-	worker_->queueRequest(streamBuffer);
+	queue_->queueRequest(streamBuffer);
 
 	return 0;
 }
 
 void CameraStream::flush()
 {
-	if (!postProcessor_)
+	if (!queue_)
 		return;
 
-	worker_->flush();
+	queue_->flush();
+}
+
+/**
+ * \brief Retrieve the post-processing statistics of the stream
+ *
+ * The statistics report the number of post-processing workers, the current and
+ * maximum number of buffers waiting for a worker, the current and maximum
+ * number of buffers in flight (queued, being processed or waiting for earlier
+ * buffers to complete), the number of processed buffers, and the number of
+ * buffers whose completion has been delayed to preserve ordering. They are
+ * meant to help sizing the number of workers.
+ *
+ * \return The post-processing statistics, all zero for direct streams
+ */
+CameraStream::PostProcessorStats CameraStream::postProcessorStats() const
+{
+	if (!queue_)
+		return {};
+
+	return queue_->stats();
 }
 
 FrameBuffer *CameraStream::getBuffer()
@@ -250,29 +287,74 @@ void CameraStream::putBuffer(FrameBuffer *buffer)
  *
  * If the association between CameraStream and camera3_stream_t dictated by
  * CameraStream::Type is internal or mapped, the stream is generated by post
- * processing of a libcamera stream. Such a request is queued to a
- * PostProcessorWorker in CameraStream::process(). A queue of post-processing
- * requests is maintained by the PostProcessorWorker and it will run the
- * post-processing on an internal thread as soon as any request is available on
- * its queue.
+ * processing of a libcamera stream. Such a request is queued to the
+ * PostProcessorQueue in CameraStream::process(), and the PostProcessorWorker
+ * instances of the stream run the post-processing on internal threads as soon
+ * as any request is available on the queue. Each worker owns a separate
+ * PostProcessor.
  */
-CameraStream::PostProcessorWorker::PostProcessorWorker(PostProcessor *postProcessor)
-	: postProcessor_(postProcessor)
+CameraStream::PostProcessorWorker::PostProcessorWorker(PostProcessorQueue *queue,
+						       PostProcessor *postProcessor)
+	: queue_(queue), postProcessor_(postProcessor)
 {
 }
 
 CameraStream::PostProcessorWorker::~PostProcessorWorker()
+{
+	wait();
+}
+
+void CameraStream::PostProcessorWorker::run()
+{
+	while (Camera3RequestDescriptor::StreamBuffer *streamBuffer =
+		       queue_->dequeueRequest())
+		postProcessor_->process(streamBuffer);
+}
+
+/**
+ * \class CameraStream::PostProcessorQueue
+ * \brief Dispatch post-processing requests to a pool of workers
+ *
+ * The PostProcessorQueue stores the post-processing requests of a CameraStream
+ * until a PostProcessorWorker is available to process them. As requests may
+ * complete out of order when multiple workers are used, completions are held
+ * in a reorder buffer and the processComplete signal is emitted in the order
+ * requests have been queued.
+ */
+CameraStream::PostProcessorQueue::PostProcessorQueue()
+	: stats_{}
+{
+}
+
+CameraStream::PostProcessorQueue::~PostProcessorQueue()
 {
 	{
 		MutexLocker lock(mutex_);
 		state_ = State::Stopped;
 	}
 
-	cv_.notify_one();
-	wait();
+	cv_.notify_all();
+	workers_.clear();
+
+	MutexLocker lock(mutex_);
+	LOG(HAL, Debug)
+		<< "Post-processing: " << stats_.workers << " workers, "
+		<< stats_.processed << " buffers, max queue depth "
+		<< stats_.maxQueueDepth << ", max in flight "
+		<< stats_.maxInFlight << ", " << stats_.reordered
+		<< " reordered";
 }
 
-void CameraStream::PostProcessorWorker::start()
+void CameraStream::PostProcessorQueue::addWorker(PostProcessor *postProcessor)
+{
+	postProcessor->processComplete.connect(this, &PostProcessorQueue::complete);
+	workers_.push_back(std::make_unique<PostProcessorWorker>(this, postProcessor));
+
+	MutexLocker lock(mutex_);
+	stats_.workers = workers_.size();
+}
+
+void CameraStream::PostProcessorQueue::start()
 {
 	{
 		MutexLocker lock(mutex_);
@@ -280,62 +362,119 @@ void CameraStream::PostProcessorWorker::start()
 		state_ = State::Running;
 	}
 
-	Thread::start();
+	for (std::unique_ptr<PostProcessorWorker> &worker : workers_)
+		worker->start();
 }
 
-void CameraStream::PostProcessorWorker::queueRequest(Camera3RequestDescriptor::StreamBuffer *dest)
+void CameraStream::PostProcessorQueue::queueRequest(Camera3RequestDescriptor::StreamBuffer *dest)
 {
 	{
 		MutexLocker lock(mutex_);
 		ASSERT(state_ == State::Running);
 		requests_.push(dest);
+		inFlight_.push_back({ dest, PostProcessor::Status::Error, false });
+
+		stats_.queueDepth = requests_.size();
+		stats_.maxQueueDepth = std::max<unsigned int>(stats_.maxQueueDepth,
+							      stats_.queueDepth);
+		stats_.inFlight = inFlight_.size();
+		stats_.maxInFlight = std::max<unsigned int>(stats_.maxInFlight,
+							    stats_.inFlight);
 	}
 
 	cv_.notify_one();
 }
 
-void CameraStream::PostProcessorWorker::run()
+/*
+ * Wait for a request to process. Return nullptr when the queue is stopped, in
+ * which case the calling worker shall exit.
+ */
+Camera3RequestDescriptor::StreamBuffer *CameraStream::PostProcessorQueue::dequeueRequest()
 {
 	MutexLocker locker(mutex_);
 
-	while (1) {
-		cv_.wait(locker, [&]() LIBCAMERA_TSA_REQUIRES(mutex_) {
-			return state_ != State::Running || !requests_.empty();
-		});
-
-		if (state_ != State::Running)
-			break;
+	cv_.wait(locker, [&]() LIBCAMERA_TSA_REQUIRES(mutex_) {
+		return state_ != State::Running || !requests_.empty();
+	});
 
+	if (state_ == State::Running) {
 		Camera3RequestDescriptor::StreamBuffer *streamBuffer = requests_.front();
 		requests_.pop();
-		locker.unlock();
-
-		postProcessor_->process(streamBuffer);
-
-		locker.lock();
+		stats_.queueDepth = requests_.size();
+		return streamBuffer;
 	}
 
+	/*
+	 * The first worker to notice a flush completes all pending requests
+	 * with an error.
+	 */
 	if (state_ == State::Flushing) {
 		std::queue<Camera3RequestDescriptor::StreamBuffer *> requests =
 			std::move(requests_);
+		requests_ = {};
+		stats_.queueDepth = 0;
+		state_ = State::Stopped;
 		locker.unlock();
 
 		while (!requests.empty()) {
-			postProcessor_->processComplete.emit(
-				requests.front(), PostProcessor::Status::Error);
+			complete(requests.front(), PostProcessor::Status::Error);
 			requests.pop();
 		}
+	}
 
-		locker.lock();
-		state_ = State::Stopped;
+	return nullptr;
+}
+
+void CameraStream::PostProcessorQueue::complete(Camera3RequestDescriptor::StreamBuffer *streamBuffer,
+						PostProcessor::Status status)
+{
+	MutexLocker completionLocker(completionMutex_);
+	std::vector<InFlightRequest> completed;
+
+	{
+		MutexLocker locker(mutex_);
+
+		auto it = std::find_if(inFlight_.begin(), inFlight_.end(),
+				       [&](const InFlightRequest &request) {
+					       return request.streamBuffer == streamBuffer;
+				       });
+		ASSERT(it != inFlight_.end());
+
+		it->status = status;
+		it->complete = true;
+
+		if (it != inFlight_.begin())
+			stats_.reordered++;
+
+		while (!inFlight_.empty() && inFlight_.front().complete) {
+			completed.push_back(inFlight_.front());
+			inFlight_.pop_front();
+		}
+
+		stats_.processed++;
+		stats_.inFlight = inFlight_.size();
 	}
+
+	/*
+	 * Emit the signal with the completion lock held, to guarantee that
+	 * requests completed concurrently by different workers are signalled
+	 * in order.
+	 */
+	for (const InFlightRequest &request : completed)
+		processComplete.emit(request.streamBuffer, request.status);
 }
 
-void CameraStream::PostProcessorWorker::flush()
+void CameraStream::PostProcessorQueue::flush()
 {
 	MutexLocker lock(mutex_);
 	state_ = State::Flushing;
 	lock.unlock();
 
-	cv_.notify_one();
+	cv_.notify_all();
+}
+
+CameraStream::PostProcessorStats CameraStream::PostProcessorQueue::stats() const
+{
+	MutexLocker lock(mutex_);
+	return stats_;
 }
@@ -7,13 +7,16 @@
 
 #pragma once
 
+#include <deque>
 #include <memory>
 #include <queue>
+#include <stdint.h>
 #include <vector>
 
 #include <hardware/camera3.h>
 
 #include <libcamera/base/mutex.h>
+#include <libcamera/base/signal.h>
 #include <libcamera/base/thread.h>
 
 #include <libcamera/camera.h>
@@ -112,6 +115,17 @@ public:
 		Internal,
 		Mapped,
 	};
+
+	struct PostProcessorStats {
+		unsigned int workers;
+		unsigned int queueDepth;
+		unsigned int maxQueueDepth;
+		unsigned int inFlight;
+		unsigned int maxInFlight;
+		uint64_t processed;
+		uint64_t reordered;
+	};
+
 	CameraStream(CameraDevice *const cameraDevice,
 		     libcamera::CameraConfiguration *config, Type type,
 		     camera3_stream_t *camera3Stream,
@@ -132,9 +146,28 @@ public:
 	void putBuffer(libcamera::FrameBuffer *buffer);
 	void flush();
 
+	PostProcessorStats postProcessorStats() const;
+
 private:
+	class PostProcessorQueue;
+
 	class PostProcessorWorker : public libcamera::Thread
 	{
+	public:
+		PostProcessorWorker(PostProcessorQueue *queue,
+				    PostProcessor *postProcessor);
+		~PostProcessorWorker();
+
+	protected:
+		void run() override;
+
+	private:
+		PostProcessorQueue *queue_;
+		PostProcessor *postProcessor_;
+	};
+
+	class PostProcessorQueue
+	{
 	public:
 		enum class State {
 			Stopped,
@@ -142,26 +175,47 @@ private:
 			Flushing,
 		};
 
-		PostProcessorWorker(PostProcessor *postProcessor);
-		~PostProcessorWorker();
+		PostProcessorQueue();
+		~PostProcessorQueue();
+
+		void addWorker(PostProcessor *postProcessor);
 
 		void start();
 		void queueRequest(Camera3RequestDescriptor::StreamBuffer *request);
 		void flush();
 
-	protected:
-		void run() override;
+		PostProcessorStats stats() const;
+
+		libcamera::Signal<Camera3RequestDescriptor::StreamBuffer *,
+				  PostProcessor::Status> processComplete;
 
 	private:
-		PostProcessor *postProcessor_;
+		friend class PostProcessorWorker;
+
+		struct InFlightRequest {
+			Camera3RequestDescriptor::StreamBuffer *streamBuffer;
+			PostProcessor::Status status;
+			bool complete;
+		};
 
-		libcamera::Mutex mutex_;
+		Camera3RequestDescriptor::StreamBuffer *dequeueRequest();
+		void complete(Camera3RequestDescriptor::StreamBuffer *streamBuffer,
+			      PostProcessor::Status status);
+
+		std::vector<std::unique_ptr<PostProcessorWorker>> workers_;
+
+		mutable libcamera::Mutex mutex_;
 		libcamera::ConditionVariable cv_;
 
 		std::queue<Camera3RequestDescriptor::StreamBuffer *> requests_
 			LIBCAMERA_TSA_GUARDED_BY(mutex_);
+		std::deque<InFlightRequest> inFlight_ LIBCAMERA_TSA_GUARDED_BY(mutex_);
+		PostProcessorStats stats_ LIBCAMERA_TSA_GUARDED_BY(mutex_);
 
 		State state_ LIBCAMERA_TSA_GUARDED_BY(mutex_) = State::Stopped;
+
+		/* Serialize completion to preserve the request order. */
+		libcamera::Mutex completionMutex_ LIBCAMERA_TSA_ACQUIRED_BEFORE(mutex_);
 	};
 
 	int waitFence(int fence);
@@ -181,7 +235,8 @@ private:
 	 * an std::vector in CameraDevice.
 	 */
 	std::unique_ptr<libcamera::Mutex> mutex_;
-	std::unique_ptr<PostProcessor> postProcessor_;
+	/* One post-processor per worker, as they are not reentrant. */
+	std::vector<std::unique_ptr<PostProcessor>> postProcessors_;
 
-	std::unique_ptr<PostProcessorWorker> worker_;
+	std::unique_ptr<PostProcessorQueue> queue_;
 };
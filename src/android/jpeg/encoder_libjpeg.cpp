@@ -7,6 +7,7 @@
 
 #include "encoder_libjpeg.h"
 
+#include <algorithm>
 #include <fcntl.h>
 #include <iomanip>
 #include <iostream>
@@ -22,6 +23,7 @@
 #include <libcamera/pixel_format.h>
 
 #include "libcamera/internal/formats.h"
+#include "libcamera/internal/framebuffer.h"
 #include "libcamera/internal/mapped_framebuffer.h"
 
 using namespace libcamera;
@@ -100,95 +102,164 @@ int EncoderLibJpeg::configure(const StreamConfiguration &cfg)
 	nv_ = pixelFormatInfo_->numPlanes() == 2;
 	nvSwap_ = info.nvSwap;
 
+	/*
+	 * Use the stride of the stream buffers when known, and fall back to
+	 * the minimum stride for the format otherwise.
+	 */
+	stride_ = cfg.stride ? cfg.stride
+			     : pixelFormatInfo_->stride(cfg.size.width, 0);
+
+	if (!nv_)
+		return 0;
+
+	const auto &formatPlanes = pixelFormatInfo_->planes;
+	chromaStride_ = stride_ * formatPlanes[1].bytesPerGroup
+		      / formatPlanes[0].bytesPerGroup;
+	horzSubSample_ = 2 * formatPlanes[0].bytesPerGroup
+		       / formatPlanes[1].bytesPerGroup;
+	vertSubSample_ = formatPlanes[1].verticalSubSampling;
+
+	/*
+	 * Pass the image to libjpeg in downsampled form, with the chroma
+	 * sampling factors matching the pixel format.
+	 */
+	compress_.raw_data_in = TRUE;
+	compress_.comp_info[0].h_samp_factor = horzSubSample_;
+	compress_.comp_info[0].v_samp_factor = vertSubSample_;
+	for (unsigned int i = 1; i < 3; i++) {
+		compress_.comp_info[i].h_samp_factor = 1;
+		compress_.comp_info[i].v_samp_factor = 1;
+	}
+
 	return 0;
 }
 
 void EncoderLibJpeg::compressRGB(const std::vector<Span<uint8_t>> &planes)
 {
 	unsigned char *src = const_cast<unsigned char *>(planes[0].data());
-	/* \todo Stride information should come from buffer configuration. */
-	unsigned int stride = pixelFormatInfo_->stride(compress_.image_width, 0);
 
 	JSAMPROW row_pointer[1];
 
 	while (compress_.next_scanline < compress_.image_height) {
-		row_pointer[0] = &src[compress_.next_scanline * stride];
+		row_pointer[0] = &src[compress_.next_scanline * stride_];
 		jpeg_write_scanlines(&compress_, row_pointer, 1);
 	}
 }
 
 /*
  * Compress the incoming buffer from a supported NV format.
- * This naively unpacks the semi-planar NV12 to a YUV888 format for libjpeg.
+ *
+ * The image is passed to libjpeg in raw (downsampled) form, one MCU row at a
+ * time. The chroma rows are deinterleaved into small Cb and Cr line buffers.
+ * This avoids upsampling the chroma to YUV888, only to have libjpeg downsample
+ * it again.
+ *
+ * libjpeg requires rows to be padded to a multiple of the DCT block size, and
+ * a full MCU row to be passed on every call. Rows beyond the bottom edge of the
+ * image replicate the last row, and columns beyond the right edge replicate the
+ * last pixel. Luma rows are used directly from the source buffer when the
+ * width is a multiple of the block size, and copied to padded line buffers
+ * otherwise.
  */
 void EncoderLibJpeg::compressNV(const std::vector<Span<uint8_t>> &planes)
 {
-	uint8_t tmprowbuf[compress_.image_width * 3];
+	const unsigned int width = compress_.image_width;
+	const unsigned int height = compress_.image_height;
+	const unsigned int chromaWidth = (width + horzSubSample_ - 1) / horzSubSample_;
+	const unsigned int chromaHeight = (height + vertSubSample_ - 1) / vertSubSample_;
+
+	/* Padded width of the rows and number of luma rows in an MCU row. */
+	const unsigned int lumaRowSize = compress_.comp_info[0].width_in_blocks * DCTSIZE;
+	const unsigned int chromaRowSize = compress_.comp_info[1].width_in_blocks * DCTSIZE;
+	const unsigned int mcuRows = vertSubSample_ * DCTSIZE;
+
+	const bool copyLuma = width < lumaRowSize;
+
+	rawBuffer_.resize(chromaRowSize * DCTSIZE * 2 +
+			  (copyLuma ? lumaRowSize * mcuRows : 0));
+
+	JSAMPROW yRows[2 * DCTSIZE];
+	JSAMPROW cbRows[DCTSIZE];
+	JSAMPROW crRows[DCTSIZE];
+	JSAMPARRAY rows[3] = { yRows, cbRows, crRows };
+
+	uint8_t *buffer = rawBuffer_.data();
+	for (unsigned int i = 0; i < DCTSIZE; i++) {
+		cbRows[i] = buffer;
+		crRows[i] = buffer + chromaRowSize;
+		buffer += chromaRowSize * 2;
+	}
 
-	/*
-	 * \todo Use the raw api, and only unpack the cb/cr samples to new line
-	 * buffers. If possible, see if we can set appropriate pixel strides
-	 * too to save even that copy.
-	 *
-	 * Possible hints at:
-	 * https://sourceforge.net/p/libjpeg/mailman/message/30815123/
-	 */
-	unsigned int y_stride = pixelFormatInfo_->stride(compress_.image_width, 0);
-	unsigned int c_stride = pixelFormatInfo_->stride(compress_.image_width, 1);
+	if (copyLuma) {
+		for (unsigned int i = 0; i < mcuRows; i++) {
+			yRows[i] = buffer;
+			buffer += lumaRowSize;
+		}
+	}
 
-	unsigned int horzSubSample = 2 * compress_.image_width / c_stride;
-	unsigned int vertSubSample = pixelFormatInfo_->planes[1].verticalSubSampling;
+	const uint8_t *srcY = planes[0].data();
+	const uint8_t *srcC = planes[1].data();
 
-	unsigned int c_inc = horzSubSample == 1 ? 2 : 0;
-	unsigned int cb_pos = nvSwap_ ? 1 : 0;
-	unsigned int cr_pos = nvSwap_ ? 0 : 1;
+	for (unsigned int y = 0; y < height; y += mcuRows) {
+		for (unsigned int i = 0; i < mcuRows; i++) {
+			const unsigned int row = std::min(y + i, height - 1);
+			const uint8_t *src = srcY + row * stride_;
 
-	const unsigned char *src = planes[0].data();
-	const unsigned char *src_c = planes[1].data();
+			if (!copyLuma) {
+				yRows[i] = const_cast<JSAMPROW>(src);
+				continue;
+			}
 
-	JSAMPROW row_pointer[1];
-	row_pointer[0] = &tmprowbuf[0];
-
-	for (unsigned int y = 0; y < compress_.image_height; y++) {
-		unsigned char *dst = &tmprowbuf[0];
-
-		const unsigned char *src_y = src + y * y_stride;
-		const unsigned char *src_cb = src_c + (y / vertSubSample) * c_stride + cb_pos;
-		const unsigned char *src_cr = src_c + (y / vertSubSample) * c_stride + cr_pos;
-
-		for (unsigned int x = 0; x < compress_.image_width; x += 2) {
-			dst[0] = *src_y;
-			dst[1] = *src_cb;
-			dst[2] = *src_cr;
-			src_y++;
-			src_cb += c_inc;
-			src_cr += c_inc;
-			dst += 3;
-
-			dst[0] = *src_y;
-			dst[1] = *src_cb;
-			dst[2] = *src_cr;
-			src_y++;
-			src_cb += 2;
-			src_cr += 2;
-			dst += 3;
+			memcpy(yRows[i], src, width);
+			memset(yRows[i] + width, src[width - 1], lumaRowSize - width);
 		}
 
-		jpeg_write_scanlines(&compress_, row_pointer, 1);
+		for (unsigned int i = 0; i < DCTSIZE; i++) {
+			const unsigned int row = std::min(y / vertSubSample_ + i,
+							  chromaHeight - 1);
+			const uint8_t *src = srcC + row * chromaStride_;
+			uint8_t *cb = nvSwap_ ? crRows[i] : cbRows[i];
+			uint8_t *cr = nvSwap_ ? cbRows[i] : crRows[i];
+
+			/*
+			 * Keep this loop simple to let the compiler vectorize
+			 * it.
+			 */
+			for (unsigned int x = 0; x < chromaWidth; x++) {
+				cb[x] = src[2 * x];
+				cr[x] = src[2 * x + 1];
+			}
+
+			memset(cb + chromaWidth, cb[chromaWidth - 1],
+			       chromaRowSize - chromaWidth);
+			memset(cr + chromaWidth, cr[chromaWidth - 1],
+			       chromaRowSize - chromaWidth);
+		}
+
+		jpeg_write_raw_data(&compress_, rows, mcuRows);
 	}
 }
 
 int EncoderLibJpeg::encode(const FrameBuffer &source, Span<uint8_t> dest,
 			   Span<const uint8_t> exifData, unsigned int quality)
 {
-	MappedFrameBuffer frame(&source, MappedFrameBuffer::MapFlag::Read);
-	if (!frame.isValid()) {
-		LOG(JPEG, Error) << "Failed to map FrameBuffer : "
-				 << strerror(frame.error());
-		return frame.error();
+	MappedFrameBuffer *frame =
+		source._d()->mapping(MappedFrameBuffer::MapFlag::Read);
+	if (!frame) {
+		LOG(JPEG, Error) << "Failed to map FrameBuffer";
+		return -EINVAL;
 	}
 
-	return encode(frame.planes(), dest, exifData, quality);
+	int ret = frame->beginAccess(MappedFrameBuffer::MapFlag::Read);
+	if (ret) {
+		LOG(JPEG, Error) << "Failed to access FrameBuffer";
+		return ret;
+	}
+
+	ret = encode(frame->planes(), dest, exifData, quality);
+	frame->endAccess();
+
+	return ret;
 }
 
 int EncoderLibJpeg::encode(const std::vector<Span<uint8_t>> &src,
@@ -230,5 +301,24 @@ int EncoderLibJpeg::encode(const std::vector<Span<uint8_t>> &src,
 
 	jpeg_finish_compress(&compress_);
 
+	/*
+	 * If the destination was too small, libjpeg has reallocated it and
+	 * the output isn't stored in the destination buffer.
+	 */
+	if (destination != dest.data()) {
+		free(destination);
+		LOG(JPEG, Error) << "JPEG destination buffer too small";
+		return -ENOSPC;
+	}
+
 	return size;
 }
+
+/*
+ * Set the restart interval, in MCUs, for the following encodes. This must be
+ * called after configure(), which resets the restart interval to 0.
+ */
+void EncoderLibJpeg::setRestartInterval(unsigned int mcus)
+{
+	compress_.restart_interval = mcus;
+}
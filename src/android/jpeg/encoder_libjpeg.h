@@ -31,6 +31,8 @@ public:
 		   libcamera::Span<const uint8_t> exifData,
 		   unsigned int quality);
 
+	void setRestartInterval(unsigned int mcus);
+
 private:
 	void compressRGB(const std::vector<libcamera::Span<uint8_t>> &planes);
 	void compressNV(const std::vector<libcamera::Span<uint8_t>> &planes);
@@ -40,6 +42,13 @@ private:
 
 	const libcamera::PixelFormatInfo *pixelFormatInfo_;
 
+	unsigned int stride_;
+	unsigned int chromaStride_;
+	unsigned int horzSubSample_;
+	unsigned int vertSubSample_;
+
 	bool nv_;
 	bool nvSwap_;
+
+	std::vector<uint8_t> rawBuffer_;
 };
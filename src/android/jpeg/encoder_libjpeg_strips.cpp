@@ -0,0 +1,525 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2022, Google Inc.
+ *
+ * encoder_libjpeg_strips.cpp - Parallel strip-based JPEG encoding using libjpeg
+ */
+
+#include "encoder_libjpeg_strips.h"
+
+#include <algorithm>
+#include <errno.h>
+#include <string.h>
+#include <thread>
+
+#include <libcamera/base/log.h>
+
+#include "libcamera/internal/formats.h"
+#include "libcamera/internal/framebuffer.h"
+#include "libcamera/internal/mapped_framebuffer.h"
+
+using namespace libcamera;
+
+LOG_DECLARE_CATEGORY(JPEG)
+
+/*
+ * The image is split in horizontal strips of whole MCU rows, encoded in
+ * parallel as independent JPEG images by a pool of workers. All strips are
+ * encoded with the same quantization and Huffman tables, and with a restart
+ * interval equal to the number of MCUs in a strip. The entropy-coded data of
+ * the strips is then concatenated, separated by restart markers, behind the
+ * headers of the first strip patched with the full image height. As the DC
+ * predictors are reset at restart markers, the result is a single valid
+ * baseline JPEG image.
+ */
+
+namespace {
+
+constexpr uint8_t kMarkerSOI = 0xd8;
+constexpr uint8_t kMarkerEOI = 0xd9;
+constexpr uint8_t kMarkerSOS = 0xda;
+constexpr uint8_t kMarkerRST0 = 0xd0;
+constexpr uint8_t kMarkerAPP0 = 0xe0;
+constexpr uint8_t kMarkerAPP1 = 0xe1;
+constexpr uint8_t kMarkerAPP15 = 0xef;
+constexpr uint8_t kMarkerSOF0 = 0xc0;
+constexpr uint8_t kMarkerSOF3 = 0xc3;
+
+/* Maximum value of the restart interval, stored on 16 bits in the DRI. */
+constexpr unsigned int kMaxRestartInterval = 65535;
+
+/* Room for the JPEG headers when sizing strip output buffers. */
+constexpr unsigned int kHeadersSize = 4096;
+
+struct JpegLayout {
+	size_t appEnd;
+	size_t sof;
+	size_t data;
+	size_t dataEnd;
+};
+
+/*
+ * Locate the end of the APPn segments, the SOF segment and the entropy-coded
+ * data in a JPEG image produced by libjpeg.
+ */
+int parseJpeg(Span<const uint8_t> jpeg, JpegLayout *layout)
+{
+	if (jpeg.size() < 4 || jpeg[0] != 0xff || jpeg[1] != kMarkerSOI ||
+	    jpeg[jpeg.size() - 2] != 0xff || jpeg[jpeg.size() - 1] != kMarkerEOI)
+		return -EINVAL;
+
+	layout->appEnd = 0;
+	layout->sof = 0;
+
+	size_t pos = 2;
+	while (pos + 4 <= jpeg.size()) {
+		if (jpeg[pos] != 0xff)
+			return -EINVAL;
+
+		const uint8_t marker = jpeg[pos + 1];
+		const size_t length = (jpeg[pos + 2] << 8) | jpeg[pos + 3];
+
+		if (!layout->appEnd &&
+		    (marker < kMarkerAPP0 || marker > kMarkerAPP15))
+			layout->appEnd = pos;
+
+		if (marker >= kMarkerSOF0 && marker <= kMarkerSOF3)
+			layout->sof = pos;
+
+		pos += 2 + length;
+
+		if (marker == kMarkerSOS) {
+			if (!layout->sof || pos > jpeg.size() - 2)
+				return -EINVAL;
+
+			layout->data = pos;
+			layout->dataEnd = jpeg.size() - 2;
+			return 0;
+		}
+	}
+
+	return -EINVAL;
+}
+
+} /* namespace */
+
+EncoderLibJpegStrips::StripWorker::StripWorker()
+	: running_(true), pending_(false), result_(0), quality_(0)
+{
+}
+
+EncoderLibJpegStrips::StripWorker::~StripWorker()
+{
+	{
+		MutexLocker locker(mutex_);
+		running_ = false;
+	}
+
+	cv_.notify_all();
+	wait();
+}
+
+int EncoderLibJpegStrips::StripWorker::configure(const StreamConfiguration &cfg,
+						 unsigned int restartInterval)
+{
+	int ret = encoder_.configure(cfg);
+	if (ret)
+		return ret;
+
+	encoder_.setRestartInterval(restartInterval);
+
+	/* The buffer is grown on demand if it turns out to be too small. */
+	output_.resize(cfg.size.width * cfg.size.height * 3 / 2 + kHeadersSize);
+
+	return 0;
+}
+
+void EncoderLibJpegStrips::StripWorker::queueEncode(const std::vector<Span<uint8_t>> &planes,
+						    unsigned int quality)
+{
+	{
+		MutexLocker locker(mutex_);
+		ASSERT(!pending_);
+
+		planes_ = planes;
+		quality_ = quality;
+		pending_ = true;
+	}
+
+	cv_.notify_all();
+}
+
+int EncoderLibJpegStrips::StripWorker::waitEncode()
+{
+	MutexLocker locker(mutex_);
+
+	cv_.wait(locker, [&]() LIBCAMERA_TSA_REQUIRES(mutex_) {
+		return !pending_;
+	});
+
+	return result_;
+}
+
+Span<const uint8_t> EncoderLibJpegStrips::StripWorker::output()
+{
+	MutexLocker locker(mutex_);
+
+	if (pending_ || result_ < 0)
+		return {};
+
+	return { output_.data(), static_cast<size_t>(result_) };
+}
+
+void EncoderLibJpegStrips::StripWorker::run()
+{
+	MutexLocker locker(mutex_);
+
+	while (1) {
+		cv_.wait(locker, [&]() LIBCAMERA_TSA_REQUIRES(mutex_) {
+			return !running_ || (pending_ && !planes_.empty());
+		});
+
+		if (!running_)
+			break;
+
+		std::vector<Span<uint8_t>> planes = std::move(planes_);
+		planes_.clear();
+		const unsigned int quality = quality_;
+		locker.unlock();
+
+		int ret;
+		while (1) {
+			ret = encoder_.encode(planes, output_, {}, quality);
+			if (ret != -ENOSPC)
+				break;
+
+			output_.resize(output_.size() * 2);
+		}
+
+		locker.lock();
+		result_ = ret;
+		pending_ = false;
+		cv_.notify_all();
+	}
+}
+
+/**
+ * \class EncoderLibJpegStrips
+ * \brief JPEG encoder splitting images in strips encoded in parallel
+ *
+ * Encoding is split in startEncode() and finishEncode() to let the caller
+ * perform other work, such as generating the thumbnail and EXIF data, while
+ * the strips are being encoded. Formats that can't be split in strips are
+ * encoded synchronously in finishEncode().
+ */
+
+/**
+ * \brief Construct a strip-based JPEG encoder
+ * \param[in] maxStrips The maximum number of strips, 0 to use one strip per CPU
+ */
+EncoderLibJpegStrips::EncoderLibJpegStrips(unsigned int maxStrips)
+	: maxStrips_(maxStrips), pixelFormatInfo_(nullptr), height_(0),
+	  stride_(0), stripHeight_(0), source_(nullptr), quality_(0)
+{
+	if (!maxStrips_)
+		maxStrips_ = std::max(std::thread::hardware_concurrency(), 1U);
+}
+
+EncoderLibJpegStrips::~EncoderLibJpegStrips() = default;
+
+int EncoderLibJpegStrips::configure(const StreamConfiguration &cfg)
+{
+	pixelFormatInfo_ = &PixelFormatInfo::info(cfg.pixelFormat);
+	height_ = cfg.size.height;
+	stride_ = cfg.stride ? cfg.stride
+			     : pixelFormatInfo_->stride(cfg.size.width, 0);
+
+	const auto &planes = pixelFormatInfo_->planes;
+	const bool semiPlanar = pixelFormatInfo_->isValid() &&
+				pixelFormatInfo_->colourEncoding == PixelFormatInfo::ColourEncodingYUV &&
+				pixelFormatInfo_->numPlanes() == 2;
+
+	unsigned int mcusPerRow = 0;
+	unsigned int mcuHeight = 0;
+	unsigned int mcuRows = 0;
+
+	if (semiPlanar) {
+		const unsigned int horzSubSample = 2 * planes[0].bytesPerGroup
+						 / planes[1].bytesPerGroup;
+		const unsigned int mcuWidth = DCTSIZE * horzSubSample;
+
+		mcuHeight = DCTSIZE * planes[1].verticalSubSampling;
+		mcusPerRow = (cfg.size.width + mcuWidth - 1) / mcuWidth;
+		mcuRows = (cfg.size.height + mcuHeight - 1) / mcuHeight;
+	}
+
+	if (!semiPlanar || !mcusPerRow || mcusPerRow > kMaxRestartInterval) {
+		LOG(JPEG, Debug)
+			<< "Encoding " << cfg.pixelFormat << " without strips";
+
+		workers_.clear();
+		encoder_ = std::make_unique<EncoderLibJpeg>();
+		return encoder_->configure(cfg);
+	}
+
+	encoder_.reset();
+
+	/*
+	 * Split the image in one strip per worker, within the limit of the
+	 * restart interval.
+	 */
+	unsigned int stripMcuRows = (mcuRows + maxStrips_ - 1) / maxStrips_;
+	stripMcuRows = std::min(stripMcuRows, kMaxRestartInterval / mcusPerRow);
+	const unsigned int numStrips = (mcuRows + stripMcuRows - 1) / stripMcuRows;
+
+	stripHeight_ = stripMcuRows * mcuHeight;
+
+	workers_.resize(numStrips);
+
+	for (unsigned int i = 0; i < numStrips; ++i) {
+		std::unique_ptr<StripWorker> &worker = workers_[i];
+		if (!worker) {
+			worker = std::make_unique<StripWorker>();
+			worker->start();
+		}
+
+		StreamConfiguration stripCfg = cfg;
+		stripCfg.size.height = std::min(stripHeight_,
+						height_ - i * stripHeight_);
+		stripCfg.stride = stride_;
+
+		int ret = worker->configure(stripCfg, mcusPerRow * stripMcuRows);
+		if (ret)
+			return ret;
+	}
+
+	LOG(JPEG, Debug)
+		<< "Encoding " << cfg.size << "-" << cfg.pixelFormat << " in "
+		<< numStrips << " strips of " << stripHeight_ << " lines";
+
+	return 0;
+}
+
+int EncoderLibJpegStrips::encode(const FrameBuffer &source, Span<uint8_t> destination,
+				 Span<const uint8_t> exifData, unsigned int quality)
+{
+	int ret = startEncode(source, quality);
+	if (ret)
+		return ret;
+
+	return finishEncode(destination, exifData);
+}
+
+int EncoderLibJpegStrips::encode(const std::vector<Span<uint8_t>> &planes,
+				 Span<uint8_t> destination,
+				 Span<const uint8_t> exifData,
+				 unsigned int quality)
+{
+	int ret = startEncode(planes, quality);
+	if (ret)
+		return ret;
+
+	return finishEncode(destination, exifData);
+}
+
+/**
+ * \brief Start encoding a frame buffer
+ * \param[in] source The frame buffer to encode
+ * \param[in] quality The JPEG quality
+ *
+ * The frame buffer memory is accessed until finishEncode() returns. If this
+ * function succeeds, finishEncode() shall be called.
+ *
+ * \return 0 on success or a negative error code otherwise
+ */
+int EncoderLibJpegStrips::startEncode(const FrameBuffer &source,
+				      unsigned int quality)
+{
+	MappedFrameBuffer *frame =
+		source._d()->mapping(MappedFrameBuffer::MapFlag::Read);
+	if (!frame) {
+		LOG(JPEG, Error) << "Failed to map FrameBuffer";
+		return -EINVAL;
+	}
+
+	int ret = frame->beginAccess(MappedFrameBuffer::MapFlag::Read);
+	if (ret) {
+		LOG(JPEG, Error) << "Failed to access FrameBuffer";
+		return ret;
+	}
+
+	ret = startEncode(frame->planes(), quality);
+	if (ret) {
+		frame->endAccess();
+		return ret;
+	}
+
+	source_ = frame;
+
+	return 0;
+}
+
+/**
+ * \brief Start encoding image planes
+ * \param[in] planes The image planes
+ * \param[in] quality The JPEG quality
+ *
+ * The planes memory is accessed until finishEncode() returns. If this function
+ * succeeds, finishEncode() shall be called.
+ *
+ * \return 0 on success or a negative error code otherwise
+ */
+int EncoderLibJpegStrips::startEncode(const std::vector<Span<uint8_t>> &planes,
+				      unsigned int quality)
+{
+	if (encoder_) {
+		planes_ = planes;
+		quality_ = quality;
+		return 0;
+	}
+
+	if (workers_.empty() || planes.size() != 2)
+		return -EINVAL;
+
+	const auto &formatPlanes = pixelFormatInfo_->planes;
+	const unsigned int chromaStride = stride_ * formatPlanes[1].bytesPerGroup
+					/ formatPlanes[0].bytesPerGroup;
+	const unsigned int vertSubSample = formatPlanes[1].verticalSubSampling;
+
+	std::vector<std::vector<Span<uint8_t>>> strips;
+
+	for (unsigned int i = 0; i < workers_.size(); ++i) {
+		const size_t lumaOffset = i * stripHeight_ * stride_;
+		const size_t chromaOffset = i * stripHeight_ / vertSubSample * chromaStride;
+
+		if (lumaOffset >= planes[0].size() ||
+		    chromaOffset >= planes[1].size()) {
+			LOG(JPEG, Error) << "Planes too small for image";
+			return -EINVAL;
+		}
+
+		strips.push_back({ planes[0].subspan(lumaOffset),
+				   planes[1].subspan(chromaOffset) });
+	}
+
+	for (unsigned int i = 0; i < workers_.size(); ++i)
+		workers_[i]->queueEncode(strips[i], quality);
+
+	return 0;
+}
+
+/**
+ * \brief Complete encoding and assemble the JPEG image
+ * \param[out] destination The destination buffer
+ * \param[in] exifData The EXIF data to store in the APP1 segment
+ *
+ * Wait for all strips to be encoded and assemble them in \a destination.
+ *
+ * \return The size of the JPEG image on success or a negative error code
+ * otherwise
+ */
+int EncoderLibJpegStrips::finishEncode(Span<uint8_t> destination,
+				       Span<const uint8_t> exifData)
+{
+	int ret;
+
+	if (encoder_) {
+		ret = encoder_->encode(planes_, destination, exifData, quality_);
+	} else {
+		ret = 0;
+		for (std::unique_ptr<StripWorker> &worker : workers_) {
+			int result = worker->waitEncode();
+			if (result < 0)
+				ret = result;
+		}
+	}
+
+	if (source_) {
+		source_->endAccess();
+		source_ = nullptr;
+	}
+
+	if (encoder_ || ret < 0)
+		return ret;
+
+	std::vector<JpegLayout> layouts(workers_.size());
+
+	for (unsigned int i = 0; i < workers_.size(); ++i) {
+		ret = parseJpeg(workers_[i]->output(), &layouts[i]);
+		if (ret) {
+			LOG(JPEG, Error) << "Failed to parse JPEG strip " << i;
+			return ret;
+		}
+	}
+
+	if (exifData.size() > 65533) {
+		LOG(JPEG, Error) << "EXIF data too large";
+		return -EINVAL;
+	}
+
+	uint8_t *out = destination.data();
+	size_t pos = 0;
+
+	auto append = [&](const uint8_t *data, size_t size) {
+		if (pos + size > destination.size())
+			return false;
+
+		memcpy(out + pos, data, size);
+		pos += size;
+		return true;
+	};
+
+	/* Copy the headers of the first strip, and insert the EXIF data. */
+	Span<const uint8_t> header = workers_[0]->output();
+	const JpegLayout &layout = layouts[0];
+	size_t sof = layout.sof;
+
+	if (!append(header.data(), layout.appEnd))
+		return -ENOSPC;
+
+	if (exifData.size()) {
+		const uint16_t length = exifData.size() + 2;
+		const uint8_t app1[] = {
+			0xff, kMarkerAPP1,
+			static_cast<uint8_t>(length >> 8),
+			static_cast<uint8_t>(length & 0xff),
+		};
+
+		if (!append(app1, sizeof(app1)) ||
+		    !append(exifData.data(), exifData.size()))
+			return -ENOSPC;
+
+		if (sof >= layout.appEnd)
+			sof += sizeof(app1) + exifData.size();
+	}
+
+	if (!append(header.data() + layout.appEnd, layout.data - layout.appEnd))
+		return -ENOSPC;
+
+	/* Patch the image height in the SOF segment. */
+	out[sof + 5] = height_ >> 8;
+	out[sof + 6] = height_ & 0xff;
+
+	/* Concatenate the strips, separated by restart markers. */
+	for (unsigned int i = 0; i < workers_.size(); ++i) {
+		Span<const uint8_t> strip = workers_[i]->output();
+
+		if (!append(strip.data() + layouts[i].data,
+			    layouts[i].dataEnd - layouts[i].data))
+			return -ENOSPC;
+
+		if (i + 1 < workers_.size()) {
+			const uint8_t rst[] = {
+				0xff, static_cast<uint8_t>(kMarkerRST0 + i % 8),
+			};
+			if (!append(rst, sizeof(rst)))
+				return -ENOSPC;
+		}
+	}
+
+	const uint8_t eoi[] = { 0xff, kMarkerEOI };
+	if (!append(eoi, sizeof(eoi)))
+		return -ENOSPC;
+
+	return pos;
+}
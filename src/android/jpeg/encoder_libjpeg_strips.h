@@ -0,0 +1,99 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2022, Google Inc.
+ *
+ * encoder_libjpeg_strips.h - Parallel strip-based JPEG encoding using libjpeg
+ */
+
+#pragma once
+
+#include "encoder.h"
+#include "encoder_libjpeg.h"
+
+#include <memory>
+#include <vector>
+
+#include <libcamera/base/mutex.h>
+#include <libcamera/base/thread.h>
+
+#include "libcamera/internal/mapped_framebuffer.h"
+
+class EncoderLibJpegStrips : public Encoder
+{
+public:
+	EncoderLibJpegStrips(unsigned int maxStrips = 0);
+	~EncoderLibJpegStrips();
+
+	int configure(const libcamera::StreamConfiguration &cfg) override;
+	int encode(const libcamera::FrameBuffer &source,
+		   libcamera::Span<uint8_t> destination,
+		   libcamera::Span<const uint8_t> exifData,
+		   unsigned int quality) override;
+	int encode(const std::vector<libcamera::Span<uint8_t>> &planes,
+		   libcamera::Span<uint8_t> destination,
+		   libcamera::Span<const uint8_t> exifData,
+		   unsigned int quality);
+
+	int startEncode(const libcamera::FrameBuffer &source,
+			unsigned int quality);
+	int startEncode(const std::vector<libcamera::Span<uint8_t>> &planes,
+			unsigned int quality);
+	int finishEncode(libcamera::Span<uint8_t> destination,
+			 libcamera::Span<const uint8_t> exifData);
+
+	unsigned int strips() const { return workers_.size(); }
+
+private:
+	class StripWorker : public libcamera::Thread
+	{
+	public:
+		StripWorker();
+		~StripWorker();
+
+		int configure(const libcamera::StreamConfiguration &cfg,
+			      unsigned int restartInterval);
+
+		void queueEncode(const std::vector<libcamera::Span<uint8_t>> &planes,
+				 unsigned int quality);
+		int waitEncode();
+
+		libcamera::Span<const uint8_t> output();
+
+	protected:
+		void run() override;
+
+	private:
+		EncoderLibJpeg encoder_;
+		std::vector<uint8_t> output_;
+
+		libcamera::Mutex mutex_;
+		libcamera::ConditionVariable cv_;
+
+		bool running_ LIBCAMERA_TSA_GUARDED_BY(mutex_);
+		bool pending_ LIBCAMERA_TSA_GUARDED_BY(mutex_);
+		int result_ LIBCAMERA_TSA_GUARDED_BY(mutex_);
+		std::vector<libcamera::Span<uint8_t>> planes_ LIBCAMERA_TSA_GUARDED_BY(mutex_);
+		unsigned int quality_ LIBCAMERA_TSA_GUARDED_BY(mutex_);
+	};
+
+	unsigned int maxStrips_;
+
+	const libcamera::PixelFormatInfo *pixelFormatInfo_;
+	unsigned int height_;
+	unsigned int stride_;
+	unsigned int stripHeight_;
+
+	/* Fallback for formats that can't be split in strips. */
+	std::unique_ptr<EncoderLibJpeg> encoder_;
+	std::vector<std::unique_ptr<StripWorker>> workers_;
+
+	/*
+	 * The mapping of the source frame buffer is shared with the other
+	 * post-processors of the request, which may run concurrently in other
+	 * threads. CPU access is bracketed on the shared mapping, whose access
+	 * nesting is thread-safe.
+	 */
+	libcamera::MappedFrameBuffer *source_;
+	std::vector<libcamera::Span<uint8_t>> planes_;
+	unsigned int quality_;
+};
@@ -44,9 +44,13 @@ int PostProcessorJpeg::configure(const StreamConfiguration &inCfg,
 
 	streamSize_ = outCfg.size;
 
-	thumbnailer_.configure(inCfg.size, inCfg.pixelFormat);
+	thumbnailer_.configure(inCfg.size, inCfg.pixelFormat, inCfg.stride);
 
-	encoder_ = std::make_unique<EncoderLibJpeg>();
+	/*
+	 * Encode the main image in strips on a pool of workers, while the
+	 * thumbnail is generated and encoded in the post-processor thread.
+	 */
+	encoder_ = std::make_unique<EncoderLibJpegStrips>();
 
 	return encoder_->configure(inCfg);
 }
@@ -56,22 +60,19 @@ void PostProcessorJpeg::generateThumbnail(const FrameBuffer &source,
 					  unsigned int quality,
 					  std::vector<unsigned char> *thumbnail)
 {
-	/* Stores the raw scaled-down thumbnail bytes. */
-	std::vector<unsigned char> rawThumbnail;
-
-	thumbnailer_.createThumbnail(source, targetSize, &rawThumbnail);
+	thumbnailer_.createThumbnail(source, targetSize, &rawThumbnail_);
 
 	StreamConfiguration thCfg;
 	thCfg.size = targetSize;
 	thCfg.pixelFormat = thumbnailer_.pixelFormat();
 	int ret = thumbnailEncoder_.configure(thCfg);
 
-	if (!rawThumbnail.empty() && !ret) {
+	if (!rawThumbnail_.empty() && !ret) {
 		/*
 		 * \todo Avoid value-initialization of all elements of the
 		 * vector.
 		 */
-		thumbnail->resize(rawThumbnail.size());
+		thumbnail->resize(rawThumbnail_.size());
 
 		/*
 		 * Split planes manually as the encoder expects a vector of
@@ -85,8 +86,8 @@ void PostProcessorJpeg::generateThumbnail(const FrameBuffer &source,
 		const PixelFormatInfo &formatNV12 = PixelFormatInfo::info(formats::NV12);
 		size_t yPlaneSize = formatNV12.planeSize(targetSize, 0);
 		size_t uvPlaneSize = formatNV12.planeSize(targetSize, 1);
-		thumbnailPlanes.push_back({ rawThumbnail.data(), yPlaneSize });
-		thumbnailPlanes.push_back({ rawThumbnail.data() + yPlaneSize, uvPlaneSize });
+		thumbnailPlanes.push_back({ rawThumbnail_.data(), yPlaneSize });
+		thumbnailPlanes.push_back({ rawThumbnail_.data() + yPlaneSize, uvPlaneSize });
 
 		int jpeg_size = thumbnailEncoder_.encode(thumbnailPlanes,
 							 *thumbnail, {}, quality);
@@ -112,6 +113,21 @@ void PostProcessorJpeg::process(Camera3RequestDescriptor::StreamBuffer *streamBu
 	camera_metadata_ro_entry_t entry;
 	int ret;
 
+	ret = requestMetadata.getEntry(ANDROID_JPEG_QUALITY, &entry);
+	const uint8_t quality = ret ? *entry.data.u8 : 95;
+	resultMetadata->addEntry(ANDROID_JPEG_QUALITY, quality);
+
+	/*
+	 * Start encoding the main image, and complete it once the EXIF data,
+	 * including the thumbnail, has been generated.
+	 */
+	ret = encoder_->startEncode(source, quality);
+	if (ret < 0) {
+		LOG(JPEG, Error) << "Failed to encode stream image";
+		processComplete.emit(streamBuffer, PostProcessor::Status::Error);
+		return;
+	}
+
 	/* Set EXIF metadata for various tags. */
 	Exif exif;
 	exif.setMake(cameraDevice_->maker());
@@ -159,12 +175,13 @@ void PostProcessorJpeg::process(Camera3RequestDescriptor::StreamBuffer *streamBu
 				       static_cast<uint32_t>(data[1]) };
 
 		ret = requestMetadata.getEntry(ANDROID_JPEG_THUMBNAIL_QUALITY, &entry);
-		uint8_t quality = ret ? *entry.data.u8 : 95;
-		resultMetadata->addEntry(ANDROID_JPEG_THUMBNAIL_QUALITY, quality);
+		uint8_t thumbnailQuality = ret ? *entry.data.u8 : 95;
+		resultMetadata->addEntry(ANDROID_JPEG_THUMBNAIL_QUALITY, thumbnailQuality);
 
 		if (thumbnailSize != Size(0, 0)) {
 			std::vector<unsigned char> thumbnail;
-			generateThumbnail(source, thumbnailSize, quality, &thumbnail);
+			generateThumbnail(source, thumbnailSize, thumbnailQuality,
+					  &thumbnail);
 			if (!thumbnail.empty())
 				exif.setThumbnail(std::move(thumbnail), Exif::Compression::JPEG);
 		}
@@ -190,12 +207,7 @@ void PostProcessorJpeg::process(Camera3RequestDescriptor::StreamBuffer *streamBu
 	if (exif.generate() != 0)
 		LOG(JPEG, Error) << "Failed to generate valid EXIF data";
 
-	ret = requestMetadata.getEntry(ANDROID_JPEG_QUALITY, &entry);
-	const uint8_t quality = ret ? *entry.data.u8 : 95;
-	resultMetadata->addEntry(ANDROID_JPEG_QUALITY, quality);
-
-	int jpeg_size = encoder_->encode(source, destination->plane(0),
-					 exif.data(), quality);
+	int jpeg_size = encoder_->finishEncode(destination->plane(0), exif.data());
 	if (jpeg_size < 0) {
 		LOG(JPEG, Error) << "Failed to encode stream image";
 		processComplete.emit(streamBuffer, PostProcessor::Status::Error);
@@ -9,6 +9,7 @@
 
 #include "../post_processor.h"
 #include "encoder_libjpeg.h"
+#include "encoder_libjpeg_strips.h"
 #include "thumbnailer.h"
 
 #include <libcamera/geometry.h>
@@ -31,8 +32,10 @@ private:
 			       std::vector<unsigned char> *thumbnail);
 
 	CameraDevice *const cameraDevice_;
-	std::unique_ptr<Encoder> encoder_;
+	std::unique_ptr<EncoderLibJpegStrips> encoder_;
 	libcamera::Size streamSize_;
 	EncoderLibJpeg thumbnailEncoder_;
 	Thumbnailer thumbnailer_;
+	/* Raw scaled-down thumbnail, reused across captures. */
+	std::vector<unsigned char> rawThumbnail_;
 };
@@ -7,25 +7,56 @@
 
 #include "thumbnailer.h"
 
+#include <algorithm>
+
 #include <libcamera/base/log.h>
 
 #include <libcamera/formats.h>
 
+#include "libcamera/internal/framebuffer.h"
 #include "libcamera/internal/mapped_framebuffer.h"
 
 using namespace libcamera;
 
 LOG_DEFINE_CATEGORY(Thumbnailer)
 
+/*
+ * Compute, for each target pixel along one dimension, the range of source
+ * pixels it covers and the fixed-point reciprocal of the range length. The
+ * ranges are contiguous when downscaling, and a single source pixel is used
+ * when upscaling.
+ */
+void Thumbnailer::ScaleTable::configure(unsigned int sourceSize,
+					unsigned int targetSize)
+{
+	start.resize(targetSize);
+	end.resize(targetSize);
+	reciprocal.resize(targetSize);
+
+	for (unsigned int i = 0; i < targetSize; ++i) {
+		unsigned int s = std::min(i * sourceSize / targetSize, sourceSize - 1);
+		unsigned int e = (i + 1) * sourceSize / targetSize;
+		e = std::clamp(e, s + 1, sourceSize);
+
+		start[i] = s;
+		end[i] = e;
+		reciprocal[i] = ((1 << 16) + (e - s) / 2) / (e - s);
+	}
+}
+
 Thumbnailer::Thumbnailer()
-	: valid_(false)
+	: stride_(0), valid_(false)
 {
 }
 
-void Thumbnailer::configure(const Size &sourceSize, PixelFormat pixelFormat)
+void Thumbnailer::configure(const Size &sourceSize, PixelFormat pixelFormat,
+			    unsigned int stride)
 {
 	sourceSize_ = sourceSize;
 	pixelFormat_ = pixelFormat;
+	stride_ = stride ? stride : sourceSize.width;
+	targetSize_ = {};
+	valid_ = false;
 
 	if (pixelFormat_ != formats::NV12) {
 		LOG(Thumbnailer, Error)
@@ -34,21 +65,111 @@ void Thumbnailer::configure(const Size &sourceSize, PixelFormat pixelFormat)
 		return;
 	}
 
+	if (stride_ < sourceSize_.width) {
+		LOG(Thumbnailer, Error)
+			<< "Failed to configure: Stride " << stride_
+			<< " too small for width " << sourceSize_.width;
+		return;
+	}
+
+	/* The NV12 luma and interleaved chroma rows have the same size. */
+	rowSums_.resize(sourceSize_.width);
+
 	valid_ = true;
 }
 
+/*
+ * The target size is selected per request from a small set of sizes, and
+ * usually doesn't change between captures. Compute the scaling tables when it
+ * changes only.
+ */
+void Thumbnailer::configureScaling(const Size &targetSize)
+{
+	if (targetSize == targetSize_)
+		return;
+
+	lumaHorz_.configure(sourceSize_.width, targetSize.width);
+	lumaVert_.configure(sourceSize_.height, targetSize.height);
+	chromaHorz_.configure(sourceSize_.width / 2, targetSize.width / 2);
+	chromaVert_.configure(sourceSize_.height / 2, targetSize.height / 2);
+
+	targetSize_ = targetSize;
+}
+
+/*
+ * Downscale one plane with a box filter. The source rows covered by each
+ * target row are first accumulated in rowSums_, in a loop simple enough for
+ * the compiler to vectorize, and the sums are then averaged horizontally
+ * using the precomputed ranges. Planes with interleaved components are
+ * handled by averaging each component separately.
+ */
+void Thumbnailer::scalePlane(const uint8_t *src, unsigned int srcStride,
+			     unsigned int srcWidth, uint8_t *dst,
+			     unsigned int dstWidth, unsigned int components,
+			     const ScaleTable &horz, const ScaleTable &vert)
+{
+	const unsigned int rowSize = srcWidth * components;
+	uint32_t *sums = rowSums_.data();
+
+	for (unsigned int y = 0; y < vert.start.size(); ++y) {
+		std::fill(sums, sums + rowSize, 0);
+
+		for (unsigned int row = vert.start[y]; row < vert.end[y]; ++row) {
+			const uint8_t *line = src + row * srcStride;
+
+			for (unsigned int i = 0; i < rowSize; ++i)
+				sums[i] += line[i];
+		}
+
+		const uint64_t vertReciprocal = vert.reciprocal[y];
+
+		for (unsigned int x = 0; x < dstWidth; ++x) {
+			const uint64_t reciprocal = horz.reciprocal[x] * vertReciprocal;
+
+			for (unsigned int c = 0; c < components; ++c) {
+				uint32_t sum = 0;
+
+				for (unsigned int i = horz.start[x]; i < horz.end[x]; ++i)
+					sum += sums[i * components + c];
+
+				uint64_t value = (sum * reciprocal + (1ULL << 31)) >> 32;
+				*dst++ = std::min<uint64_t>(value, 255);
+			}
+		}
+	}
+}
+
 void Thumbnailer::createThumbnail(const FrameBuffer &source,
 				  const Size &targetSize,
 				  std::vector<unsigned char> *destination)
 {
-	MappedFrameBuffer frame(&source, MappedFrameBuffer::MapFlag::Read);
-	if (!frame.isValid()) {
-		LOG(Thumbnailer, Error)
-			<< "Failed to map FrameBuffer : "
-			<< strerror(frame.error());
+	MappedFrameBuffer *frame =
+		source._d()->mapping(MappedFrameBuffer::MapFlag::Read);
+	if (!frame) {
+		LOG(Thumbnailer, Error) << "Failed to map FrameBuffer";
 		return;
 	}
 
+	ASSERT(frame->planes().size() == 2);
+
+	if (frame->beginAccess(MappedFrameBuffer::MapFlag::Read)) {
+		LOG(Thumbnailer, Error) << "Failed to access FrameBuffer";
+		destination->clear();
+		return;
+	}
+
+	const std::vector<Span<const uint8_t>> planes = {
+		frame->planes()[0], frame->planes()[1]
+	};
+	createThumbnail(planes, targetSize, destination);
+
+	frame->endAccess();
+}
+
+void Thumbnailer::createThumbnail(const std::vector<Span<const uint8_t>> &planes,
+				  const Size &targetSize,
+				  std::vector<unsigned char> *destination)
+{
 	if (!valid_) {
 		LOG(Thumbnailer, Error) << "Config is unconfigured or invalid.";
 		return;
@@ -59,38 +180,27 @@ void Thumbnailer::createThumbnail(const FrameBuffer &source,
 	const unsigned int tw = targetSize.width;
 	const unsigned int th = targetSize.height;
 
-	ASSERT(frame.planes().size() == 2);
+	ASSERT(planes.size() == 2);
 	ASSERT(tw % 2 == 0 && th % 2 == 0);
 
-	/* Image scaling block implementing nearest-neighbour algorithm. */
-	unsigned char *src = frame.planes()[0].data();
-	unsigned char *srcC = frame.planes()[1].data();
-	unsigned char *srcCb, *srcCr;
-	unsigned char *dstY, *srcY;
-
-	size_t dstSize = (th * tw) + ((th / 2) * tw);
-	destination->resize(dstSize);
-	unsigned char *dst = destination->data();
-	unsigned char *dstC = dst + th * tw;
-
-	for (unsigned int y = 0; y < th; y += 2) {
-		unsigned int sourceY = (sh * y + th / 2) / th;
-
-		dstY = dst + y * tw;
-		srcY = src + sw * sourceY;
-		srcCb = srcC + (sourceY / 2) * sw + 0;
-		srcCr = srcC + (sourceY / 2) * sw + 1;
+	if (planes[0].size() < stride_ * (sh - 1) + sw ||
+	    planes[1].size() < stride_ * (sh / 2 - 1) + sw) {
+		LOG(Thumbnailer, Error) << "Source planes too small";
+		return;
+	}
 
-		for (unsigned int x = 0; x < tw; x += 2) {
-			unsigned int sourceX = (sw * x + tw / 2) / tw;
+	configureScaling(targetSize);
 
-			dstY[x] = srcY[sourceX];
-			dstY[tw + x] = srcY[sw + sourceX];
-			dstY[x + 1] = srcY[sourceX + 1];
-			dstY[tw + x + 1] = srcY[sw + sourceX + 1];
+	/*
+	 * The destination vector is reused across captures by the caller, it
+	 * only reallocates when the thumbnail size grows.
+	 */
+	destination->resize(tw * th + tw * th / 2);
+	unsigned char *dst = destination->data();
+	unsigned char *dstC = dst + tw * th;
 
-			dstC[(y / 2) * tw + x + 0] = srcCb[(sourceX / 2) * 2];
-			dstC[(y / 2) * tw + x + 1] = srcCr[(sourceX / 2) * 2];
-		}
-	}
+	scalePlane(planes[0].data(), stride_, sw, dst, tw, 1,
+		   lumaHorz_, lumaVert_);
+	scalePlane(planes[1].data(), stride_, sw / 2, dstC, tw / 2, 2,
+		   chromaHorz_, chromaVert_);
 }
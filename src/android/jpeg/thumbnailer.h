@@ -7,6 +7,11 @@
 
 #pragma once
 
+#include <stdint.h>
+#include <vector>
+
+#include <libcamera/base/span.h>
+
 #include <libcamera/framebuffer.h>
 #include <libcamera/geometry.h>
 
@@ -18,15 +23,41 @@ public:
 	Thumbnailer();
 
 	void configure(const libcamera::Size &sourceSize,
-		       libcamera::PixelFormat pixelFormat);
+		       libcamera::PixelFormat pixelFormat,
+		       unsigned int stride = 0);
 	void createThumbnail(const libcamera::FrameBuffer &source,
 			     const libcamera::Size &targetSize,
 			     std::vector<unsigned char> *dest);
+	void createThumbnail(const std::vector<libcamera::Span<const uint8_t>> &planes,
+			     const libcamera::Size &targetSize,
+			     std::vector<unsigned char> *dest);
 	const libcamera::PixelFormat &pixelFormat() const { return pixelFormat_; }
 
 private:
+	struct ScaleTable {
+		void configure(unsigned int sourceSize, unsigned int targetSize);
+
+		std::vector<unsigned int> start;
+		std::vector<unsigned int> end;
+		std::vector<uint32_t> reciprocal;
+	};
+
+	void configureScaling(const libcamera::Size &targetSize);
+	void scalePlane(const uint8_t *src, unsigned int srcStride,
+			unsigned int srcWidth, uint8_t *dst, unsigned int dstWidth,
+			unsigned int components, const ScaleTable &horz,
+			const ScaleTable &vert);
+
 	libcamera::PixelFormat pixelFormat_;
 	libcamera::Size sourceSize_;
+	unsigned int stride_;
+
+	libcamera::Size targetSize_;
+	ScaleTable lumaHorz_;
+	ScaleTable lumaVert_;
+	ScaleTable chromaHorz_;
+	ScaleTable chromaVert_;
+	std::vector<uint32_t> rowSums_;
 
 	bool valid_;
 };
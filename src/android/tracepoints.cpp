@@ -0,0 +1,12 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2022, Google Inc.
+ *
+ * tracepoints.cpp - Tracepoints with lttng
+ *
+ * The tracepoint probes are provided by libcamera, the HAL only defines the
+ * tracepoints it uses.
+ */
+#define TRACEPOINT_DEFINE
+
+#include "libcamera/internal/tracepoints.h"
@@ -7,6 +7,7 @@
 
 #include "post_processor_yuv.h"
 
+#include <libyuv/planar_functions.h>
 #include <libyuv/scale.h>
 
 #include <libcamera/base/log.h>
@@ -16,12 +17,19 @@
 #include <libcamera/pixel_format.h>
 
 #include "libcamera/internal/formats.h"
+#include "libcamera/internal/framebuffer.h"
 #include "libcamera/internal/mapped_framebuffer.h"
 
 using namespace libcamera;
 
 LOG_DEFINE_CATEGORY(YUV)
 
+PostProcessorYuv::PostProcessorYuv(CameraConfigData::ScalingQuality quality)
+	: quality_(quality), copy_(false),
+	  filter_(libyuv::FilterMode::kFilterBilinear)
+{
+}
+
 int PostProcessorYuv::configure(const StreamConfiguration &inCfg,
 				const StreamConfiguration &outCfg)
 {
@@ -46,6 +54,8 @@ int PostProcessorYuv::configure(const StreamConfiguration &inCfg,
 	}
 
 	calculateLengths(inCfg, outCfg);
+	selectFilter();
+
 	return 0;
 }
 
@@ -59,25 +69,56 @@ void PostProcessorYuv::process(Camera3RequestDescriptor::StreamBuffer *streamBuf
 		return;
 	}
 
-	const MappedFrameBuffer sourceMapped(&source, MappedFrameBuffer::MapFlag::Read);
-	if (!sourceMapped.isValid()) {
+	MappedFrameBuffer *sourceMapped =
+		source._d()->mapping(MappedFrameBuffer::MapFlag::Read);
+	if (!sourceMapped) {
 		LOG(YUV, Error) << "Failed to mmap camera frame buffer";
 		processComplete.emit(streamBuffer, PostProcessor::Status::Error);
 		return;
 	}
 
-	int ret = libyuv::NV12Scale(sourceMapped.planes()[0].data(),
-				    sourceStride_[0],
-				    sourceMapped.planes()[1].data(),
-				    sourceStride_[1],
-				    sourceSize_.width, sourceSize_.height,
-				    destination->plane(0).data(),
-				    destinationStride_[0],
-				    destination->plane(1).data(),
-				    destinationStride_[1],
-				    destinationSize_.width,
-				    destinationSize_.height,
-				    libyuv::FilterMode::kFilterBilinear);
+	int ret = sourceMapped->beginAccess(MappedFrameBuffer::MapFlag::Read);
+	if (ret) {
+		LOG(YUV, Error) << "Failed to access camera frame buffer";
+		processComplete.emit(streamBuffer, PostProcessor::Status::Error);
+		return;
+	}
+
+	if (copy_) {
+		/*
+		 * The libyuv plane copy is vectorized, and copies the whole
+		 * plane at once when the strides match the width. The
+		 * interleaved chroma plane stores one CbCr pair per two
+		 * pixels, round odd widths up to a full pair.
+		 */
+		libyuv::CopyPlane(sourceMapped->planes()[0].data(),
+				  sourceStride_[0],
+				  destination->plane(0).data(),
+				  destinationStride_[0],
+				  sourceSize_.width, sourceSize_.height);
+		libyuv::CopyPlane(sourceMapped->planes()[1].data(),
+				  sourceStride_[1],
+				  destination->plane(1).data(),
+				  destinationStride_[1],
+				  (sourceSize_.width + 1) / 2 * 2,
+				  (sourceSize_.height + 1) / 2);
+	} else {
+		ret = libyuv::NV12Scale(sourceMapped->planes()[0].data(),
+					sourceStride_[0],
+					sourceMapped->planes()[1].data(),
+					sourceStride_[1],
+					sourceSize_.width, sourceSize_.height,
+					destination->plane(0).data(),
+					destinationStride_[0],
+					destination->plane(1).data(),
+					destinationStride_[1],
+					destinationSize_.width,
+					destinationSize_.height,
+					filter_);
+	}
+
+	sourceMapped->endAccess();
+
 	if (ret) {
 		LOG(YUV, Error) << "Failed NV12 scaling: " << ret;
 		processComplete.emit(streamBuffer, PostProcessor::Status::Error);
@@ -144,3 +185,42 @@ void PostProcessorYuv::calculateLengths(const StreamConfiguration &inCfg,
 							   destinationStride_[i]);
 	}
 }
+
+/*
+ * Select the fastest way to produce the destination image that meets the
+ * configured quality. Identical source and destination sizes only require a
+ * copy. Otherwise, point sampling is used for the fast quality level, and
+ * bilinear filtering for the balanced quality level. The best quality level
+ * uses a box filter when downscaling by more than 2, as bilinear filtering
+ * then skips source pixels and aliases.
+ */
+void PostProcessorYuv::selectFilter()
+{
+	copy_ = sourceSize_ == destinationSize_;
+	if (copy_) {
+		LOG(YUV, Debug) << "Copying " << sourceSize_ << " frames";
+		return;
+	}
+
+	switch (quality_) {
+	case CameraConfigData::ScalingQuality::Fast:
+		filter_ = libyuv::FilterMode::kFilterNone;
+		break;
+
+	case CameraConfigData::ScalingQuality::Balanced:
+		filter_ = libyuv::FilterMode::kFilterBilinear;
+		break;
+
+	case CameraConfigData::ScalingQuality::Best:
+		if (sourceSize_.width > destinationSize_.width * 2 ||
+		    sourceSize_.height > destinationSize_.height * 2)
+			filter_ = libyuv::FilterMode::kFilterBox;
+		else
+			filter_ = libyuv::FilterMode::kFilterBilinear;
+		break;
+	}
+
+	LOG(YUV, Debug)
+		<< "Scaling from " << sourceSize_ << " to " << destinationSize_
+		<< " with filter " << static_cast<int>(filter_);
+}
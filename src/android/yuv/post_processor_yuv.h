@@ -7,14 +7,18 @@
 
 #pragma once
 
+#include "../camera_hal_config.h"
 #include "../post_processor.h"
 
+#include <libyuv/scale.h>
+
 #include <libcamera/geometry.h>
 
 class PostProcessorYuv : public PostProcessor
 {
 public:
-	PostProcessorYuv() = default;
+	PostProcessorYuv(CameraConfigData::ScalingQuality quality =
+				 CameraConfigData::ScalingQuality::Balanced);
 
 	int configure(const libcamera::StreamConfiguration &incfg,
 		      const libcamera::StreamConfiguration &outcfg) override;
@@ -25,6 +29,11 @@ private:
 			    const CameraBuffer &destination) const;
 	void calculateLengths(const libcamera::StreamConfiguration &inCfg,
 			      const libcamera::StreamConfiguration &outCfg);
+	void selectFilter();
+
+	CameraConfigData::ScalingQuality quality_;
+	bool copy_;
+	libyuv::FilterMode filter_;
 
 	libcamera::Size sourceSize_;
 	libcamera::Size destinationSize_;
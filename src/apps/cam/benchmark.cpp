@@ -0,0 +1,407 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2022, Google Inc.
+ *
+ * benchmark.cpp - Capture benchmark statistics
+ */
+
+#include "benchmark.h"
+
+#include <algorithm>
+#include <cmath>
+#include <dirent.h>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <libcamera/control_ids.h>
+#include <libcamera/framebuffer.h>
+
+using namespace libcamera;
+
+namespace {
+
+std::string jsonString(const std::string &str)
+{
+	std::stringstream out;
+
+	out << '"';
+	for (char c : str) {
+		if (c == '"' || c == '\\')
+			out << '\\' << c;
+		else if (static_cast<unsigned char>(c) < 0x20)
+			out << "\\u" << std::hex << std::setw(4) << std::setfill('0')
+			    << static_cast<unsigned int>(c) << std::dec;
+		else
+			out << c;
+	}
+	out << '"';
+
+	return out.str();
+}
+
+} /* namespace */
+
+/*
+ * The benchmark measures the capture performance of a camera session. Frame
+ * statistics are accumulated in the event loop thread, with the exception of
+ * the completion times, which are recorded in the camera manager thread when
+ * the request completes to exclude the event loop dispatch delay.
+ */
+Benchmark::Benchmark(const Camera *camera, unsigned int numRequests)
+	: cameraId_(camera->id()), running_(false), queued_(numRequests),
+	  completed_(numRequests), frames_(0), bytes_(0), lastTimestamp_(0),
+	  dropped_(0), processStart_(0), processEnd_(0), peakRss_(0)
+{
+}
+
+void Benchmark::start()
+{
+	startTimes_ = threadTimes();
+	processStart_ = processTime();
+	start_ = clock::now();
+	running_ = true;
+}
+
+void Benchmark::stop()
+{
+	if (!running_)
+		return;
+
+	end_ = clock::now();
+	endTimes_ = threadTimes();
+	processEnd_ = processTime();
+	running_ = false;
+
+	struct rusage usage;
+	if (!getrusage(RUSAGE_SELF, &usage))
+		peakRss_ = usage.ru_maxrss;
+}
+
+std::chrono::steady_clock::duration Benchmark::elapsed() const
+{
+	return (running_ ? clock::now() : end_) - start_;
+}
+
+void Benchmark::requestQueued(const Request *request)
+{
+	queued_[request->cookie()] = clock::now();
+}
+
+void Benchmark::requestCompleted(const Request *request)
+{
+	completed_[request->cookie()] = clock::now();
+}
+
+void Benchmark::processRequest(Request *request)
+{
+	if (!running_)
+		return;
+
+	const uint64_t cookie = request->cookie();
+	auto latency = std::chrono::duration_cast<std::chrono::microseconds>(
+		completed_[cookie] - queued_[cookie]);
+	latencies_.push_back(latency.count());
+
+	frames_++;
+
+	const Request::BufferMap &buffers = request->buffers();
+
+	for (const auto &[stream, buffer] : buffers) {
+		const FrameMetadata &metadata = buffer->metadata();
+
+		for (const FrameMetadata::Plane &plane : metadata.planes())
+			bytes_ += plane.bytesused;
+
+		auto iter = sequences_.find(stream);
+		if (iter != sequences_.end() && metadata.sequence > iter->second + 1)
+			dropped_ += metadata.sequence - iter->second - 1;
+
+		sequences_[stream] = metadata.sequence;
+	}
+
+	/*
+	 * Use the sensor timestamp if reported by the pipeline handler, and
+	 * fall back to the timestamp of the first buffer otherwise.
+	 */
+	const auto sensorTimestamp = request->metadata().get(controls::SensorTimestamp);
+	uint64_t timestamp = sensorTimestamp
+			   ? static_cast<uint64_t>(*sensorTimestamp)
+			   : buffers.begin()->second->metadata().timestamp;
+
+	if (lastTimestamp_ && timestamp > lastTimestamp_)
+		intervals_.push_back(timestamp - lastTimestamp_);
+
+	lastTimestamp_ = timestamp;
+}
+
+std::map<pid_t, Benchmark::ThreadTimes> Benchmark::threadTimes()
+{
+	std::map<pid_t, ThreadTimes> times;
+
+	DIR *dir = opendir("/proc/self/task");
+	if (!dir)
+		return times;
+
+	struct dirent *ent;
+	while ((ent = readdir(dir)) != nullptr) {
+		if (ent->d_name[0] == '.')
+			continue;
+
+		pid_t tid = atoi(ent->d_name);
+		std::ifstream file("/proc/self/task/" + std::string(ent->d_name) + "/stat");
+		std::string stat;
+		if (!std::getline(file, stat))
+			continue;
+
+		/*
+		 * The thread name is enclosed in parentheses and may contain
+		 * spaces. The utime and stime fields are the 14th and 15th
+		 * fields, the 12th and 13th after the name.
+		 */
+		size_t open = stat.find('(');
+		size_t close = stat.rfind(')');
+		if (open == std::string::npos || close == std::string::npos)
+			continue;
+
+		ThreadTimes &thread = times[tid];
+		thread.name = stat.substr(open + 1, close - open - 1);
+
+		std::istringstream fields(stat.substr(close + 2));
+		std::string field;
+		for (unsigned int i = 0; i < 11; ++i)
+			fields >> field;
+
+		fields >> thread.user >> thread.system;
+	}
+
+	closedir(dir);
+
+	return times;
+}
+
+/*
+ * Compute the CPU time consumed by each thread during the benchmark. Threads
+ * that exited before the end of the benchmark are not accounted for.
+ */
+std::map<pid_t, Benchmark::ThreadTimes> Benchmark::cpuUsage() const
+{
+	std::map<pid_t, ThreadTimes> usage = endTimes_;
+
+	for (auto &[tid, thread] : usage) {
+		auto iter = startTimes_.find(tid);
+		if (iter == startTimes_.end())
+			continue;
+
+		thread.user -= std::min(thread.user, iter->second.user);
+		thread.system -= std::min(thread.system, iter->second.system);
+	}
+
+	return usage;
+}
+
+/* Retrieve the user and system CPU time consumed by all threads of the process. */
+std::chrono::microseconds Benchmark::processTime()
+{
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage))
+		return {};
+
+	return std::chrono::seconds(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec)
+	     + std::chrono::microseconds(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec);
+}
+
+Benchmark::Percentiles Benchmark::percentiles(std::vector<uint64_t> values)
+{
+	if (values.empty())
+		return {};
+
+	std::sort(values.begin(), values.end());
+
+	auto percentile = [&](unsigned int p) {
+		return values[(values.size() - 1) * p / 100];
+	};
+
+	return { values.front(), percentile(50), percentile(90), percentile(99),
+		 values.back() };
+}
+
+double Benchmark::meanInterval() const
+{
+	if (intervals_.empty())
+		return 0.0;
+
+	double sum = 0.0;
+	for (uint64_t interval : intervals_)
+		sum += interval;
+
+	return sum / intervals_.size();
+}
+
+/* Compute the jitter as the standard deviation of the frame intervals. */
+double Benchmark::intervalJitter() const
+{
+	if (intervals_.size() < 2)
+		return 0.0;
+
+	const double mean = meanInterval();
+	double sum = 0.0;
+	for (uint64_t interval : intervals_)
+		sum += (interval - mean) * (interval - mean);
+
+	return std::sqrt(sum / (intervals_.size() - 1));
+}
+
+void Benchmark::report(std::ostream &out) const
+{
+	const double seconds = std::chrono::duration<double>(elapsed()).count();
+	const Percentiles latency = percentiles(latencies_);
+	const double ticks = sysconf(_SC_CLK_TCK);
+
+	out << std::fixed << std::setprecision(2)
+	    << "Benchmark " << cameraId_ << ":" << std::endl
+	    << "  Frames: " << frames_ << " in " << seconds << " s ("
+	    << (seconds ? frames_ / seconds : 0.0) << " fps, "
+	    << (seconds ? bytes_ / seconds / 1000000 : 0.0) << " MB/s)" << std::endl
+	    << "  Frame interval: " << meanInterval() / 1000 << " us, jitter "
+	    << intervalJitter() / 1000 << " us" << std::endl
+	    << "  Latency: min " << latency.min << " us, p50 " << latency.p50
+	    << " us, p90 " << latency.p90 << " us, p99 " << latency.p99
+	    << " us, max " << latency.max << " us" << std::endl
+	    << "  Dropped frames: " << dropped_ << std::endl;
+
+	uint64_t user = 0;
+	uint64_t system = 0;
+
+	for (const auto &[tid, thread] : cpuUsage()) {
+		user += thread.user;
+		system += thread.system;
+
+		out << "  Thread " << tid << " (" << thread.name << "): "
+		    << (seconds ? (thread.user + thread.system) / ticks / seconds * 100 : 0.0)
+		    << "% CPU" << std::endl;
+	}
+
+	out << "  CPU: " << user / ticks << " s user, " << system / ticks
+	    << " s system (" << (seconds ? (user + system) / ticks / seconds * 100 : 0.0)
+	    << "%)" << std::endl
+	    << "  Peak RSS: " << peakRss_ << " kB" << std::endl;
+}
+
+void Benchmark::reportJSON(std::ostream &out) const
+{
+	const double seconds = std::chrono::duration<double>(elapsed()).count();
+	const Percentiles latency = percentiles(latencies_);
+	const double ticks = sysconf(_SC_CLK_TCK);
+
+	out << std::fixed << std::setprecision(3)
+	    << "{" << std::endl
+	    << "\t\"camera\": " << jsonString(cameraId_) << "," << std::endl
+	    << "\t\"frames\": " << frames_ << "," << std::endl
+	    << "\t\"duration_s\": " << seconds << "," << std::endl
+	    << "\t\"fps\": " << (seconds ? frames_ / seconds : 0.0) << "," << std::endl
+	    << "\t\"bytes_per_s\": " << (seconds ? bytes_ / seconds : 0.0) << "," << std::endl
+	    << "\t\"dropped\": " << dropped_ << "," << std::endl
+	    << "\t\"frame_interval_us\": {" << std::endl
+	    << "\t\t\"mean\": " << meanInterval() / 1000 << "," << std::endl
+	    << "\t\t\"jitter\": " << intervalJitter() / 1000 << std::endl
+	    << "\t}," << std::endl
+	    << "\t\"latency_us\": {" << std::endl
+	    << "\t\t\"min\": " << latency.min << "," << std::endl
+	    << "\t\t\"p50\": " << latency.p50 << "," << std::endl
+	    << "\t\t\"p90\": " << latency.p90 << "," << std::endl
+	    << "\t\t\"p99\": " << latency.p99 << "," << std::endl
+	    << "\t\t\"max\": " << latency.max << std::endl
+	    << "\t}," << std::endl
+	    << "\t\"threads\": [";
+
+	uint64_t user = 0;
+	uint64_t system = 0;
+	bool first = true;
+
+	for (const auto &[tid, thread] : cpuUsage()) {
+		user += thread.user;
+		system += thread.system;
+
+		out << (first ? "" : ",") << std::endl
+		    << "\t\t{ \"tid\": " << tid
+		    << ", \"name\": " << jsonString(thread.name)
+		    << ", \"user_s\": " << thread.user / ticks
+		    << ", \"system_s\": " << thread.system / ticks << " }";
+		first = false;
+	}
+
+	out << std::endl
+	    << "\t]," << std::endl
+	    << "\t\"cpu\": {" << std::endl
+	    << "\t\t\"user_s\": " << user / ticks << "," << std::endl
+	    << "\t\t\"system_s\": " << system / ticks << "," << std::endl
+	    << "\t\t\"usage\": " << (seconds ? (user + system) / ticks / seconds : 0.0)
+	    << std::endl
+	    << "\t}," << std::endl
+	    << "\t\"peak_rss_kb\": " << peakRss_ << std::endl
+	    << "}" << std::endl;
+}
+
+/*
+ * Report the statistics of multiple cameras capturing concurrently. The
+ * throughput is accumulated over all cameras, and the CPU usage is measured
+ * for the whole process from the first start to the last stop.
+ */
+void Benchmark::reportAggregate(std::ostream &out,
+				const std::vector<const Benchmark *> &benchmarks)
+{
+	if (benchmarks.empty())
+		return;
+
+	clock::time_point start = benchmarks.front()->start_;
+	clock::time_point end = benchmarks.front()->end_;
+	std::chrono::microseconds processStart = benchmarks.front()->processStart_;
+	std::chrono::microseconds processEnd = benchmarks.front()->processEnd_;
+	std::vector<uint64_t> latencies;
+	unsigned int frames = 0;
+	unsigned int dropped = 0;
+	double fps = 0.0;
+	double bandwidth = 0.0;
+	long peakRss = 0;
+
+	for (const Benchmark *benchmark : benchmarks) {
+		const double seconds = std::chrono::duration<double>(benchmark->elapsed()).count();
+
+		start = std::min(start, benchmark->start_);
+		end = std::max(end, benchmark->end_);
+		processStart = std::min(processStart, benchmark->processStart_);
+		processEnd = std::max(processEnd, benchmark->processEnd_);
+
+		latencies.insert(latencies.end(), benchmark->latencies_.begin(),
+				 benchmark->latencies_.end());
+		frames += benchmark->frames_;
+		dropped += benchmark->dropped_;
+		peakRss = std::max(peakRss, benchmark->peakRss_);
+
+		if (seconds) {
+			fps += benchmark->frames_ / seconds;
+			bandwidth += benchmark->bytes_ / seconds;
+		}
+	}
+
+	const double seconds = std::chrono::duration<double>(end - start).count();
+	const double cpu = std::chrono::duration<double>(processEnd - processStart).count();
+	const Percentiles latency = percentiles(std::move(latencies));
+
+	out << std::fixed << std::setprecision(2)
+	    << "Benchmark of " << benchmarks.size() << " cameras:" << std::endl
+	    << "  Frames: " << frames << " in " << seconds << " s ("
+	    << fps << " fps, " << bandwidth / 1000000 << " MB/s)" << std::endl
+	    << "  Latency: min " << latency.min << " us, p50 " << latency.p50
+	    << " us, p90 " << latency.p90 << " us, p99 " << latency.p99
+	    << " us, max " << latency.max << " us" << std::endl
+	    << "  Dropped frames: " << dropped << std::endl
+	    << "  CPU: " << cpu << " s (" << (seconds ? cpu / seconds * 100 : 0.0)
+	    << "%, " << (frames ? cpu / frames * 1000 : 0.0) << " ms per frame)"
+	    << std::endl
+	    << "  Peak RSS: " << peakRss << " kB" << std::endl;
+}
@@ -0,0 +1,99 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2022, Google Inc.
+ *
+ * benchmark.h - Capture benchmark statistics
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <ostream>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include <sys/types.h>
+
+#include <libcamera/camera.h>
+#include <libcamera/request.h>
+#include <libcamera/stream.h>
+
+class Benchmark
+{
+public:
+	Benchmark(const libcamera::Camera *camera, unsigned int numRequests);
+
+	void start();
+	void stop();
+
+	std::chrono::steady_clock::duration elapsed() const;
+
+	void requestQueued(const libcamera::Request *request);
+	void requestCompleted(const libcamera::Request *request);
+	void processRequest(libcamera::Request *request);
+
+	void report(std::ostream &out) const;
+	void reportJSON(std::ostream &out) const;
+
+	static void reportAggregate(std::ostream &out,
+				    const std::vector<const Benchmark *> &benchmarks);
+
+private:
+	using clock = std::chrono::steady_clock;
+
+	struct ThreadTimes {
+		std::string name;
+		uint64_t user;
+		uint64_t system;
+	};
+
+	struct Percentiles {
+		uint64_t min;
+		uint64_t p50;
+		uint64_t p90;
+		uint64_t p99;
+		uint64_t max;
+	};
+
+	static std::map<pid_t, ThreadTimes> threadTimes();
+	static std::chrono::microseconds processTime();
+	static Percentiles percentiles(std::vector<uint64_t> values);
+
+	std::map<pid_t, ThreadTimes> cpuUsage() const;
+	double meanInterval() const;
+	double intervalJitter() const;
+
+	std::string cameraId_;
+
+	clock::time_point start_;
+	clock::time_point end_;
+	/* Stopped from the thread that processes requests, read by all threads. */
+	std::atomic<bool> running_;
+
+	/* Queue and completion times, indexed by the request cookie. */
+	std::vector<clock::time_point> queued_;
+	std::vector<clock::time_point> completed_;
+
+	unsigned int frames_;
+	uint64_t bytes_;
+
+	/* Request round-trip latencies in microseconds. */
+	std::vector<uint64_t> latencies_;
+
+	/* Intervals between consecutive sensor timestamps in nanoseconds. */
+	uint64_t lastTimestamp_;
+	std::vector<uint64_t> intervals_;
+
+	std::map<const libcamera::Stream *, unsigned int> sequences_;
+	unsigned int dropped_;
+
+	/* CPU times in clock ticks, and peak resident set size in kB. */
+	std::map<pid_t, ThreadTimes> startTimes_;
+	std::map<pid_t, ThreadTimes> endTimes_;
+	std::chrono::microseconds processStart_;
+	std::chrono::microseconds processEnd_;
+	long peakRss_;
+};
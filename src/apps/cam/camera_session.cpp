@@ -5,9 +5,11 @@
  * camera_session.cpp - Camera capture session
  */
 
+#include <fstream>
 #include <iomanip>
 #include <iostream>
 #include <limits.h>
+#include <pthread.h>
 #include <sstream>
 
 #include <libcamera/control_ids.h>
@@ -16,6 +18,7 @@
 #include "../common/event_loop.h"
 #include "../common/stream_options.h"
 
+#include "benchmark.h"
 #include "camera_session.h"
 #include "capture_script.h"
 #include "file_sink.h"
@@ -35,7 +38,8 @@ CameraSession::CameraSession(CameraManager *cm,
 			     const OptionsParser::Options &options)
 	: options_(options), cameraIndex_(cameraIndex), last_(0),
 	  queueCount_(0), captureCount_(0), captureLimit_(0),
-	  printMetadata_(false)
+	  captureDuration_(0), captureComplete_(false), printMetadata_(false),
+	  threaded_(false), stop_(false)
 {
 	char *endptr;
 	unsigned long index = strtoul(cameraId.c_str(), &endptr, 10);
@@ -96,6 +100,14 @@ CameraSession::CameraSession(CameraManager *cm,
 	}
 #endif
 
+#ifdef HAVE_SDL
+	if (options_.isSet(OptSDL) && options_.isSet(OptThread)) {
+		std::cerr << "--sdl and --thread options are mutually exclusive"
+			  << std::endl;
+		return;
+	}
+#endif
+
 	if (options_.isSet(OptCaptureScript)) {
 		std::string scriptName = options_[OptCaptureScript].toString();
 		script_ = std::make_unique<CaptureScript>(camera_, scriptName);
@@ -129,6 +141,8 @@ CameraSession::CameraSession(CameraManager *cm,
 
 CameraSession::~CameraSession()
 {
+	stopThread();
+
 	if (camera_)
 		camera_->release();
 }
@@ -179,8 +193,15 @@ int CameraSession::start()
 	queueCount_ = 0;
 	captureCount_ = 0;
 	captureLimit_ = options_[OptCapture].toInteger();
+	captureDuration_ = std::chrono::seconds(options_[OptDuration].toInteger());
+	captureComplete_ = false;
 	printMetadata_ = options_.isSet(OptMetadata);
 
+	if (captureDuration_.count() < 0) {
+		std::cerr << "Invalid capture duration" << std::endl;
+		return -EINVAL;
+	}
+
 	ret = camera_->configure(config_.get());
 	if (ret < 0) {
 		std::cout << "Failed to configure camera" << std::endl;
@@ -207,11 +228,32 @@ int CameraSession::start()
 #endif
 
 	if (options_.isSet(OptFile)) {
+		std::unique_ptr<FileSink> sink;
+
 		if (!options_[OptFile].toString().empty())
-			sink_ = std::make_unique<FileSink>(camera_.get(), streamNames_,
-							   options_[OptFile]);
+			sink = std::make_unique<FileSink>(camera_.get(), streamNames_,
+							  options_[OptFile]);
 		else
-			sink_ = std::make_unique<FileSink>(camera_.get(), streamNames_);
+			sink = std::make_unique<FileSink>(camera_.get(), streamNames_);
+
+#ifdef HAVE_TIFF
+		if (options_.isSet(OptDNGCompression)) {
+			const std::string method = options_[OptDNGCompression].toString();
+			DNGWriter::Options dngOptions;
+
+			if (method == "deflate") {
+				dngOptions.compression = DNGWriter::Compression::Deflate;
+			} else if (method != "none") {
+				std::cerr << "Invalid DNG compression method '"
+					  << method << "'" << std::endl;
+				return -EINVAL;
+			}
+
+			sink->setDNGOptions(dngOptions);
+		}
+#endif
+
+		sink_ = std::move(sink);
 	}
 
 	if (sink_) {
@@ -225,6 +267,12 @@ int CameraSession::start()
 		sink_->requestProcessed.connect(this, &CameraSession::sinkRelease);
 	}
 
+	/*
+	 * Process completed requests in a dedicated thread if requested, to
+	 * let sessions capturing from multiple cameras run concurrently.
+	 */
+	threaded_ = options_.isSet(OptThread);
+
 	allocator_ = std::make_unique<FrameBufferAllocator>(camera_);
 
 	return startCapture();
@@ -236,6 +284,22 @@ void CameraSession::stop()
 	if (ret)
 		std::cout << "Failed to stop capture" << std::endl;
 
+	stopThread();
+
+	if (benchmark_) {
+		benchmark_->stop();
+		benchmark_->report(std::cout);
+
+		const std::string &filename = options_[OptBenchmark].toString();
+		if (options_.isSet(OptBenchmark) && !filename.empty()) {
+			std::ofstream file(filename);
+			benchmark_->reportJSON(file);
+			if (!file)
+				std::cerr << "Failed to write benchmark report to "
+					  << filename << std::endl;
+		}
+	}
+
 	if (sink_) {
 		ret = sink_->stop();
 		if (ret)
@@ -272,7 +336,7 @@ int CameraSession::startCapture()
 	 */
 
 	for (unsigned int i = 0; i < nbuffers; i++) {
-		std::unique_ptr<Request> request = camera_->createRequest();
+		std::unique_ptr<Request> request = camera_->createRequest(i);
 		if (!request) {
 			std::cerr << "Can't create request" << std::endl;
 			return -ENOMEM;
@@ -298,6 +362,16 @@ int CameraSession::startCapture()
 		requests_.push_back(std::move(request));
 	}
 
+	/*
+	 * In benchmark mode, per-frame information isn't printed, and the
+	 * requests are tracked by their cookie to measure their latency.
+	 * Statistics are also collected for sessions running in their own
+	 * thread, to compare concurrent captures.
+	 */
+	if (options_.isSet(OptBenchmark) || threaded_)
+		benchmark_ = std::make_unique<Benchmark>(camera_.get(),
+							 requests_.size());
+
 	if (sink_) {
 		ret = sink_->start();
 		if (ret) {
@@ -306,6 +380,15 @@ int CameraSession::startCapture()
 		}
 	}
 
+	captureStart_ = std::chrono::steady_clock::now();
+	if (benchmark_)
+		benchmark_->start();
+
+	{
+		std::lock_guard<std::mutex> locker(mutex_);
+		stop_ = false;
+	}
+
 	ret = camera_->start();
 	if (ret) {
 		std::cout << "Failed to start capture" << std::endl;
@@ -319,16 +402,33 @@ int CameraSession::startCapture()
 		if (ret < 0) {
 			std::cerr << "Can't queue request" << std::endl;
 			camera_->stop();
+			stopThread();
 			if (sink_)
 				sink_->stop();
 			return ret;
 		}
 	}
 
-	if (captureLimit_)
+	/*
+	 * Start the processing thread once all initial requests are queued, as
+	 * requests are requeued from that thread. Requests that complete in the
+	 * meantime wait in the calls queue.
+	 */
+	if (threaded_)
+		thread_ = std::thread(&CameraSession::processThread, this);
+
+	if (captureLimit_ && captureDuration_.count())
+		std::cout << "cam" << cameraIndex_
+			  << ": Capture " << captureLimit_ << " frames or "
+			  << captureDuration_.count() << " seconds" << std::endl;
+	else if (captureLimit_)
 		std::cout << "cam" << cameraIndex_
 			  << ": Capture " << captureLimit_ << " frames"
 			  << std::endl;
+	else if (captureDuration_.count())
+		std::cout << "cam" << cameraIndex_
+			  << ": Capture " << captureDuration_.count() << " seconds"
+			  << std::endl;
 	else
 		std::cout << "cam" << cameraIndex_
 			  << ": Capture until user interrupts by SIGINT"
@@ -337,6 +437,66 @@ int CameraSession::startCapture()
 	return 0;
 }
 
+void CameraSession::callLater(const std::function<void()> &func)
+{
+	if (!threaded_) {
+		EventLoop::instance()->callLater(func);
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> locker(mutex_);
+
+		/* Requests released by sinks after stopping are dropped. */
+		if (stop_)
+			return;
+
+		calls_.push(func);
+	}
+
+	cv_.notify_one();
+}
+
+void CameraSession::processThread()
+{
+	/* Name the thread after the session to identify it in CPU statistics. */
+	std::string name = "cam" + std::to_string(cameraIndex_);
+	pthread_setname_np(pthread_self(), name.c_str());
+
+	std::unique_lock<std::mutex> locker(mutex_);
+
+	while (true) {
+		cv_.wait(locker, [&] { return stop_ || !calls_.empty(); });
+
+		if (stop_)
+			return;
+
+		std::function<void()> call = std::move(calls_.front());
+		calls_.pop();
+
+		locker.unlock();
+		call();
+		locker.lock();
+	}
+}
+
+void CameraSession::stopThread()
+{
+	{
+		std::lock_guard<std::mutex> locker(mutex_);
+		stop_ = true;
+	}
+
+	if (thread_.joinable()) {
+		cv_.notify_one();
+		thread_.join();
+	}
+
+	/* Discard the requests that haven't been processed yet. */
+	std::lock_guard<std::mutex> locker(mutex_);
+	calls_ = {};
+}
+
 int CameraSession::queueRequest(Request *request)
 {
 	if (captureLimit_ && queueCount_ >= captureLimit_)
@@ -347,6 +507,9 @@ int CameraSession::queueRequest(Request *request)
 
 	queueCount_++;
 
+	if (benchmark_)
+		benchmark_->requestQueued(request);
+
 	return camera_->queueRequest(request);
 }
 
@@ -355,25 +518,86 @@ void CameraSession::requestComplete(Request *request)
 	if (request->status() == Request::RequestCancelled)
 		return;
 
+	if (benchmark_)
+		benchmark_->requestCompleted(request);
+
 	/*
-	 * Defer processing of the completed request to the event loop, to avoid
-	 * blocking the camera manager thread.
+	 * Defer processing of the completed request to the session thread or
+	 * the event loop, to avoid blocking the camera manager thread.
 	 */
-	EventLoop::instance()->callLater([=]() { processRequest(request); });
+	callLater([=]() { processRequest(request); });
 }
 
 void CameraSession::processRequest(Request *request)
 {
 	/*
-	 * If we've reached the capture limit, we're done. This doesn't
-	 * duplicate the check below that emits the captureDone signal, as this
+	 * If we've reached the capture limit or duration, we're done. This
 	 * function will be called for each request still in flight after the
-	 * capture limit is reached and we don't want to emit the signal every
-	 * single time.
+	 * capture completes and we don't want to emit the captureDone signal
+	 * every single time.
+	 */
+	if (captureComplete_)
+		return;
+
+	bool requeue = true;
+
+	/*
+	 * In benchmark mode, only record the frame statistics, as printing
+	 * information for every frame would skew the measurements.
+	 */
+	if (benchmark_)
+		benchmark_->processRequest(request);
+	if (!options_.isSet(OptBenchmark))
+		printRequest(request);
+
+	if (sink_) {
+		if (!sink_->processRequest(request))
+			requeue = false;
+	}
+
+	if (printMetadata_) {
+		std::stringstream info;
+
+		const ControlList &requestMetadata = request->metadata();
+		for (const auto &[key, value] : requestMetadata) {
+			const ControlId *id = controls::controls.at(key);
+			info << "\t" << id->name() << " = "
+			     << value.toString() << std::endl;
+		}
+
+		std::cout << info.str() << std::flush;
+	}
+
+	/*
+	 * Notify the user that capture is complete if the limit or the
+	 * duration has just been reached.
 	 */
-	if (captureLimit_ && captureCount_ >= captureLimit_)
+	captureCount_++;
+	if ((captureLimit_ && captureCount_ >= captureLimit_) ||
+	    (captureDuration_.count() &&
+	     std::chrono::steady_clock::now() - captureStart_ >= captureDuration_)) {
+		captureComplete_ = true;
+		if (benchmark_)
+			benchmark_->stop();
+
+		/* Notify the application from the event loop thread. */
+		EventLoop::instance()->callLater([this]() { captureDone.emit(); });
 		return;
+	}
+
+	/*
+	 * If the frame sink holds on the request, we'll requeue it later in the
+	 * complete handler.
+	 */
+	if (!requeue)
+		return;
+
+	request->reuse(Request::ReuseBuffers);
+	queueRequest(request);
+}
 
+void CameraSession::printRequest(Request *request)
+{
 	const Request::BufferMap &buffers = request->buffers();
 
 	/*
@@ -385,8 +609,6 @@ void CameraSession::processRequest(Request *request)
 	fps = last_ != 0 && fps ? 1000000000.0 / fps : 0.0;
 	last_ = ts;
 
-	bool requeue = true;
-
 	std::stringstream info;
 	info << ts / 1000000000 << "."
 	     << std::setw(6) << std::setfill('0') << ts / 1000 % 1000000
@@ -407,45 +629,22 @@ void CameraSession::processRequest(Request *request)
 		}
 	}
 
-	if (sink_) {
-		if (!sink_->processRequest(request))
-			requeue = false;
-	}
-
-	std::cout << info.str() << std::endl;
-
-	if (printMetadata_) {
-		const ControlList &requestMetadata = request->metadata();
-		for (const auto &[key, value] : requestMetadata) {
-			const ControlId *id = controls::controls.at(key);
-			std::cout << "\t" << id->name() << " = "
-				  << value.toString() << std::endl;
-		}
-	}
-
 	/*
-	 * Notify the user that capture is complete if the limit has just been
-	 * reached.
+	 * Print the whole line at once, as sessions may run concurrently in
+	 * different threads.
 	 */
-	captureCount_++;
-	if (captureLimit_ && captureCount_ >= captureLimit_) {
-		captureDone.emit();
-		return;
-	}
-
-	/*
-	 * If the frame sink holds on the request, we'll requeue it later in the
-	 * complete handler.
-	 */
-	if (!requeue)
-		return;
-
-	request->reuse(Request::ReuseBuffers);
-	queueRequest(request);
+	info << std::endl;
+	std::cout << info.str() << std::flush;
 }
 
 void CameraSession::sinkRelease(Request *request)
 {
-	request->reuse(Request::ReuseBuffers);
-	queueRequest(request);
+	/*
+	 * Sinks may release requests from a different thread. Requeue them
+	 * from the thread that processes requests to avoid races.
+	 */
+	callLater([=]() {
+		request->reuse(Request::ReuseBuffers);
+		queueRequest(request);
+	});
 }
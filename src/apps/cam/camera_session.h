@@ -7,9 +7,15 @@
 
 #pragma once
 
+#include <chrono>
+#include <condition_variable>
+#include <functional>
 #include <memory>
+#include <mutex>
+#include <queue>
 #include <stdint.h>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include <libcamera/base/signal.h>
@@ -23,6 +29,7 @@
 
 #include "../common/options.h"
 
+class Benchmark;
 class CaptureScript;
 class FrameSink;
 
@@ -39,6 +46,7 @@ public:
 
 	libcamera::Camera *camera() { return camera_.get(); }
 	libcamera::CameraConfiguration *config() { return config_.get(); }
+	const Benchmark *benchmark() const { return benchmark_.get(); }
 
 	void listControls() const;
 	void listProperties() const;
@@ -52,9 +60,14 @@ public:
 private:
 	int startCapture();
 
+	void callLater(const std::function<void()> &func);
+	void processThread();
+	void stopThread();
+
 	int queueRequest(libcamera::Request *request);
 	void requestComplete(libcamera::Request *request);
 	void processRequest(libcamera::Request *request);
+	void printRequest(libcamera::Request *request);
 	void sinkRelease(libcamera::Request *request);
 
 	const OptionsParser::Options &options_;
@@ -72,8 +85,24 @@ private:
 	unsigned int queueCount_;
 	unsigned int captureCount_;
 	unsigned int captureLimit_;
+	std::chrono::seconds captureDuration_;
+	std::chrono::steady_clock::time_point captureStart_;
+	bool captureComplete_;
 	bool printMetadata_;
 
+	std::unique_ptr<Benchmark> benchmark_;
+
+	/*
+	 * Completed requests are processed in a per-session thread when the
+	 * --thread option is set, and in the event loop thread otherwise.
+	 */
+	bool threaded_;
+	std::thread thread_;
+	std::mutex mutex_;
+	std::condition_variable cv_;
+	std::queue<std::function<void()>> calls_;
+	bool stop_;
+
 	std::unique_ptr<libcamera::FrameBufferAllocator> allocator_;
 	std::vector<std::unique_ptr<libcamera::Request>> requests_;
 };
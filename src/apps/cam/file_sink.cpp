@@ -5,12 +5,14 @@
  * file_sink.cpp - File Sink
  */
 
+#include <algorithm>
 #include <assert.h>
 #include <fcntl.h>
 #include <iomanip>
 #include <iostream>
 #include <sstream>
 #include <string.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 #include <libcamera/camera.h>
@@ -28,13 +30,33 @@ FileSink::FileSink([[maybe_unused]] const libcamera::Camera *camera,
 	:
 #ifdef HAVE_TIFF
 	  camera_(camera),
+	  dng_(pattern.find(".dng", pattern.size() - 4) != std::string::npos),
 #endif
-	  streamNames_(streamNames), pattern_(pattern)
+	  streamNames_(streamNames), pattern_(pattern), containerFd_(-1),
+	  containerOffset_(0),
+#ifdef HAVE_LIBURING
+	  ringValid_(false), ringWriteId_(0),
+#endif
+	  queueDepth_(kMaxQueueDepth), writing_(0), stop_(false), written_(0),
+	  dropped_(0), throttled_(0),
+	  throttledTime_(0), maxQueueDepth_(0)
 {
+	/*
+	 * The ',container' suffix selects the container mode, which appends
+	 * all frames to a single file with an index.
+	 */
+	static const std::string containerSuffix = ",container";
+
+	container_ = pattern_.size() > containerSuffix.size() &&
+		     pattern_.compare(pattern_.size() - containerSuffix.size(),
+				      containerSuffix.size(), containerSuffix) == 0;
+	if (container_)
+		pattern_.resize(pattern_.size() - containerSuffix.size());
 }
 
 FileSink::~FileSink()
 {
+	stop();
 }
 
 int FileSink::configure(const libcamera::CameraConfiguration &config)
@@ -43,6 +65,30 @@ int FileSink::configure(const libcamera::CameraConfiguration &config)
 	if (ret < 0)
 		return ret;
 
+	if (container_) {
+		bool valid = pattern_.back() != '/' &&
+			     pattern_.find_first_of('#') == std::string::npos;
+#ifdef HAVE_TIFF
+		valid = valid && !dng_;
+#endif
+		if (!valid) {
+			std::cerr << "Container mode requires a single file name"
+				  << std::endl;
+			return -EINVAL;
+		}
+	}
+
+	/*
+	 * Requests are held by the sink until their buffers have been written,
+	 * up to the queue depth plus the request blocked in processRequest().
+	 * Limit the queue depth to leave at least one buffer to the camera.
+	 */
+	unsigned int bufferCount = kMaxQueueDepth + 2;
+	for (const StreamConfiguration &cfg : config)
+		bufferCount = std::min(bufferCount, cfg.bufferCount);
+
+	queueDepth_ = std::max(bufferCount, 3U) - 2;
+
 	return 0;
 }
 
@@ -55,16 +101,177 @@ void FileSink::mapBuffer(FrameBuffer *buffer)
 	mappedBuffers_[buffer] = std::move(image);
 }
 
+int FileSink::start()
+{
+	if (container_) {
+		int ret = openContainer();
+		if (ret < 0)
+			return ret;
+	}
+
+#ifdef HAVE_LIBURING
+	setupRing();
+#endif
+
+	sequences_.clear();
+	written_ = 0;
+	writing_ = 0;
+	dropped_ = 0;
+	throttled_ = 0;
+	throttledTime_ = {};
+	maxQueueDepth_ = 0;
+
+	stop_ = false;
+	thread_ = std::thread(&FileSink::writerThread, this);
+
+	return 0;
+}
+
+int FileSink::stop()
+{
+	if (!thread_.joinable())
+		return 0;
+
+	/* Write all pending requests before stopping the thread. */
+	{
+		std::lock_guard<std::mutex> locker(mutex_);
+		stop_ = true;
+	}
+
+	cv_.notify_all();
+	thread_.join();
+
+	closeContainer();
+
+#ifdef HAVE_LIBURING
+	teardownRing();
+#endif
+
+	std::cout << "File sink: " << written_ << " frames written, "
+		  << dropped_ << " frames dropped, throttled " << throttled_
+		  << " times for "
+		  << std::chrono::duration_cast<std::chrono::milliseconds>(throttledTime_).count()
+		  << " ms, max queue depth " << maxQueueDepth_ << std::endl;
+
+	return 0;
+}
+
 bool FileSink::processRequest(Request *request)
 {
-	for (auto [stream, buffer] : request->buffers())
-		writeBuffer(stream, buffer, request->metadata());
+	/*
+	 * Frames are dropped by the camera when it runs out of buffers, which
+	 * happens when writing can't keep up. Detect them from the gaps in the
+	 * sequence numbers.
+	 */
+	for (auto [stream, buffer] : request->buffers()) {
+		unsigned int sequence = buffer->metadata().sequence;
+
+		auto it = sequences_.find(stream);
+		if (it != sequences_.end() && sequence > it->second + 1)
+			dropped_ += sequence - it->second - 1;
+
+		sequences_[stream] = sequence;
+	}
+
+	/*
+	 * Defer writing to the writer thread and hold the request until its
+	 * buffers have been written. When too many requests are pending or
+	 * being written, throttle the event loop until the writer catches up.
+	 */
+	std::unique_lock<std::mutex> locker(mutex_);
 
-	return true;
+	if (queue_.size() + writing_ >= queueDepth_) {
+		auto start = std::chrono::steady_clock::now();
+
+		cv_.wait(locker, [&] { return queue_.size() + writing_ < queueDepth_; });
+
+		throttledTime_ += std::chrono::steady_clock::now() - start;
+		throttled_++;
+	}
+
+	queue_.push(request);
+	maxQueueDepth_ = std::max<unsigned int>(maxQueueDepth_, queue_.size());
+	cv_.notify_all();
+
+	return false;
+}
+
+void FileSink::writerThread()
+{
+	std::unique_lock<std::mutex> locker(mutex_);
+
+	while (true) {
+#ifdef HAVE_LIBURING
+		/*
+		 * Wait for writes in flight to complete when there's no request
+		 * to submit. New requests are picked up at the next completion.
+		 */
+		if (queue_.empty() && !ringWrites_.empty()) {
+			locker.unlock();
+
+			if (reapCompletions(true) < 0)
+				teardownRing();
+
+			locker.lock();
+			continue;
+		}
+#endif
+
+		cv_.wait(locker, [&] { return stop_ || !queue_.empty(); });
+
+		if (queue_.empty())
+			return;
+
+		Request *request = queue_.front();
+		queue_.pop();
+		writing_++;
+
+		locker.unlock();
+
+		/*
+		 * Hold a reference while queuing the writes, to release the
+		 * request here if all its writes have completed synchronously.
+		 */
+		pendingWrites_[request] = 1;
+
+		for (auto [stream, buffer] : request->buffers())
+			writeBuffer(stream, buffer, request);
+
+		completeWrite(request);
+
+#ifdef HAVE_LIBURING
+		if (!ringWrites_.empty() && reapCompletions(false) < 0)
+			teardownRing();
+#endif
+
+		locker.lock();
+	}
+}
+
+void FileSink::completeWrite(Request *request)
+{
+	auto it = pendingWrites_.find(request);
+	if (--it->second)
+		return;
+
+	pendingWrites_.erase(it);
+
+	/*
+	 * The data is written directly from the camera buffers, release the
+	 * request only once all its writes have completed. The receiver
+	 * requeues it from its own thread, releasing it from the writer thread
+	 * guarantees that no request is released after stop().
+	 */
+	requestProcessed.emit(request);
+
+	std::lock_guard<std::mutex> locker(mutex_);
+	written_++;
+	writing_--;
+	cv_.notify_all();
 }
 
 void FileSink::writeBuffer(const Stream *stream, FrameBuffer *buffer,
-			   [[maybe_unused]] const ControlList &metadata)
+			   Request *request)
 {
 	std::string filename;
 	size_t pos;
@@ -73,10 +280,6 @@ void FileSink::writeBuffer(const Stream *stream, FrameBuffer *buffer,
 	if (!pattern_.empty())
 		filename = pattern_;
 
-#ifdef HAVE_TIFF
-	bool dng = filename.find(".dng", filename.size() - 4) != std::string::npos;
-#endif /* HAVE_TIFF */
-
 	if (filename.empty() || filename.back() == '/')
 		filename += "frame-#.bin";
 
@@ -91,10 +294,11 @@ void FileSink::writeBuffer(const Stream *stream, FrameBuffer *buffer,
 	Image *image = mappedBuffers_[buffer].get();
 
 #ifdef HAVE_TIFF
-	if (dng) {
+	if (dng_) {
 		ret = DNGWriter::write(filename.c_str(), camera_,
-				       stream->configuration(), metadata,
-				       buffer, image->data(0).data());
+				       stream->configuration(), request->metadata(),
+				       buffer, image->data(0).data(),
+				       dngOptions_);
 		if (ret < 0)
 			std::cerr << "failed to write DNG file `" << filename
 				  << "'" << std::endl;
@@ -103,15 +307,8 @@ void FileSink::writeBuffer(const Stream *stream, FrameBuffer *buffer,
 	}
 #endif /* HAVE_TIFF */
 
-	fd = open(filename.c_str(), O_CREAT | O_WRONLY |
-		  (pos == std::string::npos ? O_APPEND : O_TRUNC),
-		  S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH);
-	if (fd == -1) {
-		ret = -errno;
-		std::cerr << "failed to open file " << filename << ": "
-			  << strerror(-ret) << std::endl;
-		return;
-	}
+	std::vector<Span<const uint8_t>> planes;
+	size_t size = 0;
 
 	for (unsigned int i = 0; i < buffer->planes().size(); ++i) {
 		const FrameMetadata::Plane &meta = buffer->metadata().planes()[i];
@@ -124,19 +321,311 @@ void FileSink::writeBuffer(const Stream *stream, FrameBuffer *buffer,
 				  << " larger than plane size " << data.size()
 				  << std::endl;
 
-		ret = ::write(fd, data.data(), length);
+		planes.emplace_back(data.data(), length);
+		size += length;
+	}
+
+	if (container_) {
+		ret = writePlanes(containerFd_, containerOffset_, planes, request);
+		if (ret < 0)
+			return;
+
+		containerIndex_ << buffer->metadata().sequence << " "
+				<< streamNames_[stream] << " "
+				<< buffer->metadata().timestamp << " "
+				<< containerOffset_ << " " << size << std::endl;
+
+		containerOffset_ += size;
+		return;
+	}
+
+	const bool append = pos == std::string::npos;
+
+	fd = open(filename.c_str(), O_CREAT | O_WRONLY |
+		  (append ? O_APPEND : O_TRUNC),
+		  S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH);
+	if (fd == -1) {
+		ret = -errno;
+		std::cerr << "failed to open file " << filename << ": "
+			  << strerror(-ret) << std::endl;
+		return;
+	}
+
+	/* Writes in flight hold a reference to the file. */
+	writePlanes(fd, append ? -1 : 0, planes, request);
+
+	close(fd);
+}
+
+int FileSink::writePlanes(int fd, off_t offset,
+			  const std::vector<Span<const uint8_t>> &planes,
+			  [[maybe_unused]] Request *request)
+{
+	unsigned int i = 0;
+
+	/*
+	 * A negative offset appends to the file. Appends are written
+	 * synchronously, to keep the frames and planes in order.
+	 */
+#ifdef HAVE_LIBURING
+	/* Write synchronously the planes that couldn't be submitted. */
+	if (ringValid_ && offset >= 0) {
+		int ret = submitPlanes(fd, offset, planes, request);
+		if (ret < 0)
+			return ret;
+
+		for (; i < static_cast<unsigned int>(ret); ++i)
+			offset += planes[i].size();
+	}
+#endif
+
+	for (; i < planes.size(); ++i) {
+		const Span<const uint8_t> &plane = planes[i];
+		ssize_t ret = offset < 0
+			    ? write(fd, plane.data(), plane.size())
+			    : pwrite(fd, plane.data(), plane.size(), offset);
 		if (ret < 0) {
 			ret = -errno;
 			std::cerr << "write error: " << strerror(-ret)
 				  << std::endl;
-			break;
-		} else if (ret != (int)length) {
+			return ret;
+		} else if (ret != static_cast<ssize_t>(plane.size())) {
 			std::cerr << "write error: only " << ret
 				  << " bytes written instead of "
-				  << length << std::endl;
+				  << plane.size() << std::endl;
+			return -EIO;
+		}
+
+		if (offset >= 0)
+			offset += plane.size();
+	}
+
+	return 0;
+}
+
+int FileSink::openContainer()
+{
+	containerFd_ = open(pattern_.c_str(), O_CREAT | O_WRONLY,
+			    S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH);
+	if (containerFd_ == -1) {
+		int ret = -errno;
+		std::cerr << "failed to open file " << pattern_ << ": "
+			  << strerror(-ret) << std::endl;
+		return ret;
+	}
+
+	/* Append frames to the existing content. */
+	containerOffset_ = lseek(containerFd_, 0, SEEK_END);
+
+	const std::string indexName = pattern_ + ".idx";
+	struct stat st;
+	bool newIndex = stat(indexName.c_str(), &st) < 0 || !st.st_size;
+
+	containerIndex_.open(indexName, std::ios::app);
+	if (!containerIndex_) {
+		std::cerr << "failed to open index file " << indexName
+			  << std::endl;
+		closeContainer();
+		return -EIO;
+	}
+
+	if (newIndex)
+		containerIndex_ << "# sequence stream timestamp offset size" << std::endl;
+
+	return 0;
+}
+
+void FileSink::closeContainer()
+{
+	if (containerIndex_.is_open())
+		containerIndex_.close();
+
+	if (containerFd_ != -1) {
+		close(containerFd_);
+		containerFd_ = -1;
+	}
+}
+
+#ifdef HAVE_LIBURING
+void FileSink::setupRing()
+{
+	int ret = io_uring_queue_init(kRingEntries, &ring_, 0);
+	if (ret < 0) {
+		std::cerr << "io_uring not available (" << strerror(-ret)
+			  << "), using synchronous writes" << std::endl;
+		return;
+	}
+
+	ringValid_ = true;
+
+	/*
+	 * Register the mapped buffers with the ring to avoid pinning their
+	 * pages for every write. Registration fails for buffers exported by
+	 * devices that map them without struct page, writes then fall back to
+	 * regular buffers.
+	 */
+	std::vector<struct iovec> iovecs;
+	registeredBuffers_.clear();
+
+	for (const auto &[buffer, image] : mappedBuffers_) {
+		for (unsigned int i = 0; i < buffer->planes().size(); ++i) {
+			Span<uint8_t> data = image->data(i);
+
+			registeredBuffers_[data.data()] = iovecs.size();
+			iovecs.push_back({ data.data(), data.size() });
+		}
+	}
+
+	ret = io_uring_register_buffers(&ring_, iovecs.data(), iovecs.size());
+	if (ret < 0)
+		registeredBuffers_.clear();
+}
+
+void FileSink::teardownRing()
+{
+	if (!ringValid_)
+		return;
+
+	while (!ringWrites_.empty()) {
+		if (reapCompletions(true) < 0)
+			break;
+	}
+
+	/*
+	 * Exiting the ring waits for the writes still in flight, their
+	 * requests can then be released.
+	 */
+	io_uring_queue_exit(&ring_);
+	ringValid_ = false;
+	registeredBuffers_.clear();
+
+	std::map<uint64_t, RingWrite> writes = std::move(ringWrites_);
+	ringWrites_.clear();
+
+	for (const auto &[id, write] : writes)
+		completeWrite(write.request);
+}
+
+/*
+ * Submit the writes of all planes to the ring. Return the number of planes
+ * submitted, the remaining planes must be written synchronously.
+ */
+int FileSink::submitPlanes(int fd, off_t offset,
+			   const std::vector<Span<const uint8_t>> &planes,
+			   Request *request)
+{
+	if (planes.size() > kRingEntries)
+		return 0;
+
+	/* Make room in the ring for all planes. */
+	while (ringWrites_.size() + planes.size() > kRingEntries) {
+		int ret = reapCompletions(true);
+		if (ret < 0)
+			return ret;
+	}
+
+	std::vector<uint64_t> ids;
+
+	for (const Span<const uint8_t> &plane : planes) {
+		struct io_uring_sqe *sqe = io_uring_get_sqe(&ring_);
+		if (!sqe)
 			break;
+
+		auto it = registeredBuffers_.find(plane.data());
+		if (it != registeredBuffers_.end())
+			io_uring_prep_write_fixed(sqe, fd, plane.data(),
+						  plane.size(), offset, it->second);
+		else
+			io_uring_prep_write(sqe, fd, plane.data(), plane.size(),
+					    offset);
+
+		sqe->user_data = ringWriteId_;
+		ids.push_back(ringWriteId_++);
+		offset += plane.size();
+	}
+
+	/*
+	 * Submit everything that has been prepared, the ring must not be left
+	 * with entries that would be submitted along with the next buffer.
+	 */
+	unsigned int submitted = 0;
+
+	while (submitted < ids.size()) {
+		int ret = io_uring_submit(&ring_);
+		if (ret > 0) {
+			for (int i = 0; i < ret; ++i, ++submitted)
+				ringWrites_[ids[submitted]] = { request, planes[submitted].size() };
+			pendingWrites_[request] += ret;
+			continue;
 		}
+
+		if (ret == -EINTR)
+			continue;
+
+		/* Make progress on the writes in flight before retrying. */
+		if ((ret == 0 || ret == -EAGAIN || ret == -EBUSY) &&
+		    !ringWrites_.empty() && reapCompletions(true) == 0)
+			continue;
+
+		/*
+		 * The prepared entries can't be submitted nor discarded. Stop
+		 * using the ring, the planes not submitted are written
+		 * synchronously.
+		 */
+		std::cerr << "io_uring submission failed ("
+			  << strerror(ret < 0 ? -ret : EIO)
+			  << "), using synchronous writes" << std::endl;
+		teardownRing();
+		break;
 	}
 
-	close(fd);
+	return submitted;
+}
+
+/*
+ * Consume the completions available in the ring, waiting for at least one if
+ * \a wait is true. Requests are released when all their writes complete.
+ */
+int FileSink::reapCompletions(bool wait)
+{
+	while (!ringWrites_.empty()) {
+		struct io_uring_cqe *cqe;
+		int ret = wait ? io_uring_wait_cqe(&ring_, &cqe)
+			       : io_uring_peek_cqe(&ring_, &cqe);
+		if (ret == -EAGAIN && !wait)
+			return 0;
+		if (ret == -EINTR)
+			continue;
+		if (ret < 0) {
+			std::cerr << "io_uring error: " << strerror(-ret)
+				  << std::endl;
+			return ret;
+		}
+
+		uint64_t id = cqe->user_data;
+		int res = cqe->res;
+
+		io_uring_cqe_seen(&ring_, cqe);
+
+		auto it = ringWrites_.find(id);
+		if (it == ringWrites_.end())
+			continue;
+
+		RingWrite write = it->second;
+		ringWrites_.erase(it);
+
+		if (res < 0)
+			std::cerr << "write error: " << strerror(-res) << std::endl;
+		else if (static_cast<size_t>(res) != write.length)
+			std::cerr << "write error: only " << res
+				  << " bytes written instead of " << write.length
+				  << std::endl;
+
+		completeWrite(write.request);
+		wait = false;
+	}
+
+	return 0;
 }
+#endif /* HAVE_LIBURING */
+
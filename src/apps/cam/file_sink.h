@@ -7,12 +7,31 @@
 
 #pragma once
 
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
 #include <map>
 #include <memory>
+#include <mutex>
+#include <queue>
 #include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/types.h>
+
+#ifdef HAVE_LIBURING
+#include <liburing.h>
+#endif
+
+#include <libcamera/base/span.h>
 
 #include <libcamera/stream.h>
 
+#ifdef HAVE_TIFF
+#include "../common/dng_writer.h"
+#endif
+
 #include "frame_sink.h"
 
 class Image;
@@ -29,17 +48,86 @@ public:
 
 	void mapBuffer(libcamera::FrameBuffer *buffer) override;
 
+	int start() override;
+	int stop() override;
+
 	bool processRequest(libcamera::Request *request) override;
 
+#ifdef HAVE_TIFF
+	void setDNGOptions(const DNGWriter::Options &options) { dngOptions_ = options; }
+#endif
+
 private:
+	/* Maximum number of requests waiting to be written or being written. */
+	static constexpr unsigned int kMaxQueueDepth = 4;
+
+	void writerThread();
 	void writeBuffer(const libcamera::Stream *stream,
 			 libcamera::FrameBuffer *buffer,
-			 const libcamera::ControlList &metadata);
+			 libcamera::Request *request);
+	int writePlanes(int fd, off_t offset,
+			const std::vector<libcamera::Span<const uint8_t>> &planes,
+			libcamera::Request *request);
+	void completeWrite(libcamera::Request *request);
+	int openContainer();
+	void closeContainer();
+
+#ifdef HAVE_LIBURING
+	/* Maximum number of writes in flight in the ring. */
+	static constexpr unsigned int kRingEntries = 16;
+
+	struct RingWrite {
+		libcamera::Request *request;
+		size_t length;
+	};
+
+	void setupRing();
+	void teardownRing();
+	int submitPlanes(int fd, off_t offset,
+			 const std::vector<libcamera::Span<const uint8_t>> &planes,
+			 libcamera::Request *request);
+	int reapCompletions(bool wait);
+#endif
 
 #ifdef HAVE_TIFF
 	const libcamera::Camera *camera_;
+	DNGWriter::Options dngOptions_;
+	bool dng_;
 #endif
 	std::map<const libcamera::Stream *, std::string> streamNames_;
 	std::string pattern_;
 	std::map<libcamera::FrameBuffer *, std::unique_ptr<Image>> mappedBuffers_;
+
+	/* Single file container, with frames appended and a text index. */
+	bool container_;
+	int containerFd_;
+	off_t containerOffset_;
+	std::ofstream containerIndex_;
+
+#ifdef HAVE_LIBURING
+	struct io_uring ring_;
+	bool ringValid_;
+	std::map<const uint8_t *, unsigned int> registeredBuffers_;
+	std::map<uint64_t, RingWrite> ringWrites_;
+	uint64_t ringWriteId_;
+#endif
+
+	std::thread thread_;
+	std::mutex mutex_;
+	std::condition_variable cv_;
+	std::queue<libcamera::Request *> queue_;
+	unsigned int queueDepth_;
+	unsigned int writing_;
+	bool stop_;
+
+	/* Number of writes pending for each request, plus one while queuing. */
+	std::map<libcamera::Request *, unsigned int> pendingWrites_;
+
+	/* Statistics, reported when the sink is stopped. */
+	std::map<const libcamera::Stream *, unsigned int> sequences_;
+	unsigned int written_;
+	unsigned int dropped_;
+	unsigned int throttled_;
+	std::chrono::steady_clock::duration throttledTime_;
+	unsigned int maxQueueDepth_;
 };
@@ -52,6 +52,11 @@ int FrameSink::stop()
  * may process the request synchronously or queue it for asynchronous
  * processing.
  *
+ * Camera sessions call this function from their own request processing thread,
+ * concurrently with the event loop thread, unless the sink requires to be
+ * called from the event loop. The requestProcessed signal may be emitted from
+ * any thread.
+ *
  * When the request is processed synchronously, this function shall return true.
  * The \a request shall not be accessed by the FrameSink after the function
  * returns.
@@ -449,6 +449,12 @@ bool KMSSink::setupComposition(DRM::FrameBuffer *drmBuffer)
 
 bool KMSSink::processRequest(libcamera::Request *camRequest)
 {
+	/*
+	 * The request may be processed from a camera session thread, while
+	 * DRM events are handled in the event loop thread.
+	 */
+	std::lock_guard<std::mutex> lock(lock_);
+
 	/*
 	 * Perform a very crude rate adaptation by simply dropping the request
 	 * if the display queue is full.
@@ -500,8 +506,6 @@ bool KMSSink::processRequest(libcamera::Request *camRequest)
 
 	pending_ = std::make_unique<Request>(std::move(drmRequest), camRequest);
 
-	std::lock_guard<std::mutex> lock(lock_);
-
 	if (!queued_) {
 		int ret = pending_->drmRequest_->commit(flags);
 		if (ret < 0) {
@@ -18,6 +18,7 @@
 #include "../common/options.h"
 #include "../common/stream_options.h"
 
+#include "benchmark.h"
 #include "camera_session.h"
 #include "main.h"
 
@@ -145,6 +146,9 @@ int CamApp::parseOptions(int argc, char *argv[])
 			 "to write files, using the default file name. Otherwise it sets the\n"
 			 "full file path and name. The first '#' character in the file name\n"
 			 "is expanded to the camera index, stream name and frame sequence number.\n"
+			 "If the file name is followed by ',container' and contains no '#'\n"
+			 "character, all frames are appended to a single file, and an index of\n"
+			 "the frames is written to the same file name with an '.idx' suffix.\n"
 #ifdef HAVE_TIFF
 			 "If the file name ends with '.dng', then the frame will be written to\n"
 			 "the output file(s) in DNG format.\n"
@@ -152,6 +156,12 @@ int CamApp::parseOptions(int argc, char *argv[])
 			 "The default file name is 'frame-#.bin'.",
 			 "file", ArgumentOptional, "filename", false,
 			 OptCamera);
+#ifdef HAVE_TIFF
+	parser.addOption(OptDNGCompression, OptionString,
+			 "Compression method for DNG files, 'none' (default) or 'deflate'",
+			 "dng-compression", ArgumentRequired, "method", false,
+			 OptCamera);
+#endif
 #ifdef HAVE_SDL
 	parser.addOption(OptSDL, OptionNone, "Display viewfinder through SDL",
 			 "sdl", ArgumentNone, "", false, OptCamera);
@@ -171,6 +181,25 @@ int CamApp::parseOptions(int argc, char *argv[])
 			 "Load a capture session configuration script from a file",
 			 "script", ArgumentRequired, "script", false,
 			 OptCamera);
+	parser.addOption(OptBenchmark, OptionString,
+			 "Measure the capture performance instead of printing frame information\n"
+			 "Report the throughput, frame interval jitter, request latency, dropped\n"
+			 "frames, CPU usage and peak memory usage when the capture stops. If a\n"
+			 "file name is given, the report is also written to that file in JSON format.",
+			 "benchmark", ArgumentOptional, "filename", false,
+			 OptCamera);
+	parser.addOption(OptDuration, OptionInteger,
+			 "Stop the capture after <seconds> seconds",
+			 "duration", ArgumentRequired, "seconds", false,
+			 OptCamera);
+	parser.addOption(OptThread, OptionNone,
+			 "Process completed requests in a dedicated thread\n"
+			 "Run the request processing and frame sink of the camera in its own\n"
+			 "thread instead of the event loop, to let captures from multiple\n"
+			 "cameras run concurrently. Frame statistics are reported when the\n"
+			 "capture stops.",
+			 "thread", ArgumentNone, nullptr, false,
+			 OptCamera);
 
 	options_ = parser.parse(argc, argv);
 	if (!options_.valid())
@@ -258,7 +287,8 @@ int CamApp::run()
 
 	/* 4. Start capture. */
 	for (const auto &session : sessions) {
-		if (!session->options().isSet(OptCapture))
+		if (!session->options().isSet(OptCapture) &&
+		    !session->options().isSet(OptBenchmark))
 			continue;
 
 		ret = session->start();
@@ -285,13 +315,23 @@ int CamApp::run()
 		loop_.exec();
 
 	/* 6. Stop capture. */
+	std::vector<const Benchmark *> benchmarks;
+
 	for (const auto &session : sessions) {
-		if (!session->options().isSet(OptCapture))
+		if (!session->options().isSet(OptCapture) &&
+		    !session->options().isSet(OptBenchmark))
 			continue;
 
 		session->stop();
+
+		if (session->benchmark())
+			benchmarks.push_back(session->benchmark());
 	}
 
+	/* 7. Report the statistics of concurrent captures. */
+	if (benchmarks.size() > 1)
+		Benchmark::reportAggregate(std::cout, benchmarks);
+
 	return 0;
 }
 
@@ -23,4 +23,8 @@ enum {
 	OptStrictFormats = 257,
 	OptMetadata = 258,
 	OptCaptureScript = 259,
+	OptDNGCompression = 260,
+	OptBenchmark = 261,
+	OptDuration = 262,
+	OptThread = 263,
 };
@@ -8,10 +8,19 @@
 #include "dng_writer.h"
 
 #include <algorithm>
+#include <atomic>
+#include <condition_variable>
 #include <iostream>
 #include <map>
+#include <mutex>
+#include <string.h>
+#include <thread>
+#include <vector>
 
 #include <tiffio.h>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
 
 #include <libcamera/control_ids.h>
 #include <libcamera/formats.h>
@@ -380,11 +389,196 @@ static const std::map<PixelFormat, FormatInfo> formatInfo = {
 	} },
 };
 
+/*
+ * Pack and optionally compress the RAW image in tiles, and write them to the
+ * TIFF file.
+ *
+ * The image is split in bands of one row of tiles. Worker threads pick bands
+ * in order, pack the scanlines of the band into the tiles and compress them,
+ * while the calling thread writes the tiles of the completed bands to the file
+ * in order.
+ */
+class TileWriter
+{
+public:
+	TileWriter(const FormatInfo &info, const StreamConfiguration &config,
+		   const void *data, const DNGWriter::Options &options);
+
+	int write(TIFF *tif);
+
+private:
+	struct Band {
+		std::vector<std::vector<uint8_t>> tiles;
+		int result = 0;
+		bool done = false;
+	};
+
+	void run();
+	int encode(Band &band, unsigned int index);
+
+	const FormatInfo &info_;
+	const StreamConfiguration &config_;
+	const uint8_t *data_;
+	const DNGWriter::Options &options_;
+
+	unsigned int tilesAcross_;
+	/* Size in bytes of one row of a tile. */
+	unsigned int tileStride_;
+
+	std::vector<Band> bands_;
+	std::atomic<unsigned int> nextBand_;
+
+	std::mutex mutex_;
+	std::condition_variable cv_;
+};
+
+TileWriter::TileWriter(const FormatInfo &info, const StreamConfiguration &config,
+		       const void *data, const DNGWriter::Options &options)
+	: info_(info), config_(config), data_(static_cast<const uint8_t *>(data)),
+	  options_(options), nextBand_(0)
+{
+	const unsigned int tileSize = options_.tileSize;
+
+	tilesAcross_ = (config_.size.width + tileSize - 1) / tileSize;
+	tileStride_ = tileSize * info_.bitsPerSample / 8;
+
+	bands_.resize((config_.size.height + tileSize - 1) / tileSize);
+}
+
+int TileWriter::write(TIFF *tif)
+{
+	unsigned int threads = options_.threads;
+	if (!threads)
+		threads = std::thread::hardware_concurrency();
+	threads = std::clamp<unsigned int>(threads, 1, bands_.size());
+
+	std::vector<std::thread> workers;
+	for (unsigned int i = 0; i < threads; ++i)
+		workers.emplace_back(&TileWriter::run, this);
+
+	int ret = 0;
+
+	for (unsigned int index = 0; index < bands_.size(); ++index) {
+		Band &band = bands_[index];
+
+		{
+			std::unique_lock<std::mutex> locker(mutex_);
+			cv_.wait(locker, [&] { return band.done; });
+		}
+
+		ret = band.result;
+		if (ret < 0)
+			break;
+
+		for (unsigned int x = 0; x < tilesAcross_; ++x) {
+			std::vector<uint8_t> &tile = band.tiles[x];
+
+			if (TIFFWriteRawTile(tif, index * tilesAcross_ + x,
+					     tile.data(), tile.size()) < 0) {
+				std::cerr << "Failed to write RAW tile" << std::endl;
+				ret = -EIO;
+				break;
+			}
+		}
+
+		if (ret < 0)
+			break;
+
+		/* Release the memory as soon as the band has been written. */
+		band.tiles = {};
+	}
+
+	/* On error, stop the workers after the band they're encoding. */
+	if (ret < 0)
+		nextBand_ = bands_.size();
+
+	for (std::thread &worker : workers)
+		worker.join();
+
+	return ret;
+}
+
+void TileWriter::run()
+{
+	while (true) {
+		unsigned int index = nextBand_++;
+		if (index >= bands_.size())
+			return;
+
+		Band &band = bands_[index];
+		int ret = encode(band, index);
+
+		{
+			std::lock_guard<std::mutex> locker(mutex_);
+			band.result = ret;
+			band.done = true;
+		}
+
+		cv_.notify_all();
+	}
+}
+
+int TileWriter::encode(Band &band, unsigned int index)
+{
+	const unsigned int tileSize = options_.tileSize;
+	const unsigned int firstRow = index * tileSize;
+	const unsigned int rows = std::min(tileSize, config_.size.height - firstRow);
+
+	/*
+	 * Tiles at the right and bottom edges are padded to the full tile size.
+	 * Zero the padding to keep the output deterministic.
+	 */
+	std::vector<uint8_t> scanline(tilesAcross_ * tileStride_);
+	band.tiles.assign(tilesAcross_,
+			  std::vector<uint8_t>(tileStride_ * tileSize));
+
+	const uint8_t *row = data_ + firstRow * config_.stride;
+	for (unsigned int y = 0; y < rows; ++y) {
+		info_.packScanline(scanline.data(), row, config_.size.width);
+
+		for (unsigned int x = 0; x < tilesAcross_; ++x)
+			memcpy(band.tiles[x].data() + y * tileStride_,
+			       scanline.data() + x * tileStride_, tileStride_);
+
+		row += config_.stride;
+	}
+
+#ifdef HAVE_ZLIB
+	if (options_.compression == DNGWriter::Compression::Deflate) {
+		std::vector<uint8_t> compressed(compressBound(tileStride_ * tileSize));
+
+		for (std::vector<uint8_t> &tile : band.tiles) {
+			uLongf size = compressed.size();
+			int ret = compress2(compressed.data(), &size, tile.data(),
+					    tile.size(), Z_BEST_SPEED);
+			if (ret != Z_OK) {
+				std::cerr << "Failed to compress RAW tile"
+					  << std::endl;
+				return -ENOMEM;
+			}
+
+			tile.assign(compressed.begin(), compressed.begin() + size);
+		}
+	}
+#endif
+
+	return 0;
+}
+
+int DNGWriter::write(const char *filename, const Camera *camera,
+		     const StreamConfiguration &config,
+		     const ControlList &metadata,
+		     const FrameBuffer *buffer, const void *data)
+{
+	return write(filename, camera, config, metadata, buffer, data,
+		     Options{});
+}
+
 int DNGWriter::write(const char *filename, const Camera *camera,
 		     const StreamConfiguration &config,
 		     const ControlList &metadata,
 		     [[maybe_unused]] const FrameBuffer *buffer,
-		     const void *data)
+		     const void *data, const Options &options)
 {
 	const ControlList &cameraProperties = camera->properties();
 
@@ -395,18 +589,26 @@ int DNGWriter::write(const char *filename, const Camera *camera,
 	}
 	const FormatInfo *info = &it->second;
 
+	if (!options.tileSize || options.tileSize % 16) {
+		std::cerr << "Invalid tile size " << options.tileSize << std::endl;
+		return -EINVAL;
+	}
+
+#ifndef HAVE_ZLIB
+	if (options.compression == Compression::Deflate) {
+		std::cerr << "Deflate compression not supported" << std::endl;
+		return -ENOTSUP;
+	}
+#endif
+
 	TIFF *tif = TIFFOpen(filename, "w");
 	if (!tif) {
 		std::cerr << "Failed to open tiff file" << std::endl;
 		return -EINVAL;
 	}
 
-	/*
-	 * Scanline buffer, has to be large enough to store both a RAW scanline
-	 * or a thumbnail scanline. The latter will always be much smaller than
-	 * the former as we downscale by 16 in both directions.
-	 */
-	uint8_t scanline[(config.size.width * info->bitsPerSample + 7) / 8];
+	/* Scanline buffer for the thumbnail, downscaled by 16 in both directions. */
+	uint8_t scanline[config.size.width / 16 * 3];
 
 	toff_t rawIFDOffset = 0;
 	toff_t exifIFDOffset = 0;
@@ -416,7 +618,10 @@ int DNGWriter::write(const char *filename, const Camera *camera,
 	 * readers, as required by the TIFF/EP specification. Tags that apply to
 	 * the whole file are stored here.
 	 */
-	const uint8_t version[] = { 1, 2, 0, 0 };
+	/* Deflate compression has been introduced in DNG 1.4. */
+	const uint8_t minorVersion =
+		options.compression == Compression::Deflate ? 4 : 2;
+	const uint8_t version[] = { 1, minorVersion, 0, 0 };
 
 	TIFFSetField(tif, TIFFTAG_DNGVERSION, version);
 	TIFFSetField(tif, TIFFTAG_DNGBACKWARDVERSION, version);
@@ -532,8 +737,12 @@ int DNGWriter::write(const char *filename, const Camera *camera,
 	TIFFSetField(tif, TIFFTAG_SUBFILETYPE, 0);
 	TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, config.size.width);
 	TIFFSetField(tif, TIFFTAG_IMAGELENGTH, config.size.height);
+	TIFFSetField(tif, TIFFTAG_TILEWIDTH, options.tileSize);
+	TIFFSetField(tif, TIFFTAG_TILELENGTH, options.tileSize);
 	TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, info->bitsPerSample);
-	TIFFSetField(tif, TIFFTAG_COMPRESSION, COMPRESSION_NONE);
+	TIFFSetField(tif, TIFFTAG_COMPRESSION,
+		     options.compression == Compression::Deflate
+		     ? COMPRESSION_ADOBE_DEFLATE : COMPRESSION_NONE);
 	TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_CFA);
 	TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, 1);
 	TIFFSetField(tif, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
@@ -590,18 +799,11 @@ int DNGWriter::write(const char *filename, const Camera *camera,
 	TIFFSetField(tif, TIFFTAG_WHITELEVEL, 1, &whiteLevel);
 
 	/* Write RAW content. */
-	row = static_cast<const uint8_t *>(data);
-	for (unsigned int y = 0; y < config.size.height; y++) {
-		info->packScanline(&scanline, row, config.size.width);
-
-		if (TIFFWriteScanline(tif, &scanline, y, 0) != 1) {
-			std::cerr << "Failed to write RAW scanline"
-				  << std::endl;
-			TIFFClose(tif);
-			return -EINVAL;
-		}
-
-		row += config.stride;
+	TileWriter tileWriter(*info, config, data, options);
+	int ret = tileWriter.write(tif);
+	if (ret < 0) {
+		TIFFClose(tif);
+		return ret;
 	}
 
 	/* Checkpoint the IFD to retrieve its offset, and write it out. */
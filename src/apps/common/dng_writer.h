@@ -18,10 +18,28 @@
 class DNGWriter
 {
 public:
+	enum class Compression {
+		None,
+		Deflate,
+	};
+
+	struct Options {
+		Compression compression = Compression::None;
+		/* Tile width and height, must be a multiple of 16. */
+		unsigned int tileSize = 256;
+		/* Number of packing threads, 0 to use all CPUs. */
+		unsigned int threads = 0;
+	};
+
 	static int write(const char *filename, const libcamera::Camera *camera,
 			 const libcamera::StreamConfiguration &config,
 			 const libcamera::ControlList &metadata,
 			 const libcamera::FrameBuffer *buffer, const void *data);
+	static int write(const char *filename, const libcamera::Camera *camera,
+			 const libcamera::StreamConfiguration &config,
+			 const libcamera::ControlList &metadata,
+			 const libcamera::FrameBuffer *buffer, const void *data,
+			 const Options &options);
 };
 
 #endif /* HAVE_TIFF */
@@ -15,8 +15,10 @@ Environment *Environment::get()
 	return &instance;
 }
 
-void Environment::setup(CameraManager *cm, std::string cameraId)
+void Environment::setup(CameraManager *cm, std::string cameraId,
+			const Thresholds &thresholds)
 {
 	cm_ = cm;
 	cameraId_ = cameraId;
+	thresholds_ = thresholds;
 }
@@ -9,19 +9,24 @@
 
 #include <libcamera/libcamera.h>
 
+#include "thresholds.h"
+
 class Environment
 {
 public:
 	static Environment *get();
 
-	void setup(libcamera::CameraManager *cm, std::string cameraId);
+	void setup(libcamera::CameraManager *cm, std::string cameraId,
+		   const Thresholds &thresholds);
 
 	const std::string &cameraId() const { return cameraId_; }
 	libcamera::CameraManager *cm() const { return cm_; }
+	const Thresholds &thresholds() const { return thresholds_; }
 
 private:
 	Environment() = default;
 
 	std::string cameraId_;
 	libcamera::CameraManager *cm_;
+	Thresholds thresholds_;
 };
@@ -25,6 +25,7 @@ enum {
 	OptList = 'l',
 	OptFilter = 'f',
 	OptHelp = 'h',
+	OptThresholds = 't',
 };
 
 /*
@@ -73,7 +74,14 @@ static int initCamera(CameraManager *cm, OptionsParser::Options options)
 		return -ENODEV;
 	}
 
-	Environment::get()->setup(cm, cameraId);
+	Thresholds thresholds;
+	if (options.isSet(OptThresholds)) {
+		ret = thresholds.load(options[OptThresholds], cameraId);
+		if (ret)
+			return ret;
+	}
+
+	Environment::get()->setup(cm, cameraId, thresholds);
 
 	std::cout << "Using camera " << cameraId << std::endl;
 
@@ -148,6 +156,9 @@ static int parseOptions(int argc, char **argv, OptionsParser::Options *options)
 			 ArgumentRequired, "filter");
 	parser.addOption(OptHelp, OptionNone, "Display this help message",
 			 "help");
+	parser.addOption(OptThresholds, OptionString,
+			 "Load the performance tests thresholds from a file",
+			 "thresholds", ArgumentRequired, "file");
 
 	*options = parser.parse(argc, argv);
 	if (!options->valid())
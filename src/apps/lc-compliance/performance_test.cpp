@@ -0,0 +1,255 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2022, Google Inc.
+ *
+ * performance_test.cpp - Test camera performance
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <dirent.h>
+#include <fstream>
+#include <iostream>
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+#include <libcamera/control_ids.h>
+
+#include "environment.h"
+#include "simple_capture.h"
+
+using namespace libcamera;
+
+namespace {
+
+/* Number of frames captured to measure latencies and the frame rate. */
+constexpr unsigned int kLatencyFrames = 30;
+constexpr unsigned int kFrameRateFrames = 120;
+
+/* Number of initial frame intervals ignored to let the sensor settle. */
+constexpr unsigned int kFrameRateWarmup = 10;
+
+const std::vector<StreamRole> ROLES = {
+	StreamRole::Raw,
+	StreamRole::StillCapture,
+	StreamRole::VideoRecording,
+	StreamRole::Viewfinder
+};
+
+unsigned int toMilliseconds(SimpleCaptureTimed::duration duration)
+{
+	return std::chrono::duration_cast<std::chrono::milliseconds>(duration).count();
+}
+
+unsigned int openFileDescriptors()
+{
+	DIR *dir = opendir("/proc/self/fd");
+	if (!dir)
+		return 0;
+
+	unsigned int count = 0;
+	struct dirent *ent;
+	while ((ent = readdir(dir)) != nullptr) {
+		if (ent->d_name[0] != '.')
+			count++;
+	}
+
+	closedir(dir);
+
+	/* Don't count the file descriptor used to read the directory. */
+	return count - 1;
+}
+
+/* Retrieve the resident set size in kB. */
+unsigned long residentSetSize()
+{
+	std::ifstream statm("/proc/self/statm");
+	unsigned long size = 0;
+	unsigned long resident = 0;
+
+	statm >> size >> resident;
+
+	return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+} /* namespace */
+
+class Performance : public testing::TestWithParam<StreamRole>
+{
+public:
+	static std::string nameParameters(const testing::TestParamInfo<Performance::ParamType> &info);
+
+protected:
+	void SetUp() override;
+	void TearDown() override;
+
+	std::shared_ptr<Camera> camera_;
+};
+
+void Performance::SetUp()
+{
+	Environment *env = Environment::get();
+
+	camera_ = env->cm()->get(env->cameraId());
+
+	ASSERT_EQ(camera_->acquire(), 0);
+}
+
+void Performance::TearDown()
+{
+	if (!camera_)
+		return;
+
+	camera_->release();
+	camera_.reset();
+}
+
+std::string Performance::nameParameters(const testing::TestParamInfo<Performance::ParamType> &info)
+{
+	std::map<StreamRole, std::string> rolesMap = {
+		{ StreamRole::Raw, "Raw" },
+		{ StreamRole::StillCapture, "StillCapture" },
+		{ StreamRole::VideoRecording, "VideoRecording" },
+		{ StreamRole::Viewfinder, "Viewfinder" }
+	};
+
+	return rolesMap[info.param];
+}
+
+/*
+ * Test the latency of configure(), of the first frame after start(), and of
+ * stop() with requests queued.
+ */
+TEST_P(Performance, StartStopLatency)
+{
+	const Thresholds &thresholds = Environment::get()->thresholds();
+
+	SimpleCaptureTimed capture(camera_);
+
+	capture.configure(GetParam());
+
+	capture.capture(kLatencyFrames);
+
+	EXPECT_LE(toMilliseconds(capture.configureLatency()), thresholds.configureLatency)
+		<< "configure() too slow";
+	EXPECT_LE(toMilliseconds(capture.firstFrameLatency()), thresholds.firstFrameLatency)
+		<< "First frame too late after start()";
+	EXPECT_LE(toMilliseconds(capture.stopLatency()), thresholds.stopLatency)
+		<< "stop() too slow";
+}
+
+/*
+ * Test the request round-trip latency
+ *
+ * Makes sure that no request takes longer than the threshold to complete from
+ * the time it is queued. Example failure is a pipeline handler that holds on to
+ * requests or buffers for a long time.
+ */
+TEST_P(Performance, RequestLatency)
+{
+	const Thresholds &thresholds = Environment::get()->thresholds();
+
+	SimpleCaptureTimed capture(camera_);
+
+	capture.configure(GetParam());
+
+	capture.capture(kLatencyFrames);
+
+	const std::vector<SimpleCaptureTimed::duration> &latencies = capture.requestLatencies();
+	ASSERT_FALSE(latencies.empty());
+
+	auto max = *std::max_element(latencies.begin(), latencies.end());
+	EXPECT_LE(toMilliseconds(max), thresholds.requestLatency)
+		<< "Request round-trip latency too high";
+}
+
+/*
+ * Test the sustained frame rate
+ *
+ * When the camera supports the FrameDurationLimits control, capture at the
+ * shortest frame duration and make sure that the frame duration stays within
+ * the tolerance. Otherwise, compare the frame rate to the configured minimum.
+ */
+TEST_P(Performance, FrameRate)
+{
+	const Thresholds &thresholds = Environment::get()->thresholds();
+
+	SimpleCaptureTimed capture(camera_);
+
+	capture.configure(GetParam());
+
+	ControlList controls;
+	double maxInterval;
+
+	auto iter = camera_->controls().find(&controls::FrameDurationLimits);
+	if (iter != camera_->controls().end()) {
+		int64_t frameDuration = iter->second.min().get<int64_t>();
+
+		controls.set(controls::FrameDurationLimits,
+			     { frameDuration, frameDuration });
+
+		maxInterval = frameDuration * 1000.0
+			    * (1.0 + thresholds.frameRateTolerance / 100.0);
+	} else if (thresholds.minFrameRate > 0.0) {
+		maxInterval = 1000000000.0 / thresholds.minFrameRate;
+	} else {
+		std::cout << "No frame duration limits or minimum frame rate" << std::endl;
+		GTEST_SKIP();
+	}
+
+	capture.capture(kFrameRateFrames, &controls);
+
+	const std::vector<uint64_t> &intervals = capture.frameIntervals();
+	ASSERT_GT(intervals.size(), kFrameRateWarmup);
+
+	double sum = 0.0;
+	for (auto it = intervals.begin() + kFrameRateWarmup; it != intervals.end(); ++it)
+		sum += *it;
+
+	double meanInterval = sum / (intervals.size() - kFrameRateWarmup);
+
+	EXPECT_LE(meanInterval, maxInterval)
+		<< "Sustained frame rate " << 1000000000.0 / meanInterval
+		<< " fps below " << 1000000000.0 / maxInterval << " fps";
+}
+
+/*
+ * Test memory stability
+ *
+ * Makes sure that repeated configure, start, capture and stop cycles don't
+ * leak memory or file descriptors. The first cycle is used as a reference, to
+ * exclude one-time allocations.
+ */
+TEST_P(Performance, MemoryStability)
+{
+	const Thresholds &thresholds = Environment::get()->thresholds();
+
+	unsigned int fds = 0;
+	unsigned long rss = 0;
+
+	for (unsigned int cycle = 0; cycle < thresholds.memoryCycles + 1; cycle++) {
+		{
+			SimpleCaptureTimed capture(camera_);
+
+			capture.configure(GetParam());
+
+			capture.capture(thresholds.memoryFrames);
+		}
+
+		if (!cycle) {
+			fds = openFileDescriptors();
+			rss = residentSetSize();
+		}
+	}
+
+	EXPECT_LE(openFileDescriptors(), fds + thresholds.fdGrowth)
+		<< "File descriptors leaked";
+	EXPECT_LE(residentSetSize(), rss + thresholds.rssGrowth)
+		<< "Resident set size grew";
+}
+
+INSTANTIATE_TEST_SUITE_P(PerformanceTests,
+			 Performance,
+			 testing::ValuesIn(ROLES),
+			 Performance::nameParameters);
@@ -7,12 +7,14 @@
 
 #include <gtest/gtest.h>
 
+#include <libcamera/control_ids.h>
+
 #include "simple_capture.h"
 
 using namespace libcamera;
 
 SimpleCapture::SimpleCapture(std::shared_ptr<Camera> camera)
-	: loop_(nullptr), camera_(camera),
+	: loop_(nullptr), configureLatency_(0), camera_(camera),
 	  allocator_(std::make_unique<FrameBufferAllocator>(camera))
 {
 }
@@ -36,13 +38,17 @@ void SimpleCapture::configure(StreamRole role)
 		FAIL() << "Configuration not valid";
 	}
 
-	if (camera_->configure(config_.get())) {
+	auto begin = std::chrono::steady_clock::now();
+	int ret = camera_->configure(config_.get());
+	configureLatency_ = std::chrono::steady_clock::now() - begin;
+
+	if (ret) {
 		config_.reset();
 		FAIL() << "Failed to configure camera";
 	}
 }
 
-void SimpleCapture::start()
+void SimpleCapture::start(const ControlList *controls)
 {
 	Stream *stream = config_->at(0).stream();
 	int count = allocator_->allocate(stream);
@@ -52,7 +58,9 @@ void SimpleCapture::start()
 
 	camera_->requestCompleted.connect(this, &SimpleCapture::requestComplete);
 
-	ASSERT_EQ(camera_->start(), 0) << "Failed to start camera";
+	startTime_ = std::chrono::steady_clock::now();
+
+	ASSERT_EQ(camera_->start(controls), 0) << "Failed to start camera";
 }
 
 void SimpleCapture::stop()
@@ -189,3 +197,104 @@ void SimpleCaptureUnbalanced::requestComplete(Request *request)
 	if (camera_->queueRequest(request))
 		loop_->exit(-EINVAL);
 }
+
+/* SimpleCaptureTimed */
+
+SimpleCaptureTimed::SimpleCaptureTimed(std::shared_ptr<Camera> camera)
+	: SimpleCapture(camera)
+{
+}
+
+void SimpleCaptureTimed::capture(unsigned int numRequests, const ControlList *controls)
+{
+	captureCount_ = 0;
+	captureLimit_ = numRequests;
+
+	firstFrameLatency_ = {};
+	stopLatency_ = {};
+	requestLatencies_.clear();
+	lastTimestamp_ = 0;
+	frameIntervals_.clear();
+
+	start(controls);
+
+	Stream *stream = config_->at(0).stream();
+	const std::vector<std::unique_ptr<FrameBuffer>> &buffers = allocator_->buffers(stream);
+
+	queueTimes_.resize(buffers.size());
+
+	/* Queue the recommended number of requests. */
+	std::vector<std::unique_ptr<libcamera::Request>> requests;
+	for (const std::unique_ptr<FrameBuffer> &buffer : buffers) {
+		std::unique_ptr<Request> request = camera_->createRequest(requests.size());
+		ASSERT_TRUE(request) << "Can't create request";
+
+		ASSERT_EQ(request->addBuffer(stream, buffer.get()), 0) << "Can't set buffer for request";
+
+		ASSERT_EQ(queueRequest(request.get()), 0) << "Failed to queue request";
+
+		requests.push_back(std::move(request));
+	}
+
+	/* Run capture session, and measure the time to stop with requests queued. */
+	loop_ = new EventLoop();
+	int status = loop_->exec();
+
+	auto begin = std::chrono::steady_clock::now();
+	stop();
+	stopLatency_ = std::chrono::steady_clock::now() - begin;
+
+	delete loop_;
+
+	ASSERT_EQ(status, 0);
+	ASSERT_EQ(captureCount_, captureLimit_);
+}
+
+int SimpleCaptureTimed::queueRequest(Request *request)
+{
+	queueTimes_[request->cookie()] = std::chrono::steady_clock::now();
+
+	return camera_->queueRequest(request);
+}
+
+void SimpleCaptureTimed::requestComplete(Request *request)
+{
+	auto now = std::chrono::steady_clock::now();
+
+	if (request->status() == Request::RequestCancelled)
+		return;
+
+	/*
+	 * Keep requeueing requests once the limit is reached, to measure the
+	 * stop() latency with requests in flight. Queuing fails once the
+	 * camera is being stopped, ignore errors.
+	 */
+	if (captureCount_ >= captureLimit_) {
+		request->reuse(Request::ReuseBuffers);
+		queueRequest(request);
+		return;
+	}
+
+	if (!captureCount_)
+		firstFrameLatency_ = now - startTime_;
+
+	requestLatencies_.push_back(now - queueTimes_[request->cookie()]);
+
+	/* Prefer the sensor timestamp, if reported by the pipeline handler. */
+	const auto sensorTimestamp = request->metadata().get(controls::SensorTimestamp);
+	uint64_t timestamp = sensorTimestamp
+			   ? static_cast<uint64_t>(*sensorTimestamp)
+			   : request->buffers().begin()->second->metadata().timestamp;
+
+	if (lastTimestamp_ && timestamp > lastTimestamp_)
+		frameIntervals_.push_back(timestamp - lastTimestamp_);
+	lastTimestamp_ = timestamp;
+
+	captureCount_++;
+
+	request->reuse(Request::ReuseBuffers);
+	if (queueRequest(request))
+		loop_->exit(-EINVAL);
+	else if (captureCount_ >= captureLimit_)
+		loop_->exit(0);
+}
@@ -7,7 +7,10 @@
 
 #pragma once
 
+#include <chrono>
 #include <memory>
+#include <stdint.h>
+#include <vector>
 
 #include <libcamera/libcamera.h>
 
@@ -22,13 +25,17 @@ protected:
 	SimpleCapture(std::shared_ptr<libcamera::Camera> camera);
 	virtual ~SimpleCapture();
 
-	void start();
+	void start(const libcamera::ControlList *controls = nullptr);
 	void stop();
 
 	virtual void requestComplete(libcamera::Request *request) = 0;
 
 	EventLoop *loop_;
 
+	/* Duration of the Camera::configure() call, and time of Camera::start(). */
+	std::chrono::steady_clock::duration configureLatency_;
+	std::chrono::steady_clock::time_point startTime_;
+
 	std::shared_ptr<libcamera::Camera> camera_;
 	std::unique_ptr<libcamera::FrameBufferAllocator> allocator_;
 	std::unique_ptr<libcamera::CameraConfiguration> config_;
@@ -63,3 +70,38 @@ private:
 	unsigned int captureCount_;
 	unsigned int captureLimit_;
 };
+
+class SimpleCaptureTimed : public SimpleCapture
+{
+public:
+	using duration = std::chrono::steady_clock::duration;
+
+	SimpleCaptureTimed(std::shared_ptr<libcamera::Camera> camera);
+
+	void capture(unsigned int numRequests,
+		     const libcamera::ControlList *controls = nullptr);
+
+	duration configureLatency() const { return configureLatency_; }
+	duration firstFrameLatency() const { return firstFrameLatency_; }
+	duration stopLatency() const { return stopLatency_; }
+	const std::vector<duration> &requestLatencies() const { return requestLatencies_; }
+	const std::vector<uint64_t> &frameIntervals() const { return frameIntervals_; }
+
+private:
+	int queueRequest(libcamera::Request *request);
+	void requestComplete(libcamera::Request *request) override;
+
+	unsigned int captureCount_;
+	unsigned int captureLimit_;
+
+	/* Queue times indexed by the request cookie. */
+	std::vector<std::chrono::steady_clock::time_point> queueTimes_;
+
+	duration firstFrameLatency_;
+	duration stopLatency_;
+	std::vector<duration> requestLatencies_;
+
+	/* Intervals between consecutive frame timestamps, in nanoseconds. */
+	uint64_t lastTimestamp_;
+	std::vector<uint64_t> frameIntervals_;
+};
@@ -0,0 +1,202 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2022, Google Inc.
+ *
+ * thresholds.cpp - Performance test thresholds
+ */
+
+#include "thresholds.h"
+
+#include <errno.h>
+#include <iostream>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * The thresholds file is a YAML mapping of sections. The 'default' section
+ * applies to all cameras, and other sections apply to the cameras whose ID
+ * starts with the section name. As the camera IDs are specific to each
+ * pipeline handler, this allows setting thresholds per pipeline handler or
+ * per camera. When multiple sections match, the longest one takes
+ * precedence.
+ *
+ * default:
+ *   first-frame-latency: 1000
+ * platform/vimc:
+ *   min-frame-rate: 25
+ */
+
+Thresholds::Thresholds()
+	: frameRateTolerance(5.0), minFrameRate(0.0), configureLatency(500),
+	  firstFrameLatency(1000), stopLatency(500), requestLatency(1000),
+	  memoryCycles(10), memoryFrames(30), rssGrowth(1024), fdGrowth(0)
+{
+}
+
+int Thresholds::load(const std::string &fileName, const std::string &cameraId)
+{
+	FILE *fh = fopen(fileName.c_str(), "r");
+	if (!fh) {
+		int ret = -errno;
+		std::cerr << "Failed to open thresholds file " << fileName
+			  << ": " << strerror(-ret) << std::endl;
+		return ret;
+	}
+
+	int ret = parseFile(fh);
+	fclose(fh);
+	if (ret) {
+		std::cerr << "Failed to parse thresholds file " << fileName
+			  << std::endl;
+		return ret;
+	}
+
+	auto iter = sections_.find("default");
+	if (iter != sections_.end()) {
+		ret = apply(iter->second);
+		if (ret)
+			return ret;
+	}
+
+	const std::map<std::string, std::string> *match = nullptr;
+	size_t length = 0;
+
+	for (const auto &[prefix, values] : sections_) {
+		if (prefix == "default" || prefix.size() < length ||
+		    cameraId.compare(0, prefix.size(), prefix))
+			continue;
+
+		match = &values;
+		length = prefix.size();
+	}
+
+	return match ? apply(*match) : 0;
+}
+
+Thresholds::EventPtr Thresholds::nextEvent(yaml_event_type_t expectedType)
+{
+	EventPtr event(new yaml_event_t);
+
+	if (!yaml_parser_parse(&parser_, event.get()))
+		return nullptr;
+
+	if (expectedType != YAML_NO_EVENT && event->type != expectedType) {
+		std::cerr << "Thresholds error on line " << event->start_mark.line
+			  << " column " << event->start_mark.column
+			  << ": unexpected event" << std::endl;
+		return nullptr;
+	}
+
+	return event;
+}
+
+std::string Thresholds::eventScalarValue(const EventPtr &event)
+{
+	return std::string(reinterpret_cast<char *>(event->data.scalar.value),
+			   event->data.scalar.length);
+}
+
+int Thresholds::parseFile(FILE *fh)
+{
+	int ret = yaml_parser_initialize(&parser_);
+	if (!ret) {
+		std::cerr << "Failed to initialize yaml parser" << std::endl;
+		return -EINVAL;
+	}
+
+	/* Delete the parser upon function exit. */
+	struct ParserDeleter {
+		ParserDeleter(yaml_parser_t *parser) : parser_(parser) { }
+		~ParserDeleter() { yaml_parser_delete(parser_); }
+		yaml_parser_t *parser_;
+	} deleter(&parser_);
+
+	yaml_parser_set_input_file(&parser_, fh);
+
+	if (!nextEvent(YAML_STREAM_START_EVENT) ||
+	    !nextEvent(YAML_DOCUMENT_START_EVENT) ||
+	    !nextEvent(YAML_MAPPING_START_EVENT))
+		return -EINVAL;
+
+	while (1) {
+		EventPtr event = nextEvent();
+		if (!event)
+			return -EINVAL;
+
+		if (event->type == YAML_MAPPING_END_EVENT)
+			return 0;
+
+		if (event->type != YAML_SCALAR_EVENT)
+			return -EINVAL;
+
+		ret = parseSection(&sections_[eventScalarValue(event)]);
+		if (ret)
+			return ret;
+	}
+}
+
+int Thresholds::parseSection(std::map<std::string, std::string> *values)
+{
+	if (!nextEvent(YAML_MAPPING_START_EVENT))
+		return -EINVAL;
+
+	while (1) {
+		EventPtr event = nextEvent();
+		if (!event)
+			return -EINVAL;
+
+		if (event->type == YAML_MAPPING_END_EVENT)
+			return 0;
+
+		if (event->type != YAML_SCALAR_EVENT)
+			return -EINVAL;
+
+		std::string key = eventScalarValue(event);
+
+		event = nextEvent(YAML_SCALAR_EVENT);
+		if (!event)
+			return -EINVAL;
+
+		(*values)[key] = eventScalarValue(event);
+	}
+}
+
+int Thresholds::apply(const std::map<std::string, std::string> &values)
+{
+	const std::map<std::string, unsigned int *> integers = {
+		{ "configure-latency", &configureLatency },
+		{ "first-frame-latency", &firstFrameLatency },
+		{ "stop-latency", &stopLatency },
+		{ "request-latency", &requestLatency },
+		{ "memory-cycles", &memoryCycles },
+		{ "memory-frames", &memoryFrames },
+		{ "rss-growth", &rssGrowth },
+		{ "fd-growth", &fdGrowth },
+	};
+
+	const std::map<std::string, double *> reals = {
+		{ "frame-rate-tolerance", &frameRateTolerance },
+		{ "min-frame-rate", &minFrameRate },
+	};
+
+	for (const auto &[key, value] : values) {
+		char *end;
+
+		if (integers.count(key)) {
+			*integers.at(key) = strtoul(value.c_str(), &end, 10);
+		} else if (reals.count(key)) {
+			*reals.at(key) = strtod(value.c_str(), &end);
+		} else {
+			std::cerr << "Unknown threshold '" << key << "'" << std::endl;
+			return -EINVAL;
+		}
+
+		if (value.empty() || *end != '\0') {
+			std::cerr << "Invalid value '" << value << "' for threshold '"
+				  << key << "'" << std::endl;
+			return -EINVAL;
+		}
+	}
+
+	return 0;
+}
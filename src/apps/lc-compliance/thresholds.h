@@ -0,0 +1,59 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2022, Google Inc.
+ *
+ * thresholds.h - Performance test thresholds
+ */
+
+#pragma once
+
+#include <map>
+#include <memory>
+#include <stdio.h>
+#include <string>
+
+#include <yaml.h>
+
+struct Thresholds
+{
+	Thresholds();
+
+	int load(const std::string &fileName, const std::string &cameraId);
+
+	/* Maximum deviation from the expected frame duration, in percent. */
+	double frameRateTolerance;
+	/* Minimum sustained frame rate, when the camera has no frame duration limits. */
+	double minFrameRate;
+
+	/* Latencies, in milliseconds. */
+	unsigned int configureLatency;
+	unsigned int firstFrameLatency;
+	unsigned int stopLatency;
+	unsigned int requestLatency;
+
+	/* Memory stability run, and maximum growth of RSS (in kB) and fds. */
+	unsigned int memoryCycles;
+	unsigned int memoryFrames;
+	unsigned int rssGrowth;
+	unsigned int fdGrowth;
+
+private:
+	struct EventDeleter {
+		void operator()(yaml_event_t *event) const
+		{
+			yaml_event_delete(event);
+			delete event;
+		}
+	};
+	using EventPtr = std::unique_ptr<yaml_event_t, EventDeleter>;
+
+	EventPtr nextEvent(yaml_event_type_t expectedType = YAML_NO_EVENT);
+	static std::string eventScalarValue(const EventPtr &event);
+
+	int parseFile(FILE *fh);
+	int parseSection(std::map<std::string, std::string> *values);
+	int apply(const std::map<std::string, std::string> &values);
+
+	yaml_parser_t parser_;
+	std::map<std::string, std::map<std::string, std::string>> sections_;
+};
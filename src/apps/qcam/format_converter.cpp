@@ -7,31 +7,47 @@
 
 #include "format_converter.h"
 
+#include <algorithm>
+#include <array>
+#include <cmath>
 #include <errno.h>
 #include <utility>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
 #include <QImage>
 
 #include <libcamera/formats.h>
 
 #include "../common/image.h"
 
-#define RGBSHIFT		8
-#ifndef MAX
-#define MAX(a,b)		((a)>(b)?(a):(b))
-#endif
-#ifndef MIN
-#define MIN(a,b)		((a)<(b)?(a):(b))
-#endif
-#ifndef CLAMP
-#define CLAMP(a,low,high)	MAX((low),MIN((high),(a)))
-#endif
-#ifndef CLIP
-#define CLIP(x)			CLAMP(x,0,255)
-#endif
+FormatConverter::FormatConverter()
+	: width_(0), height_(0), bandHeight_(0), numBands_(0), stop_(false),
+	  src_(nullptr), dst_(nullptr), nextBand_(0), pendingBands_(0)
+{
+}
+
+FormatConverter::~FormatConverter()
+{
+	{
+		std::unique_lock<std::mutex> locker(mutex_);
+		stop_ = true;
+	}
+
+	cv_.notify_all();
+
+	for (std::thread &worker : workers_)
+		worker.join();
+}
 
 int FormatConverter::configure(const libcamera::PixelFormat &format,
-			       const QSize &size, unsigned int stride)
+			       const QSize &size,
+			       const libcamera::ColorSpace &colorSpace,
+			       unsigned int stride)
 {
 	switch (format) {
 	case libcamera::formats::NV12:
@@ -173,52 +189,327 @@ int FormatConverter::configure(const libcamera::PixelFormat &format,
 		return -EINVAL;
 	};
 
+
 	format_ = format;
 	width_ = size.width();
 	height_ = size.height();
 	stride_ = stride;
 
+	selectColorSpace(colorSpace);
+	configureBands();
+
 	return 0;
 }
 
+void FormatConverter::selectColorSpace(const libcamera::ColorSpace &colorSpace)
+{
+	/* Coefficients of Cr for R, Cb and Cr for G, and Cb for B. */
+	std::array<double, 4> yuv2rgb;
+
+	/*
+	 * Default to BT.601 for YUV formats that don't specify a Y'CbCr
+	 * encoding.
+	 */
+	switch (colorSpace.ycbcrEncoding) {
+	case libcamera::ColorSpace::YcbcrEncoding::None:
+	case libcamera::ColorSpace::YcbcrEncoding::Rec601:
+	default:
+		yuv2rgb = { 1.4020, -0.3441, -0.7141, 1.7720 };
+		break;
+
+	case libcamera::ColorSpace::YcbcrEncoding::Rec709:
+		yuv2rgb = { 1.5748, -0.1873, -0.4681, 1.8556 };
+		break;
+
+	case libcamera::ColorSpace::YcbcrEncoding::Rec2020:
+		yuv2rgb = { 1.4746, -0.1646, -0.5714, 1.8814 };
+		break;
+	}
+
+	double yScale;
+
+	switch (colorSpace.range) {
+	case libcamera::ColorSpace::Range::Full:
+	default:
+		yScale = 1.0;
+		coeffs_.yOffset = 0;
+		break;
+
+	case libcamera::ColorSpace::Range::Limited:
+		yScale = 255.0 / 219.0;
+		coeffs_.yOffset = 16;
+
+		for (double &coeff : yuv2rgb)
+			coeff *= 255.0 / 224.0;
+		break;
+	}
+
+	auto fixed = [](double coeff) {
+		return static_cast<int16_t>(std::lround(coeff * (1 << Coefficients::kShift)));
+	};
+
+	coeffs_.y = fixed(yScale);
+	coeffs_.crR = fixed(yuv2rgb[0]);
+	coeffs_.cbG = fixed(yuv2rgb[1]);
+	coeffs_.crG = fixed(yuv2rgb[2]);
+	coeffs_.cbB = fixed(yuv2rgb[3]);
+}
+
+void FormatConverter::configureBands()
+{
+	/*
+	 * Split the image in one band per CPU, with bands aligned to the
+	 * vertical chroma subsampling to convert each chroma line once only.
+	 */
+	const unsigned int align = formatFamily_ == YUVPlanar ||
+				   formatFamily_ == YUVSemiPlanar
+				 ? vertSubSample_ : 1;
+	const unsigned int cpus = std::max(std::thread::hardware_concurrency(), 1U);
+	unsigned int bands = std::clamp(height_ / kMinBandHeight, 1U, cpus);
+
+	if (formatFamily_ == MJPEG)
+		bands = 1;
+
+	bandHeight_ = (height_ + bands - 1) / bands;
+	bandHeight_ = (bandHeight_ + align - 1) / align * align;
+	numBands_ = bandHeight_ ? (height_ + bandHeight_ - 1) / bandHeight_ : 0;
+
+	std::unique_lock<std::mutex> locker(mutex_);
+
+	while (workers_.size() + 1 < numBands_) {
+		unsigned int index = workers_.size();
+		workers_.emplace_back(&FormatConverter::workerThread, this, index);
+	}
+
+	/* One set of line buffers per worker and one for the calling thread. */
+	const unsigned int lineSize = (width_ + 1) & ~1U;
+
+	lines_.resize(workers_.size() + 1);
+	for (LineBuffers &lines : lines_) {
+		lines.y.resize(lineSize);
+		lines.cb.resize(lineSize);
+		lines.cr.resize(lineSize);
+	}
+}
+
 void FormatConverter::convert(const Image *src, size_t size, QImage *dst)
 {
+	if (formatFamily_ == MJPEG) {
+		dst->loadFromData(src->data(0).data(), size, "JPEG");
+		return;
+	}
+
+	std::unique_lock<std::mutex> locker(mutex_);
+
+	src_ = src;
+	dst_ = dst->bits();
+	nextBand_ = 0;
+	pendingBands_ = numBands_;
+
+	cv_.notify_all();
+
+	/* Convert bands in the calling thread too, until none is left. */
+	LineBuffers *lines = &lines_[workers_.size()];
+
+	while (nextBand_ < numBands_) {
+		unsigned int band = nextBand_++;
+
+		locker.unlock();
+		convertBand(band, lines);
+		locker.lock();
+
+		pendingBands_--;
+	}
+
+	doneCv_.wait(locker, [&] { return !pendingBands_; });
+
+	src_ = nullptr;
+	dst_ = nullptr;
+}
+
+void FormatConverter::workerThread(unsigned int index)
+{
+	std::unique_lock<std::mutex> locker(mutex_);
+
+	while (true) {
+		cv_.wait(locker, [&] {
+			return stop_ || (src_ && nextBand_ < numBands_);
+		});
+
+		if (stop_)
+			return;
+
+		unsigned int band = nextBand_++;
+
+		locker.unlock();
+		convertBand(band, &lines_[index]);
+		locker.lock();
+
+		if (!--pendingBands_)
+			doneCv_.notify_one();
+	}
+}
+
+void FormatConverter::convertBand(unsigned int band, LineBuffers *lines)
+{
+	const unsigned int start = band * bandHeight_;
+	const unsigned int end = std::min(start + bandHeight_, height_);
+
+	lines->chromaRow = -1;
+
 	switch (formatFamily_) {
 	case MJPEG:
-		dst->loadFromData(src->data(0).data(), size, "JPEG");
 		break;
 	case RGB:
-		convertRGB(src, dst->bits());
+		convertRGB(src_->data(0).data(), dst_, start, end);
 		break;
 	case YUVPacked:
-		convertYUVPacked(src, dst->bits());
+		convertYUVPacked(src_->data(0).data(), dst_, start, end, lines);
 		break;
 	case YUVSemiPlanar:
-		convertYUVSemiPlanar(src, dst->bits());
+		convertYUVSemiPlanar(src_, dst_, start, end, lines);
 		break;
 	case YUVPlanar:
-		convertYUVPlanar(src, dst->bits());
+		convertYUVPlanar(src_, dst_, start, end, lines);
 		break;
 	};
 }
 
-static void yuv_to_rgb(int y, int u, int v, int *r, int *g, int *b)
+/*
+ * Convert one line of YCbCr samples, with chroma at full horizontal
+ * resolution, to XRGB8888. The SIMD implementations compute the same
+ * fixed-point values as the scalar implementation, which also handles the
+ * pixels left at the end of the line.
+ */
+void FormatConverter::yuvToRgbLine(const Coefficients &coeffs, const uint8_t *y,
+				   const uint8_t *cb, const uint8_t *cr,
+				   uint8_t *dst, unsigned int width)
 {
-	int c = y - 16;
-	int d = u - 128;
-	int e = v - 128;
-	*r = CLIP(( 298 * c           + 409 * e + 128) >> RGBSHIFT);
-	*g = CLIP(( 298 * c - 100 * d - 208 * e + 128) >> RGBSHIFT);
-	*b = CLIP(( 298 * c + 516 * d           + 128) >> RGBSHIFT);
+	constexpr unsigned int shift = Coefficients::kShift;
+	unsigned int x = 0;
+
+#if defined(__SSE2__)
+	/*
+	 * Interleave the Y' and chroma values to compute the products and sums
+	 * in 32-bit precision with _mm_madd_epi16().
+	 */
+	auto pair = [](int16_t a, int16_t b) {
+		return _mm_set1_epi32(static_cast<uint16_t>(a) |
+				      (static_cast<uint32_t>(static_cast<uint16_t>(b)) << 16));
+	};
+
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i alpha = _mm_set1_epi8(-1);
+	const __m128i yOffset = _mm_set1_epi16(coeffs.yOffset);
+	const __m128i cOffset = _mm_set1_epi16(128);
+	const __m128i rounding = _mm_set1_epi32(1 << (shift - 1));
+	const __m128i kR = pair(coeffs.y, coeffs.crR);
+	const __m128i kG = pair(coeffs.y, coeffs.cbG);
+	const __m128i kGCr = pair(coeffs.crG, 0);
+	const __m128i kB = pair(coeffs.y, coeffs.cbB);
+
+	auto scale = [&](__m128i lo, __m128i hi) {
+		lo = _mm_srai_epi32(_mm_add_epi32(lo, rounding), shift);
+		hi = _mm_srai_epi32(_mm_add_epi32(hi, rounding), shift);
+		__m128i v = _mm_packs_epi32(lo, hi);
+		return _mm_packus_epi16(v, v);
+	};
+
+	for (; x + 8 <= width; x += 8) {
+		__m128i vy = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(y + x));
+		__m128i vcb = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(cb + x));
+		__m128i vcr = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(cr + x));
+
+		vy = _mm_sub_epi16(_mm_unpacklo_epi8(vy, zero), yOffset);
+		vcb = _mm_sub_epi16(_mm_unpacklo_epi8(vcb, zero), cOffset);
+		vcr = _mm_sub_epi16(_mm_unpacklo_epi8(vcr, zero), cOffset);
+
+		const __m128i yCrLo = _mm_unpacklo_epi16(vy, vcr);
+		const __m128i yCrHi = _mm_unpackhi_epi16(vy, vcr);
+		const __m128i yCbLo = _mm_unpacklo_epi16(vy, vcb);
+		const __m128i yCbHi = _mm_unpackhi_epi16(vy, vcb);
+		const __m128i crLo = _mm_unpacklo_epi16(vcr, zero);
+		const __m128i crHi = _mm_unpackhi_epi16(vcr, zero);
+
+		const __m128i r = scale(_mm_madd_epi16(yCrLo, kR),
+					_mm_madd_epi16(yCrHi, kR));
+		const __m128i g = scale(_mm_add_epi32(_mm_madd_epi16(yCbLo, kG),
+						      _mm_madd_epi16(crLo, kGCr)),
+					_mm_add_epi32(_mm_madd_epi16(yCbHi, kG),
+						      _mm_madd_epi16(crHi, kGCr)));
+		const __m128i b = scale(_mm_madd_epi16(yCbLo, kB),
+					_mm_madd_epi16(yCbHi, kB));
+
+		const __m128i bg = _mm_unpacklo_epi8(b, g);
+		const __m128i ra = _mm_unpacklo_epi8(r, alpha);
+
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(dst + 4 * x),
+				 _mm_unpacklo_epi16(bg, ra));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(dst + 4 * x + 16),
+				 _mm_unpackhi_epi16(bg, ra));
+	}
+#elif defined(__ARM_NEON)
+	const uint8x8_t yOffset = vdup_n_u8(coeffs.yOffset);
+	const uint8x8_t cOffset = vdup_n_u8(128);
+
+	for (; x + 8 <= width; x += 8) {
+		const int16x8_t vy = vreinterpretq_s16_u16(vsubl_u8(vld1_u8(y + x), yOffset));
+		const int16x8_t vcb = vreinterpretq_s16_u16(vsubl_u8(vld1_u8(cb + x), cOffset));
+		const int16x8_t vcr = vreinterpretq_s16_u16(vsubl_u8(vld1_u8(cr + x), cOffset));
+
+		const int32x4_t yLo = vmull_n_s16(vget_low_s16(vy), coeffs.y);
+		const int32x4_t yHi = vmull_n_s16(vget_high_s16(vy), coeffs.y);
+
+		int32x4_t rLo = vmlal_n_s16(yLo, vget_low_s16(vcr), coeffs.crR);
+		int32x4_t rHi = vmlal_n_s16(yHi, vget_high_s16(vcr), coeffs.crR);
+		int32x4_t gLo = vmlal_n_s16(yLo, vget_low_s16(vcb), coeffs.cbG);
+		int32x4_t gHi = vmlal_n_s16(yHi, vget_high_s16(vcb), coeffs.cbG);
+		gLo = vmlal_n_s16(gLo, vget_low_s16(vcr), coeffs.crG);
+		gHi = vmlal_n_s16(gHi, vget_high_s16(vcr), coeffs.crG);
+		int32x4_t bLo = vmlal_n_s16(yLo, vget_low_s16(vcb), coeffs.cbB);
+		int32x4_t bHi = vmlal_n_s16(yHi, vget_high_s16(vcb), coeffs.cbB);
+
+		uint8x8x4_t pixels;
+		pixels.val[0] = vqmovun_s16(vcombine_s16(vqrshrn_n_s32(bLo, shift),
+							 vqrshrn_n_s32(bHi, shift)));
+		pixels.val[1] = vqmovun_s16(vcombine_s16(vqrshrn_n_s32(gLo, shift),
+							 vqrshrn_n_s32(gHi, shift)));
+		pixels.val[2] = vqmovun_s16(vcombine_s16(vqrshrn_n_s32(rLo, shift),
+							 vqrshrn_n_s32(rHi, shift)));
+		pixels.val[3] = vdup_n_u8(0xff);
+
+		vst4_u8(dst + 4 * x, pixels);
+	}
+#endif
+
+	auto clip = [](int value) {
+		return static_cast<uint8_t>(std::clamp(value, 0, 255));
+	};
+
+	const int round = 1 << (shift - 1);
+
+	for (; x < width; ++x) {
+		const int c = (y[x] - coeffs.yOffset) * coeffs.y + round;
+		const int d = cb[x] - 128;
+		const int e = cr[x] - 128;
+
+		dst[4 * x + 0] = clip((c + coeffs.cbB * d) >> shift);
+		dst[4 * x + 1] = clip((c + coeffs.cbG * d + coeffs.crG * e) >> shift);
+		dst[4 * x + 2] = clip((c + coeffs.crR * e) >> shift);
+		dst[4 * x + 3] = 0xff;
+	}
 }
 
-void FormatConverter::convertRGB(const Image *srcImage, unsigned char *dst)
+void FormatConverter::convertRGB(const unsigned char *src, unsigned char *dst,
+				 unsigned int start, unsigned int end)
 {
-	const unsigned char *src = srcImage->data(0).data();
 	unsigned int x, y;
 	int r, g, b;
 
-	for (y = 0; y < height_; y++) {
+	src += start * stride_;
+	dst += start * width_ * 4;
+
+	for (y = start; y < end; y++) {
 		for (x = 0; x < width_; x++) {
 			r = src[bpp_ * x + r_pos_];
 			g = src[bpp_ * x + g_pos_];
@@ -235,125 +526,104 @@ void FormatConverter::convertRGB(const Image *srcImage, unsigned char *dst)
 	}
 }
 
-void FormatConverter::convertYUVPacked(const Image *srcImage, unsigned char *dst)
+void FormatConverter::convertYUVPacked(const unsigned char *src, unsigned char *dst,
+				       unsigned int start, unsigned int end,
+				       LineBuffers *lines)
 {
-	const unsigned char *src = srcImage->data(0).data();
-	unsigned int src_x, src_y, dst_x, dst_y;
-	unsigned int src_stride;
-	unsigned int dst_stride;
-	unsigned int cr_pos;
-	int r, g, b, y, cr, cb;
-
-	cr_pos = (cb_pos_ + 2) % 4;
-	src_stride = stride_;
-	dst_stride = width_ * 4;
-
-	for (src_y = 0, dst_y = 0; dst_y < height_; src_y++, dst_y++) {
-		for (src_x = 0, dst_x = 0; dst_x < width_; ) {
-			cb = src[src_y * src_stride + src_x * 4 + cb_pos_];
-			cr = src[src_y * src_stride + src_x * 4 + cr_pos];
-
-			y = src[src_y * src_stride + src_x * 4 + y_pos_];
-			yuv_to_rgb(y, cb, cr, &r, &g, &b);
-			dst[dst_y * dst_stride + 4 * dst_x + 0] = b;
-			dst[dst_y * dst_stride + 4 * dst_x + 1] = g;
-			dst[dst_y * dst_stride + 4 * dst_x + 2] = r;
-			dst[dst_y * dst_stride + 4 * dst_x + 3] = 0xff;
-			dst_x++;
-
-			y = src[src_y * src_stride + src_x * 4 + y_pos_ + 2];
-			yuv_to_rgb(y, cb, cr, &r, &g, &b);
-			dst[dst_y * dst_stride + 4 * dst_x + 0] = b;
-			dst[dst_y * dst_stride + 4 * dst_x + 1] = g;
-			dst[dst_y * dst_stride + 4 * dst_x + 2] = r;
-			dst[dst_y * dst_stride + 4 * dst_x + 3] = 0xff;
-			dst_x++;
-
-			src_x++;
+	unsigned int cr_pos = (cb_pos_ + 2) % 4;
+	uint8_t *line_y = lines->y.data();
+	uint8_t *line_cb = lines->cb.data();
+	uint8_t *line_cr = lines->cr.data();
+
+	for (unsigned int y = start; y < end; y++) {
+		const unsigned char *src_y = src + y * stride_;
+
+		for (unsigned int x = 0; x < width_; x += 2) {
+			const unsigned char *pair = src_y + x * 2;
+
+			line_y[x] = pair[y_pos_];
+			line_y[x + 1] = pair[y_pos_ + 2];
+			line_cb[x] = line_cb[x + 1] = pair[cb_pos_];
+			line_cr[x] = line_cr[x + 1] = pair[cr_pos];
 		}
+
+		yuvToRgbLine(coeffs_, line_y, line_cb, line_cr,
+			     dst + y * width_ * 4, width_);
 	}
 }
 
-void FormatConverter::convertYUVPlanar(const Image *srcImage, unsigned char *dst)
+void FormatConverter::convertYUVPlanar(const Image *srcImage, unsigned char *dst,
+				       unsigned int start, unsigned int end,
+				       LineBuffers *lines)
 {
 	unsigned int c_stride = stride_ / horzSubSample_;
-	unsigned int c_inc = horzSubSample_ == 1 ? 1 : 0;
 	const unsigned char *src_y = srcImage->data(0).data();
 	const unsigned char *src_cb = srcImage->data(1).data();
 	const unsigned char *src_cr = srcImage->data(2).data();
-	int r, g, b;
 
 	if (nvSwap_)
 		std::swap(src_cb, src_cr);
 
-	for (unsigned int y = 0; y < height_; y++) {
-		const unsigned char *line_y = src_y + y * stride_;
-		const unsigned char *line_cb = src_cb + (y / vertSubSample_) *
-					       c_stride;
-		const unsigned char *line_cr = src_cr + (y / vertSubSample_) *
-					       c_stride;
+	for (unsigned int y = start; y < end; y++) {
+		const int c_row = y / vertSubSample_;
+		const uint8_t *line_cb = src_cb + c_row * c_stride;
+		const uint8_t *line_cr = src_cr + c_row * c_stride;
 
-		for (unsigned int x = 0; x < width_; x += 2) {
-			yuv_to_rgb(*line_y, *line_cb, *line_cr, &r, &g, &b);
-			dst[0] = b;
-			dst[1] = g;
-			dst[2] = r;
-			dst[3] = 0xff;
-			line_y++;
-			line_cb += c_inc;
-			line_cr += c_inc;
-			dst += 4;
-
-			yuv_to_rgb(*line_y, *line_cb, *line_cr, &r, &g, &b);
-			dst[0] = b;
-			dst[1] = g;
-			dst[2] = r;
-			dst[3] = 0xff;
-			line_y++;
-			line_cb += 1;
-			line_cr += 1;
-			dst += 4;
+		/* Upsample the chroma horizontally, once per chroma line. */
+		if (horzSubSample_ != 1) {
+			if (c_row != lines->chromaRow) {
+				for (unsigned int x = 0; x < width_; x += 2) {
+					lines->cb[x] = lines->cb[x + 1] = line_cb[x / 2];
+					lines->cr[x] = lines->cr[x + 1] = line_cr[x / 2];
+				}
+
+				lines->chromaRow = c_row;
+			}
+
+			line_cb = lines->cb.data();
+			line_cr = lines->cr.data();
 		}
+
+		yuvToRgbLine(coeffs_, src_y + y * stride_, line_cb, line_cr,
+			     dst + y * width_ * 4, width_);
 	}
 }
 
-void FormatConverter::convertYUVSemiPlanar(const Image *srcImage, unsigned char *dst)
+void FormatConverter::convertYUVSemiPlanar(const Image *srcImage, unsigned char *dst,
+					   unsigned int start, unsigned int end,
+					   LineBuffers *lines)
 {
 	unsigned int c_stride = stride_ * (2 / horzSubSample_);
-	unsigned int c_inc = horzSubSample_ == 1 ? 2 : 0;
 	unsigned int cb_pos = nvSwap_ ? 1 : 0;
 	unsigned int cr_pos = nvSwap_ ? 0 : 1;
 	const unsigned char *src = srcImage->data(0).data();
 	const unsigned char *src_c = srcImage->data(1).data();
-	int r, g, b;
-
-	for (unsigned int y = 0; y < height_; y++) {
-		const unsigned char *src_y = src + y * stride_;
-		const unsigned char *src_cb = src_c + (y / vertSubSample_) *
-					      c_stride + cb_pos;
-		const unsigned char *src_cr = src_c + (y / vertSubSample_) *
-					      c_stride + cr_pos;
-
-		for (unsigned int x = 0; x < width_; x += 2) {
-			yuv_to_rgb(*src_y, *src_cb, *src_cr, &r, &g, &b);
-			dst[0] = b;
-			dst[1] = g;
-			dst[2] = r;
-			dst[3] = 0xff;
-			src_y++;
-			src_cb += c_inc;
-			src_cr += c_inc;
-			dst += 4;
-
-			yuv_to_rgb(*src_y, *src_cb, *src_cr, &r, &g, &b);
-			dst[0] = b;
-			dst[1] = g;
-			dst[2] = r;
-			dst[3] = 0xff;
-			src_y++;
-			src_cb += 2;
-			src_cr += 2;
-			dst += 4;
+	uint8_t *line_cb = lines->cb.data();
+	uint8_t *line_cr = lines->cr.data();
+
+	for (unsigned int y = start; y < end; y++) {
+		const int c_row = y / vertSubSample_;
+
+		/* De-interleave and upsample the chroma, once per chroma line. */
+		if (c_row != lines->chromaRow) {
+			const unsigned char *src_cbcr = src_c + c_row * c_stride;
+
+			if (horzSubSample_ == 1) {
+				for (unsigned int x = 0; x < width_; x++) {
+					line_cb[x] = src_cbcr[2 * x + cb_pos];
+					line_cr[x] = src_cbcr[2 * x + cr_pos];
+				}
+			} else {
+				for (unsigned int x = 0; x < width_; x += 2) {
+					line_cb[x] = line_cb[x + 1] = src_cbcr[x + cb_pos];
+					line_cr[x] = line_cr[x + 1] = src_cbcr[x + cr_pos];
+				}
+			}
+
+			lines->chromaRow = c_row;
 		}
+
+		yuvToRgbLine(coeffs_, src + y * stride_, line_cb, line_cr,
+			     dst + y * width_ * 4, width_);
 	}
 }
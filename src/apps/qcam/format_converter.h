@@ -7,10 +7,16 @@
 
 #pragma once
 
+#include <condition_variable>
+#include <mutex>
 #include <stddef.h>
+#include <stdint.h>
+#include <thread>
+#include <vector>
 
 #include <QSize>
 
+#include <libcamera/color_space.h>
 #include <libcamera/pixel_format.h>
 
 class Image;
@@ -19,7 +25,11 @@ class QImage;
 class FormatConverter
 {
 public:
+	FormatConverter();
+	~FormatConverter();
+
 	int configure(const libcamera::PixelFormat &format, const QSize &size,
+		      const libcamera::ColorSpace &colorSpace,
 		      unsigned int stride);
 
 	void convert(const Image *src, size_t size, QImage *dst);
@@ -33,10 +43,50 @@ private:
 		YUVSemiPlanar,
 	};
 
-	void convertRGB(const Image *src, unsigned char *dst);
-	void convertYUVPacked(const Image *src, unsigned char *dst);
-	void convertYUVPlanar(const Image *src, unsigned char *dst);
-	void convertYUVSemiPlanar(const Image *src, unsigned char *dst);
+	/* Fixed-point YCbCr to RGB conversion coefficients. */
+	struct Coefficients {
+		static constexpr unsigned int kShift = 13;
+
+		int16_t y;
+		int16_t crR;
+		int16_t cbG;
+		int16_t crG;
+		int16_t cbB;
+		uint8_t yOffset;
+	};
+
+	/* Per-thread line buffers holding one row of Y, Cb and Cr samples. */
+	struct LineBuffers {
+		std::vector<uint8_t> y;
+		std::vector<uint8_t> cb;
+		std::vector<uint8_t> cr;
+		int chromaRow;
+	};
+
+	/* Minimum number of lines per band for parallel conversion. */
+	static constexpr unsigned int kMinBandHeight = 64;
+
+	void selectColorSpace(const libcamera::ColorSpace &colorSpace);
+	void configureBands();
+
+	void workerThread(unsigned int index);
+	void convertBand(unsigned int band, LineBuffers *lines);
+
+	void convertRGB(const unsigned char *src, unsigned char *dst,
+			unsigned int start, unsigned int end);
+	void convertYUVPacked(const unsigned char *src, unsigned char *dst,
+			      unsigned int start, unsigned int end,
+			      LineBuffers *lines);
+	void convertYUVPlanar(const Image *src, unsigned char *dst,
+			      unsigned int start, unsigned int end,
+			      LineBuffers *lines);
+	void convertYUVSemiPlanar(const Image *src, unsigned char *dst,
+				  unsigned int start, unsigned int end,
+				  LineBuffers *lines);
+
+	static void yuvToRgbLine(const Coefficients &coeffs, const uint8_t *y,
+				 const uint8_t *cb, const uint8_t *cr,
+				 uint8_t *dst, unsigned int width);
 
 	libcamera::PixelFormat format_;
 	unsigned int width_;
@@ -59,4 +109,24 @@ private:
 	/* YUV parameters */
 	unsigned int y_pos_;
 	unsigned int cb_pos_;
+	Coefficients coeffs_;
+
+	/*
+	 * Row-parallel conversion. The image is split in bands, processed by
+	 * the worker threads and the calling thread.
+	 */
+	unsigned int bandHeight_;
+	unsigned int numBands_;
+	std::vector<LineBuffers> lines_;
+
+	std::vector<std::thread> workers_;
+	std::mutex mutex_;
+	std::condition_variable cv_;
+	std::condition_variable doneCv_;
+	bool stop_;
+
+	const Image *src_;
+	unsigned char *dst_;
+	unsigned int nextBand_;
+	unsigned int pendingBands_;
 };
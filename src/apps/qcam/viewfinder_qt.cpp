@@ -55,7 +55,7 @@ const QList<libcamera::PixelFormat> &ViewFinderQt::nativeFormats() const
 }
 
 int ViewFinderQt::setFormat(const libcamera::PixelFormat &format, const QSize &size,
-			    [[maybe_unused]] const libcamera::ColorSpace &colorSpace,
+			    const libcamera::ColorSpace &colorSpace,
 			    unsigned int stride)
 {
 	image_ = QImage();
@@ -65,7 +65,7 @@ int ViewFinderQt::setFormat(const libcamera::PixelFormat &format, const QSize &s
 	 * the destination image.
 	 */
 	if (!::nativeFormats.contains(format)) {
-		int ret = converter_.configure(format, size, stride);
+		int ret = converter_.configure(format, size, colorSpace, stride);
 		if (ret < 0)
 			return ret;
 
@@ -189,14 +189,13 @@ gst_libcamera_allocator_class_init(GstLibcameraAllocatorClass *klass)
 
 GstLibcameraAllocator *
 gst_libcamera_allocator_new(std::shared_ptr<Camera> camera,
-			    CameraConfiguration *config_)
+			    const std::vector<Stream *> &streams)
 {
 	auto *self = GST_LIBCAMERA_ALLOCATOR(g_object_new(GST_TYPE_LIBCAMERA_ALLOCATOR,
 							  nullptr));
 
 	self->fb_allocator = new FrameBufferAllocator(camera);
-	for (StreamConfiguration &streamCfg : *config_) {
-		Stream *stream = streamCfg.stream();
+	for (Stream *stream : streams) {
 		gint ret;
 
 		ret = self->fb_allocator->allocate(stream);
@@ -256,5 +255,8 @@ gst_libcamera_memory_get_frame_buffer(GstMemory *mem)
 {
 	auto *frame = reinterpret_cast<FrameWrap *>(gst_mini_object_get_qdata(GST_MINI_OBJECT_CAST(mem),
 									      FrameWrap::getQuark()));
+	if (!frame)
+		return nullptr;
+
 	return frame->buffer_;
 }
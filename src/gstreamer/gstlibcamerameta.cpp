@@ -0,0 +1,141 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2022, Collabora Ltd.
+ *
+ * gstlibcamerameta.cpp - GStreamer Frame Metadata
+ */
+
+#include "gstlibcamerameta.h"
+
+#include <string.h>
+
+#include <libcamera/control_ids.h>
+
+using namespace libcamera;
+
+GType
+gst_libcamera_meta_api_get_type()
+{
+	static GType type = 0;
+	static const gchar *tags[] = { nullptr };
+
+	if (g_once_init_enter(&type)) {
+		GType api = gst_meta_api_type_register("GstLibcameraMetaAPI", tags);
+		g_once_init_leave(&type, api);
+	}
+
+	return type;
+}
+
+static gboolean
+gst_libcamera_meta_init(GstMeta *meta, [[maybe_unused]] gpointer params,
+			[[maybe_unused]] GstBuffer *buffer)
+{
+	auto *self = reinterpret_cast<GstLibcameraMeta *>(meta);
+
+	self->fields = 0;
+	self->sequence = 0;
+
+	return TRUE;
+}
+
+static gboolean
+gst_libcamera_meta_transform(GstBuffer *dest, GstMeta *meta,
+			     [[maybe_unused]] GstBuffer *buffer, GQuark type,
+			     [[maybe_unused]] gpointer data)
+{
+	auto *self = reinterpret_cast<GstLibcameraMeta *>(meta);
+
+	/* The metadata describes the whole frame, only copy it. */
+	if (!GST_META_TRANSFORM_IS_COPY(type))
+		return FALSE;
+
+	GstLibcameraMeta *copy = gst_buffer_add_libcamera_meta(dest);
+	if (!copy)
+		return FALSE;
+
+	memcpy(reinterpret_cast<guint8 *>(copy) + sizeof(GstMeta),
+	       reinterpret_cast<guint8 *>(self) + sizeof(GstMeta),
+	       sizeof(GstLibcameraMeta) - sizeof(GstMeta));
+
+	return TRUE;
+}
+
+const GstMetaInfo *
+gst_libcamera_meta_get_info()
+{
+	static const GstMetaInfo *info = nullptr;
+
+	if (g_once_init_enter(const_cast<GstMetaInfo **>(&info))) {
+		const GstMetaInfo *meta =
+			gst_meta_register(GST_LIBCAMERA_META_API_TYPE,
+					  "GstLibcameraMeta", sizeof(GstLibcameraMeta),
+					  gst_libcamera_meta_init, nullptr,
+					  gst_libcamera_meta_transform);
+		g_once_init_leave(const_cast<GstMetaInfo **>(&info),
+				  const_cast<GstMetaInfo *>(meta));
+	}
+
+	return info;
+}
+
+GstLibcameraMeta *
+gst_buffer_add_libcamera_meta(GstBuffer *buffer)
+{
+	return reinterpret_cast<GstLibcameraMeta *>(gst_buffer_add_meta(buffer, GST_LIBCAMERA_META_INFO,
+									 nullptr));
+}
+
+/*
+ * Fill the meta from the request metadata. The meta is meant to be attached
+ * once to pooled buffers and updated for every frame, which doesn't allocate
+ * memory.
+ */
+void
+gst_libcamera_meta_set_metadata(GstLibcameraMeta *meta, guint32 sequence,
+				const ControlList &metadata)
+{
+	meta->fields = 0;
+	meta->sequence = sequence;
+
+	if (auto value = metadata.get(controls::SensorTimestamp)) {
+		meta->sensor_timestamp = *value;
+		meta->fields |= GST_LIBCAMERA_META_SENSOR_TIMESTAMP;
+	}
+
+	if (auto value = metadata.get(controls::ExposureTime)) {
+		meta->exposure_time = *value;
+		meta->fields |= GST_LIBCAMERA_META_EXPOSURE_TIME;
+	}
+
+	if (auto value = metadata.get(controls::AnalogueGain)) {
+		meta->analogue_gain = *value;
+		meta->fields |= GST_LIBCAMERA_META_ANALOGUE_GAIN;
+	}
+
+	if (auto value = metadata.get(controls::DigitalGain)) {
+		meta->digital_gain = *value;
+		meta->fields |= GST_LIBCAMERA_META_DIGITAL_GAIN;
+	}
+
+	if (auto value = metadata.get(controls::ColourTemperature)) {
+		meta->colour_temperature = *value;
+		meta->fields |= GST_LIBCAMERA_META_COLOUR_TEMPERATURE;
+	}
+
+	if (auto value = metadata.get(controls::ColourGains)) {
+		meta->colour_gains[0] = (*value)[0];
+		meta->colour_gains[1] = (*value)[1];
+		meta->fields |= GST_LIBCAMERA_META_COLOUR_GAINS;
+	}
+
+	if (auto value = metadata.get(controls::FrameDuration)) {
+		meta->frame_duration = *value;
+		meta->fields |= GST_LIBCAMERA_META_FRAME_DURATION;
+	}
+
+	if (auto value = metadata.get(controls::Lux)) {
+		meta->lux = *value;
+		meta->fields |= GST_LIBCAMERA_META_LUX;
+	}
+}
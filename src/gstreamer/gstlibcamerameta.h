@@ -0,0 +1,63 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2022, Collabora Ltd.
+ *
+ * gstlibcamerameta.h - GStreamer Frame Metadata
+ */
+
+#pragma once
+
+#include <gst/gst.h>
+
+#include <libcamera/controls.h>
+
+#define GST_LIBCAMERA_META_API_TYPE gst_libcamera_meta_api_get_type()
+#define GST_LIBCAMERA_META_INFO gst_libcamera_meta_get_info()
+
+/* Fields of the GstLibcameraMeta reported by the camera for the frame. */
+typedef enum {
+	GST_LIBCAMERA_META_SENSOR_TIMESTAMP = (1 << 0),
+	GST_LIBCAMERA_META_EXPOSURE_TIME = (1 << 1),
+	GST_LIBCAMERA_META_ANALOGUE_GAIN = (1 << 2),
+	GST_LIBCAMERA_META_DIGITAL_GAIN = (1 << 3),
+	GST_LIBCAMERA_META_COLOUR_TEMPERATURE = (1 << 4),
+	GST_LIBCAMERA_META_COLOUR_GAINS = (1 << 5),
+	GST_LIBCAMERA_META_FRAME_DURATION = (1 << 6),
+	GST_LIBCAMERA_META_LUX = (1 << 7),
+} GstLibcameraMetaFields;
+
+typedef struct _GstLibcameraMeta GstLibcameraMeta;
+
+/*
+ * Snapshot of the libcamera metadata of a frame. The fields are only valid
+ * when the corresponding GstLibcameraMetaFields flag is set in fields. Times
+ * are expressed in microseconds, except for the sensor timestamp that is
+ * expressed in nanoseconds.
+ */
+struct _GstLibcameraMeta {
+	GstMeta meta;
+
+	guint fields;
+	guint32 sequence;
+
+	gint64 sensor_timestamp;
+	gint32 exposure_time;
+	gfloat analogue_gain;
+	gfloat digital_gain;
+	gint32 colour_temperature;
+	gfloat colour_gains[2];
+	gint64 frame_duration;
+	gfloat lux;
+};
+
+GType gst_libcamera_meta_api_get_type();
+
+const GstMetaInfo *gst_libcamera_meta_get_info();
+
+GstLibcameraMeta *gst_buffer_add_libcamera_meta(GstBuffer *buffer);
+
+#define gst_buffer_get_libcamera_meta(b) \
+	((GstLibcameraMeta *)gst_buffer_get_meta((b), GST_LIBCAMERA_META_API_TYPE))
+
+void gst_libcamera_meta_set_metadata(GstLibcameraMeta *meta, guint32 sequence,
+				     const libcamera::ControlList &metadata);
@@ -19,11 +19,25 @@ struct _GstLibcameraPad {
 	StreamRole role;
 	GstLibcameraPool *pool;
 	GstClockTime latency;
+
+	/* Buffers and events to push, protected by the object lock. */
+	GQueue queue;
+	guint queued_buffers;
+	GCond cond;
+	gboolean flushing;
+
+	/* Queue limit and statistics, protected by the object lock. */
+	guint max_buffers;
+	gboolean leaky;
+	guint64 processed;
+	guint64 dropped;
 };
 
 enum {
 	PROP_0,
-	PROP_STREAM_ROLE
+	PROP_STREAM_ROLE,
+	PROP_MAX_BUFFERS,
+	PROP_LEAKY
 };
 
 G_DEFINE_TYPE(GstLibcameraPad, gst_libcamera_pad, GST_TYPE_PAD)
@@ -39,6 +53,14 @@ gst_libcamera_pad_set_property(GObject *object, guint prop_id,
 	case PROP_STREAM_ROLE:
 		self->role = (StreamRole)g_value_get_enum(value);
 		break;
+	case PROP_MAX_BUFFERS:
+		self->max_buffers = g_value_get_uint(value);
+		g_cond_broadcast(&self->cond);
+		break;
+	case PROP_LEAKY:
+		self->leaky = g_value_get_boolean(value);
+		g_cond_broadcast(&self->cond);
+		break;
 	default:
 		G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
 		break;
@@ -56,6 +78,12 @@ gst_libcamera_pad_get_property(GObject *object, guint prop_id, GValue *value,
 	case PROP_STREAM_ROLE:
 		g_value_set_enum(value, static_cast<gint>(self->role));
 		break;
+	case PROP_MAX_BUFFERS:
+		g_value_set_uint(value, self->max_buffers);
+		break;
+	case PROP_LEAKY:
+		g_value_set_boolean(value, self->leaky);
+		break;
 	default:
 		G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
 		break;
@@ -76,10 +104,50 @@ gst_libcamera_pad_query(GstPad *pad, GstObject *parent, GstQuery *query)
 	return TRUE;
 }
 
+static void
+gst_libcamera_pad_clear_queue(GQueue *queue)
+{
+	gpointer item;
+
+	while ((item = g_queue_pop_head(queue)))
+		gst_mini_object_unref(GST_MINI_OBJECT(item));
+}
+
+static gboolean
+gst_libcamera_pad_activate_mode(GstPad *pad, [[maybe_unused]] GstObject *parent,
+				GstPadMode mode, gboolean active)
+{
+	if (mode != GST_PAD_MODE_PUSH)
+		return FALSE;
+
+	/* Wake up and stop the push task before deactivating the pad. */
+	gst_libcamera_pad_set_flushing(pad, !active);
+	if (!active)
+		return gst_pad_stop_task(pad);
+
+	return TRUE;
+}
+
 static void
 gst_libcamera_pad_init(GstLibcameraPad *self)
 {
 	GST_PAD_QUERYFUNC(self) = gst_libcamera_pad_query;
+	GST_PAD_ACTIVATEMODEFUNC(self) = gst_libcamera_pad_activate_mode;
+
+	g_queue_init(&self->queue);
+	g_cond_init(&self->cond);
+	self->flushing = TRUE;
+}
+
+static void
+gst_libcamera_pad_finalize(GObject *object)
+{
+	auto *self = GST_LIBCAMERA_PAD(object);
+
+	gst_libcamera_pad_clear_queue(&self->queue);
+	g_cond_clear(&self->cond);
+
+	G_OBJECT_CLASS(gst_libcamera_pad_parent_class)->finalize(object);
 }
 
 static GType
@@ -116,6 +184,7 @@ gst_libcamera_pad_class_init(GstLibcameraPadClass *klass)
 
 	object_class->set_property = gst_libcamera_pad_set_property;
 	object_class->get_property = gst_libcamera_pad_get_property;
+	object_class->finalize = gst_libcamera_pad_finalize;
 
 	auto *spec = g_param_spec_enum("stream-role", "Stream Role",
 				       "The selected stream role",
@@ -126,6 +195,25 @@ gst_libcamera_pad_class_init(GstLibcameraPadClass *klass)
 						     | G_PARAM_READWRITE
 						     | G_PARAM_STATIC_STRINGS));
 	g_object_class_install_property(object_class, PROP_STREAM_ROLE, spec);
+
+	spec = g_param_spec_uint("max-buffers", "Max Buffers",
+				 "Maximum number of buffers waiting to be pushed "
+				 "(0 = as many as buffers are available)",
+				 0, G_MAXUINT, 0,
+				 (GParamFlags)(GST_PARAM_MUTABLE_PLAYING
+					       | G_PARAM_READWRITE
+					       | G_PARAM_STATIC_STRINGS));
+	g_object_class_install_property(object_class, PROP_MAX_BUFFERS, spec);
+
+	spec = g_param_spec_boolean("leaky", "Leaky",
+				    "Drop the oldest buffer when max-buffers are "
+				    "waiting to be pushed, instead of blocking the "
+				    "capture until downstream catches up",
+				    FALSE,
+				    (GParamFlags)(GST_PARAM_MUTABLE_PLAYING
+						  | G_PARAM_READWRITE
+						  | G_PARAM_STATIC_STRINGS));
+	g_object_class_install_property(object_class, PROP_LEAKY, spec);
 }
 
 StreamRole
@@ -171,3 +259,150 @@ gst_libcamera_pad_set_latency(GstPad *pad, GstClockTime latency)
 	GLibLocker lock(GST_OBJECT(self));
 	self->latency = latency;
 }
+
+/*
+ * Queue a buffer to be pushed by the pad task. When max-buffers are already
+ * queued, either wait for the pad task to push one, or drop the oldest ones
+ * if the pad is leaky and post a QoS message. Return the number of buffers
+ * dropped.
+ */
+guint
+gst_libcamera_pad_queue_buffer(GstPad *pad, GstBuffer *buffer)
+{
+	auto *self = GST_LIBCAMERA_PAD(pad);
+	GQueue dropped = G_QUEUE_INIT;
+	GstMessage *qos = nullptr;
+	guint overflow = 0;
+
+	{
+		GLibLocker lock(GST_OBJECT(self));
+
+		/* Apply back-pressure until the pad task catches up. */
+		while (!self->flushing && !self->leaky && self->max_buffers &&
+		       self->queued_buffers >= self->max_buffers)
+			g_cond_wait(&self->cond, GST_OBJECT_GET_LOCK(self));
+
+		if (self->flushing) {
+			g_queue_push_tail(&dropped, buffer);
+		} else {
+			GList *item = self->queue.head;
+
+			while (self->max_buffers && item &&
+			       self->queued_buffers >= self->max_buffers) {
+				GList *next = item->next;
+
+				if (GST_IS_BUFFER(item->data)) {
+					g_queue_push_tail(&dropped, item->data);
+					g_queue_delete_link(&self->queue, item);
+					self->queued_buffers--;
+					overflow++;
+				}
+
+				item = next;
+			}
+
+			g_queue_push_tail(&self->queue, buffer);
+			self->queued_buffers++;
+			g_cond_broadcast(&self->cond);
+
+			self->processed += overflow + 1;
+			self->dropped += overflow;
+
+			if (overflow) {
+				auto *last = GST_BUFFER(g_queue_peek_tail(&dropped));
+
+				qos = gst_message_new_qos(GST_OBJECT(self), TRUE,
+							  GST_CLOCK_TIME_NONE,
+							  GST_CLOCK_TIME_NONE,
+							  GST_BUFFER_PTS(last),
+							  GST_BUFFER_DURATION(last));
+				gst_message_set_qos_stats(qos, GST_FORMAT_BUFFERS,
+							  self->processed,
+							  self->dropped);
+			}
+		}
+	}
+
+	/* Release the buffers outside of the lock, they return to the pool. */
+	gst_libcamera_pad_clear_queue(&dropped);
+
+	if (qos) {
+		GstObject *parent = gst_pad_get_parent(pad);
+
+		if (parent) {
+			gst_element_post_message(GST_ELEMENT(parent), qos);
+			gst_object_unref(parent);
+		} else {
+			gst_message_unref(qos);
+		}
+	}
+
+	return overflow;
+}
+
+void
+gst_libcamera_pad_queue_event(GstPad *pad, GstEvent *event)
+{
+	auto *self = GST_LIBCAMERA_PAD(pad);
+
+	{
+		GLibLocker lock(GST_OBJECT(self));
+
+		if (!self->flushing) {
+			g_queue_push_tail(&self->queue, event);
+			g_cond_broadcast(&self->cond);
+			return;
+		}
+	}
+
+	gst_event_unref(event);
+}
+
+/*
+ * Wait for the next buffer or event to push. Return nullptr when the pad is
+ * flushing.
+ */
+GstMiniObject *
+gst_libcamera_pad_dequeue(GstPad *pad)
+{
+	auto *self = GST_LIBCAMERA_PAD(pad);
+	GLibLocker lock(GST_OBJECT(self));
+
+	while (!self->flushing && g_queue_is_empty(&self->queue))
+		g_cond_wait(&self->cond, GST_OBJECT_GET_LOCK(self));
+
+	if (self->flushing)
+		return nullptr;
+
+	auto *item = GST_MINI_OBJECT(g_queue_pop_head(&self->queue));
+	if (GST_IS_BUFFER(item)) {
+		self->queued_buffers--;
+		g_cond_broadcast(&self->cond);
+	}
+
+	return item;
+}
+
+void
+gst_libcamera_pad_set_flushing(GstPad *pad, bool flushing)
+{
+	auto *self = GST_LIBCAMERA_PAD(pad);
+	GQueue queue = G_QUEUE_INIT;
+
+	{
+		GLibLocker lock(GST_OBJECT(self));
+
+		self->flushing = flushing;
+		if (flushing) {
+			queue = self->queue;
+			g_queue_init(&self->queue);
+			self->queued_buffers = 0;
+			g_cond_broadcast(&self->cond);
+		} else {
+			self->processed = 0;
+			self->dropped = 0;
+		}
+	}
+
+	gst_libcamera_pad_clear_queue(&queue);
+}
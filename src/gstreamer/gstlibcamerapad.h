@@ -26,3 +26,11 @@ void gst_libcamera_pad_set_pool(GstPad *pad, GstLibcameraPool *pool);
 libcamera::Stream *gst_libcamera_pad_get_stream(GstPad *pad);
 
 void gst_libcamera_pad_set_latency(GstPad *pad, GstClockTime latency);
+
+guint gst_libcamera_pad_queue_buffer(GstPad *pad, GstBuffer *buffer);
+
+void gst_libcamera_pad_queue_event(GstPad *pad, GstEvent *event);
+
+GstMiniObject *gst_libcamera_pad_dequeue(GstPad *pad);
+
+void gst_libcamera_pad_set_flushing(GstPad *pad, bool flushing);
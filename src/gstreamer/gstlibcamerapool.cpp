@@ -8,8 +8,15 @@
 
 #include "gstlibcamerapool.h"
 
+#include <vector>
+
+#include <libcamera/base/shared_fd.h>
+
+#include <libcamera/framebuffer.h>
 #include <libcamera/stream.h>
 
+#include "libcamera/internal/formats.h"
+
 #include "gstlibcamera-utils.h"
 
 using namespace libcamera;
@@ -27,6 +34,16 @@ struct _GstLibcameraPool {
 	GstAtomicQueue *queue;
 	GstLibcameraAllocator *allocator;
 	Stream *stream;
+
+	/*
+	 * Downstream pool whose buffers are imported, with the default layout
+	 * of its buffers and the plane strides and sizes required by libcamera.
+	 */
+	GstBufferPool *downstream;
+	GstVideoInfo info;
+	guint n_planes;
+	gint strides[GST_VIDEO_MAX_PLANES];
+	gsize sizes[GST_VIDEO_MAX_PLANES];
 };
 
 G_DEFINE_TYPE(GstLibcameraPool, gst_libcamera_pool, GST_TYPE_BUFFER_POOL)
@@ -88,7 +105,14 @@ gst_libcamera_pool_finalize(GObject *object)
 		gst_buffer_unref(buf);
 
 	gst_atomic_queue_unref(self->queue);
-	g_object_unref(self->allocator);
+
+	if (self->downstream) {
+		gst_buffer_pool_set_active(self->downstream, FALSE);
+		gst_object_unref(self->downstream);
+	}
+
+	if (self->allocator)
+		g_object_unref(self->allocator);
 
 	G_OBJECT_CLASS(gst_libcamera_pool_parent_class)->finalize(object);
 }
@@ -128,6 +152,166 @@ gst_libcamera_pool_new(GstLibcameraAllocator *allocator, Stream *stream)
 	return pool;
 }
 
+static GQuark
+gst_libcamera_pool_import_quark()
+{
+	static gsize import_quark = 0;
+
+	if (g_once_init_enter(&import_quark)) {
+		GQuark quark = g_quark_from_string("GstLibcameraImportedFrameBuffer");
+		g_once_init_leave(&import_quark, quark);
+	}
+
+	return import_quark;
+}
+
+/*
+ * Wrap the dmabufs of a downstream buffer in a FrameBuffer. The FrameBuffer is
+ * attached to the first memory of the buffer and reused for as long as the
+ * memory lives, to let the pipeline handler map it to the same V4L2 buffer.
+ */
+static FrameBuffer *
+gst_libcamera_pool_import_buffer(GstLibcameraPool *self, GstBuffer *buffer)
+{
+	GstMemory *first = gst_buffer_peek_memory(buffer, 0);
+	if (!first)
+		return nullptr;
+
+	auto *fb = reinterpret_cast<FrameBuffer *>(gst_mini_object_get_qdata(GST_MINI_OBJECT_CAST(first),
+									     gst_libcamera_pool_import_quark()));
+	if (fb)
+		return fb;
+
+	GstVideoMeta *meta = gst_buffer_get_video_meta(buffer);
+	std::vector<FrameBuffer::Plane> planes;
+
+	for (guint i = 0; i < self->n_planes; i++) {
+		gsize offset = meta ? meta->offset[i]
+				    : GST_VIDEO_INFO_PLANE_OFFSET(&self->info, i);
+		gint stride = meta ? meta->stride[i]
+				   : GST_VIDEO_INFO_PLANE_STRIDE(&self->info, i);
+
+		if (stride != self->strides[i]) {
+			GST_DEBUG_OBJECT(self, "Plane %u stride %d doesn't match %d",
+					 i, stride, self->strides[i]);
+			return nullptr;
+		}
+
+		guint idx, length;
+		gsize skip;
+		if (!gst_buffer_find_memory(buffer, offset, self->sizes[i],
+					    &idx, &length, &skip) || length != 1) {
+			GST_DEBUG_OBJECT(self, "Plane %u isn't in a single memory", i);
+			return nullptr;
+		}
+
+		GstMemory *mem = gst_buffer_peek_memory(buffer, idx);
+		if (!gst_is_dmabuf_memory(mem)) {
+			GST_DEBUG_OBJECT(self, "Plane %u isn't a dmabuf", i);
+			return nullptr;
+		}
+
+		/* Duplicate the file descriptor, it is owned by the memory. */
+		const int fd = gst_dmabuf_memory_get_fd(mem);
+
+		FrameBuffer::Plane plane;
+		plane.fd = SharedFD(fd);
+		plane.offset = mem->offset + skip;
+		plane.length = self->sizes[i];
+		planes.push_back(std::move(plane));
+	}
+
+	fb = new FrameBuffer(planes);
+	gst_mini_object_set_qdata(GST_MINI_OBJECT_CAST(first),
+				  gst_libcamera_pool_import_quark(), fb,
+				  [](gpointer data) { delete reinterpret_cast<FrameBuffer *>(data); });
+
+	return fb;
+}
+
+GstLibcameraPool *
+gst_libcamera_pool_new_import(GstBufferPool *downstream,
+			      const StreamConfiguration &cfg,
+			      const GstVideoInfo *info)
+{
+	const PixelFormatInfo &formatInfo = PixelFormatInfo::info(cfg.pixelFormat);
+	if (!formatInfo.isValid() ||
+	    formatInfo.numPlanes() != GST_VIDEO_INFO_N_PLANES(info))
+		return nullptr;
+
+	auto *pool = GST_LIBCAMERA_POOL(g_object_new(GST_TYPE_LIBCAMERA_POOL, nullptr));
+
+	pool->downstream = GST_BUFFER_POOL(gst_object_ref(downstream));
+	pool->stream = cfg.stream();
+	pool->info = *info;
+	pool->n_planes = formatInfo.numPlanes();
+
+	/*
+	 * Compute the layout libcamera expects, with the stride of the planes
+	 * other than the first one derived from the horizontal subsampling.
+	 */
+	for (guint i = 0; i < pool->n_planes; i++) {
+		pool->strides[i] = cfg.stride * formatInfo.planes[i].bytesPerGroup
+				 / formatInfo.planes[0].bytesPerGroup;
+		pool->sizes[i] = formatInfo.planeSize(cfg.size.height, i,
+						      pool->strides[i]);
+	}
+
+	/* Check that the downstream buffers can be imported. */
+	GstBuffer *buffer;
+	GstBufferPoolAcquireParams params = {};
+	params.flags = GST_BUFFER_POOL_ACQUIRE_FLAG_DONTWAIT;
+
+	if (gst_buffer_pool_acquire_buffer(downstream, &buffer, &params) != GST_FLOW_OK) {
+		g_object_unref(pool);
+		return nullptr;
+	}
+
+	FrameBuffer *fb = gst_libcamera_pool_import_buffer(pool, buffer);
+	gst_buffer_unref(buffer);
+
+	if (!fb) {
+		g_object_unref(pool);
+		return nullptr;
+	}
+
+	return pool;
+}
+
+/*
+ * Acquire a buffer for the stream. Buffers from a downstream pool are acquired
+ * without blocking unless \a wait is true, as the task isn't notified when
+ * downstream releases them.
+ */
+GstFlowReturn
+gst_libcamera_pool_acquire(GstLibcameraPool *self, GstBuffer **buffer, bool wait)
+{
+	if (!self->downstream)
+		return gst_buffer_pool_acquire_buffer(GST_BUFFER_POOL(self), buffer, nullptr);
+
+	GstBufferPoolAcquireParams params = {};
+	if (!wait)
+		params.flags = GST_BUFFER_POOL_ACQUIRE_FLAG_DONTWAIT;
+
+	GstFlowReturn ret = gst_buffer_pool_acquire_buffer(self->downstream, buffer, &params);
+	if (ret != GST_FLOW_OK)
+		return ret;
+
+	if (!gst_libcamera_pool_import_buffer(self, *buffer)) {
+		GST_ERROR_OBJECT(self, "Failed to import downstream buffer");
+		gst_buffer_unref(*buffer);
+		return GST_FLOW_ERROR;
+	}
+
+	return GST_FLOW_OK;
+}
+
+GstBufferPool *
+gst_libcamera_pool_get_downstream(GstLibcameraPool *self)
+{
+	return self->downstream;
+}
+
 Stream *
 gst_libcamera_pool_get_stream(GstLibcameraPool *self)
 {
@@ -138,5 +322,10 @@ FrameBuffer *
 gst_libcamera_buffer_get_frame_buffer(GstBuffer *buffer)
 {
 	GstMemory *mem = gst_buffer_peek_memory(buffer, 0);
-	return gst_libcamera_memory_get_frame_buffer(mem);
+	FrameBuffer *fb = gst_libcamera_memory_get_frame_buffer(mem);
+	if (fb)
+		return fb;
+
+	return reinterpret_cast<FrameBuffer *>(gst_mini_object_get_qdata(GST_MINI_OBJECT_CAST(mem),
+									 gst_libcamera_pool_import_quark()));
 }
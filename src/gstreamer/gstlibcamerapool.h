@@ -7,6 +7,9 @@
  *
  * This is a partial implementation of GstBufferPool intended for internal use
  * only. This pool cannot be configured or activated.
+ *
+ * The pool either provides buffers allocated by libcamera, or imports the
+ * dmabuf buffers of a downstream pool as libcamera frame buffers.
  */
 
 #pragma once
@@ -14,6 +17,7 @@
 #include "gstlibcameraallocator.h"
 
 #include <gst/gst.h>
+#include <gst/video/video.h>
 
 #include <libcamera/stream.h>
 
@@ -23,6 +27,15 @@ G_DECLARE_FINAL_TYPE(GstLibcameraPool, gst_libcamera_pool, GST_LIBCAMERA, POOL,
 GstLibcameraPool *gst_libcamera_pool_new(GstLibcameraAllocator *allocator,
 					 libcamera::Stream *stream);
 
+GstLibcameraPool *gst_libcamera_pool_new_import(GstBufferPool *downstream,
+						const libcamera::StreamConfiguration &cfg,
+						const GstVideoInfo *info);
+
+GstFlowReturn gst_libcamera_pool_acquire(GstLibcameraPool *self,
+					 GstBuffer **buffer, bool wait);
+
+GstBufferPool *gst_libcamera_pool_get_downstream(GstLibcameraPool *self);
+
 libcamera::Stream *gst_libcamera_pool_get_stream(GstLibcameraPool *self);
 
 libcamera::FrameBuffer *gst_libcamera_buffer_get_frame_buffer(GstBuffer *buffer);
@@ -14,10 +14,8 @@
  *    + Prevent the main thread from accessing streaming thread
  *  - Implement renegotiation (even if slow)
  *  - Implement GstElement::request-new-pad (multi stream)
- *    + Evaluate if a single streaming thread is fine
  *  - Add application driven request (snapshot)
  *  - Add framerate control
- *  - Add buffer importation support
  *
  *  Requires new libcamera API:
  *  - Add framerate negotiation support
@@ -29,6 +27,10 @@
 
 #include "gstlibcamerasrc.h"
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <optional>
 #include <queue>
 #include <vector>
 
@@ -41,6 +43,7 @@
 #include <gst/base/base.h>
 
 #include "gstlibcameraallocator.h"
+#include "gstlibcamerameta.h"
 #include "gstlibcamerapad.h"
 #include "gstlibcamerapool.h"
 #include "gstlibcamera-utils.h"
@@ -105,6 +108,22 @@ GstBuffer *RequestWrap::detachBuffer(Stream *stream)
 	return buffer;
 }
 
+/*
+ * Controls exposed as element properties, in the order of the corresponding
+ * PROP_* identifiers starting at PROP_AE_ENABLE.
+ */
+static const ControlId *const controlProperties[] = {
+	&controls::AeEnable,
+	&controls::ExposureTime,
+	&controls::AnalogueGain,
+	&controls::ExposureValue,
+	&controls::AwbEnable,
+	&controls::Brightness,
+	&controls::Contrast,
+	&controls::Saturation,
+	&controls::Sharpness,
+};
+
 /* Used for C++ object with destructors. */
 struct GstLibcameraSrcState {
 	GstLibcameraSrc *src_;
@@ -130,10 +149,30 @@ struct GstLibcameraSrcState {
 		LIBCAMERA_TSA_GUARDED_BY(lock_);
 	std::queue<std::unique_ptr<RequestWrap>> completedRequests_
 		LIBCAMERA_TSA_GUARDED_BY(lock_);
+	std::vector<GstBufferPool *> downstreamPools_
+		LIBCAMERA_TSA_GUARDED_BY(lock_);
 
 	ControlList initControls_;
 	guint group_id_;
 
+	/* Statistics, reset when streaming starts. */
+	std::optional<uint32_t> sequence_;
+	std::atomic<guint> droppedFrames_;
+	std::atomic<guint> droppedBuffers_;
+
+	/*
+	 * Values of the controls set through element properties, protected by
+	 * the object lock. Controls marked as dirty are set in the next queued
+	 * request, avoiding the construction of a separate ControlList.
+	 */
+	std::array<ControlValue, std::size(controlProperties)> controls_;
+	uint32_t controlsSet_;
+	uint32_t controlsDirty_;
+
+	void setControl(unsigned int index, const GValue *value);
+	bool getControl(unsigned int index, GValue *value);
+	void applyControls(ControlList &controls, uint32_t mask);
+
 	int queueRequest();
 	void requestCompleted(Request *request);
 	int processRequest();
@@ -145,7 +184,9 @@ struct _GstLibcameraSrc {
 	GRecMutex stream_lock;
 	GstTask *task;
 
+	/* Protected by the object lock. */
 	gchar *camera_name;
+	guint queue_depth;
 
 	GstLibcameraSrcState *state;
 	GstLibcameraAllocator *allocator;
@@ -154,7 +195,20 @@ struct _GstLibcameraSrc {
 
 enum {
 	PROP_0,
-	PROP_CAMERA_NAME
+	PROP_CAMERA_NAME,
+	PROP_QUEUE_DEPTH,
+	PROP_REQUESTS_IN_FLIGHT,
+	PROP_DROPPED_FRAMES,
+	PROP_DROPPED_BUFFERS,
+	PROP_AE_ENABLE,
+	PROP_EXPOSURE_TIME,
+	PROP_ANALOGUE_GAIN,
+	PROP_EXPOSURE_VALUE,
+	PROP_AWB_ENABLE,
+	PROP_BRIGHTNESS,
+	PROP_CONTRAST,
+	PROP_SATURATION,
+	PROP_SHARPNESS,
 };
 
 G_DEFINE_TYPE_WITH_CODE(GstLibcameraSrc, gst_libcamera_src, GST_TYPE_ELEMENT,
@@ -173,9 +227,109 @@ GstStaticPadTemplate request_src_template = {
 	"src_%u", GST_PAD_SRC, GST_PAD_REQUEST, TEMPLATE_CAPS
 };
 
+/* Must be called with the object lock held. */
+void GstLibcameraSrcState::setControl(unsigned int index, const GValue *value)
+{
+	const ControlId *id = controlProperties[index];
+
+	switch (id->type()) {
+	case ControlTypeBool:
+		controls_[index] = static_cast<bool>(g_value_get_boolean(value));
+		break;
+	case ControlTypeInteger32:
+		controls_[index] = static_cast<int32_t>(g_value_get_int(value));
+		break;
+	case ControlTypeFloat:
+		controls_[index] = g_value_get_float(value);
+		break;
+	default:
+		g_return_if_reached();
+	}
+
+	controlsSet_ |= 1 << index;
+	controlsDirty_ |= 1 << index;
+}
+
+/*
+ * Retrieve the value of a control set through a property. Return false if the
+ * control has never been set. Must be called with the object lock held.
+ */
+bool GstLibcameraSrcState::getControl(unsigned int index, GValue *value)
+{
+	if (!(controlsSet_ & (1 << index)))
+		return false;
+
+	const ControlValue &control = controls_[index];
+
+	switch (control.type()) {
+	case ControlTypeBool:
+		g_value_set_boolean(value, control.get<bool>());
+		break;
+	case ControlTypeInteger32:
+		g_value_set_int(value, control.get<int32_t>());
+		break;
+	case ControlTypeFloat:
+		g_value_set_float(value, control.get<float>());
+		break;
+	default:
+		return false;
+	}
+
+	return true;
+}
+
+/*
+ * Copy the controls selected by \a mask to \a controls and clear their dirty
+ * flag. Controls not supported by the camera are skipped. Must be called with
+ * the object lock held.
+ */
+void GstLibcameraSrcState::applyControls(ControlList &controls, uint32_t mask)
+{
+	const ControlInfoMap &info = cam_->controls();
+
+	for (unsigned int i = 0; i < controls_.size(); ++i) {
+		if (!(mask & (1 << i)))
+			continue;
+
+		const ControlId *id = controlProperties[i];
+		if (info.find(id) == info.end()) {
+			GST_WARNING_OBJECT(src_, "Control '%s' not supported by the camera",
+					   id->name().c_str());
+			continue;
+		}
+
+		controls.set(id->id(), controls_[i]);
+	}
+
+	controlsDirty_ &= ~mask;
+}
+
 /* Must be called with stream_lock held. */
 int GstLibcameraSrcState::queueRequest()
 {
+	guint depth;
+	{
+		GLibLocker locker(GST_OBJECT(src_));
+		depth = src_->queue_depth;
+	}
+
+	/*
+	 * The task isn't notified when downstream pools get buffers back. Wait
+	 * for a buffer when no request is in flight or completed, as nothing
+	 * else would resume the task. The wait is interrupted by flushing the
+	 * pool. Otherwise, return -EAGAIN to let the task run again once the
+	 * completed requests have been handed over.
+	 */
+	bool wait;
+	{
+		MutexLocker locker(lock_);
+
+		if (depth && queuedRequests_.size() >= depth)
+			return -ENOBUFS;
+
+		wait = queuedRequests_.empty() && completedRequests_.empty();
+	}
+
 	std::unique_ptr<Request> request = cam_->createRequest();
 	if (!request)
 		return -ENOMEM;
@@ -189,19 +343,27 @@ int GstLibcameraSrcState::queueRequest()
 		GstBuffer *buffer;
 		GstFlowReturn ret;
 
-		ret = gst_buffer_pool_acquire_buffer(GST_BUFFER_POOL(pool),
-						     &buffer, nullptr);
+		ret = gst_libcamera_pool_acquire(pool, &buffer, wait);
 		if (ret != GST_FLOW_OK) {
 			/*
 			 * RequestWrap has ownership of the request, and we
 			 * won't be queueing this one due to lack of buffers.
 			 */
+			if (!wait && gst_libcamera_pool_get_downstream(pool))
+				return -EAGAIN;
+
 			return -ENOBUFS;
 		}
 
 		wrap->attachBuffer(stream, buffer);
 	}
 
+	{
+		GLibLocker locker(GST_OBJECT(src_));
+		if (controlsDirty_)
+			applyControls(wrap->request_->controls(), controlsDirty_);
+	}
+
 	GST_TRACE_OBJECT(src_, "Requesting buffers");
 	cam_->queueRequest(wrap->request_.get());
 
@@ -256,29 +418,25 @@ GstLibcameraSrcState::requestCompleted(Request *request)
 	gst_task_resume(src_->task);
 }
 
-/* Must be called with stream_lock held. */
+/*
+ * Hand the buffers of one completed request over to the pad tasks. Return 0 if
+ * a request has been processed, or -ENOBUFS if no request has completed.
+ *
+ * Must be called with stream_lock held.
+ */
 int GstLibcameraSrcState::processRequest()
 {
 	std::unique_ptr<RequestWrap> wrap;
-	int err = 0;
 
 	{
 		MutexLocker locker(lock_);
 
-		if (!completedRequests_.empty()) {
-			wrap = std::move(completedRequests_.front());
-			completedRequests_.pop();
-		}
-
 		if (completedRequests_.empty())
-			err = -ENOBUFS;
-	}
-
-	if (!wrap)
-		return -ENOBUFS;
+			return -ENOBUFS;
 
-	GstFlowReturn ret = GST_FLOW_OK;
-	gst_flow_combiner_reset(src_->flow_combiner);
+		wrap = std::move(completedRequests_.front());
+		completedRequests_.pop();
+	}
 
 	for (GstPad *srcpad : srcpads_) {
 		Stream *stream = gst_libcamera_pad_get_stream(srcpad);
@@ -286,6 +444,15 @@ int GstLibcameraSrcState::processRequest()
 
 		FrameBuffer *fb = gst_libcamera_buffer_get_frame_buffer(buffer);
 
+		/* Count the frames dropped by the camera from sequence gaps. */
+		if (srcpad == srcpads_.front()) {
+			uint32_t sequence = fb->metadata().sequence;
+
+			if (sequence_ && sequence > *sequence_ + 1)
+				droppedFrames_ += sequence - *sequence_ - 1;
+			sequence_ = sequence;
+		}
+
 		if (GST_CLOCK_TIME_IS_VALID(wrap->pts_)) {
 			GST_BUFFER_PTS(buffer) = wrap->pts_;
 			gst_libcamera_pad_set_latency(srcpad, wrap->latency_);
@@ -296,26 +463,23 @@ int GstLibcameraSrcState::processRequest()
 		GST_BUFFER_OFFSET(buffer) = fb->metadata().sequence;
 		GST_BUFFER_OFFSET_END(buffer) = fb->metadata().sequence;
 
-		ret = gst_pad_push(srcpad, buffer);
-		ret = gst_flow_combiner_update_pad_flow(src_->flow_combiner,
-							srcpad, ret);
-	}
-
-	if (ret != GST_FLOW_OK) {
-		if (ret == GST_FLOW_EOS) {
-			g_autoptr(GstEvent) eos = gst_event_new_eos();
-			guint32 seqnum = gst_util_seqnum_next();
-			gst_event_set_seqnum(eos, seqnum);
-			for (GstPad *srcpad : srcpads_)
-				gst_pad_push_event(srcpad, gst_event_ref(eos));
-		} else if (ret != GST_FLOW_FLUSHING) {
-			GST_ELEMENT_FLOW_ERROR(src_, ret);
+		/*
+		 * Buffers come from pools, attach the metadata once as a pooled
+		 * meta and update it in place for every frame.
+		 */
+		GstLibcameraMeta *meta = gst_buffer_get_libcamera_meta(buffer);
+		if (!meta) {
+			meta = gst_buffer_add_libcamera_meta(buffer);
+			GST_META_FLAG_SET(meta, GST_META_FLAG_POOLED);
 		}
 
-		return -EPIPE;
+		gst_libcamera_meta_set_metadata(meta, fb->metadata().sequence,
+						wrap->request_->metadata());
+
+		droppedBuffers_ += gst_libcamera_pad_queue_buffer(srcpad, buffer);
 	}
 
-	return err;
+	return 0;
 }
 
 static bool
@@ -386,71 +550,191 @@ gst_libcamera_src_task_run(gpointer user_data)
 	GstLibcameraSrcState *state = self->state;
 
 	/*
-	 * Start by pausing the task. The task may also get resumed by the
-	 * buffer-notify signal when new buffers are queued back to the pool,
-	 * or by the request completion handler when a new request has
-	 * completed.  Both will resume the task after adding the buffers or
-	 * request to their respective lists, which are checked below to decide
-	 * if the task needs to be resumed for another iteration. This is thus
+	 * Start by pausing the task. The task gets resumed by the buffer-notify
+	 * signal when new buffers are queued back to the pool, or by the
+	 * request completion handler when a new request has completed. Both
+	 * will resume the task after adding the buffers or request to their
+	 * respective lists, which are all consumed below. This is thus
 	 * guaranteed to be race-free, the lock taken by gst_task_pause() and
 	 * gst_task_resume() serves as a memory barrier.
 	 */
 	gst_task_pause(self->task);
 
-	bool doResume = false;
-
 	/*
-	 * Create and queue one request. If no buffers are available the
-	 * function returns -ENOBUFS, which we ignore here as that's not a
-	 * fatal error.
+	 * Keep the camera fed by queuing requests until the queue depth is
+	 * reached or no more buffers are available, in which case the function
+	 * returns -ENOBUFS, or -EAGAIN for downstream pools. That's not a fatal
+	 * error.
 	 */
-	int ret = state->queueRequest();
-	switch (ret) {
-	case 0:
-		/*
-		 * The request was successfully queued, there may be enough
-		 * buffers to create a new one. Don't pause the task to give it
-		 * another try.
-		 */
-		doResume = true;
-		break;
+	int ret;
+	while (!(ret = state->queueRequest()));
 
-	case -ENOMEM:
+	if (ret == -ENOMEM) {
 		GST_ELEMENT_ERROR(self, RESOURCE, NO_SPACE_LEFT,
 				  ("Failed to allocate request for camera '%s'.",
 				   state->cam_->id().c_str()),
 				  ("libcamera::Camera::createRequest() failed"));
 		gst_task_stop(self->task);
 		return;
-
-	case -ENOBUFS:
-	default:
-		break;
 	}
 
 	/*
-	 * Process one completed request, if available, and record if further
-	 * requests are ready for processing.
+	 * Hand all completed requests over to the pad tasks. Buffers are
+	 * pushed downstream by one task per pad, so that a slow branch doesn't
+	 * stall the others or the camera.
 	 */
-	ret = state->processRequest();
-	switch (ret) {
-	case 0:
-		/* Another completed request is available, resume the task. */
-		doResume = true;
-		break;
+	while (!state->processRequest());
 
-	case -EPIPE:
-		gst_task_stop(self->task);
+	/*
+	 * If a downstream pool had no buffer available and the last request in
+	 * flight has just completed, nothing would resume the task. Run it
+	 * again to wait for a downstream buffer.
+	 */
+	if (ret == -EAGAIN) {
+		MutexLocker locker(state->lock_);
+		if (state->queuedRequests_.empty())
+			gst_task_resume(self->task);
+	}
+}
+
+static gboolean
+gst_libcamera_src_queue_eos([[maybe_unused]] GstElement *element, GstPad *pad,
+			    gpointer user_data)
+{
+	gst_libcamera_pad_queue_event(pad, gst_event_ref(GST_EVENT(user_data)));
+	return TRUE;
+}
+
+static void
+gst_libcamera_src_pad_task_run(gpointer user_data)
+{
+	GstPad *srcpad = GST_PAD(user_data);
+	GstLibcameraSrc *self = GST_LIBCAMERA_SRC(GST_PAD_PARENT(srcpad));
+
+	GstMiniObject *item = gst_libcamera_pad_dequeue(srcpad);
+	if (!item) {
+		gst_pad_pause_task(srcpad);
 		return;
+	}
 
-	case -ENOBUFS:
-	default:
-		break;
+	if (GST_IS_EVENT(item)) {
+		GstEvent *event = GST_EVENT(item);
+		bool eos = GST_EVENT_TYPE(event) == GST_EVENT_EOS;
+
+		gst_pad_push_event(srcpad, event);
+		if (eos)
+			gst_pad_pause_task(srcpad);
+		return;
+	}
+
+	GstFlowReturn ret = gst_pad_push(srcpad, GST_BUFFER(item));
+
+	{
+		GLibLocker lock(GST_OBJECT(self));
+		if (self->flow_combiner)
+			ret = gst_flow_combiner_update_pad_flow(self->flow_combiner,
+								srcpad, ret);
+	}
+
+	if (ret == GST_FLOW_OK)
+		return;
+
+	/*
+	 * Stop capturing. On EOS, queue the event on all pads behind the
+	 * pending buffers. The pad tasks stop after pushing it.
+	 */
+	if (ret == GST_FLOW_EOS) {
+		g_autoptr(GstEvent) eos = gst_event_new_eos();
+		guint32 seqnum = gst_util_seqnum_next();
+		gst_event_set_seqnum(eos, seqnum);
+		gst_element_foreach_src_pad(GST_ELEMENT(self),
+					    gst_libcamera_src_queue_eos, eos);
+	} else {
+		if (ret != GST_FLOW_FLUSHING)
+			GST_ELEMENT_FLOW_ERROR(self, ret);
+		gst_pad_pause_task(srcpad);
 	}
 
-	/* Resume the task for another iteration if needed. */
-	if (doResume)
-		gst_task_resume(self->task);
+	gst_task_stop(self->task);
+}
+
+/*
+ * Propose the stream caps to downstream through an allocation query, and
+ * import the buffers of the first proposed pool whose buffers are dmabufs with
+ * the layout required by libcamera.
+ */
+static GstLibcameraPool *
+gst_libcamera_src_import_pool(GstLibcameraSrc *self, GstPad *srcpad,
+			      const StreamConfiguration &stream_cfg)
+{
+	g_autoptr(GstCaps) caps = gst_pad_get_current_caps(srcpad);
+	GstVideoInfo info;
+
+	if (!caps || !gst_video_info_from_caps(&info, caps))
+		return nullptr;
+
+	g_autoptr(GstQuery) query = gst_query_new_allocation(caps, TRUE);
+	if (!gst_pad_peer_query(srcpad, query))
+		return nullptr;
+
+	for (guint i = 0; i < gst_query_get_n_allocation_pools(query); i++) {
+		g_autoptr(GstBufferPool) pool = nullptr;
+		GstVideoInfo pool_info = info;
+		guint size, min, max;
+
+		gst_query_parse_nth_allocation_pool(query, i, &pool, &size, &min, &max);
+		if (!pool)
+			continue;
+
+		min = std::max(min, stream_cfg.bufferCount);
+		if (max && max < min)
+			continue;
+
+		GstStructure *config = gst_buffer_pool_get_config(pool);
+
+		if (gst_buffer_pool_has_option(pool, GST_BUFFER_POOL_OPTION_VIDEO_META))
+			gst_buffer_pool_config_add_option(config, GST_BUFFER_POOL_OPTION_VIDEO_META);
+
+		/* Pad the lines to the stride of the stream if possible. */
+		gint pstride = GST_VIDEO_INFO_COMP_PSTRIDE(&pool_info, 0);
+		gint stride = GST_VIDEO_INFO_PLANE_STRIDE(&pool_info, 0);
+
+		if (gst_buffer_pool_has_option(pool, GST_BUFFER_POOL_OPTION_VIDEO_ALIGNMENT) &&
+		    pstride && static_cast<gint>(stream_cfg.stride) > stride) {
+			GstVideoAlignment align;
+
+			gst_video_alignment_reset(&align);
+			align.padding_right = (stream_cfg.stride - stride) / pstride;
+			gst_video_info_align(&pool_info, &align);
+
+			gst_buffer_pool_config_add_option(config, GST_BUFFER_POOL_OPTION_VIDEO_ALIGNMENT);
+			gst_buffer_pool_config_set_video_alignment(config, &align);
+		}
+
+		size = std::max<guint>({ size, stream_cfg.frameSize,
+					 static_cast<guint>(GST_VIDEO_INFO_SIZE(&pool_info)) });
+		gst_buffer_pool_config_set_params(config, caps, size, min, max);
+
+		if (!gst_buffer_pool_set_config(pool, config) ||
+		    !gst_buffer_pool_set_active(pool, TRUE)) {
+			GST_DEBUG_OBJECT(self, "Failed to configure %" GST_PTR_FORMAT, pool);
+			continue;
+		}
+
+		GstLibcameraPool *import = gst_libcamera_pool_new_import(pool, stream_cfg,
+									 &pool_info);
+		if (!import) {
+			GST_DEBUG_OBJECT(self, "Can't import buffers from %" GST_PTR_FORMAT,
+					 pool);
+			gst_buffer_pool_set_active(pool, FALSE);
+			continue;
+		}
+
+		GST_INFO_OBJECT(self, "Importing buffers from %" GST_PTR_FORMAT, pool);
+		return import;
+	}
+
+	return nullptr;
 }
 
 static void
@@ -461,6 +745,8 @@ gst_libcamera_src_task_enter(GstTask *task, [[maybe_unused]] GThread *thread,
 	GLibRecLocker lock(&self->stream_lock);
 	GstLibcameraSrcState *state = self->state;
 	GstFlowReturn flow_ret = GST_FLOW_OK;
+	std::vector<GstLibcameraPool *> pools;
+	std::vector<Stream *> streams;
 	gint ret;
 
 	g_autoptr(GstStructure) element_caps = gst_structure_new_empty("caps");
@@ -555,8 +841,30 @@ gst_libcamera_src_task_enter(GstTask *task, [[maybe_unused]] GThread *thread,
 		gst_pad_push_event(srcpad, gst_event_new_segment(&segment));
 	}
 
-	self->allocator = gst_libcamera_allocator_new(state->cam_, state->config_.get());
+	/*
+	 * Import downstream buffers when possible, and allocate buffers with
+	 * libcamera for the other streams.
+	 */
+	for (gsize i = 0; i < state->srcpads_.size(); i++) {
+		const StreamConfiguration &stream_cfg = state->config_->at(i);
+		GstLibcameraPool *pool = nullptr;
+
+		if (flow_ret == GST_FLOW_OK)
+			pool = gst_libcamera_src_import_pool(self, state->srcpads_[i],
+							     stream_cfg);
+		if (!pool)
+			streams.push_back(stream_cfg.stream());
+
+		pools.push_back(pool);
+	}
+
+	self->allocator = gst_libcamera_allocator_new(state->cam_, streams);
 	if (!self->allocator) {
+		for (GstLibcameraPool *pool : pools) {
+			if (pool)
+				g_object_unref(pool);
+		}
+
 		GST_ELEMENT_ERROR(self, RESOURCE, NO_SPACE_LEFT,
 				  ("Failed to allocate memory"),
 				  ("gst_libcamera_allocator_new() failed."));
@@ -568,15 +876,32 @@ gst_libcamera_src_task_enter(GstTask *task, [[maybe_unused]] GThread *thread,
 	for (gsize i = 0; i < state->srcpads_.size(); i++) {
 		GstPad *srcpad = state->srcpads_[i];
 		const StreamConfiguration &stream_cfg = state->config_->at(i);
-		GstLibcameraPool *pool = gst_libcamera_pool_new(self->allocator,
-								stream_cfg.stream());
-		g_signal_connect_swapped(pool, "buffer-notify",
-					 G_CALLBACK(gst_task_resume), task);
+		GstLibcameraPool *pool = pools[i];
+
+		if (pool) {
+			MutexLocker locker(state->lock_);
+			state->downstreamPools_.push_back(gst_libcamera_pool_get_downstream(pool));
+		} else {
+			pool = gst_libcamera_pool_new(self->allocator,
+						      stream_cfg.stream());
+			g_signal_connect_swapped(pool, "buffer-notify",
+						 G_CALLBACK(gst_task_resume), task);
+		}
 
 		gst_libcamera_pad_set_pool(srcpad, pool);
 		gst_flow_combiner_add_pad(self->flow_combiner, srcpad);
 	}
 
+	state->sequence_.reset();
+	state->droppedFrames_ = 0;
+	state->droppedBuffers_ = 0;
+
+	/* Apply all the controls set through properties when starting. */
+	{
+		GLibLocker lock(GST_OBJECT(self));
+		state->applyControls(state->initControls_, state->controlsSet_);
+	}
+
 	ret = state->cam_->start(&state->initControls_);
 	if (ret) {
 		GST_ELEMENT_ERROR(self, RESOURCE, SETTINGS,
@@ -586,6 +911,10 @@ gst_libcamera_src_task_enter(GstTask *task, [[maybe_unused]] GThread *thread,
 		return;
 	}
 
+	for (GstPad *srcpad : state->srcpads_)
+		gst_pad_start_task(srcpad, gst_libcamera_src_pad_task_run, srcpad,
+				   nullptr);
+
 done:
 	state->initControls_.clear();
 	switch (flow_ret) {
@@ -613,6 +942,14 @@ gst_libcamera_src_task_leave([[maybe_unused]] GstTask *task,
 	{
 		MutexLocker locker(state->lock_);
 		state->completedRequests_ = {};
+
+		/*
+		 * Downstream pools have been flushed to unblock the task, clear
+		 * the flushing state as they may be reused when restarting.
+		 */
+		for (GstBufferPool *pool : state->downstreamPools_)
+			gst_buffer_pool_set_flushing(pool, FALSE);
+		state->downstreamPools_.clear();
 	}
 
 	{
@@ -622,8 +959,16 @@ gst_libcamera_src_task_leave([[maybe_unused]] GstTask *task,
 	}
 
 	g_clear_object(&self->allocator);
-	g_clear_pointer(&self->flow_combiner,
-			(GDestroyNotify)gst_flow_combiner_free);
+
+	/*
+	 * The pad tasks keep pushing the pending buffers and events until the
+	 * pads get deactivated.
+	 */
+	{
+		GLibLocker locker(GST_OBJECT(self));
+		g_clear_pointer(&self->flow_combiner,
+				(GDestroyNotify)gst_flow_combiner_free);
+	}
 }
 
 static void
@@ -651,14 +996,35 @@ static void
 gst_libcamera_src_set_property(GObject *object, guint prop_id,
 			       const GValue *value, GParamSpec *pspec)
 {
-	GLibLocker lock(GST_OBJECT(object));
 	GstLibcameraSrc *self = GST_LIBCAMERA_SRC(object);
 
 	switch (prop_id) {
-	case PROP_CAMERA_NAME:
+	case PROP_CAMERA_NAME: {
+		GLibLocker lock(GST_OBJECT(self));
 		g_free(self->camera_name);
 		self->camera_name = g_value_dup_string(value);
 		break;
+	}
+	case PROP_QUEUE_DEPTH: {
+		/* Read by queueRequest() in the streaming threads. */
+		GLibLocker lock(GST_OBJECT(self));
+		self->queue_depth = g_value_get_uint(value);
+		break;
+	}
+	case PROP_AE_ENABLE:
+	case PROP_EXPOSURE_TIME:
+	case PROP_ANALOGUE_GAIN:
+	case PROP_EXPOSURE_VALUE:
+	case PROP_AWB_ENABLE:
+	case PROP_BRIGHTNESS:
+	case PROP_CONTRAST:
+	case PROP_SATURATION:
+	case PROP_SHARPNESS: {
+		/* Dirty controls are applied by queueRequest(). */
+		GLibLocker lock(GST_OBJECT(self));
+		self->state->setControl(prop_id - PROP_AE_ENABLE, value);
+		break;
+	}
 	default:
 		G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
 		break;
@@ -669,13 +1035,44 @@ static void
 gst_libcamera_src_get_property(GObject *object, guint prop_id, GValue *value,
 			       GParamSpec *pspec)
 {
-	GLibLocker lock(GST_OBJECT(object));
 	GstLibcameraSrc *self = GST_LIBCAMERA_SRC(object);
 
 	switch (prop_id) {
-	case PROP_CAMERA_NAME:
+	case PROP_CAMERA_NAME: {
+		GLibLocker lock(GST_OBJECT(self));
 		g_value_set_string(value, self->camera_name);
 		break;
+	}
+	case PROP_QUEUE_DEPTH: {
+		GLibLocker lock(GST_OBJECT(self));
+		g_value_set_uint(value, self->queue_depth);
+		break;
+	}
+	case PROP_REQUESTS_IN_FLIGHT: {
+		MutexLocker locker(self->state->lock_);
+		g_value_set_uint(value, self->state->queuedRequests_.size());
+		break;
+	}
+	case PROP_DROPPED_FRAMES:
+		g_value_set_uint(value, self->state->droppedFrames_);
+		break;
+	case PROP_DROPPED_BUFFERS:
+		g_value_set_uint(value, self->state->droppedBuffers_);
+		break;
+	case PROP_AE_ENABLE:
+	case PROP_EXPOSURE_TIME:
+	case PROP_ANALOGUE_GAIN:
+	case PROP_EXPOSURE_VALUE:
+	case PROP_AWB_ENABLE:
+	case PROP_BRIGHTNESS:
+	case PROP_CONTRAST:
+	case PROP_SATURATION:
+	case PROP_SHARPNESS: {
+		GLibLocker lock(GST_OBJECT(self));
+		if (!self->state->getControl(prop_id - PROP_AE_ENABLE, value))
+			g_param_value_set_default(pspec, value);
+		break;
+	}
 	default:
 		G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
 		break;
@@ -712,13 +1109,18 @@ gst_libcamera_src_change_state(GstElement *element, GstStateChange transition)
 		ret = GST_STATE_CHANGE_NO_PREROLL;
 		break;
 	case GST_STATE_CHANGE_PAUSED_TO_READY:
-		/*
-		 * \todo this might require some thread unblocking in the future
-		 * if the streaming thread starts doing any kind of blocking
-		 * operations. If this was the case, we would need to do so
-		 * before pad deactivation, so before chaining to the parent
-		 * change_state function.
-		 */
+		{
+			/*
+			 * Unblock the task if it waits for a downstream buffer.
+			 * The task isn't a pad task, so flushing after pad
+			 * deactivation is safe. The flushing state is cleared
+			 * when the task leaves.
+			 */
+			MutexLocker locker(self->state->lock_);
+			for (GstBufferPool *pool : self->state->downstreamPools_)
+				gst_buffer_pool_set_flushing(pool, TRUE);
+		}
+
 		gst_task_join(self->task);
 		break;
 	case GST_STATE_CHANGE_READY_TO_NULL:
@@ -844,4 +1246,89 @@ gst_libcamera_src_class_init(GstLibcameraSrcClass *klass)
 							     | G_PARAM_READWRITE
 							     | G_PARAM_STATIC_STRINGS));
 	g_object_class_install_property(object_class, PROP_CAMERA_NAME, spec);
+
+	spec = g_param_spec_uint("queue-depth", "Queue Depth",
+				 "Maximum number of requests queued to the camera "
+				 "(0 = as many as buffers are available)",
+				 0, G_MAXUINT, 0,
+				 (GParamFlags)(GST_PARAM_MUTABLE_PLAYING
+					       | G_PARAM_READWRITE
+					       | G_PARAM_STATIC_STRINGS));
+	g_object_class_install_property(object_class, PROP_QUEUE_DEPTH, spec);
+
+	spec = g_param_spec_uint("requests-in-flight", "Requests in Flight",
+				 "Number of requests currently queued to the camera",
+				 0, G_MAXUINT, 0,
+				 (GParamFlags)(G_PARAM_READABLE
+					       | G_PARAM_STATIC_STRINGS));
+	g_object_class_install_property(object_class, PROP_REQUESTS_IN_FLIGHT, spec);
+
+	spec = g_param_spec_uint("dropped-frames", "Dropped Frames",
+				 "Number of frames dropped by the camera",
+				 0, G_MAXUINT, 0,
+				 (GParamFlags)(G_PARAM_READABLE
+					       | G_PARAM_STATIC_STRINGS));
+	g_object_class_install_property(object_class, PROP_DROPPED_FRAMES, spec);
+
+	spec = g_param_spec_uint("dropped-buffers", "Dropped Buffers",
+				 "Number of buffers dropped by leaky pads because downstream "
+				 "didn't keep up",
+				 0, G_MAXUINT, 0,
+				 (GParamFlags)(G_PARAM_READABLE
+					       | G_PARAM_STATIC_STRINGS));
+	g_object_class_install_property(object_class, PROP_DROPPED_BUFFERS, spec);
+
+	/*
+	 * Camera controls. They are only applied when set, leaving the camera
+	 * defaults untouched otherwise.
+	 */
+	GParamFlags controlFlags = (GParamFlags)(GST_PARAM_CONTROLLABLE
+						 | GST_PARAM_MUTABLE_PLAYING
+						 | G_PARAM_READWRITE
+						 | G_PARAM_STATIC_STRINGS);
+
+	spec = g_param_spec_boolean("ae-enable", "AE Enable",
+				    "Enable the automatic exposure and gain control",
+				    TRUE, controlFlags);
+	g_object_class_install_property(object_class, PROP_AE_ENABLE, spec);
+
+	spec = g_param_spec_int("exposure-time", "Exposure Time",
+				"Exposure time in microseconds, when AE is disabled",
+				0, G_MAXINT, 0, controlFlags);
+	g_object_class_install_property(object_class, PROP_EXPOSURE_TIME, spec);
+
+	spec = g_param_spec_float("analogue-gain", "Analogue Gain",
+				  "Analogue gain, when AE is disabled",
+				  1.0, G_MAXFLOAT, 1.0, controlFlags);
+	g_object_class_install_property(object_class, PROP_ANALOGUE_GAIN, spec);
+
+	spec = g_param_spec_float("exposure-value", "Exposure Value",
+				  "Exposure compensation in stops, when AE is enabled",
+				  -G_MAXFLOAT, G_MAXFLOAT, 0.0, controlFlags);
+	g_object_class_install_property(object_class, PROP_EXPOSURE_VALUE, spec);
+
+	spec = g_param_spec_boolean("awb-enable", "AWB Enable",
+				    "Enable the automatic white balance",
+				    TRUE, controlFlags);
+	g_object_class_install_property(object_class, PROP_AWB_ENABLE, spec);
+
+	spec = g_param_spec_float("brightness", "Brightness",
+				  "Brightness adjustment (0.0 = unchanged)",
+				  -1.0, 1.0, 0.0, controlFlags);
+	g_object_class_install_property(object_class, PROP_BRIGHTNESS, spec);
+
+	spec = g_param_spec_float("contrast", "Contrast",
+				  "Contrast adjustment (1.0 = normal)",
+				  0.0, G_MAXFLOAT, 1.0, controlFlags);
+	g_object_class_install_property(object_class, PROP_CONTRAST, spec);
+
+	spec = g_param_spec_float("saturation", "Saturation",
+				  "Saturation adjustment (1.0 = normal, 0.0 = greyscale)",
+				  0.0, G_MAXFLOAT, 1.0, controlFlags);
+	g_object_class_install_property(object_class, PROP_SATURATION, spec);
+
+	spec = g_param_spec_float("sharpness", "Sharpness",
+				  "Sharpening strength (1.0 = normal, 0.0 = none)",
+				  0.0, G_MAXFLOAT, 1.0, controlFlags);
+	g_object_class_install_property(object_class, PROP_SHARPNESS, spec);
 }
@@ -8,7 +8,12 @@
 #include <libcamera/base/thread.h>
 
 #include <atomic>
+#include <errno.h>
 #include <list>
+#include <optional>
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
 #include <sys/syscall.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -163,6 +168,9 @@ private:
 	int exitCode_;
 
 	MessageQueue messages_;
+
+	std::optional<cpu_set_t> cpuset_ LIBCAMERA_TSA_GUARDED_BY(mutex_);
+	std::optional<int> priority_ LIBCAMERA_TSA_GUARDED_BY(mutex_);
 };
 
 /**
@@ -316,6 +324,14 @@ void Thread::startThread()
 	data_->tid_ = syscall(SYS_gettid);
 	currentThreadData = data_;
 
+	{
+		MutexLocker locker(data_->mutex_);
+		if (data_->cpuset_)
+			setThreadAffinityInternal(*data_->cpuset_);
+		if (data_->priority_)
+			setThreadPriorityInternal(*data_->priority_);
+	}
+
 	run();
 }
 
@@ -456,6 +472,126 @@ bool Thread::isRunning()
 	return data_->running_;
 }
 
+/**
+ * \brief Set the CPU affinity mask of the thread
+ * \param[in] cpus The list of CPU indices that the thread is allowed to run on
+ *
+ * This function sets the CPU affinity of the thread to the CPUs listed in
+ * \a cpus. If the thread is running the affinity is applied immediately,
+ * otherwise it is stored and applied when the thread is started. The affinity
+ * is retained across thread restarts.
+ *
+ * \context This function is \threadsafe.
+ *
+ * \return 0 on success or a negative error code otherwise
+ * \retval -EINVAL The list of CPUs is empty or references an invalid CPU
+ */
+int Thread::setThreadAffinity(const Span<const unsigned int> &cpus)
+{
+	const unsigned int numCpus = std::thread::hardware_concurrency();
+
+	if (cpus.empty())
+		return -EINVAL;
+
+	cpu_set_t cpuset;
+	CPU_ZERO(&cpuset);
+
+	for (unsigned int cpu : cpus) {
+		if (cpu >= numCpus || cpu >= CPU_SETSIZE) {
+			LOG(Thread, Error)
+				<< "Invalid CPU " << cpu << " for thread affinity";
+			return -EINVAL;
+		}
+
+		CPU_SET(cpu, &cpuset);
+	}
+
+	MutexLocker locker(data_->mutex_);
+
+	data_->cpuset_ = cpuset;
+
+	if (!data_->running_)
+		return 0;
+
+	return setThreadAffinityInternal(cpuset);
+}
+
+/**
+ * \brief Set the scheduling priority of the thread
+ * \param[in] priority The real-time priority, or 0 for normal scheduling
+ *
+ * This function selects the scheduling policy of the thread. A \a priority
+ * value of 0 selects the default time-sharing policy (SCHED_OTHER), while
+ * strictly positive values select the SCHED_FIFO real-time policy with the
+ * given static priority.
+ *
+ * As for setThreadAffinity(), the priority is applied immediately if the
+ * thread is running, or when it gets started otherwise. Real-time scheduling
+ * usually requires the CAP_SYS_NICE capability or an appropriate RLIMIT_RTPRIO
+ * resource limit.
+ *
+ * \context This function is \threadsafe.
+ *
+ * \return 0 on success or a negative error code otherwise
+ * \retval -EINVAL The priority is out of range for the SCHED_FIFO policy
+ * \retval -EPERM The process isn't allowed to select the requested policy
+ */
+int Thread::setThreadPriority(int priority)
+{
+	if (priority < 0 || priority > sched_get_priority_max(SCHED_FIFO)) {
+		LOG(Thread, Error) << "Invalid thread priority " << priority;
+		return -EINVAL;
+	}
+
+	MutexLocker locker(data_->mutex_);
+
+	data_->priority_ = priority;
+
+	if (!data_->running_)
+		return 0;
+
+	return setThreadPriorityInternal(priority);
+}
+
+int Thread::setThreadAffinityInternal(const cpu_set_t &cpuset)
+{
+	/*
+	 * Threads not created by the Thread class (such as the main application
+	 * thread) have no native handle and are not managed by libcamera.
+	 */
+	if (!thread_.joinable())
+		return -EINVAL;
+
+	int ret = pthread_setaffinity_np(thread_.native_handle(), sizeof(cpuset),
+					 &cpuset);
+	if (ret) {
+		LOG(Thread, Error)
+			<< "Failed to set thread affinity: " << strerror(ret);
+		return -ret;
+	}
+
+	return 0;
+}
+
+int Thread::setThreadPriorityInternal(int priority)
+{
+	if (!thread_.joinable())
+		return -EINVAL;
+
+	struct sched_param param = {};
+	param.sched_priority = priority;
+	int policy = priority ? SCHED_FIFO : SCHED_OTHER;
+
+	int ret = pthread_setschedparam(thread_.native_handle(), policy, &param);
+	if (ret) {
+		LOG(Thread, Error)
+			<< "Failed to set thread priority: " << strerror(ret);
+		return -ret;
+	}
+
+	return 0;
+}
+
 /**
  * \var Thread::finished
  * \brief Signal the end of thread execution
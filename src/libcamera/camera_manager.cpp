@@ -33,6 +33,52 @@ namespace libcamera {
 
 LOG_DEFINE_CATEGORY(Camera)
 
+/*
+ * Create and match pipeline handlers in the thread the matcher is bound to,
+ * binding the pipeline handler and all the objects it creates to that thread.
+ * Pipeline handlers that fail to match are destroyed in the same thread.
+ */
+class PipelineHandlerMatcher : public Object
+{
+public:
+	std::shared_ptr<PipelineHandler> match(const PipelineHandlerFactoryBase *factory,
+					       CameraManager *manager,
+					       DeviceEnumerator *enumerator)
+	{
+		std::shared_ptr<PipelineHandler> pipe = factory->create(manager);
+		if (!pipe->match(enumerator))
+			return nullptr;
+
+		return pipe;
+	}
+};
+
+/*
+ * Thread hosting a pipeline handler in the PerPipelineHandler threading model.
+ * Cameras are released with Object::deleteLater() when the camera manager
+ * stops, make sure the deletion requests posted before exit() are processed.
+ */
+class PipelineHandlerThread : public Thread
+{
+public:
+	PipelineHandlerThread()
+	{
+		matcher_.moveToThread(this);
+	}
+
+	PipelineHandlerMatcher *matcher() { return &matcher_; }
+
+protected:
+	void run() override
+	{
+		exec();
+		dispatchMessages(Message::Type::DeferredDelete);
+	}
+
+private:
+	PipelineHandlerMatcher matcher_;
+};
+
 class CameraManager::Private : public Extensible::Private, public Thread
 {
 	LIBCAMERA_DECLARE_PUBLIC(CameraManager)
@@ -45,28 +91,41 @@ public:
 		       const std::vector<dev_t> &devnums) LIBCAMERA_TSA_EXCLUDES(mutex_);
 	void removeCamera(Camera *camera) LIBCAMERA_TSA_EXCLUDES(mutex_);
 
+	bool isManagerThread() const LIBCAMERA_TSA_EXCLUDES(mutex_);
+
 	/*
 	 * This mutex protects
 	 *
 	 * - initialized_ and status_ during initialization
 	 * - cameras_ and camerasByDevnum_ after initialization
+	 * - pipelineThreads_
 	 */
 	mutable Mutex mutex_;
 	std::vector<std::shared_ptr<Camera>> cameras_ LIBCAMERA_TSA_GUARDED_BY(mutex_);
 	std::map<dev_t, std::weak_ptr<Camera>> camerasByDevnum_ LIBCAMERA_TSA_GUARDED_BY(mutex_);
 
+	ThreadingModel threadingModel_;
+
 protected:
 	void run() override;
 
 private:
 	int init();
 	void createPipelineHandlers();
+	std::shared_ptr<PipelineHandler>
+	matchPipelineHandler(const PipelineHandlerFactoryBase *factory)
+		LIBCAMERA_TSA_EXCLUDES(mutex_);
 	void cleanup() LIBCAMERA_TSA_EXCLUDES(mutex_);
 
 	ConditionVariable cv_;
 	bool initialized_ LIBCAMERA_TSA_GUARDED_BY(mutex_);
 	int status_ LIBCAMERA_TSA_GUARDED_BY(mutex_);
 
+	std::vector<std::unique_ptr<PipelineHandlerThread>> pipelineThreads_
+		LIBCAMERA_TSA_GUARDED_BY(mutex_);
+	/* Thread not hosting any pipeline handler yet, used for matching. */
+	PipelineHandlerThread *spareThread_ LIBCAMERA_TSA_GUARDED_BY(mutex_);
+
 	std::unique_ptr<DeviceEnumerator> enumerator_;
 
 	IPAManager ipaManager_;
@@ -74,7 +133,8 @@ private:
 };
 
 CameraManager::Private::Private()
-	: initialized_(false)
+	: threadingModel_(ThreadingModel::Shared), initialized_(false),
+	  spareThread_(nullptr)
 {
 }
 
@@ -126,19 +186,29 @@ void CameraManager::Private::run()
 
 int CameraManager::Private::init()
 {
+	utils::time_point start = utils::clock::now();
+
 	enumerator_ = DeviceEnumerator::create();
 	if (!enumerator_ || enumerator_->enumerate())
 		return -ENODEV;
 
+	utils::time_point enumerated = utils::clock::now();
+
 	createPipelineHandlers();
 
+	utils::time_point matched = utils::clock::now();
+
+	LOG(Camera, Debug)
+		<< "Device enumeration took "
+		<< utils::Duration(enumerated - start)
+		<< ", pipeline handlers matching took "
+		<< utils::Duration(matched - enumerated);
+
 	return 0;
 }
 
 void CameraManager::Private::createPipelineHandlers()
 {
-	CameraManager *const o = LIBCAMERA_O_PTR();
-
 	/*
 	 * \todo Try to read handlers and order from configuration
 	 * file and only fallback on all handlers if there is no
@@ -156,19 +226,74 @@ void CameraManager::Private::createPipelineHandlers()
 		 * all pipelines it can provide.
 		 */
 		while (1) {
-			std::shared_ptr<PipelineHandler> pipe = factory->create(o);
-			if (!pipe->match(enumerator_.get()))
+			utils::time_point start = utils::clock::now();
+
+			std::shared_ptr<PipelineHandler> pipe =
+				matchPipelineHandler(factory);
+			if (!pipe)
 				break;
 
 			LOG(Camera, Debug)
 				<< "Pipeline handler \"" << factory->name()
-				<< "\" matched";
+				<< "\" matched in "
+				<< utils::Duration(utils::clock::now() - start);
 		}
 	}
 
 	enumerator_->devicesAdded.connect(this, &Private::createPipelineHandlers);
 }
 
+std::shared_ptr<PipelineHandler>
+CameraManager::Private::matchPipelineHandler(const PipelineHandlerFactoryBase *factory)
+{
+	CameraManager *const o = LIBCAMERA_O_PTR();
+
+	if (threadingModel_ == ThreadingModel::Shared) {
+		std::shared_ptr<PipelineHandler> pipe = factory->create(o);
+		if (!pipe->match(enumerator_.get()))
+			return nullptr;
+
+		return pipe;
+	}
+
+	/*
+	 * Create the pipeline handler and call match() from a spare thread to
+	 * bind all the objects it creates (cameras, devices, event notifiers
+	 * and timers) to that thread. The call is blocking, access to the
+	 * device enumerator thus remains serialized with the camera manager
+	 * thread. The thread is recorded before matching, as match() registers
+	 * cameras from within the pipeline handler thread.
+	 *
+	 * Pipeline handlers that fail to match are destroyed in the spare
+	 * thread, which is then reused for the next match. It is dedicated to
+	 * the pipeline handler only once it matches.
+	 */
+	PipelineHandlerThread *thread;
+
+	{
+		MutexLocker locker(mutex_);
+
+		if (!spareThread_) {
+			pipelineThreads_.push_back(std::make_unique<PipelineHandlerThread>());
+			spareThread_ = pipelineThreads_.back().get();
+			spareThread_->start();
+		}
+
+		thread = spareThread_;
+	}
+
+	std::shared_ptr<PipelineHandler> pipe =
+		thread->matcher()->invokeMethod(&PipelineHandlerMatcher::match,
+						ConnectionTypeBlocking, factory,
+						o, enumerator_.get());
+	if (pipe) {
+		MutexLocker locker(mutex_);
+		spareThread_ = nullptr;
+	}
+
+	return pipe;
+}
+
 void CameraManager::Private::cleanup()
 {
 	enumerator_->devicesAdded.disconnect(this);
@@ -180,13 +305,26 @@ void CameraManager::Private::cleanup()
 	 * process deletion requests from the thread's message queue as the event
 	 * loop is not in action here.
 	 */
+	std::vector<std::unique_ptr<PipelineHandlerThread>> threads;
+
 	{
 		MutexLocker locker(mutex_);
 		cameras_.clear();
+		threads = std::move(pipelineThreads_);
+		spareThread_ = nullptr;
 	}
 
 	dispatchMessages(Message::Type::DeferredDelete);
 
+	/*
+	 * Stop the pipeline handler threads, which deletes the cameras they
+	 * host and, with the last camera reference, the pipeline handlers.
+	 */
+	for (std::unique_ptr<PipelineHandlerThread> &thread : threads) {
+		thread->exit();
+		thread->wait();
+	}
+
 	enumerator_.reset(nullptr);
 }
 
@@ -235,6 +373,22 @@ void CameraManager::Private::removeCamera(Camera *camera)
 	cameras_.erase(iter);
 }
 
+bool CameraManager::Private::isManagerThread() const
+{
+	Thread *current = Thread::current();
+	if (current == this)
+		return true;
+
+	MutexLocker locker(mutex_);
+
+	for (const std::unique_ptr<PipelineHandlerThread> &thread : pipelineThreads_) {
+		if (current == thread.get())
+			return true;
+	}
+
+	return false;
+}
+
 /**
  * \class CameraManager
  * \brief Provide access and manage all cameras in the system
@@ -258,6 +412,37 @@ void CameraManager::Private::removeCamera(Camera *camera)
  * action from the application. Once the application has released all the
  * references it held to cameras, the camera manager can be stopped with
  * stop().
+ *
+ * By default all pipeline handlers, and thus all cameras, are handled by a
+ * single internal thread. Systems running multiple cameras concurrently may
+ * instead select a dedicated thread for each pipeline handler with
+ * setThreadingModel() before starting the manager, and tune the scheduling of
+ * those threads with setThreadAffinity() and setThreadPriority().
+ */
+
+/**
+ * \enum CameraManager::ThreadingModel
+ * \brief Threading model for the pipeline handlers
+ *
+ * \var CameraManager::ThreadingModel::Shared
+ * \brief All pipeline handlers live in the camera manager thread
+ *
+ * Events from all cameras (buffer completion, request completion, IPA
+ * signals, ...) are processed sequentially in a single thread. Slow
+ * processing for one camera thus delays the processing for all other cameras.
+ *
+ * \var CameraManager::ThreadingModel::PerPipelineHandler
+ * \brief Each pipeline handler instance lives in a dedicated thread
+ *
+ * Every pipeline handler instance matched by the camera manager is bound to
+ * its own thread, along with all the cameras it creates. Events for cameras
+ * handled by different pipeline handler instances are processed concurrently.
+ * Cameras that share a pipeline handler instance (for instance multiple
+ * sensors connected to the same ISP) still share a thread.
+ *
+ * In this mode, the Camera signals, as well as the cameraAdded and
+ * cameraRemoved signals, are emitted from the thread of the corresponding
+ * pipeline handler.
  */
 
 CameraManager *CameraManager::self_ = nullptr;
@@ -284,6 +469,38 @@ CameraManager::~CameraManager()
 	self_ = nullptr;
 }
 
+/**
+ * \brief Select the threading model for the pipeline handlers
+ * \param[in] model The threading model
+ *
+ * This function selects how pipeline handlers are mapped to internal threads.
+ * It shall be called before the camera manager is started, the default model
+ * is ThreadingModel::Shared.
+ *
+ * \return 0 on success or a negative error code otherwise
+ * \retval -EBUSY The camera manager is running
+ */
+int CameraManager::setThreadingModel(ThreadingModel model)
+{
+	Private *const d = _d();
+
+	if (d->isRunning())
+		return -EBUSY;
+
+	d->threadingModel_ = model;
+
+	return 0;
+}
+
+/**
+ * \brief Retrieve the threading model for the pipeline handlers
+ * \return The threading model
+ */
+CameraManager::ThreadingModel CameraManager::threadingModel() const
+{
+	return _d()->threadingModel_;
+}
+
 /**
  * \brief Start the camera manager
  *
@@ -298,12 +515,20 @@ int CameraManager::start()
 {
 	LOG(Camera, Info) << "libcamera " << version_;
 
+	utils::time_point start = utils::clock::now();
+
 	int ret = _d()->start();
-	if (ret)
+	if (ret) {
 		LOG(Camera, Error) << "Failed to start camera manager: "
 				   << strerror(-ret);
+		return ret;
+	}
 
-	return ret;
+	LOG(Camera, Debug)
+		<< "Camera manager started in "
+		<< utils::Duration(utils::clock::now() - start);
+
+	return 0;
 }
 
 /**
@@ -407,9 +632,10 @@ std::shared_ptr<Camera> CameraManager::get(dev_t devnum)
  * connected to the system. When the signal is emitted the new camera is already
  * available from the list of cameras().
  *
- * The signal is emitted from the CameraManager thread. Applications shall
- * minimize the time spent in the signal handler and shall in particular not
- * perform any blocking operation.
+ * The signal is emitted from the CameraManager thread, or from the thread of
+ * the pipeline handler in the ThreadingModel::PerPipelineHandler threading
+ * model. Applications shall minimize the time spent in the signal handler and
+ * shall in particular not perform any blocking operation.
  */
 
 /**
@@ -420,9 +646,10 @@ std::shared_ptr<Camera> CameraManager::get(dev_t devnum)
  * signal is emitted the camera is not available from the list of cameras()
  * anymore.
  *
- * The signal is emitted from the CameraManager thread. Applications shall
- * minimize the time spent in the signal handler and shall in particular not
- * perform any blocking operation.
+ * The signal is emitted from the CameraManager thread, or from the thread of
+ * the pipeline handler in the ThreadingModel::PerPipelineHandler threading
+ * model. Applications shall minimize the time spent in the signal handler and
+ * shall in particular not perform any blocking operation.
  */
 
 /**
@@ -437,14 +664,16 @@ std::shared_ptr<Camera> CameraManager::get(dev_t devnum)
  * \a devnums are used by the V4L2 compatibility layer to map V4L2 device nodes
  * to Camera instances.
  *
- * \context This function shall be called from the CameraManager thread.
+ * \context This function shall be called from the CameraManager thread, or from
+ * the thread of the calling pipeline handler in the
+ * ThreadingModel::PerPipelineHandler threading model.
  */
 void CameraManager::addCamera(std::shared_ptr<Camera> camera,
 			      const std::vector<dev_t> &devnums)
 {
 	Private *const d = _d();
 
-	ASSERT(Thread::current() == d);
+	ASSERT(d->isManagerThread());
 
 	d->addCamera(camera, devnums);
 	cameraAdded.emit(camera);
@@ -458,18 +687,69 @@ void CameraManager::addCamera(std::shared_ptr<Camera> camera,
  * camera manager. Unregistered cameras won't be reported anymore by the
  * cameras() and get() calls, but references may still exist in applications.
  *
- * \context This function shall be called from the CameraManager thread.
+ * \context This function shall be called from the CameraManager thread, or from
+ * the thread of the calling pipeline handler in the
+ * ThreadingModel::PerPipelineHandler threading model.
  */
 void CameraManager::removeCamera(std::shared_ptr<Camera> camera)
 {
 	Private *const d = _d();
 
-	ASSERT(Thread::current() == d);
+	ASSERT(d->isManagerThread());
 
 	d->removeCamera(camera.get());
 	cameraRemoved.emit(camera);
 }
 
+/**
+ * \brief Set the CPU affinity of the thread handling a camera
+ * \param[in] camera The camera
+ * \param[in] cpus The list of CPU indices the thread is allowed to run on
+ *
+ * This function restricts the thread that processes events for \a camera to
+ * the CPUs listed in \a cpus. In the ThreadingModel::Shared threading model
+ * the thread is shared by all cameras, and the affinity applies to all of them.
+ *
+ * \context This function is \threadsafe.
+ *
+ * \return 0 on success or a negative error code otherwise
+ * \retval -ENODEV The camera is not handled by this camera manager
+ * \retval -EINVAL The list of CPUs is invalid
+ */
+int CameraManager::setThreadAffinity(std::shared_ptr<Camera> camera,
+				     const Span<const unsigned int> &cpus)
+{
+	if (!camera || get(camera->id()) != camera)
+		return -ENODEV;
+
+	return camera->thread()->setThreadAffinity(cpus);
+}
+
+/**
+ * \brief Set the scheduling priority of the thread handling a camera
+ * \param[in] camera The camera
+ * \param[in] priority The SCHED_FIFO priority, or 0 for normal scheduling
+ *
+ * This function sets the scheduling policy and priority of the thread that
+ * processes events for \a camera, as described in Thread::setThreadPriority().
+ * In the ThreadingModel::Shared threading model the thread is shared by all
+ * cameras, and the priority applies to all of them.
+ *
+ * \context This function is \threadsafe.
+ *
+ * \return 0 on success or a negative error code otherwise
+ * \retval -ENODEV The camera is not handled by this camera manager
+ * \retval -EINVAL The priority is out of range
+ * \retval -EPERM The process isn't allowed to select real-time scheduling
+ */
+int CameraManager::setThreadPriority(std::shared_ptr<Camera> camera, int priority)
+{
+	if (!camera || get(camera->id()) != camera)
+		return -ENODEV;
+
+	return camera->thread()->setThreadPriority(priority);
+}
+
 /**
  * \fn const std::string &CameraManager::version()
  * \brief Retrieve the libcamera version string
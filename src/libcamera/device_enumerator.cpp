@@ -7,9 +7,14 @@
 
 #include "libcamera/internal/device_enumerator.h"
 
+#include <algorithm>
+#include <atomic>
+#include <functional>
 #include <string.h>
 
 #include <libcamera/base/log.h>
+#include <libcamera/base/thread.h>
+#include <libcamera/base/utils.h>
 
 #include "libcamera/internal/device_enumerator_sysfs.h"
 #include "libcamera/internal/device_enumerator_udev.h"
@@ -38,6 +43,32 @@
 
 namespace libcamera {
 
+namespace {
+
+/*
+ * Worker thread used to populate media devices in parallel. It runs the work
+ * function once and stops, without entering an event loop.
+ */
+class DeviceEnumeratorWorker : public Thread
+{
+public:
+	DeviceEnumeratorWorker(const std::function<void()> &work)
+		: work_(work)
+	{
+	}
+
+protected:
+	void run() override
+	{
+		work_();
+	}
+
+private:
+	std::function<void()> work_;
+};
+
+} /* namespace */
+
 LOG_DEFINE_CATEGORY(DeviceEnumerator)
 
 /**
@@ -238,6 +269,62 @@ std::unique_ptr<MediaDevice> DeviceEnumerator::createDevice(const std::string &d
 * enumerator types may support dynamic detection of new devices.
 */
 
+/**
+ * \brief Create media device instances in parallel
+ * \param[in] deviceNodes paths to the media devices to create
+ *
+ * Create a media device for each entry in \a deviceNodes as done by
+ * createDevice(). Opening a media device and retrieving its graph topology
+ * requires multiple ioctl calls that can take a significant amount of time
+ * on systems with many media devices. Media devices are independent from each
+ * other, this function thus populates them concurrently in worker threads.
+ *
+ * The returned vector has the same size and order as \a deviceNodes. Entries
+ * corresponding to media devices that failed to be created are set to nullptr.
+ *
+ * \return The created media device instances
+ */
+std::vector<std::unique_ptr<MediaDevice>>
+DeviceEnumerator::createDevices(const std::vector<std::string> &deviceNodes)
+{
+	if (deviceNodes.empty())
+		return {};
+
+	std::vector<std::unique_ptr<MediaDevice>> devices(deviceNodes.size());
+	std::atomic<unsigned int> next = 0;
+
+	auto populate = [&]() {
+		unsigned int index;
+
+		while ((index = next.fetch_add(1)) < deviceNodes.size())
+			devices[index] = createDevice(deviceNodes[index]);
+	};
+
+	utils::time_point start = utils::clock::now();
+
+	/* Use the calling thread as one of the workers. */
+	unsigned int numWorkers = std::max(std::thread::hardware_concurrency(), 1U);
+	numWorkers = std::min<std::size_t>(numWorkers, deviceNodes.size());
+
+	std::vector<std::unique_ptr<DeviceEnumeratorWorker>> workers;
+	for (unsigned int i = 1; i < numWorkers; ++i) {
+		workers.push_back(std::make_unique<DeviceEnumeratorWorker>(populate));
+		workers.back()->start();
+	}
+
+	populate();
+
+	for (std::unique_ptr<DeviceEnumeratorWorker> &worker : workers)
+		worker->wait();
+
+	LOG(DeviceEnumerator, Debug)
+		<< "Populated " << deviceNodes.size() << " media devices with "
+		<< numWorkers << " threads in "
+		<< utils::Duration(utils::clock::now() - start);
+
+	return devices;
+}
+
 /**
  * \brief Add a media device to the enumerator
  * \param[in] media media device instance to add
@@ -32,6 +32,7 @@ int DeviceEnumeratorSysfs::init()
 
 int DeviceEnumeratorSysfs::enumerate()
 {
+	std::vector<std::string> deviceNodes;
 	struct dirent *ent;
 	DIR *dir;
 
@@ -73,7 +74,14 @@ int DeviceEnumeratorSysfs::enumerate()
 			continue;
 		}
 
-		std::unique_ptr<MediaDevice> media = createDevice(devnode);
+		deviceNodes.push_back(devnode);
+	}
+
+	closedir(dir);
+
+	std::vector<std::unique_ptr<MediaDevice>> devices = createDevices(deviceNodes);
+
+	for (std::unique_ptr<MediaDevice> &media : devices) {
 		if (!media)
 			continue;
 
@@ -88,8 +96,6 @@ int DeviceEnumeratorSysfs::enumerate()
 		addDevice(std::move(media));
 	}
 
-	closedir(dir);
-
 	return 0;
 }
 
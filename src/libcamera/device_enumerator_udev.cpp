@@ -16,6 +16,7 @@
 #include <sys/ioctl.h>
 #include <sys/sysmacros.h>
 #include <unistd.h>
+#include <vector>
 
 #include <libcamera/base/event_notifier.h>
 #include <libcamera/base/log.h>
@@ -81,32 +82,7 @@ int DeviceEnumeratorUdev::addUdevDevice(struct udev_device *dev)
 		if (!media)
 			return -ENODEV;
 
-		DependencyMap deps;
-		int ret = populateMediaDevice(media.get(), &deps);
-		if (ret < 0) {
-			LOG(DeviceEnumerator, Warning)
-				<< "Failed to populate media device "
-				<< media->deviceNode()
-				<< " (" << media->driver() << "), skipping";
-			return ret;
-		}
-
-		if (!deps.empty()) {
-			LOG(DeviceEnumerator, Debug)
-				<< "Defer media device " << media->deviceNode()
-				<< " due to " << deps.size()
-				<< " missing dependencies";
-
-			pending_.emplace_back(std::move(media), std::move(deps));
-			MediaDeviceDeps *mediaDeps = &pending_.back();
-			for (const auto &dep : mediaDeps->deps_)
-				devMap_[dep.first] = mediaDeps;
-
-			return 0;
-		}
-
-		addDevice(std::move(media));
-		return 0;
+		return addMediaDevice(std::move(media));
 	}
 
 	if (!strcmp(subsystem, "video4linux")) {
@@ -117,10 +93,44 @@ int DeviceEnumeratorUdev::addUdevDevice(struct udev_device *dev)
 	return -ENODEV;
 }
 
+int DeviceEnumeratorUdev::addMediaDevice(std::unique_ptr<MediaDevice> media)
+{
+	DependencyMap deps;
+	int ret = populateMediaDevice(media.get(), &deps);
+	if (ret < 0) {
+		LOG(DeviceEnumerator, Warning)
+			<< "Failed to populate media device "
+			<< media->deviceNode()
+			<< " (" << media->driver() << "), skipping";
+		return ret;
+	}
+
+	if (!deps.empty()) {
+		LOG(DeviceEnumerator, Debug)
+			<< "Defer media device " << media->deviceNode()
+			<< " due to " << deps.size()
+			<< " missing dependencies";
+
+		pending_.emplace_back(std::move(media), std::move(deps));
+		MediaDeviceDeps *mediaDeps = &pending_.back();
+		for (const auto &dep : mediaDeps->deps_)
+			devMap_[dep.first] = mediaDeps;
+
+		return 0;
+	}
+
+	addDevice(std::move(media));
+	return 0;
+}
+
 int DeviceEnumeratorUdev::enumerate()
 {
 	struct udev_enumerate *udev_enum = nullptr;
 	struct udev_list_entry *ents, *ent;
+	std::vector<struct udev_device *> devices;
+	std::vector<std::string> mediaNodes;
+	std::vector<std::unique_ptr<MediaDevice>> media;
+	unsigned int mediaIndex = 0;
 	int ret;
 
 	udev_enum = udev_enumerate_new(udev_);
@@ -169,10 +179,38 @@ int DeviceEnumeratorUdev::enumerate()
 			continue;
 		}
 
-		if (addUdevDevice(dev) < 0)
+		devices.push_back(dev);
+	}
+
+	/*
+	 * Populating media devices is the most expensive part of the
+	 * enumeration, do it in parallel for all media devices before
+	 * resolving the dependencies between media and V4L2 devices in
+	 * enumeration order.
+	 */
+	for (struct udev_device *dev : devices) {
+		const char *subsystem = udev_device_get_subsystem(dev);
+		if (subsystem && !strcmp(subsystem, "media"))
+			mediaNodes.push_back(udev_device_get_devnode(dev));
+	}
+
+	media = createDevices(mediaNodes);
+
+	for (struct udev_device *dev : devices) {
+		const char *subsystem = udev_device_get_subsystem(dev);
+		const char *syspath = udev_device_get_syspath(dev);
+
+		if (subsystem && !strcmp(subsystem, "media")) {
+			std::unique_ptr<MediaDevice> &device = media[mediaIndex++];
+			if (!device || addMediaDevice(std::move(device)) < 0)
+				LOG(DeviceEnumerator, Warning)
+					<< "Failed to add device for '"
+					<< syspath << "', skipping";
+		} else if (addUdevDevice(dev) < 0) {
 			LOG(DeviceEnumerator, Warning)
 				<< "Failed to add device for '"
 				<< syspath << "', skipping";
+		}
 
 		udev_device_unref(dev);
 	}
@@ -0,0 +1,610 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2020, Raspberry Pi Ltd
+ * Copyright (C) 2022, Google Inc.
+ *
+ * dma_buf_allocator.cpp - dma-buf allocator with buffer pool
+ */
+
+#include <libcamera/dma_buf_allocator.h>
+
+#include <algorithm>
+#include <array>
+#include <dirent.h>
+#include <fcntl.h>
+#include <iterator>
+#include <map>
+#include <numeric>
+#include <set>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <linux/dma-buf.h>
+#include <linux/dma-heap.h>
+#include <linux/udmabuf.h>
+
+#include <libcamera/base/log.h>
+#include <libcamera/base/mutex.h>
+
+#include <libcamera/framebuffer.h>
+
+/**
+ * \file dma_buf_allocator.h
+ * \brief dma-buf allocator with buffer pool
+ */
+
+namespace libcamera {
+
+LOG_DEFINE_CATEGORY(DmaBufAllocator)
+
+namespace {
+
+struct DmaBufAllocatorInfo {
+	DmaBufAllocator::DmaBufAllocatorFlag type;
+	const char *deviceNodeName;
+};
+
+/*
+ * /dev/dma_heap/linux,cma is the CMA dma-heap. When the CMA heap size is
+ * specified on the kernel command line instead of DT, the heap gets named
+ * "reserved" instead.
+ */
+static constexpr std::array<DmaBufAllocatorInfo, 4> providerInfos = { {
+	{ DmaBufAllocator::DmaBufAllocatorFlag::CmaHeap, "/dev/dma_heap/linux,cma" },
+	{ DmaBufAllocator::DmaBufAllocatorFlag::CmaHeap, "/dev/dma_heap/reserved" },
+	{ DmaBufAllocator::DmaBufAllocatorFlag::SystemHeap, "/dev/dma_heap/system" },
+	{ DmaBufAllocator::DmaBufAllocatorFlag::UDmaBuf, "/dev/udmabuf" },
+} };
+
+/* Default maximum amount of memory kept in the pool, in bytes. */
+static constexpr size_t kDefaultPoolLimit = 128 * 1024 * 1024;
+
+/*
+ * Compute the size class of an allocation. Sizes are rounded up to the page
+ * size, and above four pages to a quarter of their power of two, which bounds
+ * the memory wasted by rounding to 25% while keeping the number of classes
+ * small enough for pooled buffers to be reused across similar formats.
+ */
+size_t sizeClass(size_t size)
+{
+	static const size_t pageSize = sysconf(_SC_PAGESIZE);
+
+	size = (size + pageSize - 1) / pageSize * pageSize;
+	if (size <= 4 * pageSize)
+		return size;
+
+	size_t step = size_t(1) << (8 * sizeof(size_t) - 1 - __builtin_clzl(size));
+	step /= 4;
+
+	return (size + step - 1) / step * step;
+}
+
+/* dma-buf inode numbers are unique for the lifetime of the system. */
+ino_t bufferInode(int fd)
+{
+	struct stat st;
+	if (fstat(fd, &st))
+		return 0;
+
+	return st.st_ino;
+}
+
+/* Number of tracked buffers above which stale entries are pruned. */
+static constexpr size_t kMinPruneThreshold = 64;
+
+} /* namespace */
+
+class DmaBufAllocator::Private : public Extensible::Private
+{
+	LIBCAMERA_DECLARE_PUBLIC(DmaBufAllocator)
+
+public:
+	Private();
+
+	UniqueFD allocFromHeap(const char *name, size_t size);
+	UniqueFD allocFromUDmaBuf(const char *name, size_t size);
+	void trimPool(size_t limit) LIBCAMERA_TSA_REQUIRES(mutex_);
+	void pruneBuffers() LIBCAMERA_TSA_REQUIRES(mutex_);
+
+	UniqueFD providerHandle_;
+	DmaBufAllocatorFlag type_;
+
+	/*
+	 * The mutex protects the pool and the set of buffers allocated by the
+	 * allocator. Buffers are identified by their inode number, and map to
+	 * their size class. Entries for buffers freed without being released
+	 * are pruned when the number of entries exceeds pruneThreshold_.
+	 */
+	mutable Mutex mutex_;
+	std::map<size_t, std::vector<UniqueFD>> pool_ LIBCAMERA_TSA_GUARDED_BY(mutex_);
+	std::map<ino_t, size_t> buffers_ LIBCAMERA_TSA_GUARDED_BY(mutex_);
+	size_t poolSize_ LIBCAMERA_TSA_GUARDED_BY(mutex_);
+	size_t poolLimit_ LIBCAMERA_TSA_GUARDED_BY(mutex_);
+	size_t pruneThreshold_ LIBCAMERA_TSA_GUARDED_BY(mutex_);
+};
+
+DmaBufAllocator::Private::Private()
+	: poolSize_(0), poolLimit_(kDefaultPoolLimit),
+	  pruneThreshold_(kMinPruneThreshold)
+{
+}
+
+/**
+ * \class DmaBufAllocator
+ * \brief Helper class for dma-buf allocations
+ *
+ * The DmaBufAllocator allocates dma-buf memory from a dma-heap (CMA or system)
+ * or, as a fallback, from memfd-backed memory exported through the udmabuf
+ * driver. It can be used by pipeline handlers to allocate internal buffers,
+ * and by applications to allocate buffers that are then imported in a Camera
+ * through Request::addBuffer().
+ *
+ * Allocating contiguous memory is expensive, especially from the CMA heap
+ * where it can require migrating pages. To avoid that cost when buffers are
+ * repeatedly freed and allocated, for instance when switching between preview
+ * and still capture configurations, the allocator keeps buffers returned with
+ * release() or recycle() in a pool. Buffers are grouped in size classes, and
+ * alloc() reuses a pooled buffer of the matching class when one is available.
+ * The amount of memory held by the pool is bounded by setPoolLimit(), and the
+ * pool can be emptied explicitly with trim().
+ *
+ * Buffers are allocated with the size of their class, which may be larger
+ * than the requested size. The contents of recycled buffers are not cleared.
+ * Only buffers created by the allocator are pooled, other buffers passed to
+ * release() or recycle() are freed.
+ *
+ * The allocator is thread-safe.
+ */
+
+/**
+ * \enum DmaBufAllocator::DmaBufAllocatorFlag
+ * \brief Type of the dma-buf provider
+ * \var DmaBufAllocator::DmaBufAllocatorFlag::CmaHeap
+ * \brief Allocate from a CMA dma-heap, providing physically-contiguous memory
+ * \var DmaBufAllocator::DmaBufAllocatorFlag::SystemHeap
+ * \brief Allocate from the system dma-heap, using the page allocator
+ * \var DmaBufAllocator::DmaBufAllocatorFlag::UDmaBuf
+ * \brief Allocate using a memfd and /dev/udmabuf
+ */
+
+/**
+ * \typedef DmaBufAllocator::DmaBufAllocatorFlags
+ * \brief A bitwise combination of DmaBufAllocator::DmaBufAllocatorFlag values
+ */
+
+/**
+ * \brief Construct a DmaBufAllocator of a given type
+ * \param[in] type The type(s) of the dma-buf providers to allocate from
+ *
+ * The dma-buf provider type is selected with the \a type parameter, which
+ * defaults to the CMA heap. If multiple types are selected, the first provider
+ * that is available is used, in the order of the DmaBufAllocatorFlag
+ * enumerators.
+ */
+DmaBufAllocator::DmaBufAllocator(DmaBufAllocatorFlags type)
+	: Extensible(std::make_unique<Private>())
+{
+	Private *const d = _d();
+
+	for (const auto &info : providerInfos) {
+		if (!(type & info.type))
+			continue;
+
+		int ret = ::open(info.deviceNodeName, O_RDWR | O_CLOEXEC, 0);
+		if (ret < 0) {
+			ret = errno;
+			LOG(DmaBufAllocator, Debug)
+				<< "Failed to open " << info.deviceNodeName << ": "
+				<< strerror(ret);
+			continue;
+		}
+
+		LOG(DmaBufAllocator, Debug) << "Using " << info.deviceNodeName;
+		d->providerHandle_ = UniqueFD(ret);
+		d->type_ = info.type;
+		break;
+	}
+
+	if (!d->providerHandle_.isValid())
+		LOG(DmaBufAllocator, Error) << "Could not open any dma-buf provider";
+}
+
+/**
+ * \brief Destroy the DmaBufAllocator instance
+ *
+ * All buffers held in the pool are freed.
+ */
+DmaBufAllocator::~DmaBufAllocator() = default;
+
+/**
+ * \brief Check if the DmaBufAllocator instance is valid
+ * \return True if the DmaBufAllocator is valid, false otherwise
+ */
+bool DmaBufAllocator::isValid() const
+{
+	return _d()->providerHandle_.isValid();
+}
+
+/**
+ * \brief Allocate a dma-buf
+ * \param[in] name The name to set for the allocated buffer
+ * \param[in] size The size of the buffer to allocate
+ *
+ * Allocate a dma-buf of at least \a size bytes, reusing a buffer from the pool
+ * if one of the right size class is available. The buffer is named \a name.
+ *
+ * \return The UniqueFD of the allocated buffer, or an invalid UniqueFD on error
+ */
+UniqueFD DmaBufAllocator::alloc(const char *name, size_t size)
+{
+	Private *const d = _d();
+
+	if (!name || !size)
+		return {};
+
+	const size_t allocSize = sizeClass(size);
+	UniqueFD fd;
+
+	{
+		MutexLocker locker(d->mutex_);
+
+		auto iter = d->pool_.find(allocSize);
+		if (iter != d->pool_.end()) {
+			fd = std::move(iter->second.back());
+			iter->second.pop_back();
+			if (iter->second.empty())
+				d->pool_.erase(iter);
+
+			d->poolSize_ -= allocSize;
+		}
+	}
+
+	if (fd.isValid()) {
+		LOG(DmaBufAllocator, Debug)
+			<< "Reusing pooled buffer of " << allocSize
+			<< " bytes for " << name;
+
+		/*
+		 * Renaming fails on kernels that don't allow renaming attached
+		 * buffers, which is harmless.
+		 */
+		::ioctl(fd.get(), DMA_BUF_SET_NAME, name);
+		return fd;
+	}
+
+	if (!isValid()) {
+		LOG(DmaBufAllocator, Error) << "Allocation attempted without allocator";
+		return {};
+	}
+
+	if (d->type_ == DmaBufAllocatorFlag::UDmaBuf)
+		fd = d->allocFromUDmaBuf(name, allocSize);
+	else
+		fd = d->allocFromHeap(name, allocSize);
+
+	if (!fd.isValid())
+		return {};
+
+	ino_t ino = bufferInode(fd.get());
+	if (ino) {
+		MutexLocker locker(d->mutex_);
+		d->buffers_[ino] = allocSize;
+
+		if (d->buffers_.size() > d->pruneThreshold_)
+			d->pruneBuffers();
+	}
+
+	return fd;
+}
+
+/**
+ * \brief Return a dma-buf to the pool
+ * \param[in] fd The dma-buf file descriptor
+ *
+ * Return a buffer allocated with alloc() to the allocator. The buffer is kept
+ * in the pool for reuse by later allocations, unless the pool limit would be
+ * exceeded, in which case pooled buffers are freed, largest first. Buffers that
+ * have not been allocated by this allocator are freed.
+ *
+ * The caller shall not hold any other reference to the buffer, including
+ * duplicated file descriptors and memory mappings.
+ */
+void DmaBufAllocator::release(UniqueFD fd)
+{
+	Private *const d = _d();
+
+	if (!fd.isValid())
+		return;
+
+	struct stat st;
+	if (fstat(fd.get(), &st))
+		return;
+
+	MutexLocker locker(d->mutex_);
+
+	auto iter = d->buffers_.find(st.st_ino);
+	if (iter == d->buffers_.end()) {
+		/* Not allocated by us, free it. */
+		return;
+	}
+
+	const size_t size = iter->second;
+
+	/*
+	 * The inode number of a buffer freed without being released may have
+	 * been reused by another buffer before its entry got pruned. Check the
+	 * buffer size to avoid pooling a foreign buffer.
+	 */
+	if (static_cast<size_t>(st.st_size) != size) {
+		d->buffers_.erase(iter);
+		return;
+	}
+
+	d->pool_[size].push_back(std::move(fd));
+	d->poolSize_ += size;
+
+	d->trimPool(d->poolLimit_);
+}
+
+/**
+ * \brief Allocate FrameBuffer instances backed by dma-bufs
+ * \param[in] count The number of buffers to allocate
+ * \param[in] planeSizes The size of each plane, in bytes
+ * \param[out] buffers Array of buffers successfully allocated
+ *
+ * Allocate \a count FrameBuffer instances. Each buffer is backed by a single
+ * dma-buf holding all planes contiguously, with the sizes given by
+ * \a planeSizes. The buffers can be returned to the pool with recycle().
+ *
+ * \return The number of allocated buffers on success or a negative error code
+ * otherwise
+ */
+int DmaBufAllocator::exportBuffers(unsigned int count,
+				   const std::vector<unsigned int> &planeSizes,
+				   std::vector<std::unique_ptr<FrameBuffer>> *buffers)
+{
+	if (planeSizes.empty())
+		return -EINVAL;
+
+	const size_t frameSize = std::accumulate(planeSizes.begin(),
+						 planeSizes.end(), size_t(0));
+
+	for (unsigned int i = 0; i < count; ++i) {
+		std::string name = "frame-" + std::to_string(i);
+		UniqueFD fd = alloc(name.c_str(), frameSize);
+		if (!fd.isValid()) {
+			buffers->clear();
+			return -ENOMEM;
+		}
+
+		SharedFD sharedFd(std::move(fd));
+		std::vector<FrameBuffer::Plane> planes;
+		unsigned int offset = 0;
+
+		for (unsigned int planeSize : planeSizes) {
+			FrameBuffer::Plane plane;
+			plane.fd = sharedFd;
+			plane.offset = offset;
+			plane.length = planeSize;
+			planes.push_back(std::move(plane));
+
+			offset += planeSize;
+		}
+
+		buffers->push_back(std::make_unique<FrameBuffer>(planes));
+	}
+
+	return count;
+}
+
+/**
+ * \brief Return a FrameBuffer's memory to the pool
+ * \param[in] buffer The frame buffer
+ *
+ * Destroy a FrameBuffer allocated with exportBuffers() and return its memory
+ * to the pool. The same constraints as for release() apply.
+ */
+void DmaBufAllocator::recycle(std::unique_ptr<FrameBuffer> buffer)
+{
+	if (!buffer)
+		return;
+
+	const std::vector<FrameBuffer::Plane> &planes = buffer->planes();
+	for (const FrameBuffer::Plane &plane : planes) {
+		if (plane.fd != planes[0].fd)
+			return;
+	}
+
+	UniqueFD fd = planes[0].fd.dup();
+	buffer.reset();
+
+	release(std::move(fd));
+}
+
+/**
+ * \brief Set the maximum amount of memory held by the pool
+ * \param[in] bytes The pool limit, in bytes
+ *
+ * Buffers in excess of the limit are freed immediately. Setting the limit to
+ * 0 disables pooling.
+ */
+void DmaBufAllocator::setPoolLimit(size_t bytes)
+{
+	Private *const d = _d();
+
+	MutexLocker locker(d->mutex_);
+
+	d->poolLimit_ = bytes;
+	d->trimPool(d->poolLimit_);
+}
+
+/**
+ * \brief Retrieve the amount of memory held by the pool
+ * \return The size of all pooled buffers, in bytes
+ */
+size_t DmaBufAllocator::pooledBytes() const
+{
+	const Private *const d = _d();
+
+	MutexLocker locker(d->mutex_);
+	return d->poolSize_;
+}
+
+/**
+ * \brief Free all buffers held in the pool
+ */
+void DmaBufAllocator::trim()
+{
+	Private *const d = _d();
+
+	MutexLocker locker(d->mutex_);
+	d->trimPool(0);
+}
+
+UniqueFD DmaBufAllocator::Private::allocFromHeap(const char *name, size_t size)
+{
+	struct dma_heap_allocation_data alloc = {};
+	int ret;
+
+	alloc.len = size;
+	alloc.fd_flags = O_CLOEXEC | O_RDWR;
+
+	ret = ::ioctl(providerHandle_.get(), DMA_HEAP_IOCTL_ALLOC, &alloc);
+	if (ret < 0) {
+		LOG(DmaBufAllocator, Error)
+			<< "dma-heap allocation failure for " << name;
+		return {};
+	}
+
+	UniqueFD allocFd(alloc.fd);
+	ret = ::ioctl(allocFd.get(), DMA_BUF_SET_NAME, name);
+	if (ret < 0) {
+		LOG(DmaBufAllocator, Error)
+			<< "dma-heap naming failure for " << name;
+		return {};
+	}
+
+	return allocFd;
+}
+
+UniqueFD DmaBufAllocator::Private::allocFromUDmaBuf(const char *name, size_t size)
+{
+	/* Size is already page-aligned by sizeClass(), as udmabuf requires. */
+	UniqueFD memfd(memfd_create(name, MFD_ALLOW_SEALING | MFD_CLOEXEC));
+	if (!memfd.isValid()) {
+		int ret = errno;
+		LOG(DmaBufAllocator, Error)
+			<< "Failed to allocate memfd storage for " << name
+			<< ": " << strerror(ret);
+		return {};
+	}
+
+	int ret = ftruncate(memfd.get(), size);
+	if (ret < 0) {
+		ret = errno;
+		LOG(DmaBufAllocator, Error)
+			<< "Failed to set memfd size for " << name << ": "
+			<< strerror(ret);
+		return {};
+	}
+
+	/* udmabuf dma-buffers *must* have the F_SEAL_SHRINK seal. */
+	ret = fcntl(memfd.get(), F_ADD_SEALS, F_SEAL_SHRINK);
+	if (ret < 0) {
+		ret = errno;
+		LOG(DmaBufAllocator, Error)
+			<< "Failed to seal the memfd for " << name << ": "
+			<< strerror(ret);
+		return {};
+	}
+
+	struct udmabuf_create create;
+
+	create.memfd = memfd.get();
+	create.flags = UDMABUF_FLAGS_CLOEXEC;
+	create.offset = 0;
+	create.size = size;
+
+	ret = ::ioctl(providerHandle_.get(), UDMABUF_CREATE, &create);
+	if (ret < 0) {
+		ret = errno;
+		LOG(DmaBufAllocator, Error)
+			<< "Failed to create dma buf for " << name << ": "
+			<< strerror(ret);
+		return {};
+	}
+
+	/* The underlying memfd is kept as a reference in the kernel. */
+	UniqueFD allocFd(ret);
+
+	ret = ::ioctl(allocFd.get(), DMA_BUF_SET_NAME, name);
+	if (ret < 0) {
+		LOG(DmaBufAllocator, Error)
+			<< "dma-buf naming failure for " << name;
+		return {};
+	}
+
+	return allocFd;
+}
+
+/*
+ * Buffers allocated with alloc() can be freed by closing their file descriptor
+ * instead of calling release(), and buffers created by exportBuffers() by
+ * destroying the FrameBuffer. Their entries would then stay in buffers_
+ * forever. As a buffer can only be released while the process holds a file
+ * descriptor for it, drop the entries of all buffers that are not open in the
+ * process anymore. The threshold is then set to twice the number of remaining
+ * entries, to amortize the cost of the scan over allocations.
+ */
+void DmaBufAllocator::Private::pruneBuffers()
+{
+	DIR *dir = opendir("/proc/self/fd");
+	if (!dir)
+		return;
+
+	std::set<ino_t> inodes;
+	struct dirent *ent;
+
+	while ((ent = readdir(dir)) != nullptr) {
+		if (ent->d_name[0] == '.')
+			continue;
+
+		struct stat st;
+		if (!fstat(atoi(ent->d_name), &st))
+			inodes.insert(st.st_ino);
+	}
+
+	closedir(dir);
+
+	for (auto iter = buffers_.begin(); iter != buffers_.end();) {
+		if (inodes.count(iter->first))
+			++iter;
+		else
+			iter = buffers_.erase(iter);
+	}
+
+	pruneThreshold_ = std::max(buffers_.size() * 2, kMinPruneThreshold);
+}
+
+void DmaBufAllocator::Private::trimPool(size_t limit)
+{
+	/* Free the largest buffers first, they're the most expensive to hold. */
+	while (poolSize_ > limit) {
+		auto iter = std::prev(pool_.end());
+		std::vector<UniqueFD> &fds = iter->second;
+
+		buffers_.erase(bufferInode(fds.front().get()));
+		fds.erase(fds.begin());
+		poolSize_ -= iter->first;
+
+		if (fds.empty())
+			pool_.erase(iter);
+	}
+}
+
+} /* namespace libcamera */
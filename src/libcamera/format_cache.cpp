@@ -0,0 +1,282 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2022, Google Inc.
+ *
+ * format_cache.cpp - Persistent cache of device formats
+ */
+
+#include "libcamera/internal/format_cache.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <fstream>
+#include <sstream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <libcamera/base/log.h>
+#include <libcamera/base/unique_fd.h>
+#include <libcamera/base/utils.h>
+
+#include "libcamera/internal/media_device.h"
+
+/**
+ * \file format_cache.h
+ * \brief Persistent cache of device formats
+ */
+
+namespace libcamera {
+
+LOG_DEFINE_CATEGORY(FormatCache)
+
+namespace {
+
+constexpr const char *kCacheHeader = "libcamera-format-cache 1";
+
+} /* namespace */
+
+/**
+ * \class FormatCache
+ * \brief Persistent on-disk cache of the formats supported by a media device
+ *
+ * Enumerating the formats supported by a V4L2 subdevice requires one ioctl
+ * call per media bus code and per frame size, which adds up to a significant
+ * amount of time at startup for sensors that support many formats. For a
+ * given hardware configuration the result of the enumeration is static.
+ *
+ * The FormatCache stores the formats enumerated on the pads of the entities of
+ * a media device in a file, and makes them available to later runs. Only the
+ * formats that don't depend on the device configuration, such as the formats
+ * of camera sensors, are cached, see V4L2Subdevice::cachedFormats(). The cache
+ * is keyed by the media device driver name, model, bus information, media API
+ * version, driver version and hardware revision. A cache file whose key
+ * doesn't match the media device is ignored and overwritten.
+ *
+ * The cache is opt-in and is enabled by setting the LIBCAMERA_CACHE_DIR
+ * environment variable to the directory where cache files are stored. It
+ * shall be cleared manually when the kernel drivers are modified in a way that
+ * changes the formats they report without changing their version.
+ */
+
+/**
+ * \typedef FormatCache::Formats
+ * \brief A map of media bus codes to the frame sizes supported for each code
+ */
+
+FormatCache::FormatCache(const std::string &path, const std::string &key)
+	: path_(path), key_(key)
+{
+}
+
+/**
+ * \brief Create the format cache for a media device
+ * \param[in] media The media device
+ *
+ * The \a media device shall be populated before calling this function.
+ *
+ * \return The format cache for the media device, or nullptr if caching is
+ * disabled
+ */
+std::unique_ptr<FormatCache> FormatCache::create(const MediaDevice *media)
+{
+	const char *dir = utils::secure_getenv("LIBCAMERA_CACHE_DIR");
+	if (!dir || !*dir)
+		return nullptr;
+
+	std::string name = media->driver() + "-" + media->busInfo();
+	for (char &c : name) {
+		if (!isalnum(c) && c != '-' && c != '_')
+			c = '_';
+	}
+
+	std::ostringstream key;
+	key << media->driver() << "|" << media->model() << "|"
+	    << media->busInfo() << "|" << media->version() << "|"
+	    << media->driverVersion() << "|" << media->hwRevision();
+
+	std::unique_ptr<FormatCache> cache(
+		new FormatCache(std::string(dir) + "/" + name + ".cache", key.str()));
+	cache->load();
+
+	return cache;
+}
+
+/**
+ * \brief Look up the formats of a pad in the cache
+ * \param[in] entity The entity name
+ * \param[in] pad The pad index
+ * \param[out] formats The cached formats
+ * \return True if the formats for the pad have been found in the cache, false
+ * otherwise
+ */
+bool FormatCache::lookup(const std::string &entity, unsigned int pad,
+			 Formats *formats) const
+{
+	auto iter = formats_.find({ entity, pad });
+	if (iter == formats_.end())
+		return false;
+
+	*formats = iter->second;
+	return true;
+}
+
+/**
+ * \brief Store the formats of a pad in the cache
+ * \param[in] entity The entity name
+ * \param[in] pad The pad index
+ * \param[in] formats The formats
+ *
+ * The cache file is updated immediately.
+ */
+void FormatCache::store(const std::string &entity, unsigned int pad,
+			const Formats &formats)
+{
+	formats_[{ entity, pad }] = formats;
+	save();
+}
+
+int FormatCache::load()
+{
+	std::ifstream file(path_);
+	if (!file.is_open())
+		return -ENOENT;
+
+	std::string line;
+	if (!std::getline(file, line) || line != kCacheHeader)
+		return -EINVAL;
+
+	if (!std::getline(file, line) || line != key_) {
+		LOG(FormatCache, Debug)
+			<< "Discarding stale cache " << path_;
+		return -ESTALE;
+	}
+
+	/*
+	 * Each line stores the formats for one media bus code of one pad, as
+	 * tab-separated entity name, pad index, media bus code and list of
+	 * space-separated size ranges.
+	 */
+	std::map<std::pair<std::string, unsigned int>, Formats> formats;
+
+	while (std::getline(file, line)) {
+		std::istringstream fields(line);
+		std::string entity, ranges;
+		unsigned int pad, code;
+
+		if (!std::getline(fields, entity, '\t') ||
+		    !(fields >> pad) || fields.get() != '\t' ||
+		    !(fields >> code) || fields.get() != '\t' ||
+		    !std::getline(fields, ranges)) {
+			LOG(FormatCache, Warning) << "Invalid cache " << path_;
+			return -EINVAL;
+		}
+
+		std::vector<SizeRange> &sizes = formats[{ entity, pad }][code];
+
+		std::istringstream rangeStream(ranges);
+		std::string range;
+		while (rangeStream >> range) {
+			SizeRange size;
+			if (sscanf(range.c_str(), "%ux%u-%ux%u",
+				   &size.min.width, &size.min.height,
+				   &size.max.width, &size.max.height) != 4) {
+				LOG(FormatCache, Warning)
+					<< "Invalid cache " << path_;
+				return -EINVAL;
+			}
+
+			sizes.push_back(size);
+		}
+	}
+
+	formats_ = std::move(formats);
+
+	LOG(FormatCache, Debug)
+		<< "Loaded " << formats_.size() << " pads from " << path_;
+
+	return 0;
+}
+
+int FormatCache::save() const
+{
+	const std::string dir = utils::dirname(path_);
+	if (mkdir(dir.c_str(), 0755) && errno != EEXIST) {
+		int ret = -errno;
+		LOG(FormatCache, Warning)
+			<< "Failed to create cache directory " << dir << ": "
+			<< strerror(-ret);
+		return ret;
+	}
+
+	std::ostringstream data;
+	data << kCacheHeader << "\n" << key_ << "\n";
+
+	for (const auto &[pad, padFormats] : formats_) {
+		for (const auto &[code, sizes] : padFormats) {
+			data << pad.first << "\t" << pad.second << "\t"
+			     << code << "\t";
+
+			for (const SizeRange &size : sizes)
+				data << size.min.width << "x" << size.min.height << "-"
+				     << size.max.width << "x" << size.max.height << " ";
+
+			data << "\n";
+		}
+	}
+
+	/*
+	 * Write to a temporary file and rename it to update atomically. The
+	 * temporary file name is unique, as multiple processes may update the
+	 * cache concurrently.
+	 */
+	std::string tmpPath = path_ + ".XXXXXX";
+	UniqueFD fd(mkstemp(tmpPath.data()));
+	if (!fd.isValid()) {
+		int ret = -errno;
+		LOG(FormatCache, Warning)
+			<< "Failed to create temporary cache file for " << path_
+			<< ": " << strerror(-ret);
+		return ret;
+	}
+
+	fchmod(fd.get(), 0644);
+
+	const std::string content = data.str();
+	size_t written = 0;
+
+	while (written < content.size()) {
+		ssize_t ret = write(fd.get(), content.data() + written,
+				    content.size() - written);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+
+			ret = -errno;
+			LOG(FormatCache, Warning)
+				<< "Failed to write cache " << tmpPath << ": "
+				<< strerror(-ret);
+			unlink(tmpPath.c_str());
+			return ret;
+		}
+
+		written += ret;
+	}
+
+	fd.reset();
+
+	if (rename(tmpPath.c_str(), path_.c_str())) {
+		int ret = -errno;
+		LOG(FormatCache, Warning)
+			<< "Failed to update cache " << path_ << ": "
+			<< strerror(-ret);
+		unlink(tmpPath.c_str());
+		return ret;
+	}
+
+	return 0;
+}
+
+} /* namespace libcamera */
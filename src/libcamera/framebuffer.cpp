@@ -207,6 +207,46 @@ FrameBuffer::Private::~Private()
  * \return Dynamic metadata for the frame contained in the buffer
  */
 
+/**
+ * \brief Retrieve a persistent CPU mapping of the frame buffer
+ * \param[in] flags The mapping protection flags
+ *
+ * Mapping a frame buffer is expensive, as it requires setting up page tables,
+ * and unmapping it requires TLB shootdowns. This function creates a mapping of
+ * the frame buffer with the protection \a flags on first use, and caches it
+ * for the lifetime of the frame buffer. Users that process the same buffer for
+ * every frame should use this function instead of creating a new
+ * MappedFrameBuffer every time.
+ *
+ * CPU access to the mapped memory shall be bracketed by calls to
+ * MappedFrameBuffer::beginAccess() and MappedFrameBuffer::endAccess(). The
+ * mapping is shared by all users of the frame buffer, which may access it from
+ * multiple threads concurrently. This function is thread-safe.
+ *
+ * \return The mapping, or nullptr if the frame buffer can't be mapped
+ */
+MappedFrameBuffer *FrameBuffer::Private::mapping(MappedFrameBuffer::MapFlags flags) const
+{
+	const unsigned int index =
+		static_cast<MappedFrameBuffer::MapFlags::Type>(flags) - 1;
+	if (index >= mappings_.size())
+		return nullptr;
+
+	MutexLocker locker(mappingLock_);
+
+	std::unique_ptr<MappedFrameBuffer> &mapping = mappings_[index];
+	if (!mapping) {
+		auto map = std::make_unique<MappedFrameBuffer>(_o<FrameBuffer>(),
+							       flags);
+		if (!map->isValid())
+			return nullptr;
+
+		mapping = std::move(map);
+	}
+
+	return mapping.get();
+}
+
 /**
  * \class FrameBuffer
  * \brief Frame buffer data and its associated dynamic metadata
@@ -10,9 +10,12 @@
 #include <algorithm>
 #include <errno.h>
 #include <map>
+#include <sys/ioctl.h>
 #include <sys/mman.h>
 #include <unistd.h>
 
+#include <linux/dma-buf.h>
+
 #include <libcamera/base/log.h>
 
 /**
@@ -150,6 +153,20 @@ MappedBuffer::~MappedBuffer()
 /**
  * \class MappedFrameBuffer
  * \brief Map a FrameBuffer using the MappedBuffer interface
+ *
+ * CPU access to the mapped memory of dma-buf backed frame buffers shall be
+ * bracketed by calls to beginAccess() and endAccess(), which synchronize the
+ * CPU caches with the device. Only the dma-bufs backing the planes passed to
+ * those functions are synchronized, in the directions that are accessed. When
+ * multiple planes are stored in the same dma-buf, synchronization covers the
+ * whole dma-buf.
+ *
+ * Creating a mapping is expensive for large buffers. Users that access the
+ * same frame buffer repeatedly should keep the MappedFrameBuffer alive across
+ * frames, or use the mapping cached by FrameBuffer::Private::mapping().
+ *
+ * The access bracketing functions are thread-safe, allowing a mapping to be
+ * shared by multiple threads. Moving a MappedFrameBuffer isn't thread-safe.
  */
 
 /**
@@ -194,6 +211,7 @@ MappedFrameBuffer::MappedFrameBuffer(const FrameBuffer *buffer, MapFlags flags)
 		uint8_t *address = nullptr;
 		size_t mapLength = 0;
 		size_t dmabufLength = 0;
+		unsigned int index = 0;
 	};
 	std::map<int, MappedBufferInfo> mappedBuffers;
 
@@ -201,7 +219,7 @@ MappedFrameBuffer::MappedFrameBuffer(const FrameBuffer *buffer, MapFlags flags)
 		const int fd = plane.fd.get();
 		if (mappedBuffers.find(fd) == mappedBuffers.end()) {
 			const size_t length = lseek(fd, 0, SEEK_END);
-			mappedBuffers[fd] = MappedBufferInfo{ nullptr, 0, length };
+			mappedBuffers[fd] = MappedBufferInfo{ nullptr, 0, length, 0 };
 		}
 
 		const size_t length = mappedBuffers[fd].dmabufLength;
@@ -233,11 +251,222 @@ MappedFrameBuffer::MappedFrameBuffer(const FrameBuffer *buffer, MapFlags flags)
 			}
 
 			info.address = static_cast<uint8_t *>(address);
+			info.index = dmabufs_.size();
 			maps_.emplace_back(info.address, info.mapLength);
+			dmabufs_.push_back({ plane.fd, {}, 0 });
 		}
 
 		planes_.emplace_back(info.address + plane.offset, plane.length);
+		planeDmaBufs_.push_back(info.index);
 	}
 }
 
+/**
+ * \brief Move constructor, transfer the \a other mapping to this instance
+ * \param[in] other The other MappedFrameBuffer
+ *
+ * Moving a mapping while CPU access is in progress in another thread results
+ * in undefined behaviour.
+ */
+MappedFrameBuffer::MappedFrameBuffer(MappedFrameBuffer &&other)
+	: MappedBuffer(std::move(other))
+{
+	MutexLocker locker(other.accessLock_);
+
+	dmabufs_ = std::move(other.dmabufs_);
+	planeDmaBufs_ = std::move(other.planeDmaBufs_);
+}
+
+/**
+ * \brief Move assignment operator, replace the mapping with the \a other one
+ * \param[in] other The other MappedFrameBuffer
+ *
+ * Moving a mapping while CPU access is in progress in another thread results
+ * in undefined behaviour.
+ *
+ * \return A reference to this MappedFrameBuffer
+ */
+MappedFrameBuffer &MappedFrameBuffer::operator=(MappedFrameBuffer &&other)
+{
+	MappedBuffer::operator=(std::move(other));
+
+	MutexLocker locker(accessLock_);
+	MutexLocker otherLocker(other.accessLock_);
+
+	dmabufs_ = std::move(other.dmabufs_);
+	planeDmaBufs_ = std::move(other.planeDmaBufs_);
+
+	return *this;
+}
+
+/**
+ * \brief Begin CPU access to all planes
+ * \param[in] access The access directions
+ *
+ * This function is equivalent to calling beginAccess(unsigned int, MapFlags)
+ * for all planes. If access to any plane fails to begin, the accesses to the
+ * previous planes are ended, and endAccess() shall not be called.
+ *
+ * \return 0 on success or a negative error code otherwise
+ */
+int MappedFrameBuffer::beginAccess(MapFlags access)
+{
+	for (unsigned int i = 0; i < planes_.size(); ++i) {
+		int ret = beginAccess(i, access);
+		if (ret) {
+			/* Undo the accesses that have begun. */
+			while (i--)
+				endAccess(i);
+			return ret;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * \brief Begin CPU access to a plane
+ * \param[in] plane The plane index
+ * \param[in] access The access directions
+ *
+ * Prepare the dma-buf backing \a plane for CPU access in the \a access
+ * directions, invalidating the CPU caches for read access. If CPU access to
+ * the dma-buf has already begun in all the requested directions, this function
+ * returns immediately without any system call.
+ *
+ * Calls to beginAccess() and endAccess() nest, allowing multiple users of a
+ * shared mapping to bracket their accesses independently, from the same or
+ * from different threads. Every call to beginAccess() shall be balanced by a
+ * call to endAccess().
+ *
+ * When access has already begun in other directions, it is ended and begun
+ * again in all directions, to keep the dma-buf synchronization calls balanced.
+ *
+ * Buffers that are not dma-bufs don't need synchronization, and are ignored.
+ *
+ * If this function fails, CPU access hasn't begun and endAccess() shall not be
+ * called.
+ *
+ * \return 0 on success or a negative error code otherwise
+ */
+int MappedFrameBuffer::beginAccess(unsigned int plane, MapFlags access)
+{
+	if (plane >= planeDmaBufs_.size())
+		return -EINVAL;
+
+	MutexLocker locker(accessLock_);
+
+	DmaBuf &dmabuf = dmabufs_[planeDmaBufs_[plane]];
+
+	if ((dmabuf.access & access) != access) {
+		const MapFlags newAccess = access | dmabuf.access;
+		int ret;
+
+		if (dmabuf.access) {
+			ret = sync(dmabuf.fd, dmabuf.access, DMA_BUF_SYNC_END);
+			if (ret)
+				return ret;
+
+			dmabuf.access = {};
+		}
+
+		/*
+		 * If access fails to begin, accesses of other users in
+		 * progress continue unsynchronized, as they would if the
+		 * dma-buf was not shared.
+		 */
+		ret = sync(dmabuf.fd, newAccess, DMA_BUF_SYNC_START);
+		if (ret)
+			return ret;
+
+		dmabuf.access = newAccess;
+	}
+
+	dmabuf.users++;
+
+	return 0;
+}
+
+/**
+ * \brief End CPU access to all planes
+ *
+ * This function is equivalent to calling endAccess(unsigned int) for all
+ * planes.
+ *
+ * \return 0 on success or a negative error code otherwise
+ */
+int MappedFrameBuffer::endAccess()
+{
+	int ret = 0;
+
+	for (unsigned int i = 0; i < planes_.size(); ++i) {
+		int err = endAccess(i);
+		if (err)
+			ret = err;
+	}
+
+	return ret;
+}
+
+/**
+ * \brief End CPU access to a plane
+ * \param[in] plane The plane index
+ *
+ * End CPU access to the dma-buf backing \a plane, in the directions passed to
+ * beginAccess(), flushing the CPU caches for write access. CPU access ends when
+ * the last nested access to the dma-buf ends, for all planes stored in the
+ * same dma-buf. If CPU access to the dma-buf hasn't begun, or other accesses
+ * are still in progress, this function returns immediately without any system
+ * call.
+ *
+ * \return 0 on success or a negative error code otherwise
+ */
+int MappedFrameBuffer::endAccess(unsigned int plane)
+{
+	if (plane >= planeDmaBufs_.size())
+		return -EINVAL;
+
+	MutexLocker locker(accessLock_);
+
+	DmaBuf &dmabuf = dmabufs_[planeDmaBufs_[plane]];
+	if (!dmabuf.users || --dmabuf.users || !dmabuf.access)
+		return 0;
+
+	int ret = sync(dmabuf.fd, dmabuf.access, DMA_BUF_SYNC_END);
+	dmabuf.access = {};
+
+	return ret;
+}
+
+int MappedFrameBuffer::sync(const SharedFD &fd, MapFlags access,
+			    unsigned int flags)
+{
+	struct dma_buf_sync sync = {};
+
+	sync.flags = flags;
+	if (access & MapFlag::Read)
+		sync.flags |= DMA_BUF_SYNC_READ;
+	if (access & MapFlag::Write)
+		sync.flags |= DMA_BUF_SYNC_WRITE;
+
+	int ret;
+	do {
+		ret = ioctl(fd.get(), DMA_BUF_IOCTL_SYNC, &sync);
+	} while (ret && (errno == EINTR || errno == EAGAIN));
+
+	if (ret) {
+		ret = -errno;
+
+		/* Not a dma-buf, no synchronization is needed. */
+		if (ret == -ENOTTY)
+			return 0;
+
+		LOG(Buffer, Error) << "Failed to sync dma-buf: "
+				   << strerror(-ret);
+		return ret;
+	}
+
+	return 0;
+}
+
 } /* namespace libcamera */
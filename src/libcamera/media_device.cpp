@@ -20,6 +20,8 @@
 
 #include <libcamera/base/log.h>
 
+#include "libcamera/internal/format_cache.h"
+
 /**
  * \file media_device.h
  * \brief Provide a representation of a Linux kernel Media Controller device
@@ -63,7 +65,8 @@ LOG_DEFINE_CATEGORY(MediaDevice)
  * populate() before the media graph can be queried.
  */
 MediaDevice::MediaDevice(const std::string &deviceNode)
-	: deviceNode_(deviceNode), valid_(false), acquired_(false)
+	: deviceNode_(deviceNode), formatCacheInitialized_(false), valid_(false),
+	  acquired_(false)
 {
 }
 
@@ -217,7 +220,9 @@ int MediaDevice::populate()
 
 	driver_ = info.driver;
 	model_ = info.model;
+	busInfo_ = info.bus_info;
 	version_ = info.media_version;
+	driverVersion_ = info.driver_version;
 	hwRevision_ = info.hw_revision;
 
 	/*
@@ -320,6 +325,45 @@ done:
  * \return The MediaDevice hardware revision
  */
 
+/**
+ * \fn MediaDevice::busInfo()
+ * \brief Retrieve the media device bus information
+ *
+ * The bus information uniquely identifies the location of the device in the
+ * system, in a bus-specific format.
+ *
+ * \return The MediaDevice bus information
+ */
+
+/**
+ * \fn MediaDevice::driverVersion()
+ * \brief Retrieve the media device driver version
+ *
+ * The driver version is formatted with the KERNEL_VERSION macro, and usually
+ * matches the kernel version for in-tree drivers.
+ *
+ * \return The MediaDevice driver version
+ */
+
+/**
+ * \brief Retrieve the persistent format cache for the media device
+ *
+ * The cache is created on first use, and is only available if enabled through
+ * the LIBCAMERA_CACHE_DIR environment variable. See FormatCache for more
+ * information.
+ *
+ * \return The format cache, or nullptr if format caching is disabled
+ */
+FormatCache *MediaDevice::formatCache() const
+{
+	if (!formatCacheInitialized_) {
+		formatCache_ = FormatCache::create(this);
+		formatCacheInitialized_ = true;
+	}
+
+	return formatCache_.get();
+}
+
 /**
  * \fn MediaDevice::entities()
  * \brief Retrieve the list of entities in the media graph
@@ -19,6 +19,7 @@
 
 #include <libcamera/camera.h>
 #include <libcamera/control_ids.h>
+#include <libcamera/dma_buf_allocator.h>
 #include <libcamera/formats.h>
 #include <libcamera/ipa/raspberrypi_ipa_interface.h>
 #include <libcamera/ipa/raspberrypi_ipa_proxy.h>
@@ -41,7 +42,6 @@
 #include "libcamera/internal/v4l2_videodevice.h"
 
 #include "delayed_controls.h"
-#include "dma_heaps.h"
 #include "rpi_stream.h"
 
 using namespace std::chrono_literals;
@@ -239,8 +239,8 @@ public:
 	 */
 	std::vector<std::pair<std::unique_ptr<V4L2Subdevice>, MediaLink *>> bridgeDevices_;
 
-	/* DMAHEAP allocation helper. */
-	RPi::DmaHeap dmaHeap_;
+	/* dma-buf allocation helper. */
+	DmaBufAllocator dmaHeap_;
 	SharedFD lsTable_;
 
 	std::unique_ptr<RPi::DelayedControls> delayedCtrls_;
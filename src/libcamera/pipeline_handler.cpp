@@ -56,6 +56,11 @@ LOG_DEFINE_CATEGORY(Pipeline)
  * They implement std::enable_shared_from_this<> in order to create new
  * std::shared_ptr<> in code paths originating from member functions of the
  * PipelineHandler class where only the 'this' pointer is available.
+ *
+ * When the camera manager uses the
+ * CameraManager::ThreadingModel::PerPipelineHandler threading model, each
+ * pipeline handler instance lives in a dedicated thread, and the references
+ * to the CameraManager thread in this documentation designate that thread.
  */
 
 /**
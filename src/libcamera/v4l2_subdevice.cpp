@@ -23,6 +23,7 @@
 #include <libcamera/base/log.h>
 #include <libcamera/base/utils.h>
 
+#include "libcamera/internal/format_cache.h"
 #include "libcamera/internal/formats.h"
 #include "libcamera/internal/media_device.h"
 #include "libcamera/internal/media_object.h"
@@ -455,26 +456,44 @@ int V4L2Subdevice::setSelection(unsigned int pad, unsigned int target,
  */
 V4L2Subdevice::Formats V4L2Subdevice::formats(unsigned int pad)
 {
-	Formats formats;
-
 	if (pad >= entity_->pads().size()) {
 		LOG(V4L2, Error) << "Invalid pad: " << pad;
 		return {};
 	}
 
-	for (unsigned int code : enumPadCodes(pad)) {
-		std::vector<SizeRange> sizes = enumPadSizes(pad, code);
-		if (sizes.empty())
-			return {};
+	return enumPadFormats(pad);
+}
 
-		const auto inserted = formats.insert({ code, sizes });
-		if (!inserted.second) {
-			LOG(V4L2, Error)
-				<< "Could not add sizes for media bus code "
-				<< code << " on pad " << pad;
-			return {};
-		}
-	}
+/**
+ * \brief Retrieve the media bus codes and frame sizes on a \a pad through the
+ * persistent format cache
+ * \param[in] pad The 0-indexed pad number to enumerate formats on
+ *
+ * This function behaves as formats(), but retrieves the formats from the
+ * persistent format cache (see FormatCache) when it is enabled for the media
+ * device and contains the formats for the \a pad. Otherwise, the formats are
+ * enumerated and stored in the cache.
+ *
+ * Only the formats of pads that don't depend on the configuration of the
+ * subdevice shall be cached. This is the case of the source pad of camera
+ * sensors, but not of the source pads of ISPs, CSI-2 receivers or muxes,
+ * whose formats depend on the format of their sink pads.
+ *
+ * \return A list of the supported device formats
+ */
+V4L2Subdevice::Formats V4L2Subdevice::cachedFormats(unsigned int pad)
+{
+	FormatCache *cache = entity_->device()->formatCache();
+	if (!cache)
+		return formats(pad);
+
+	Formats formats;
+	if (cache->lookup(entity_->name(), pad, &formats))
+		return formats;
+
+	formats = this->formats(pad);
+	if (!formats.empty())
+		cache->store(entity_->name(), pad, formats);
 
 	return formats;
 }
@@ -747,6 +766,27 @@ std::string V4L2Subdevice::logPrefix() const
 	return "'" + entity_->name() + "'";
 }
 
+V4L2Subdevice::Formats V4L2Subdevice::enumPadFormats(unsigned int pad)
+{
+	Formats formats;
+
+	for (unsigned int code : enumPadCodes(pad)) {
+		std::vector<SizeRange> sizes = enumPadSizes(pad, code);
+		if (sizes.empty())
+			return {};
+
+		const auto inserted = formats.insert({ code, sizes });
+		if (!inserted.second) {
+			LOG(V4L2, Error)
+				<< "Could not add sizes for media bus code "
+				<< code << " on pad " << pad;
+			return {};
+		}
+	}
+
+	return formats;
+}
+
 std::vector<unsigned int> V4L2Subdevice::enumPadCodes(unsigned int pad)
 {
 	std::vector<unsigned int> codes;
@@ -27,6 +27,7 @@ class CameraContext:
     stream_names: dict[libcam.Stream, str]
     streams: list[libcam.Stream]
     allocator: libcam.FrameBufferAllocator
+    mfbs: dict[libcam.FrameBuffer, libcamera.utils.MappedFrameBuffer]
     requests: list[libcam.Request]
     reqs_queued: int
     reqs_completed: int
@@ -39,6 +40,7 @@ class CameraContext:
         self.id = 'cam' + str(idx)
         self.reqs_queued = 0
         self.reqs_completed = 0
+        self.mfbs = {}
 
     def do_cmd_list_props(self):
         print('Properties for', self.id)
@@ -184,6 +186,11 @@ class CameraContext:
 
             print('{}-{}: Allocated {} buffers'.format(self.id, self.stream_names[stream], allocated))
 
+            # Map the buffers once, to avoid mapping them for every frame
+            if self.opt_crc or self.opt_save_frames:
+                for fb in allocator.buffers(stream):
+                    self.mfbs[fb] = libcamera.utils.MappedFrameBuffer(fb).mmap()
+
         self.allocator = allocator
 
     def create_requests(self):
@@ -220,6 +227,10 @@ class CameraContext:
     def stop(self):
         self.camera.stop()
 
+        for mfb in self.mfbs.values():
+            mfb.munmap()
+        self.mfbs = {}
+
     def queue_requests(self):
         for request in self.requests:
             self.camera.queue_request(request)
@@ -271,9 +282,9 @@ class CaptureState:
 
             crcs = []
             if ctx.opt_crc:
-                with libcamera.utils.MappedFrameBuffer(fb) as mfb:
-                    plane_crcs = [binascii.crc32(p) for p in mfb.planes]
-                    crcs.append(plane_crcs)
+                mfb = ctx.mfbs[fb]
+                plane_crcs = [binascii.crc32(p) for p in mfb.planes]
+                crcs.append(plane_crcs)
 
             meta = fb.metadata
 
@@ -290,11 +301,11 @@ class CaptureState:
                     print(f'\t{ctrl} = {val}')
 
             if ctx.opt_save_frames:
-                with libcamera.utils.MappedFrameBuffer(fb) as mfb:
-                    filename = 'frame-{}-{}-{}.data'.format(ctx.id, stream_name, ctx.reqs_completed)
-                    with open(filename, 'wb') as f:
-                        for p in mfb.planes:
-                            f.write(p)
+                mfb = ctx.mfbs[fb]
+                filename = 'frame-{}-{}-{}.data'.format(ctx.id, stream_name, ctx.reqs_completed)
+                with open(filename, 'wb') as f:
+                    for p in mfb.planes:
+                        f.write(p)
 
         self.renderer.request_handler(ctx, req)
 
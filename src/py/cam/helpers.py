@@ -73,13 +73,36 @@ def demosaic(data, r0, g0, g1, b0):
     return output
 
 
+def bayer_to_rgb(bayer_pattern, data):
+    idx = bayer_pattern.find('R')
+    assert(idx != -1)
+    r0 = (idx % 2, idx // 2)
+
+    idx = bayer_pattern.find('G')
+    assert(idx != -1)
+    g0 = (idx % 2, idx // 2)
+
+    idx = bayer_pattern.find('G', idx + 1)
+    assert(idx != -1)
+    g1 = (idx % 2, idx // 2)
+
+    idx = bayer_pattern.find('B')
+    assert(idx != -1)
+    b0 = (idx % 2, idx // 2)
+
+    rgb = demosaic(data, r0, g0, g1, b0)
+    return (rgb >> 8).astype(np.uint8)
+
+
+# Convert the data of a single plane frame, as returned by
+# libcamera.plane_arrays(), to 24-bit RGB
 def to_rgb(fmt, size, data):
     w = size.width
     h = size.height
 
     if fmt == libcam.formats.YUYV:
         # YUV422
-        yuyv = data.reshape((h, w // 2 * 4))
+        yuyv = data[:, :w * 2]
 
         # YUV444
         yuv = np.empty((h, w, 3), dtype=np.uint8)
@@ -99,53 +122,30 @@ def to_rgb(fmt, size, data):
         rgb[:, :, 2] -= 226.8183044444304
         rgb = rgb.astype(np.uint8)
 
+    # The RGB formats are reordered with a single copy from the frame buffer
     elif fmt == libcam.formats.RGB888:
-        rgb = data.reshape((h, w, 3))
-        rgb[:, :, [0, 1, 2]] = rgb[:, :, [2, 1, 0]]
+        rgb = np.ascontiguousarray(data[:, :, ::-1])
 
     elif fmt == libcam.formats.BGR888:
-        rgb = data.reshape((h, w, 3))
+        rgb = np.ascontiguousarray(data)
 
     elif fmt in [libcam.formats.ARGB8888, libcam.formats.XRGB8888]:
-        rgb = data.reshape((h, w, 4))
-        rgb = np.flip(rgb, axis=2)
         # drop alpha component
-        rgb = np.delete(rgb, np.s_[0::4], axis=2)
+        rgb = np.ascontiguousarray(data[:, :, 2::-1])
 
     elif str(fmt).startswith('S'):
         fmt = str(fmt)
-        bayer_pattern = fmt[1:5]
         bitspp = int(fmt[5:])
 
         # \todo shifting leaves the lowest bits 0
         if bitspp == 8:
-            data = data.reshape((h, w))
             data = data.astype(np.uint16) << 8
         elif bitspp in [10, 12]:
-            data = data.view(np.uint16)
-            data = data.reshape((h, w))
             data = data << (16 - bitspp)
         else:
             raise Exception('Bad bitspp:' + str(bitspp))
 
-        idx = bayer_pattern.find('R')
-        assert(idx != -1)
-        r0 = (idx % 2, idx // 2)
-
-        idx = bayer_pattern.find('G')
-        assert(idx != -1)
-        g0 = (idx % 2, idx // 2)
-
-        idx = bayer_pattern.find('G', idx + 1)
-        assert(idx != -1)
-        g1 = (idx % 2, idx // 2)
-
-        idx = bayer_pattern.find('B')
-        assert(idx != -1)
-        b0 = (idx % 2, idx // 2)
-
-        rgb = demosaic(data, r0, g0, g1, b0)
-        rgb = (rgb >> 8).astype(np.uint8)
+        rgb = bayer_to_rgb(fmt[1:5], data)
 
     else:
         rgb = None
@@ -153,8 +153,20 @@ def to_rgb(fmt, size, data):
     return rgb
 
 
-# A naive format conversion to 24-bit RGB
+# A naive format conversion to 24-bit RGB. The plane data is accessed in place
+# through NumPy arrays, and the NV12 and CSI-2 packed RAW formats are converted
+# by the native helpers of the bindings.
 def mfb_to_rgb(mfb: libcamera.utils.MappedFrameBuffer, cfg: libcam.StreamConfiguration):
-    data = np.array(mfb.planes[0], dtype=np.uint8)
-    rgb = to_rgb(cfg.pixel_format, cfg.size, data)
-    return rgb
+    fmt = cfg.pixel_format
+
+    if fmt in [libcam.formats.NV12, libcam.formats.NV21]:
+        return libcam.nv12_to_rgb(mfb.planes[0], mfb.planes[1], cfg)
+
+    if str(fmt).endswith('_CSI2P'):
+        name = str(fmt)
+        bitspp = int(name[5:-6])
+        data = libcam.unpack_csi2p(mfb.planes[0], cfg) << (16 - bitspp)
+        return bayer_to_rgb(name[1:5], data)
+
+    data = libcam.plane_arrays(mfb.planes, cfg)[0]
+    return to_rgb(fmt, cfg.size, data)
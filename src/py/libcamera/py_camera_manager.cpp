@@ -5,6 +5,7 @@
 
 #include "py_camera_manager.h"
 
+#include <algorithm>
 #include <errno.h>
 #include <memory>
 #include <sys/eventfd.h>
@@ -19,6 +20,7 @@ namespace py = pybind11;
 using namespace libcamera;
 
 PyCameraManager::PyCameraManager()
+	: completedRequests_(nullptr)
 {
 	LOG(Python, Debug) << "PyCameraManager()";
 
@@ -40,6 +42,8 @@ PyCameraManager::PyCameraManager()
 PyCameraManager::~PyCameraManager()
 {
 	LOG(Python, Debug) << "~PyCameraManager()";
+
+	getCompletedRequests();
 }
 
 py::list PyCameraManager::cameras()
@@ -62,12 +66,12 @@ py::list PyCameraManager::cameras()
 
 std::vector<py::object> PyCameraManager::getReadyRequests()
 {
+	/*
+	 * Clear the eventfd before retrieving the requests. A request
+	 * completing after the retrieval writes to the eventfd again.
+	 */
 	int ret = readFd();
-
-	if (ret == -EAGAIN)
-		return std::vector<py::object>();
-
-	if (ret != 0)
+	if (ret != 0 && ret != -EAGAIN)
 		throw std::system_error(-ret, std::generic_category());
 
 	std::vector<py::object> py_reqs;
@@ -85,8 +89,12 @@ std::vector<py::object> PyCameraManager::getReadyRequests()
 /* Note: Called from another thread */
 void PyCameraManager::handleRequestCompleted(Request *req)
 {
-	pushRequest(req);
-	writeFd();
+	/*
+	 * Only signal the eventfd when the first request is queued, the
+	 * following ones will be retrieved along with it.
+	 */
+	if (pushRequest(req))
+		writeFd();
 }
 
 void PyCameraManager::writeFd()
@@ -116,16 +124,39 @@ int PyCameraManager::readFd()
 		return -EIO;
 }
 
-void PyCameraManager::pushRequest(Request *req)
+/*
+ * Push a completed request, and return true if no other request was waiting to
+ * be retrieved.
+ */
+bool PyCameraManager::pushRequest(Request *req)
 {
-	MutexLocker guard(completedRequestsMutex_);
-	completedRequests_.push_back(req);
+	CompletedRequest *entry = new CompletedRequest{ req, nullptr };
+
+	CompletedRequest *head = completedRequests_.load(std::memory_order_relaxed);
+	do {
+		entry->next = head;
+	} while (!completedRequests_.compare_exchange_weak(head, entry,
+							    std::memory_order_release,
+							    std::memory_order_relaxed));
+
+	return !head;
 }
 
 std::vector<Request *> PyCameraManager::getCompletedRequests()
 {
+	CompletedRequest *entry = completedRequests_.exchange(nullptr,
+							      std::memory_order_acquire);
+
 	std::vector<Request *> v;
-	MutexLocker guard(completedRequestsMutex_);
-	swap(v, completedRequests_);
+	while (entry) {
+		CompletedRequest *next = entry->next;
+		v.push_back(entry->request);
+		delete entry;
+		entry = next;
+	}
+
+	/* The stack holds the requests in reverse completion order. */
+	std::reverse(v.begin(), v.end());
+
 	return v;
 }
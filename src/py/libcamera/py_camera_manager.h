@@ -5,7 +5,7 @@
 
 #pragma once
 
-#include <libcamera/base/mutex.h>
+#include <atomic>
 
 #include <libcamera/libcamera.h>
 
@@ -31,15 +31,23 @@ public:
 	void handleRequestCompleted(Request *req);
 
 private:
+	struct CompletedRequest {
+		Request *request;
+		CompletedRequest *next;
+	};
+
 	std::unique_ptr<CameraManager> cameraManager_;
 
 	UniqueFD eventFd_;
-	libcamera::Mutex completedRequestsMutex_;
-	std::vector<Request *> completedRequests_
-		LIBCAMERA_TSA_GUARDED_BY(completedRequestsMutex_);
+
+	/*
+	 * Lock-free stack of completed requests, pushed by the camera manager
+	 * thread and drained at once by getReadyRequests().
+	 */
+	std::atomic<CompletedRequest *> completedRequests_;
 
 	void writeFd();
 	int readFd();
-	void pushRequest(Request *req);
+	bool pushRequest(Request *req);
 	std::vector<Request *> getCompletedRequests();
 };
@@ -0,0 +1,485 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Copyright (C) 2022, Tomi Valkeinen <tomi.valkeinen@ideasonboard.com>
+ *
+ * Python bindings - Image data access and conversion
+ */
+
+#include <algorithm>
+#include <optional>
+#include <stdexcept>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include <libcamera/color_space.h>
+#include <libcamera/formats.h>
+#include <libcamera/libcamera.h>
+
+#include "libcamera/internal/formats.h"
+
+#include <pybind11/numpy.h>
+#include <pybind11/smart_holder.h>
+#include <pybind11/stl.h>
+
+namespace py = pybind11;
+
+using namespace libcamera;
+
+namespace {
+
+/*
+ * Request access to the data of a Python buffer, and check that it spans at
+ * least size bytes. The returned buffer_info holds the buffer export, which
+ * prevents the memory from being released (for instance by closing an mmap
+ * object) as long as it is alive. It shall be kept alive until the data isn't
+ * accessed anymore, including when the GIL is released.
+ */
+py::buffer_info bufferData(const py::buffer &buffer, size_t size)
+{
+	py::buffer_info info = buffer.request();
+
+	size_t extent = info.itemsize;
+	for (py::ssize_t dim = 0; dim < info.ndim; ++dim) {
+		if (!info.shape[dim])
+			extent = 0;
+		else
+			extent += (info.shape[dim] - 1) * info.strides[dim];
+	}
+
+	if (extent < size)
+		throw std::invalid_argument("Buffer too small for the image");
+
+	return info;
+}
+
+/*
+ * Create NumPy arrays for the planes of a frame, sharing the memory of the
+ * plane buffers. The arrays keep a reference to a memoryview of the buffers,
+ * which holds a buffer export for the lifetime of the arrays.
+ */
+py::list planeArrays(const std::vector<py::buffer> &planes,
+		     const StreamConfiguration &cfg)
+{
+	const PixelFormatInfo &info = PixelFormatInfo::info(cfg.pixelFormat);
+	if (!info.isValid())
+		throw std::invalid_argument("Unsupported pixel format");
+
+	if (planes.size() < info.numPlanes())
+		throw std::invalid_argument("Not enough planes for the pixel format");
+
+	if (cfg.size.isNull())
+		throw std::invalid_argument("Invalid image size");
+
+	const py::ssize_t width = cfg.size.width;
+	const py::ssize_t height = cfg.size.height;
+
+	py::list arrays;
+
+	for (unsigned int i = 0; i < info.numPlanes(); ++i) {
+		const PixelFormatInfo::Plane &plane = info.planes[i];
+
+		/* The stride of the other planes is derived from the first one. */
+		const py::ssize_t stride = cfg.stride * plane.bytesPerGroup
+					 / info.planes[0].bytesPerGroup;
+		const py::ssize_t rows = (height + plane.verticalSubSampling - 1)
+				       / plane.verticalSubSampling;
+		const py::ssize_t lineBytes = info.stride(width, i, 1);
+
+		const py::buffer_info data = bufferData(planes[i],
+							(rows - 1) * stride + lineBytes);
+
+		std::vector<py::ssize_t> shape;
+		std::vector<py::ssize_t> strides;
+		py::dtype dtype = py::dtype::of<uint8_t>();
+
+		const py::ssize_t bytesPerPixel = plane.bytesPerGroup / info.pixelsPerGroup;
+
+		if (info.colourEncoding == PixelFormatInfo::ColourEncodingRAW &&
+		    !info.packed && info.bitsPerPixel > 8) {
+			/* Unpacked RAW, stored in 16-bit containers. */
+			dtype = py::dtype::of<uint16_t>();
+			shape = { rows, width };
+			strides = { stride, 2 };
+		} else if (!info.packed && info.numPlanes() == 1 &&
+			   info.pixelsPerGroup == 1) {
+			/* Interleaved samples, one group of bytes per pixel. */
+			if (bytesPerPixel == 1) {
+				shape = { rows, width };
+				strides = { stride, 1 };
+			} else {
+				shape = { rows, width, bytesPerPixel };
+				strides = { stride, bytesPerPixel, 1 };
+			}
+		} else {
+			/*
+			 * Packed and subsampled data, including horizontally
+			 * subsampled interleaved formats such as YUYV, exposed
+			 * as lines of bytes.
+			 */
+			shape = { rows, lineBytes };
+			strides = { stride, 1 };
+		}
+
+		py::object view = py::reinterpret_steal<py::object>(
+			PyMemoryView_FromObject(planes[i].ptr()));
+		if (!view)
+			throw py::error_already_set();
+
+		arrays.append(py::array(dtype, shape, strides, data.ptr, view));
+	}
+
+	return arrays;
+}
+
+/*
+ * Unpack one line of CSI-2 packed 10-bit samples. The SIMD implementation
+ * processes two groups of four pixels per iteration, reading three bytes past
+ * the second group, and leaves the last group of the line to the scalar
+ * implementation.
+ */
+void unpackLineCSI2P10(const uint8_t *src, uint16_t *dst, unsigned int width)
+{
+	unsigned int x = 0;
+
+#if defined(__SSE2__)
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i mask = _mm_set1_epi16(0x03);
+	/* Shift the LSBs of pixel n to bits 7:6 with a multiplication. */
+	const __m128i lsbShift = _mm_set_epi16(1, 4, 16, 64, 1, 4, 16, 64);
+
+	for (; x + 12 <= width; x += 8, src += 10, dst += 8) {
+		const __m128i g0 = _mm_unpacklo_epi8(
+			_mm_loadl_epi64(reinterpret_cast<const __m128i *>(src)), zero);
+		const __m128i g1 = _mm_unpacklo_epi8(
+			_mm_loadl_epi64(reinterpret_cast<const __m128i *>(src + 5)), zero);
+
+		/* Bytes 0-3 of each group are the MSBs, byte 4 the LSBs. */
+		const __m128i msbs = _mm_unpacklo_epi64(g0, g1);
+		__m128i lsbs = _mm_unpackhi_epi64(g0, g1);
+		lsbs = _mm_shufflehi_epi16(_mm_shufflelo_epi16(lsbs, 0), 0);
+		lsbs = _mm_and_si128(_mm_srli_epi16(_mm_mullo_epi16(lsbs, lsbShift), 6),
+				     mask);
+
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(dst),
+				 _mm_or_si128(_mm_slli_epi16(msbs, 2), lsbs));
+	}
+#endif
+
+	for (; x < width; x += 4, src += 5, dst += 4) {
+		const uint8_t lsbs = src[4];
+
+		dst[0] = (src[0] << 2) | (lsbs & 0x03);
+		dst[1] = (src[1] << 2) | ((lsbs >> 2) & 0x03);
+		dst[2] = (src[2] << 2) | ((lsbs >> 4) & 0x03);
+		dst[3] = (src[3] << 2) | (lsbs >> 6);
+	}
+}
+
+/*
+ * Unpack one line of CSI-2 packed 12-bit samples. The SIMD implementation
+ * processes four groups of two pixels per iteration, reading five bytes past
+ * the fourth group, and leaves the last groups of the line to the scalar
+ * implementation.
+ */
+void unpackLineCSI2P12(const uint8_t *src, uint16_t *dst, unsigned int width)
+{
+	unsigned int x = 0;
+
+#if defined(__SSE2__)
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i low = _mm_set1_epi32(0xffff);
+	const __m128i mask = _mm_set1_epi16(0x0f);
+	/* Shift the LSBs of even pixels to bits 7:4 with a multiplication. */
+	const __m128i lsbShift = _mm_set1_epi32(0x00010010);
+
+	auto load = [&](const uint8_t *p) {
+		return _mm_unpacklo_epi8(
+			_mm_loadl_epi64(reinterpret_cast<const __m128i *>(p)), zero);
+	};
+
+	for (; x + 12 <= width; x += 8, src += 12, dst += 8) {
+		/*
+		 * Gather bytes 0-1 of each group in the low 64 bits of a and
+		 * b, and byte 2 of each group in their high 64 bits.
+		 */
+		const __m128i a = _mm_unpacklo_epi32(load(src), load(src + 3));
+		const __m128i b = _mm_unpacklo_epi32(load(src + 6), load(src + 9));
+
+		const __m128i msbs = _mm_unpacklo_epi64(a, b);
+		__m128i lsbs = _mm_and_si128(_mm_unpackhi_epi64(a, b), low);
+		lsbs = _mm_or_si128(lsbs, _mm_slli_epi32(lsbs, 16));
+		lsbs = _mm_and_si128(_mm_srli_epi16(_mm_mullo_epi16(lsbs, lsbShift), 4),
+				     mask);
+
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(dst),
+				 _mm_or_si128(_mm_slli_epi16(msbs, 4), lsbs));
+	}
+#endif
+
+	for (; x < width; x += 2, src += 3, dst += 2) {
+		const uint8_t lsbs = src[2];
+
+		dst[0] = (src[0] << 4) | (lsbs & 0x0f);
+		dst[1] = (src[1] << 4) | (lsbs >> 4);
+	}
+}
+
+/* Unpack a CSI-2 packed RAW frame to 16-bit samples, without shifting. */
+py::array_t<uint16_t> unpackCSI2P(const py::buffer &src,
+				  const StreamConfiguration &cfg)
+{
+	const PixelFormatInfo &info = PixelFormatInfo::info(cfg.pixelFormat);
+	if (!info.isValid() || !info.packed ||
+	    info.colourEncoding != PixelFormatInfo::ColourEncodingRAW ||
+	    (info.bitsPerPixel != 10 && info.bitsPerPixel != 12))
+		throw std::invalid_argument("Not a CSI-2 packed 10 or 12-bit format");
+
+	const unsigned int width = cfg.size.width;
+	const unsigned int height = cfg.size.height;
+	const unsigned int stride = cfg.stride;
+
+	if (!width || !height || width % info.pixelsPerGroup)
+		throw std::invalid_argument("Invalid width for the pixel format");
+
+	const py::buffer_info buffer = bufferData(src, (height - 1) * stride +
+						  info.stride(width, 0, 1));
+	const uint8_t *data = static_cast<const uint8_t *>(buffer.ptr);
+
+	py::array_t<uint16_t> dst({ height, width });
+	uint16_t *out = dst.mutable_data();
+
+	auto unpackLine = info.bitsPerPixel == 10 ? unpackLineCSI2P10
+						  : unpackLineCSI2P12;
+
+	py::gil_scoped_release release;
+
+	for (unsigned int y = 0; y < height; ++y)
+		unpackLine(data + y * stride, out + y * width, width);
+
+	return dst;
+}
+
+/* Fixed-point YCbCr to RGB conversion coefficients. */
+struct YuvCoefficients {
+	static constexpr unsigned int kShift = 13;
+
+	int y;
+	int crR;
+	int cbG;
+	int crG;
+	int cbB;
+	int yOffset;
+};
+
+YuvCoefficients yuvCoefficients(const std::optional<ColorSpace> &colorSpace)
+{
+	/* Default to the BT.601 limited range encoding. */
+	ColorSpace::YcbcrEncoding encoding = ColorSpace::YcbcrEncoding::Rec601;
+	ColorSpace::Range range = ColorSpace::Range::Limited;
+
+	if (colorSpace) {
+		if (colorSpace->ycbcrEncoding != ColorSpace::YcbcrEncoding::None)
+			encoding = colorSpace->ycbcrEncoding;
+		range = colorSpace->range;
+	}
+
+	double kr, kb;
+	switch (encoding) {
+	case ColorSpace::YcbcrEncoding::Rec709:
+		kr = 0.2126;
+		kb = 0.0722;
+		break;
+	case ColorSpace::YcbcrEncoding::Rec2020:
+		kr = 0.2627;
+		kb = 0.0593;
+		break;
+	default:
+		kr = 0.299;
+		kb = 0.114;
+		break;
+	}
+
+	const double kg = 1.0 - kr - kb;
+
+	double yScale = 1.0;
+	double cScale = 1.0;
+	int yOffset = 0;
+	if (range == ColorSpace::Range::Limited) {
+		yScale = 255.0 / 219.0;
+		cScale = 255.0 / 224.0;
+		yOffset = 16;
+	}
+
+	auto fixed = [](double value) {
+		return static_cast<int>(value * (1 << YuvCoefficients::kShift) + 0.5);
+	};
+
+	return {
+		fixed(yScale),
+		fixed(2.0 * (1.0 - kr) * cScale),
+		fixed(2.0 * kb * (1.0 - kb) / kg * cScale),
+		fixed(2.0 * kr * (1.0 - kr) / kg * cScale),
+		fixed(2.0 * (1.0 - kb) * cScale),
+		yOffset,
+	};
+}
+
+/*
+ * Convert one line of NV12 or NV21 to RGB. The SIMD implementation computes
+ * the same fixed-point values as the scalar implementation, and writes each
+ * pixel with a four bytes store that overlaps the next pixel. It thus stops
+ * before the last pixel of the line, which is left to the scalar
+ * implementation along with the pixels that don't fill a SIMD iteration.
+ */
+void nv12LineToRGB(const YuvCoefficients &coeffs, const uint8_t *y,
+		   const uint8_t *cbcr, unsigned int cbPos, uint8_t *dst,
+		   unsigned int width)
+{
+	constexpr unsigned int shift = YuvCoefficients::kShift;
+	constexpr int round = 1 << (shift - 1);
+	unsigned int x = 0;
+
+#if defined(__SSE2__)
+	/*
+	 * Interleave the Y' and chroma values to compute the products and sums
+	 * in 32-bit precision with _mm_madd_epi16().
+	 */
+	auto pair = [](int a, int b) {
+		return _mm_set1_epi32(static_cast<uint16_t>(a) |
+				      (static_cast<uint32_t>(static_cast<uint16_t>(b)) << 16));
+	};
+
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i low = _mm_set1_epi32(0xffff);
+	const __m128i yOffset = _mm_set1_epi16(coeffs.yOffset);
+	const __m128i cOffset = _mm_set1_epi16(128);
+	const __m128i rounding = _mm_set1_epi32(round);
+	const __m128i kR = pair(coeffs.y, coeffs.crR);
+	const __m128i kG = pair(coeffs.y, -coeffs.cbG);
+	const __m128i kGCr = pair(-coeffs.crG, 0);
+	const __m128i kB = pair(coeffs.y, coeffs.cbB);
+
+	auto scale = [&](__m128i lo, __m128i hi) {
+		lo = _mm_srai_epi32(_mm_add_epi32(lo, rounding), shift);
+		hi = _mm_srai_epi32(_mm_add_epi32(hi, rounding), shift);
+		__m128i v = _mm_packs_epi32(lo, hi);
+		return _mm_packus_epi16(v, v);
+	};
+
+	auto store = [](uint8_t *p, __m128i pixels) {
+		for (unsigned int i = 0; i < 4; ++i, p += 3) {
+			const uint32_t pixel = _mm_cvtsi128_si32(pixels);
+			memcpy(p, &pixel, sizeof(pixel));
+			pixels = _mm_srli_si128(pixels, 4);
+		}
+	};
+
+	for (; x + 8 < width; x += 8) {
+		__m128i vy = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(y + x));
+		__m128i vc = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(cbcr + x));
+
+		vy = _mm_sub_epi16(_mm_unpacklo_epi8(vy, zero), yOffset);
+		vc = _mm_sub_epi16(_mm_unpacklo_epi8(vc, zero), cOffset);
+
+		/* Duplicate the first and second chroma samples of each pair. */
+		const __m128i first = _mm_and_si128(vc, low);
+		const __m128i second = _mm_srli_epi32(vc, 16);
+		__m128i vcb = _mm_or_si128(first, _mm_slli_epi32(first, 16));
+		__m128i vcr = _mm_or_si128(second, _mm_slli_epi32(second, 16));
+		if (cbPos)
+			std::swap(vcb, vcr);
+
+		const __m128i yCrLo = _mm_unpacklo_epi16(vy, vcr);
+		const __m128i yCrHi = _mm_unpackhi_epi16(vy, vcr);
+		const __m128i yCbLo = _mm_unpacklo_epi16(vy, vcb);
+		const __m128i yCbHi = _mm_unpackhi_epi16(vy, vcb);
+		const __m128i crLo = _mm_unpacklo_epi16(vcr, zero);
+		const __m128i crHi = _mm_unpackhi_epi16(vcr, zero);
+
+		const __m128i r = scale(_mm_madd_epi16(yCrLo, kR),
+					_mm_madd_epi16(yCrHi, kR));
+		const __m128i g = scale(_mm_add_epi32(_mm_madd_epi16(yCbLo, kG),
+						      _mm_madd_epi16(crLo, kGCr)),
+					_mm_add_epi32(_mm_madd_epi16(yCbHi, kG),
+						      _mm_madd_epi16(crHi, kGCr)));
+		const __m128i b = scale(_mm_madd_epi16(yCbLo, kB),
+					_mm_madd_epi16(yCbHi, kB));
+
+		const __m128i rg = _mm_unpacklo_epi8(r, g);
+		const __m128i bx = _mm_unpacklo_epi8(b, zero);
+
+		store(dst + 3 * x, _mm_unpacklo_epi16(rg, bx));
+		store(dst + 3 * x + 12, _mm_unpackhi_epi16(rg, bx));
+	}
+#endif
+
+	for (; x < width; ++x) {
+		const int luma = (y[x] - coeffs.yOffset) * coeffs.y + round;
+		const int cb = cbcr[(x & ~1u) + cbPos] - 128;
+		const int cr = cbcr[(x & ~1u) + (cbPos ^ 1)] - 128;
+
+		const int r = (luma + coeffs.crR * cr) >> shift;
+		const int g = (luma - coeffs.cbG * cb - coeffs.crG * cr) >> shift;
+		const int b = (luma + coeffs.cbB * cb) >> shift;
+
+		dst[x * 3 + 0] = std::clamp(r, 0, 255);
+		dst[x * 3 + 1] = std::clamp(g, 0, 255);
+		dst[x * 3 + 2] = std::clamp(b, 0, 255);
+	}
+}
+
+/* Convert an NV12 or NV21 frame to a packed RGB image. */
+py::array_t<uint8_t> nv12ToRGB(const py::buffer &yPlane, const py::buffer &uvPlane,
+			       const StreamConfiguration &cfg)
+{
+	unsigned int cbPos;
+	if (cfg.pixelFormat == formats::NV12)
+		cbPos = 0;
+	else if (cfg.pixelFormat == formats::NV21)
+		cbPos = 1;
+	else
+		throw std::invalid_argument("Not an NV12 or NV21 format");
+
+	const unsigned int width = cfg.size.width;
+	const unsigned int height = cfg.size.height;
+	const unsigned int stride = cfg.stride;
+
+	if (!width || !height)
+		throw std::invalid_argument("Invalid image size");
+
+	const py::buffer_info yBuffer = bufferData(yPlane, (height - 1) * stride + width);
+	const py::buffer_info uvBuffer = bufferData(uvPlane, ((height + 1) / 2 - 1) * stride +
+						    (width + 1) / 2 * 2);
+	const uint8_t *y = static_cast<const uint8_t *>(yBuffer.ptr);
+	const uint8_t *uv = static_cast<const uint8_t *>(uvBuffer.ptr);
+
+	const YuvCoefficients coeffs = yuvCoefficients(cfg.colorSpace);
+
+	py::array_t<uint8_t> dst({ height, width, 3U });
+	uint8_t *out = dst.mutable_data();
+
+	py::gil_scoped_release release;
+
+	for (unsigned int row = 0; row < height; ++row)
+		nv12LineToRGB(coeffs, y + row * stride, uv + row / 2 * stride,
+			      cbPos, out + row * width * 3, width);
+
+	return dst;
+}
+
+} /* namespace */
+
+void init_py_image(py::module &m)
+{
+	m.def("plane_arrays", &planeArrays, py::arg("planes"), py::arg("config"),
+	      "Create NumPy arrays sharing the memory of the frame planes");
+	m.def("unpack_csi2p", &unpackCSI2P, py::arg("data"), py::arg("config"),
+	      "Unpack a CSI-2 packed 10 or 12-bit RAW frame to 16-bit samples");
+	m.def("nv12_to_rgb", &nv12ToRGB, py::arg("y"), py::arg("uv"), py::arg("config"),
+	      "Convert an NV12 or NV21 frame to RGB");
+}
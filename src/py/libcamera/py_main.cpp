@@ -44,6 +44,7 @@ void init_py_enums(py::module &m);
 void init_py_controls_generated(py::module &m);
 void init_py_formats_generated(py::module &m);
 void init_py_geometry(py::module &m);
+void init_py_image(py::module &m);
 void init_py_properties_generated(py::module &m);
 
 PYBIND11_MODULE(_libcamera, m)
@@ -88,6 +89,7 @@ PYBIND11_MODULE(_libcamera, m)
 	auto pyPixelFormat = py::class_<PixelFormat>(m, "PixelFormat");
 
 	init_py_formats_generated(m);
+	init_py_image(m);
 
 	/* Global functions */
 	m.def("log_set_level", &logSetLevel);
@@ -0,0 +1,83 @@
+# SPDX-License-Identifier: LGPL-2.1-or-later
+# Copyright (C) 2022, Tomi Valkeinen <tomi.valkeinen@ideasonboard.com>
+
+import asyncio
+import collections
+import libcamera
+from typing import List
+
+
+class RequestStream:
+    """
+    Asynchronous stream of completed requests
+
+    Integrates the CameraManager's event fd with an asyncio event loop. The
+    completed requests can be awaited with get(), or iterated one by one with
+    'async for'. Only one RequestStream shall exist for a CameraManager at a
+    time, as it retrieves all the ready requests.
+    """
+    def __init__(self, cm: libcamera.CameraManager, loop: asyncio.AbstractEventLoop = None):
+        self.__cm = cm
+        self.__loop = loop if loop else asyncio.get_running_loop()
+        self.__reqs = collections.deque()
+        self.__waiter = None
+        self.__closed = False
+
+        self.__loop.add_reader(cm.event_fd, self.__handle_event)
+
+    async def __aenter__(self):
+        return self
+
+    async def __aexit__(self, exc_type, exc_value, exc_traceback):
+        self.close()
+
+    def close(self):
+        if self.__closed:
+            return
+
+        self.__loop.remove_reader(self.__cm.event_fd)
+        self.__closed = True
+
+        if self.__waiter and not self.__waiter.done():
+            self.__waiter.cancel()
+
+    def __handle_event(self):
+        self.__reqs.extend(self.__cm.get_ready_requests())
+
+        if self.__reqs and self.__waiter and not self.__waiter.done():
+            self.__waiter.set_result(None)
+
+    async def __wait(self):
+        while not self.__reqs:
+            if self.__closed:
+                raise RuntimeError('RequestStream closed')
+
+            self.__waiter = self.__loop.create_future()
+            try:
+                await self.__waiter
+            finally:
+                self.__waiter = None
+
+    async def get(self) -> List[libcamera.Request]:
+        """Wait for completed requests and return all the ready ones"""
+        await self.__wait()
+
+        reqs = list(self.__reqs)
+        self.__reqs.clear()
+        return reqs
+
+    def __aiter__(self):
+        return self
+
+    async def __anext__(self) -> libcamera.Request:
+        if self.__closed and not self.__reqs:
+            raise StopAsyncIteration
+
+        try:
+            await self.__wait()
+        except (RuntimeError, asyncio.CancelledError):
+            if self.__closed:
+                raise StopAsyncIteration
+            raise
+
+        return self.__reqs.popleft()
@@ -8,17 +8,21 @@
 #include "v4l2_camera.h"
 
 #include <errno.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 #include <libcamera/base/log.h>
 
+#include "libcamera/internal/formats.h"
+
 using namespace libcamera;
 
 LOG_DECLARE_CATEGORY(V4L2Compat)
 
 V4L2Camera::V4L2Camera(std::shared_ptr<Camera> camera)
 	: camera_(camera), isRunning_(false), bufferAllocator_(nullptr),
-	  efd_(-1), bufferAvailableCount_(0)
+	  external_(false), completedHead_(0), completedTail_(0), efd_(-1),
+	  bufferAvailableCount_(0)
 {
 	camera_->requestCompleted.connect(this, &V4L2Camera::requestComplete);
 }
@@ -67,16 +71,20 @@ void V4L2Camera::unbind()
 	efd_ = -1;
 }
 
-std::vector<V4L2Camera::Buffer> V4L2Camera::completedBuffers()
+/*
+ * Retrieve the next completed buffer. Return false if no buffer has completed.
+ * Only one thread may call this function at a time.
+ */
+bool V4L2Camera::completedBuffer(Buffer *buffer)
 {
-	std::vector<Buffer> v;
+	unsigned int tail = completedTail_.load(std::memory_order_relaxed);
+	if (tail == completedHead_.load(std::memory_order_acquire))
+		return false;
 
-	MutexLocker lock(bufferLock_);
-	for (std::unique_ptr<Buffer> &metadata : completedBuffers_)
-		v.push_back(*metadata.get());
-	completedBuffers_.clear();
+	*buffer = completedBuffers_[tail & (completedBuffers_.size() - 1)];
+	completedTail_.store(tail + 1, std::memory_order_release);
 
-	return v;
+	return true;
 }
 
 void V4L2Camera::requestComplete(Request *request)
@@ -84,13 +92,25 @@ void V4L2Camera::requestComplete(Request *request)
 	if (request->status() == Request::RequestCancelled)
 		return;
 
-	/* We only have one stream at the moment. */
-	bufferLock_.lock();
+	/*
+	 * We only have one stream at the moment. The ring can't overflow, as
+	 * there can't be more completed buffers than requests.
+	 */
 	FrameBuffer *buffer = request->buffers().begin()->second;
-	std::unique_ptr<Buffer> metadata =
-		std::make_unique<Buffer>(request->cookie(), buffer->metadata());
-	completedBuffers_.push_back(std::move(metadata));
-	bufferLock_.unlock();
+	const FrameMetadata &fmd = buffer->metadata();
+
+	unsigned int head = completedHead_.load(std::memory_order_relaxed);
+	Buffer &completed = completedBuffers_[head & (completedBuffers_.size() - 1)];
+
+	completed.index_ = request->cookie();
+	completed.status_ = fmd.status;
+	completed.sequence_ = fmd.sequence;
+	completed.timestamp_ = fmd.timestamp;
+	completed.bytesused_ = 0;
+	for (const FrameMetadata::Plane &plane : fmd.planes())
+		completed.bytesused_ += plane.bytesused;
+
+	completedHead_.store(head + 1, std::memory_order_release);
 
 	uint64_t data = 1;
 	int ret = ::write(efd_, &data, sizeof(data));
@@ -156,13 +176,33 @@ int V4L2Camera::validateConfiguration(const PixelFormat &pixelFormat,
 	return 0;
 }
 
-int V4L2Camera::allocBuffers(unsigned int count)
+int V4L2Camera::allocBuffers(unsigned int count, bool external)
 {
 	Stream *stream = config_->at(0).stream();
+	int ret = 0;
+
+	/*
+	 * External buffers are imported with importBuffer() when queued, only
+	 * allocate the requests in that case.
+	 */
+	if (external) {
+		importedBuffers_.clear();
+		importedBuffers_.resize(count);
+	} else {
+		ret = bufferAllocator_->allocate(stream);
+		if (ret < 0)
+			return ret;
+	}
 
-	int ret = bufferAllocator_->allocate(stream);
-	if (ret < 0)
-		return ret;
+	external_ = external;
+
+	unsigned int ringSize = 1;
+	while (ringSize < count)
+		ringSize <<= 1;
+
+	completedBuffers_.resize(ringSize);
+	completedHead_ = 0;
+	completedTail_ = 0;
 
 	for (unsigned int i = 0; i < count; i++) {
 		std::unique_ptr<Request> request = camera_->createRequest(i);
@@ -181,6 +221,15 @@ void V4L2Camera::freeBuffers()
 	pendingRequests_.clear();
 	requestPool_.clear();
 
+	completedBuffers_.clear();
+	completedHead_ = 0;
+	completedTail_ = 0;
+
+	if (external_) {
+		importedBuffers_.clear();
+		return;
+	}
+
 	Stream *stream = config_->at(0).stream();
 	bufferAllocator_->free(stream);
 }
@@ -197,6 +246,69 @@ int V4L2Camera::getBufferFd(unsigned int index)
 	return buffers[index]->planes()[0].fd.get();
 }
 
+int V4L2Camera::importBuffer(unsigned int index, int fd)
+{
+	if (!external_ || index >= importedBuffers_.size())
+		return -EINVAL;
+
+	struct stat st;
+	if (fstat(fd, &st) < 0)
+		return -errno;
+
+	/* Applications usually queue the same dmabuf for a given index. */
+	ImportedBuffer &imported = importedBuffers_[index];
+	if (imported.buffer && imported.inode == st.st_ino)
+		return 0;
+
+	const StreamConfiguration &streamConfig = config_->at(0);
+
+	off_t size = lseek(fd, 0, SEEK_END);
+	if (size < 0 || static_cast<size_t>(size) < streamConfig.frameSize) {
+		LOG(V4L2Compat, Error)
+			<< "dmabuf too small for buffer " << index;
+		return -EINVAL;
+	}
+
+	SharedFD sharedFd(fd);
+	if (!sharedFd.isValid())
+		return -EINVAL;
+
+	/* The V4L2 single-planar API stores all planes contiguously. */
+	std::vector<FrameBuffer::Plane> planes;
+	const PixelFormatInfo &info = PixelFormatInfo::info(streamConfig.pixelFormat);
+
+	if (info.isValid()) {
+		size_t offset = 0;
+
+		for (unsigned int i = 0; i < info.numPlanes(); ++i) {
+			unsigned int stride = streamConfig.stride
+					    * info.planes[i].bytesPerGroup
+					    / info.planes[0].bytesPerGroup;
+
+			FrameBuffer::Plane plane;
+			plane.fd = sharedFd;
+			plane.offset = offset;
+			plane.length = info.planeSize(streamConfig.size.height,
+						      i, stride);
+			offset += plane.length;
+
+			planes.push_back(std::move(plane));
+		}
+	} else {
+		FrameBuffer::Plane plane;
+		plane.fd = sharedFd;
+		plane.offset = 0;
+		plane.length = streamConfig.frameSize;
+
+		planes.push_back(std::move(plane));
+	}
+
+	imported.inode = st.st_ino;
+	imported.buffer = std::make_unique<FrameBuffer>(planes);
+
+	return 0;
+}
+
 int V4L2Camera::streamOn()
 {
 	if (isRunning_)
@@ -253,7 +365,17 @@ int V4L2Camera::qbuf(unsigned int index)
 	Request *request = requestPool_[index].get();
 
 	Stream *stream = config_->at(0).stream();
-	FrameBuffer *buffer = bufferAllocator_->buffers(stream)[index].get();
+	FrameBuffer *buffer;
+	if (external_) {
+		buffer = importedBuffers_[index].buffer.get();
+		if (!buffer) {
+			LOG(V4L2Compat, Error) << "Buffer " << index << " not imported";
+			return -EINVAL;
+		}
+	} else {
+		buffer = bufferAllocator_->buffers(stream)[index].get();
+	}
+
 	int ret = request->addBuffer(stream, buffer);
 	if (ret < 0) {
 		LOG(V4L2Compat, Error) << "Can't set buffer for request";
@@ -7,9 +7,12 @@
 
 #pragma once
 
+#include <atomic>
 #include <deque>
 #include <utility>
 
+#include <sys/types.h>
+
 #include <libcamera/base/mutex.h>
 #include <libcamera/base/semaphore.h>
 #include <libcamera/base/shared_fd.h>
@@ -22,13 +25,11 @@ class V4L2Camera
 {
 public:
 	struct Buffer {
-		Buffer(unsigned int index, const libcamera::FrameMetadata &data)
-			: index_(index), data_(data)
-		{
-		}
-
 		unsigned int index_;
-		libcamera::FrameMetadata data_;
+		libcamera::FrameMetadata::Status status_;
+		unsigned int sequence_;
+		uint64_t timestamp_;
+		unsigned int bytesused_;
 	};
 
 	V4L2Camera(std::shared_ptr<libcamera::Camera> camera);
@@ -39,7 +40,7 @@ public:
 	void bind(int efd);
 	void unbind();
 
-	std::vector<Buffer> completedBuffers() LIBCAMERA_TSA_EXCLUDES(bufferLock_);
+	bool completedBuffer(Buffer *buffer);
 
 	int configure(libcamera::StreamConfiguration *streamConfigOut,
 		      const libcamera::Size &size,
@@ -49,9 +50,10 @@ public:
 				  const libcamera::Size &size,
 				  libcamera::StreamConfiguration *streamConfigOut);
 
-	int allocBuffers(unsigned int count);
+	int allocBuffers(unsigned int count, bool external);
 	void freeBuffers();
 	int getBufferFd(unsigned int index);
+	int importBuffer(unsigned int index, int fd);
 
 	int streamOn();
 	int streamOff();
@@ -64,22 +66,39 @@ public:
 	bool isRunning();
 
 private:
-	void requestComplete(libcamera::Request *request)
-		LIBCAMERA_TSA_EXCLUDES(bufferLock_);
+	struct ImportedBuffer {
+		ino_t inode;
+		std::unique_ptr<libcamera::FrameBuffer> buffer;
+	};
+
+	void requestComplete(libcamera::Request *request);
 
 	std::shared_ptr<libcamera::Camera> camera_;
 	std::unique_ptr<libcamera::CameraConfiguration> config_;
 
 	bool isRunning_;
 
-	libcamera::Mutex bufferLock_;
 	libcamera::FrameBufferAllocator *bufferAllocator_;
 
+	/*
+	 * Buffers imported from dmabufs provided by the application, cached
+	 * per index and identified by the dmabuf inode.
+	 */
+	bool external_;
+	std::vector<ImportedBuffer> importedBuffers_;
+
 	std::vector<std::unique_ptr<libcamera::Request>> requestPool_;
 
 	std::deque<libcamera::Request *> pendingRequests_;
-	std::deque<std::unique_ptr<Buffer>> completedBuffers_
-		LIBCAMERA_TSA_GUARDED_BY(bufferLock_);
+
+	/*
+	 * Single-producer single-consumer ring of completed buffers, filled by
+	 * requestComplete() and drained by completedBuffer() without locking.
+	 * Its size is a power of two large enough to hold all the requests.
+	 */
+	std::vector<Buffer> completedBuffers_;
+	std::atomic<unsigned int> completedHead_;
+	std::atomic<unsigned int> completedTail_;
 
 	int efd_;
 
@@ -10,7 +10,6 @@
 #include <algorithm>
 #include <array>
 #include <errno.h>
-#include <numeric>
 #include <set>
 #include <string.h>
 #include <sys/mman.h>
@@ -40,7 +39,8 @@ LOG_DECLARE_CATEGORY(V4L2Compat)
 V4L2CameraProxy::V4L2CameraProxy(unsigned int index,
 				 std::shared_ptr<Camera> camera)
 	: refcount_(0), index_(index), bufferCount_(0), currentBuf_(0),
-	  vcam_(std::make_unique<V4L2Camera>(camera)), owner_(nullptr)
+	  memory_(V4L2_MEMORY_MMAP), vcam_(std::make_unique<V4L2Camera>(camera)),
+	  owner_(nullptr)
 {
 	querycap(camera);
 }
@@ -89,7 +89,10 @@ void V4L2CameraProxy::close(V4L2CameraFile *file)
 
 	files_.erase(file);
 
-	release(file);
+	{
+		MutexLocker bufferLocker(bufferMutex_);
+		release(file);
+	}
 
 	if (--refcount_ > 0)
 		return;
@@ -104,6 +107,12 @@ void *V4L2CameraProxy::mmap(V4L2CameraFile *file, void *addr, size_t length,
 		<< "[" << file->description() << "] " << __func__ << "()";
 
 	MutexLocker locker(proxyMutex_);
+	MutexLocker bufferLocker(bufferMutex_);
+
+	if (memory_ != V4L2_MEMORY_MMAP) {
+		errno = EINVAL;
+		return MAP_FAILED;
+	}
 
 	/*
 	 * Mimic the videobuf2 behaviour, which requires PROT_READ and
@@ -149,6 +158,7 @@ int V4L2CameraProxy::munmap(V4L2CameraFile *file, void *addr, size_t length)
 		<< "[" << file->description() << "] " << __func__ << "()";
 
 	MutexLocker locker(proxyMutex_);
+	MutexLocker bufferLocker(bufferMutex_);
 
 	auto iter = mmaps_.find(addr);
 	if (iter == mmaps_.end() || length != sizeimage_) {
@@ -173,7 +183,26 @@ bool V4L2CameraProxy::validateBufferType(uint32_t type)
 
 bool V4L2CameraProxy::validateMemoryType(uint32_t memory)
 {
-	return memory == V4L2_MEMORY_MMAP;
+	return memory == memory_;
+}
+
+int V4L2CameraProxy::mapUserptrBuffers()
+{
+	for (unsigned int i = 0; i < bufferCount_; i++) {
+		int fd = vcam_->getBufferFd(i);
+		if (fd < 0)
+			return -EINVAL;
+
+		void *map = V4L2CompatManager::instance()->fops().mmap(nullptr, sizeimage_,
+								       PROT_READ, MAP_SHARED,
+								       fd, 0);
+		if (map == MAP_FAILED)
+			return -errno;
+
+		userptrMaps_.emplace_back(static_cast<uint8_t *>(map), sizeimage_);
+	}
+
+	return 0;
 }
 
 void V4L2CameraProxy::setFmtFromConfig(const StreamConfiguration &streamConfig)
@@ -218,22 +247,18 @@ void V4L2CameraProxy::querycap(std::shared_ptr<Camera> camera)
 
 void V4L2CameraProxy::updateBuffers()
 {
-	std::vector<V4L2Camera::Buffer> completedBuffers = vcam_->completedBuffers();
-	for (const V4L2Camera::Buffer &buffer : completedBuffers) {
-		const FrameMetadata &fmd = buffer.data_;
+	V4L2Camera::Buffer buffer;
+
+	while (vcam_->completedBuffer(&buffer)) {
 		struct v4l2_buffer &buf = buffers_[buffer.index_];
 
-		switch (fmd.status) {
+		switch (buffer.status_) {
 		case FrameMetadata::FrameSuccess:
-			buf.bytesused = std::accumulate(fmd.planes().begin(),
-							fmd.planes().end(), 0,
-							[](unsigned int total, const auto &plane) {
-								return total + plane.bytesused;
-							});
+			buf.bytesused = buffer.bytesused_;
 			buf.field = V4L2_FIELD_NONE;
-			buf.timestamp.tv_sec = fmd.timestamp / 1000000000;
-			buf.timestamp.tv_usec = (fmd.timestamp / 1000) % 1000000;
-			buf.sequence = fmd.sequence;
+			buf.timestamp.tv_sec = buffer.timestamp_ / 1000000000;
+			buf.timestamp.tv_usec = (buffer.timestamp_ / 1000) % 1000000;
+			buf.sequence = buffer.sequence_;
 
 			buf.flags |= V4L2_BUF_FLAG_DONE;
 			break;
@@ -357,6 +382,8 @@ int V4L2CameraProxy::vidioc_s_fmt(V4L2CameraFile *file, struct v4l2_format *arg)
 	if (file->priority() < maxPriority())
 		return -EBUSY;
 
+	MutexLocker locker(bufferMutex_);
+
 	int ret = acquire(file);
 	if (ret < 0)
 		return ret;
@@ -468,6 +495,10 @@ int V4L2CameraProxy::vidioc_s_input(V4L2CameraFile *file, int *arg)
 
 void V4L2CameraProxy::freeBuffers()
 {
+	for (Span<uint8_t> &map : userptrMaps_)
+		V4L2CompatManager::instance()->fops().munmap(map.data(), map.size());
+	userptrMaps_.clear();
+
 	vcam_->freeBuffers();
 	buffers_.clear();
 	bufferCount_ = 0;
@@ -478,8 +509,12 @@ int V4L2CameraProxy::vidioc_reqbufs(V4L2CameraFile *file, struct v4l2_requestbuf
 	LOG(V4L2Compat, Debug)
 		<< "[" << file->description() << "] " << __func__ << "()";
 
-	if (!validateBufferType(arg->type) ||
-	    !validateMemoryType(arg->memory))
+	if (!validateBufferType(arg->type))
+		return -EINVAL;
+
+	if (arg->memory != V4L2_MEMORY_MMAP &&
+	    arg->memory != V4L2_MEMORY_USERPTR &&
+	    arg->memory != V4L2_MEMORY_DMABUF)
 		return -EINVAL;
 
 	LOG(V4L2Compat, Debug) << arg->count << " buffers requested ";
@@ -487,10 +522,14 @@ int V4L2CameraProxy::vidioc_reqbufs(V4L2CameraFile *file, struct v4l2_requestbuf
 	if (file->priority() < maxPriority())
 		return -EBUSY;
 
+	MutexLocker locker(bufferMutex_);
+
 	if (!hasOwnership(file) && owner_)
 		return -EBUSY;
 
-	arg->capabilities = V4L2_BUF_CAP_SUPPORTS_MMAP;
+	arg->capabilities = V4L2_BUF_CAP_SUPPORTS_MMAP
+			  | V4L2_BUF_CAP_SUPPORTS_USERPTR
+			  | V4L2_BUF_CAP_SUPPORTS_DMABUF;
 	arg->flags = 0;
 	memset(arg->reserved, 0, sizeof(arg->reserved));
 
@@ -511,6 +550,8 @@ int V4L2CameraProxy::vidioc_reqbufs(V4L2CameraFile *file, struct v4l2_requestbuf
 	if (bufferCount_ > 0)
 		freeBuffers();
 
+	memory_ = arg->memory;
+
 	Size size(v4l2PixFormat_.width, v4l2PixFormat_.height);
 	V4L2PixelFormat v4l2Format = V4L2PixelFormat(v4l2PixFormat_.pixelformat);
 	int ret = vcam_->configure(&streamConfig_, size,
@@ -523,19 +564,31 @@ int V4L2CameraProxy::vidioc_reqbufs(V4L2CameraFile *file, struct v4l2_requestbuf
 	arg->count = streamConfig_.bufferCount;
 	bufferCount_ = arg->count;
 
-	ret = vcam_->allocBuffers(arg->count);
+	/* DMABUF buffers are imported from the application when queued. */
+	ret = vcam_->allocBuffers(arg->count, memory_ == V4L2_MEMORY_DMABUF);
 	if (ret < 0) {
 		arg->count = 0;
+		bufferCount_ = 0;
 		return ret;
 	}
 
+	if (memory_ == V4L2_MEMORY_USERPTR) {
+		ret = mapUserptrBuffers();
+		if (ret < 0) {
+			freeBuffers();
+			arg->count = 0;
+			return ret;
+		}
+	}
+
 	buffers_.resize(arg->count);
 	for (unsigned int i = 0; i < arg->count; i++) {
 		struct v4l2_buffer buf = {};
 		buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
 		buf.length = v4l2PixFormat_.sizeimage;
-		buf.memory = V4L2_MEMORY_MMAP;
-		buf.m.offset = i * v4l2PixFormat_.sizeimage;
+		buf.memory = memory_;
+		if (memory_ == V4L2_MEMORY_MMAP)
+			buf.m.offset = i * v4l2PixFormat_.sizeimage;
 		buf.index = i;
 		buf.flags = V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC;
 
@@ -620,7 +673,35 @@ int V4L2CameraProxy::vidioc_qbuf(V4L2CameraFile *file, struct v4l2_buffer *arg)
 	    arg->index >= bufferCount_)
 		return -EINVAL;
 
-	int ret = vcam_->qbuf(arg->index);
+	struct v4l2_buffer &buffer = buffers_[arg->index];
+	int ret;
+
+	switch (memory_) {
+	case V4L2_MEMORY_USERPTR:
+		if (!arg->m.userptr || arg->length < sizeimage_)
+			return -EINVAL;
+
+		buffer.m.userptr = arg->m.userptr;
+		buffer.length = arg->length;
+		break;
+
+	case V4L2_MEMORY_DMABUF:
+		if (arg->length && arg->length < sizeimage_)
+			return -EINVAL;
+
+		ret = vcam_->importBuffer(arg->index, arg->m.fd);
+		if (ret < 0)
+			return ret;
+
+		buffer.m.fd = arg->m.fd;
+		buffer.length = arg->length ? arg->length : sizeimage_;
+		break;
+
+	default:
+		break;
+	}
+
+	ret = vcam_->qbuf(arg->index);
 	if (ret < 0)
 		return ret;
 
@@ -668,8 +749,14 @@ int V4L2CameraProxy::vidioc_dqbuf(V4L2CameraFile *file, struct v4l2_buffer *arg,
 
 	struct v4l2_buffer &buf = buffers_[currentBuf_];
 
+	if (memory_ == V4L2_MEMORY_USERPTR && !(buf.flags & V4L2_BUF_FLAG_ERROR))
+		memcpy(reinterpret_cast<void *>(buf.m.userptr),
+		       userptrMaps_[currentBuf_].data(),
+		       std::min<size_t>(buf.bytesused, buf.length));
+
 	buf.flags &= ~(V4L2_BUF_FLAG_QUEUED | V4L2_BUF_FLAG_DONE | V4L2_BUF_FLAG_PREPARED);
-	buf.length = sizeimage_;
+	if (memory_ == V4L2_MEMORY_MMAP)
+		buf.length = sizeimage_;
 	*arg = buf;
 
 	currentBuf_ = (currentBuf_ + 1) % bufferCount_;
@@ -687,11 +774,12 @@ int V4L2CameraProxy::vidioc_expbuf(V4L2CameraFile *file, struct v4l2_exportbuffe
 	LOG(V4L2Compat, Debug)
 		<< "[" << file->description() << "] " << __func__ << "()";
 
+	MutexLocker locker(bufferMutex_);
+
 	if (!hasOwnership(file))
 		return -EBUSY;
 
-	/* \todo Verify that the memory type is MMAP when adding DMABUF support */
-	if (!validateBufferType(arg->type))
+	if (!validateBufferType(arg->type) || memory_ != V4L2_MEMORY_MMAP)
 		return -EINVAL;
 
 	if (arg->index >= bufferCount_)
@@ -714,6 +802,8 @@ int V4L2CameraProxy::vidioc_streamon(V4L2CameraFile *file, int *arg)
 	LOG(V4L2Compat, Debug)
 		<< "[" << file->description() << "] " << __func__ << "()";
 
+	MutexLocker locker(bufferMutex_);
+
 	if (bufferCount_ == 0)
 		return -EINVAL;
 
@@ -745,6 +835,8 @@ int V4L2CameraProxy::vidioc_streamoff(V4L2CameraFile *file, int *arg)
 	if (file->priority() < maxPriority())
 		return -EBUSY;
 
+	MutexLocker locker(bufferMutex_);
+
 	if (!hasOwnership(file) && owner_)
 		return -EBUSY;
 
@@ -778,25 +870,11 @@ const std::set<unsigned long> V4L2CameraProxy::supportedIoctls_ = {
 	VIDIOC_STREAMOFF,
 };
 
-int V4L2CameraProxy::ioctl(V4L2CameraFile *file, unsigned long request, void *arg)
+int V4L2CameraProxy::controlIoctl(V4L2CameraFile *file, unsigned long request,
+				  void *arg)
 {
 	MutexLocker locker(proxyMutex_);
 
-	if (!arg && (_IOC_DIR(request) & _IOC_WRITE)) {
-		errno = EFAULT;
-		return -1;
-	}
-
-	if (supportedIoctls_.find(request) == supportedIoctls_.end()) {
-		errno = ENOTTY;
-		return -1;
-	}
-
-	if (!arg && (_IOC_DIR(request) & _IOC_READ)) {
-		errno = EFAULT;
-		return -1;
-	}
-
 	int ret;
 	switch (request) {
 	case VIDIOC_QUERYCAP:
@@ -835,15 +913,6 @@ int V4L2CameraProxy::ioctl(V4L2CameraFile *file, unsigned long request, void *ar
 	case VIDIOC_REQBUFS:
 		ret = vidioc_reqbufs(file, static_cast<struct v4l2_requestbuffers *>(arg));
 		break;
-	case VIDIOC_QUERYBUF:
-		ret = vidioc_querybuf(file, static_cast<struct v4l2_buffer *>(arg));
-		break;
-	case VIDIOC_QBUF:
-		ret = vidioc_qbuf(file, static_cast<struct v4l2_buffer *>(arg));
-		break;
-	case VIDIOC_DQBUF:
-		ret = vidioc_dqbuf(file, static_cast<struct v4l2_buffer *>(arg), &proxyMutex_);
-		break;
 	case VIDIOC_EXPBUF:
 		ret = vidioc_expbuf(file, static_cast<struct v4l2_exportbuffer *>(arg));
 		break;
@@ -858,6 +927,62 @@ int V4L2CameraProxy::ioctl(V4L2CameraFile *file, unsigned long request, void *ar
 		break;
 	}
 
+	return ret;
+}
+
+int V4L2CameraProxy::bufferIoctl(V4L2CameraFile *file, unsigned long request,
+				 void *arg)
+{
+	MutexLocker locker(bufferMutex_);
+
+	int ret;
+	switch (request) {
+	case VIDIOC_QUERYBUF:
+		ret = vidioc_querybuf(file, static_cast<struct v4l2_buffer *>(arg));
+		break;
+	case VIDIOC_QBUF:
+		ret = vidioc_qbuf(file, static_cast<struct v4l2_buffer *>(arg));
+		break;
+	case VIDIOC_DQBUF:
+		ret = vidioc_dqbuf(file, static_cast<struct v4l2_buffer *>(arg), &bufferMutex_);
+		break;
+	default:
+		ret = -ENOTTY;
+		break;
+	}
+
+	return ret;
+}
+
+int V4L2CameraProxy::ioctl(V4L2CameraFile *file, unsigned long request, void *arg)
+{
+	if (!arg && (_IOC_DIR(request) & _IOC_WRITE)) {
+		errno = EFAULT;
+		return -1;
+	}
+
+	if (supportedIoctls_.find(request) == supportedIoctls_.end()) {
+		errno = ENOTTY;
+		return -1;
+	}
+
+	if (!arg && (_IOC_DIR(request) & _IOC_READ)) {
+		errno = EFAULT;
+		return -1;
+	}
+
+	int ret;
+	switch (request) {
+	case VIDIOC_QUERYBUF:
+	case VIDIOC_QBUF:
+	case VIDIOC_DQBUF:
+		ret = bufferIoctl(file, request, arg);
+		break;
+	default:
+		ret = controlIoctl(file, request, arg);
+		break;
+	}
+
 	if (ret < 0) {
 		errno = -ret;
 		return -1;
@@ -15,6 +15,7 @@
 #include <vector>
 
 #include <libcamera/base/mutex.h>
+#include <libcamera/base/span.h>
 
 #include <libcamera/camera.h>
 
@@ -35,11 +36,12 @@ public:
 		LIBCAMERA_TSA_EXCLUDES(proxyMutex_);
 
 	int ioctl(V4L2CameraFile *file, unsigned long request, void *arg)
-		LIBCAMERA_TSA_EXCLUDES(proxyMutex_);
+		LIBCAMERA_TSA_EXCLUDES(proxyMutex_, bufferMutex_);
 
 private:
 	bool validateBufferType(uint32_t type);
 	bool validateMemoryType(uint32_t memory);
+	int mapUserptrBuffers();
 	void setFmtFromConfig(const libcamera::StreamConfiguration &streamConfig);
 	void querycap(std::shared_ptr<libcamera::Camera> camera);
 	int tryFormat(struct v4l2_format *arg);
@@ -47,6 +49,11 @@ private:
 	void updateBuffers();
 	void freeBuffers();
 
+	int controlIoctl(V4L2CameraFile *file, unsigned long request, void *arg)
+		LIBCAMERA_TSA_EXCLUDES(proxyMutex_);
+	int bufferIoctl(V4L2CameraFile *file, unsigned long request, void *arg)
+		LIBCAMERA_TSA_EXCLUDES(bufferMutex_);
+
 	int vidioc_querycap(V4L2CameraFile *file, struct v4l2_capability *arg);
 	int vidioc_enum_framesizes(V4L2CameraFile *file, struct v4l2_frmsizeenum *arg);
 	int vidioc_enum_fmt(V4L2CameraFile *file, struct v4l2_fmtdesc *arg);
@@ -69,8 +76,8 @@ private:
 	int vidioc_streamoff(V4L2CameraFile *file, int *arg);
 
 	bool hasOwnership(V4L2CameraFile *file);
-	int acquire(V4L2CameraFile *file);
-	void release(V4L2CameraFile *file);
+	int acquire(V4L2CameraFile *file) LIBCAMERA_TSA_REQUIRES(bufferMutex_);
+	void release(V4L2CameraFile *file) LIBCAMERA_TSA_REQUIRES(bufferMutex_);
 
 	static const std::set<unsigned long> supportedIoctls_;
 
@@ -85,9 +92,19 @@ private:
 	struct v4l2_capability capabilities_;
 	struct v4l2_pix_format v4l2PixFormat_;
 
+	/* Memory type selected by the last reqbufs call. */
+	uint32_t memory_;
+
 	std::vector<struct v4l2_buffer> buffers_;
 	std::map<void *, unsigned int> mmaps_;
 
+	/*
+	 * Mappings of the internal buffers for V4L2_MEMORY_USERPTR. Frames are
+	 * copied to the application memory when dequeued, as user pointers
+	 * can't be imported as dmabufs.
+	 */
+	std::vector<libcamera::Span<uint8_t>> userptrMaps_;
+
 	std::set<V4L2CameraFile *> files_;
 
 	std::unique_ptr<V4L2Camera> vcam_;
@@ -103,6 +120,14 @@ private:
 	 */
 	V4L2CameraFile *owner_;
 
-	/* This mutex is to serialize access to the proxy. */
+	/*
+	 * This mutex is to serialize access to the proxy. Buffer queuing
+	 * ioctls only take the bufferMutex_, which protects the buffers and
+	 * ownership, allowing applications to queue and dequeue buffers from
+	 * different threads without contending with other operations. The
+	 * proxyMutex_ must be taken before the bufferMutex_ when both are
+	 * needed.
+	 */
 	libcamera::Mutex proxyMutex_;
+	libcamera::Mutex bufferMutex_;
 };
@@ -104,19 +104,29 @@ LIBCAMERA_PUBLIC int close(int fd)
 	return V4L2CompatManager::instance()->close(fd);
 }
 
+/*
+ * mmap() and ioctl() are called at high rates on files unrelated to cameras,
+ * pass them through directly without looking up the camera files.
+ */
 LIBCAMERA_PUBLIC void *mmap(void *addr, size_t length, int prot, int flags,
 			    int fd, off_t offset)
 {
-	return V4L2CompatManager::instance()->mmap(addr, length, prot, flags,
-						   fd, offset);
+	V4L2CompatManager *manager = V4L2CompatManager::instance();
+	if (!manager->isCameraFd(fd))
+		return manager->fops().mmap(addr, length, prot, flags, fd, offset);
+
+	return manager->mmap(addr, length, prot, flags, fd, offset);
 }
 
 #ifndef mmap64
 LIBCAMERA_PUBLIC void *mmap64(void *addr, size_t length, int prot, int flags,
 			      int fd, off64_t offset)
 {
-	return V4L2CompatManager::instance()->mmap(addr, length, prot, flags,
-						   fd, offset);
+	V4L2CompatManager *manager = V4L2CompatManager::instance();
+	if (!manager->isCameraFd(fd))
+		return manager->fops().mmap(addr, length, prot, flags, fd, offset);
+
+	return manager->mmap(addr, length, prot, flags, fd, offset);
 }
 #endif
 
@@ -130,7 +140,11 @@ LIBCAMERA_PUBLIC int ioctl(int fd, unsigned long request, ...)
 	void *arg;
 	extract_va_arg(void *, arg, request);
 
-	return V4L2CompatManager::instance()->ioctl(fd, request, arg);
+	V4L2CompatManager *manager = V4L2CompatManager::instance();
+	if (!manager->isCameraFd(fd))
+		return manager->fops().ioctl(fd, request, arg);
+
+	return manager->ioctl(fd, request, arg);
 }
 
 }
@@ -40,7 +40,7 @@ void get_symbol(T &func, const char *name)
 } /* namespace */
 
 V4L2CompatManager::V4L2CompatManager()
-	: cm_(nullptr)
+	: cm_(nullptr), cameraFds_{}, highCameraFds_(0), numMmaps_(0)
 {
 	get_symbol(fops_.openat, "openat64");
 	get_symbol(fops_.dup, "dup");
@@ -52,8 +52,16 @@ V4L2CompatManager::V4L2CompatManager()
 
 V4L2CompatManager::~V4L2CompatManager()
 {
-	files_.clear();
-	mmaps_.clear();
+	{
+		MutexLocker locker(mutex_);
+
+		for (const auto &file : files_)
+			setCameraFd(file.first, false);
+
+		files_.clear();
+		mmaps_.clear();
+		numMmaps_ = 0;
+	}
 
 	if (cm_) {
 		proxies_.clear();
@@ -99,6 +107,11 @@ V4L2CompatManager *V4L2CompatManager::instance()
 
 std::shared_ptr<V4L2CameraFile> V4L2CompatManager::cameraFile(int fd)
 {
+	if (!isCameraFd(fd))
+		return nullptr;
+
+	MutexLocker locker(mutex_);
+
 	auto file = files_.find(fd);
 	if (file == files_.end())
 		return nullptr;
@@ -106,6 +119,23 @@ std::shared_ptr<V4L2CameraFile> V4L2CompatManager::cameraFile(int fd)
 	return file->second;
 }
 
+void V4L2CompatManager::setCameraFd(int fd, bool camera)
+{
+	if (static_cast<unsigned int>(fd) >= kFdBitmapSize) {
+		if (camera)
+			highCameraFds_++;
+		else
+			highCameraFds_--;
+		return;
+	}
+
+	uint64_t bit = UINT64_C(1) << (fd % 64);
+	if (camera)
+		cameraFds_[fd / 64].fetch_or(bit, std::memory_order_release);
+	else
+		cameraFds_[fd / 64].fetch_and(~bit, std::memory_order_release);
+}
+
 int V4L2CompatManager::getCameraIndex(int fd)
 {
 	struct stat statbuf;
@@ -156,9 +186,15 @@ int V4L2CompatManager::openat(int dirfd, const char *path, int oflag, mode_t mod
 		return efd;
 
 	V4L2CameraProxy *proxy = proxies_[ret].get();
-	files_.emplace(efd, std::make_shared<V4L2CameraFile>(dirfd, path, efd,
-							     oflag & O_NONBLOCK,
-							     proxy));
+	std::shared_ptr<V4L2CameraFile> file =
+		std::make_shared<V4L2CameraFile>(dirfd, path, efd,
+						 oflag & O_NONBLOCK, proxy);
+
+	{
+		MutexLocker locker(mutex_);
+		files_.emplace(efd, std::move(file));
+		setCameraFd(efd, true);
+	}
 
 	LOG(V4L2Compat, Debug) << "Opened " << path << " -> fd " << efd;
 	return efd;
@@ -167,21 +203,31 @@ int V4L2CompatManager::openat(int dirfd, const char *path, int oflag, mode_t mod
 int V4L2CompatManager::dup(int oldfd)
 {
 	int newfd = fops_.dup(oldfd);
-	if (newfd < 0)
+	if (newfd < 0 || !isCameraFd(oldfd))
 		return newfd;
 
+	MutexLocker locker(mutex_);
+
 	auto file = files_.find(oldfd);
-	if (file != files_.end())
+	if (file != files_.end()) {
 		files_[newfd] = file->second;
+		setCameraFd(newfd, true);
+	}
 
 	return newfd;
 }
 
 int V4L2CompatManager::close(int fd)
 {
-	auto file = files_.find(fd);
-	if (file != files_.end())
-		files_.erase(file);
+	if (isCameraFd(fd)) {
+		MutexLocker locker(mutex_);
+
+		auto file = files_.find(fd);
+		if (file != files_.end()) {
+			files_.erase(file);
+			setCameraFd(fd, false);
+		}
+	}
 
 	/* We still need to close the eventfd. */
 	return fops_.close(fd);
@@ -199,23 +245,37 @@ void *V4L2CompatManager::mmap(void *addr, size_t length, int prot, int flags,
 	if (map == MAP_FAILED)
 		return map;
 
+	MutexLocker locker(mutex_);
 	mmaps_[map] = file;
+	numMmaps_ = mmaps_.size();
+
 	return map;
 }
 
 int V4L2CompatManager::munmap(void *addr, size_t length)
 {
-	auto device = mmaps_.find(addr);
-	if (device == mmaps_.end())
+	if (!numMmaps_.load(std::memory_order_acquire))
 		return fops_.munmap(addr, length);
 
-	V4L2CameraFile *file = device->second.get();
+	std::shared_ptr<V4L2CameraFile> file;
+
+	{
+		MutexLocker locker(mutex_);
+
+		auto device = mmaps_.find(addr);
+		if (device == mmaps_.end())
+			return fops_.munmap(addr, length);
+
+		file = device->second;
+	}
 
-	int ret = file->proxy()->munmap(file, addr, length);
+	int ret = file->proxy()->munmap(file.get(), addr, length);
 	if (ret < 0)
 		return ret;
 
-	mmaps_.erase(device);
+	MutexLocker locker(mutex_);
+	mmaps_.erase(addr);
+	numMmaps_ = mmaps_.size();
 
 	return 0;
 }
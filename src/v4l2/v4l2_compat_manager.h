@@ -7,12 +7,17 @@
 
 #pragma once
 
+#include <array>
+#include <atomic>
 #include <fcntl.h>
 #include <map>
 #include <memory>
+#include <stdint.h>
 #include <sys/types.h>
 #include <vector>
 
+#include <libcamera/base/mutex.h>
+
 #include <libcamera/camera_manager.h>
 
 #include "v4l2_camera_proxy.h"
@@ -42,6 +47,22 @@ public:
 
 	const FileOperations &fops() const { return fops_; }
 
+	/*
+	 * Check without locking if a file descriptor may refer to a camera.
+	 * This allows fast pass-through of operations on other files.
+	 */
+	bool isCameraFd(int fd) const
+	{
+		if (fd < 0)
+			return false;
+
+		if (static_cast<unsigned int>(fd) >= kFdBitmapSize)
+			return highCameraFds_.load(std::memory_order_acquire);
+
+		uint64_t bits = cameraFds_[fd / 64].load(std::memory_order_acquire);
+		return bits & (UINT64_C(1) << (fd % 64));
+	}
+
 	int openat(int dirfd, const char *path, int oflag, mode_t mode);
 
 	int dup(int oldfd);
@@ -52,18 +73,35 @@ public:
 	int ioctl(int fd, unsigned long request, void *arg);
 
 private:
+	/* Number of file descriptors tracked by the cameraFds_ bitmap. */
+	static constexpr unsigned int kFdBitmapSize = 1024;
+
 	V4L2CompatManager();
 	~V4L2CompatManager();
 
 	int start();
 	int getCameraIndex(int fd);
-	std::shared_ptr<V4L2CameraFile> cameraFile(int fd);
+	std::shared_ptr<V4L2CameraFile> cameraFile(int fd)
+		LIBCAMERA_TSA_EXCLUDES(mutex_);
+	void setCameraFd(int fd, bool camera) LIBCAMERA_TSA_REQUIRES(mutex_);
 
 	FileOperations fops_;
 
 	libcamera::CameraManager *cm_;
 
 	std::vector<std::unique_ptr<V4L2CameraProxy>> proxies_;
-	std::map<int, std::shared_ptr<V4L2CameraFile>> files_;
-	std::map<void *, std::shared_ptr<V4L2CameraFile>> mmaps_;
+
+	libcamera::Mutex mutex_;
+	std::map<int, std::shared_ptr<V4L2CameraFile>> files_
+		LIBCAMERA_TSA_GUARDED_BY(mutex_);
+	std::map<void *, std::shared_ptr<V4L2CameraFile>> mmaps_
+		LIBCAMERA_TSA_GUARDED_BY(mutex_);
+
+	/*
+	 * Lock-free mirrors of files_ and mmaps_, updated with the mutex_ held.
+	 * File descriptors above the bitmap size are only counted.
+	 */
+	std::array<std::atomic<uint64_t>, kFdBitmapSize / 64> cameraFds_;
+	std::atomic<unsigned int> highCameraFds_;
+	std::atomic<unsigned int> numMmaps_;
 };
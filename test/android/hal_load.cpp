@@ -0,0 +1,330 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2022, Google Inc.
+ *
+ * hal_load.cpp - Android camera HAL synthetic load test
+ *
+ * Open the first camera available through the camera HAL module entry points,
+ * stream a YUV stream with all buffers queued as fast as the HAL accepts them,
+ * verify that capture results are delivered in order, and print the HAL dump
+ * output with the request latency statistics.
+ */
+
+#include <chrono>
+#include <condition_variable>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <hardware/camera3.h>
+#include <hardware/camera_common.h>
+#include <hardware/hardware.h>
+
+#include <libcamera/dma_buf_allocator.h>
+
+#include "test.h"
+
+using namespace libcamera;
+using namespace std;
+using namespace std::chrono_literals;
+
+extern camera_module_t HAL_MODULE_INFO_SYM;
+
+class HalLoadTest : public Test
+{
+protected:
+	static constexpr unsigned int kRequests = 120;
+	static constexpr unsigned int kWidth = 640;
+	static constexpr unsigned int kHeight = 480;
+
+	struct Callbacks : camera3_callback_ops_t {
+		HalLoadTest *test;
+	};
+
+	static void processCaptureResult(const camera3_callback_ops_t *ops,
+					 const camera3_capture_result_t *result)
+	{
+		static_cast<const Callbacks *>(ops)->test->captureResult(result);
+	}
+
+	static void notify(const camera3_callback_ops_t *ops,
+			   const camera3_notify_msg_t *msg)
+	{
+		if (msg->type != CAMERA3_MSG_ERROR)
+			return;
+
+		HalLoadTest *test = static_cast<const Callbacks *>(ops)->test;
+		std::unique_lock<std::mutex> locker(test->mutex_);
+		test->errors_++;
+	}
+
+	static void cameraDeviceStatusChange([[maybe_unused]] const camera_module_callbacks_t *callbacks,
+					     [[maybe_unused]] int cameraId,
+					     [[maybe_unused]] int newStatus)
+	{
+	}
+
+	static void torchModeStatusChange([[maybe_unused]] const camera_module_callbacks_t *callbacks,
+					  [[maybe_unused]] const char *cameraId,
+					  [[maybe_unused]] int newStatus)
+	{
+	}
+
+	void captureResult(const camera3_capture_result_t *result)
+	{
+		std::unique_lock<std::mutex> locker(mutex_);
+
+		if (!result->num_output_buffers)
+			return;
+
+		if (result->frame_number != nextFrame_)
+			outOfOrder_++;
+		nextFrame_ = result->frame_number + 1;
+
+		for (unsigned int i = 0; i < result->num_output_buffers; ++i) {
+			const camera3_stream_buffer_t &buffer = result->output_buffers[i];
+
+			if (buffer.status != CAMERA3_BUFFER_STATUS_OK)
+				errors_++;
+
+			freeBuffers_.push_back(buffer.buffer);
+		}
+
+		completed_++;
+		cv_.notify_all();
+	}
+
+	int init() override
+	{
+		camera_module_t *module = &HAL_MODULE_INFO_SYM;
+
+		moduleCallbacks_.camera_device_status_change = cameraDeviceStatusChange;
+		moduleCallbacks_.torch_mode_status_change = torchModeStatusChange;
+
+		if (module->init() ||
+		    module->set_callbacks(&moduleCallbacks_)) {
+			cerr << "Failed to initialize the HAL" << endl;
+			return TestFail;
+		}
+
+		/* Pick the first internal camera, or the first external one. */
+		std::vector<int> ids;
+		for (int id = 0; id < module->get_number_of_cameras(); ++id)
+			ids.push_back(id);
+		ids.push_back(1000);
+
+		int cameraId = -1;
+		for (int id : ids) {
+			struct camera_info info;
+			if (!module->get_camera_info(id, &info)) {
+				cameraId = id;
+				break;
+			}
+		}
+
+		if (cameraId < 0) {
+			cout << "No camera available through the HAL" << endl;
+			return TestSkip;
+		}
+
+		hw_device_t *hwDevice;
+		int ret = module->common.methods->open(&module->common,
+						       std::to_string(cameraId).c_str(),
+						       &hwDevice);
+		if (ret) {
+			cerr << "Failed to open camera " << cameraId << endl;
+			return TestFail;
+		}
+
+		device_ = reinterpret_cast<camera3_device_t *>(hwDevice);
+
+		callbacks_.process_capture_result = processCaptureResult;
+		callbacks_.notify = notify;
+		callbacks_.test = this;
+
+		ret = device_->ops->initialize(device_, &callbacks_);
+		if (ret) {
+			cerr << "Failed to initialize the camera device" << endl;
+			return TestFail;
+		}
+
+		allocator_ = std::make_unique<DmaBufAllocator>();
+		if (!allocator_->isValid()) {
+			cout << "No dma-buf provider available" << endl;
+			return TestSkip;
+		}
+
+		return TestPass;
+	}
+
+	int run() override
+	{
+		const camera_metadata_t *settings =
+			device_->ops->construct_default_request_settings(device_,
+									 CAMERA3_TEMPLATE_PREVIEW);
+		if (!settings) {
+			cerr << "Failed to construct default settings" << endl;
+			return TestFail;
+		}
+
+		camera3_stream_t stream = {};
+		stream.stream_type = CAMERA3_STREAM_OUTPUT;
+		stream.width = kWidth;
+		stream.height = kHeight;
+		stream.format = HAL_PIXEL_FORMAT_YCbCr_420_888;
+
+		camera3_stream_t *streams[] = { &stream };
+		camera3_stream_configuration_t config = {};
+		config.num_streams = 1;
+		config.streams = streams;
+		config.operation_mode = CAMERA3_STREAM_CONFIGURATION_NORMAL_MODE;
+
+		if (device_->ops->configure_streams(device_, &config)) {
+			cout << "Stream configuration not supported" << endl;
+			return TestSkip;
+		}
+
+		/* Create one native handle per buffer, backed by a dma-buf. */
+		const size_t bufferSize = kWidth * kHeight * 3 / 2;
+		const unsigned int bufferCount = std::max(stream.max_buffers, 1u);
+
+		for (unsigned int i = 0; i < bufferCount; ++i) {
+			UniqueFD fd = allocator_->alloc("hal-load", bufferSize);
+			if (!fd.isValid()) {
+				cerr << "Failed to allocate buffer" << endl;
+				return TestFail;
+			}
+
+			std::vector<int> &handle = handles_.emplace_back(
+				sizeof(native_handle_t) / sizeof(int) + 1);
+			native_handle_t *nativeHandle =
+				reinterpret_cast<native_handle_t *>(handle.data());
+			nativeHandle->version = sizeof(native_handle_t);
+			nativeHandle->numFds = 1;
+			nativeHandle->numInts = 0;
+			nativeHandle->data[0] = fd.release();
+		}
+
+		handlePointers_.resize(handles_.size());
+		for (unsigned int i = 0; i < handles_.size(); ++i) {
+			handlePointers_[i] =
+				reinterpret_cast<native_handle_t *>(handles_[i].data());
+			freeBuffers_.push_back(&handlePointers_[i]);
+		}
+
+		/* Queue requests as soon as a buffer is available. */
+		auto start = std::chrono::steady_clock::now();
+
+		for (unsigned int frame = 0; frame < kRequests; ++frame) {
+			buffer_handle_t *handle;
+
+			{
+				std::unique_lock<std::mutex> locker(mutex_);
+				if (!cv_.wait_for(locker, 1s, [&] { return !freeBuffers_.empty(); })) {
+					cerr << "Timeout waiting for a buffer" << endl;
+					return TestFail;
+				}
+
+				handle = freeBuffers_.front();
+				freeBuffers_.erase(freeBuffers_.begin());
+			}
+
+			camera3_stream_buffer_t buffer = {};
+			buffer.stream = &stream;
+			buffer.buffer = handle;
+			buffer.status = CAMERA3_BUFFER_STATUS_OK;
+			buffer.acquire_fence = -1;
+			buffer.release_fence = -1;
+
+			camera3_capture_request_t request = {};
+			request.frame_number = frame;
+			request.settings = frame ? nullptr : settings;
+			request.num_output_buffers = 1;
+			request.output_buffers = &buffer;
+
+			if (device_->ops->process_capture_request(device_, &request)) {
+				cerr << "Failed to queue request " << frame << endl;
+				return TestFail;
+			}
+		}
+
+		{
+			std::unique_lock<std::mutex> locker(mutex_);
+			if (!cv_.wait_for(locker, 10s, [&] { return completed_ == kRequests; })) {
+				cerr << "Timeout waiting for requests, " << completed_
+				     << " completed" << endl;
+				return TestFail;
+			}
+		}
+
+		auto elapsed = std::chrono::steady_clock::now() - start;
+		cout << kRequests << " requests in "
+		     << std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count()
+		     << " ms" << endl;
+
+		if (outOfOrder_ || errors_) {
+			cerr << outOfOrder_ << " results out of order, " << errors_
+			     << " errors" << endl;
+			return TestFail;
+		}
+
+		/* Retrieve the dump output and check it reports all requests. */
+		UniqueFD dumpFd(memfd_create("hal-dump", MFD_CLOEXEC));
+		if (!dumpFd.isValid()) {
+			cerr << "Failed to create dump file" << endl;
+			return TestFail;
+		}
+
+		device_->ops->dump(device_, dumpFd.get());
+
+		std::string dump(lseek(dumpFd.get(), 0, SEEK_CUR), '\0');
+		if (pread(dumpFd.get(), dump.data(), dump.size(), 0) !=
+		    static_cast<ssize_t>(dump.size())) {
+			cerr << "Failed to read dump output" << endl;
+			return TestFail;
+		}
+
+		cout << dump;
+
+		if (dump.find("Requests: " + std::to_string(kRequests) + " completed") ==
+		    std::string::npos) {
+			cerr << "Dump output doesn't report all requests" << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
+	void cleanup() override
+	{
+		if (device_)
+			device_->common.close(&device_->common);
+
+		for (std::vector<int> &handle : handles_)
+			close(handle[sizeof(native_handle_t) / sizeof(int)]);
+	}
+
+private:
+	camera_module_callbacks_t moduleCallbacks_ = {};
+	Callbacks callbacks_ = {};
+	camera3_device_t *device_ = nullptr;
+
+	std::unique_ptr<DmaBufAllocator> allocator_;
+	std::vector<std::vector<int>> handles_;
+	std::vector<buffer_handle_t> handlePointers_;
+
+	std::mutex mutex_;
+	std::condition_variable cv_;
+	std::vector<buffer_handle_t *> freeBuffers_;
+	unsigned int completed_ = 0;
+	unsigned int nextFrame_ = 0;
+	unsigned int outOfOrder_ = 0;
+	unsigned int errors_ = 0;
+};
+
+TEST_REGISTER(HalLoadTest)
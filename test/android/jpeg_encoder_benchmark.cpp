@@ -0,0 +1,185 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2022, Google Inc.
+ *
+ * jpeg_encoder_benchmark.cpp - Android HAL JPEG encoders benchmark
+ *
+ * Encode synthetic NV12 frames of common resolutions with the single-threaded
+ * and the strip-based JPEG encoders, verify that the strip-based encoder
+ * produces a valid image that decodes identically, and report the encoding
+ * time of both encoders.
+ */
+
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+#include <stdio.h>
+
+#include <jpeglib.h>
+
+#include <libcamera/base/log.h>
+
+#include <libcamera/formats.h>
+#include <libcamera/stream.h>
+
+#include "jpeg/encoder_libjpeg.h"
+#include "jpeg/encoder_libjpeg_strips.h"
+
+#include "test.h"
+
+using namespace libcamera;
+using namespace std;
+
+LOG_DEFINE_CATEGORY(JPEG)
+
+namespace {
+
+constexpr unsigned int kIterations = 5;
+constexpr unsigned int kQuality = 95;
+
+bool decode(Span<const uint8_t> jpeg, const Size &size,
+	    std::vector<uint8_t> *image)
+{
+	struct jpeg_decompress_struct decompress;
+	struct jpeg_error_mgr jerr;
+
+	decompress.err = jpeg_std_error(&jerr);
+	jpeg_create_decompress(&decompress);
+
+	jpeg_mem_src(&decompress, jpeg.data(), jpeg.size());
+	jpeg_read_header(&decompress, TRUE);
+
+	if (decompress.image_width != size.width ||
+	    decompress.image_height != size.height) {
+		jpeg_destroy_decompress(&decompress);
+		return false;
+	}
+
+	decompress.out_color_space = JCS_YCbCr;
+	jpeg_start_decompress(&decompress);
+
+	const unsigned int stride = size.width * 3;
+	image->resize(stride * size.height);
+
+	while (decompress.output_scanline < size.height) {
+		JSAMPROW row = image->data() + decompress.output_scanline * stride;
+		jpeg_read_scanlines(&decompress, &row, 1);
+	}
+
+	jpeg_finish_decompress(&decompress);
+	jpeg_destroy_decompress(&decompress);
+
+	return true;
+}
+
+} /* namespace */
+
+class JpegEncoderBenchmark : public Test
+{
+protected:
+	template<typename T>
+	int encode(T *encoder, const char *name,
+		   const std::vector<Span<uint8_t>> &planes,
+		   std::vector<uint8_t> *output)
+	{
+		const std::vector<uint8_t> exif = { 'E', 'x', 'i', 'f', 0, 0 };
+		std::chrono::steady_clock::duration total{};
+		int size = 0;
+
+		for (unsigned int i = 0; i < kIterations; ++i) {
+			auto start = std::chrono::steady_clock::now();
+
+			size = encoder->encode(planes, *output, exif, kQuality);
+
+			total += std::chrono::steady_clock::now() - start;
+
+			if (size < 0) {
+				cerr << "Failed to encode with " << name << endl;
+				return size;
+			}
+		}
+
+		cout << "  " << name << ": " << size << " bytes, "
+		     << std::chrono::duration_cast<std::chrono::microseconds>(total).count() / kIterations
+		     << " us" << endl;
+
+		output->resize(size);
+		return 0;
+	}
+
+	int run() override
+	{
+		const std::vector<Size> sizes = {
+			{ 640, 480 },
+			{ 1280, 720 },
+			{ 1920, 1080 },
+			{ 3264, 2448 },
+			{ 4032, 3024 },
+		};
+
+		for (const Size &size : sizes) {
+			StreamConfiguration cfg;
+			cfg.size = size;
+			cfg.pixelFormat = formats::NV12;
+			cfg.stride = size.width;
+
+			/* Generate a synthetic frame with gradients. */
+			const unsigned int lumaSize = size.width * size.height;
+			std::vector<uint8_t> frame(lumaSize * 3 / 2);
+
+			for (unsigned int y = 0; y < size.height; ++y) {
+				for (unsigned int x = 0; x < size.width; ++x)
+					frame[y * size.width + x] = (x * 3 + y * 5) & 0xff;
+			}
+
+			for (unsigned int i = lumaSize; i < frame.size(); ++i)
+				frame[i] = 128 + i % 37;
+
+			std::vector<Span<uint8_t>> planes = {
+				{ frame.data(), lumaSize },
+				{ frame.data() + lumaSize, frame.size() - lumaSize },
+			};
+
+			EncoderLibJpeg single;
+			EncoderLibJpegStrips strips;
+			/* Force multiple strips to test stitching on all systems. */
+			EncoderLibJpegStrips strips4(4);
+
+			if (single.configure(cfg) || strips.configure(cfg) ||
+			    strips4.configure(cfg)) {
+				cerr << "Failed to configure encoders" << endl;
+				return TestFail;
+			}
+
+			cout << size << " (" << strips.strips() << " strips):" << endl;
+
+			std::vector<uint8_t> singleOutput(frame.size() * 2);
+			std::vector<uint8_t> stripsOutput(frame.size() * 2);
+			std::vector<uint8_t> strips4Output(frame.size() * 2);
+
+			if (encode(&single, "single", planes, &singleOutput) ||
+			    encode(&strips, "strips", planes, &stripsOutput) ||
+			    encode(&strips4, "4 strips", planes, &strips4Output))
+				return TestFail;
+
+			std::vector<uint8_t> singleImage, stripsImage, strips4Image;
+			if (!decode(singleOutput, size, &singleImage) ||
+			    !decode(stripsOutput, size, &stripsImage) ||
+			    !decode(strips4Output, size, &strips4Image)) {
+				cerr << "Failed to decode JPEG image" << endl;
+				return TestFail;
+			}
+
+			if (stripsImage != singleImage || strips4Image != singleImage) {
+				cerr << "Strip-based encoding differs from reference"
+				     << endl;
+				return TestFail;
+			}
+		}
+
+		return TestPass;
+	}
+};
+
+TEST_REGISTER(JpegEncoderBenchmark)
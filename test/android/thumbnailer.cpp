@@ -0,0 +1,94 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2022, Google Inc.
+ *
+ * thumbnailer.cpp - Android HAL thumbnailer test
+ */
+
+#include <iostream>
+#include <vector>
+
+#include <libcamera/formats.h>
+
+#include "jpeg/thumbnailer.h"
+
+#include "test.h"
+
+using namespace libcamera;
+using namespace std;
+
+class ThumbnailerTest : public Test
+{
+protected:
+	int run() override
+	{
+		const Size sourceSize{ 640, 480 };
+		const unsigned int stride = 704;
+
+		/*
+		 * Fill the source with a 4x4 checkerboard in luma, and
+		 * constant chroma, and set the padding bytes to a value
+		 * that must not show up in the thumbnail.
+		 */
+		std::vector<uint8_t> luma(stride * sourceSize.height, 0xff);
+		std::vector<uint8_t> chroma(stride * sourceSize.height / 2, 0xff);
+
+		for (unsigned int y = 0; y < sourceSize.height; ++y) {
+			for (unsigned int x = 0; x < sourceSize.width; ++x)
+				luma[y * stride + x] = ((x / 4 + y / 4) % 2) ? 200 : 40;
+		}
+
+		for (unsigned int y = 0; y < sourceSize.height / 2; ++y) {
+			for (unsigned int x = 0; x < sourceSize.width; x += 2) {
+				chroma[y * stride + x] = 64;
+				chroma[y * stride + x + 1] = 192;
+			}
+		}
+
+		Thumbnailer thumbnailer;
+		thumbnailer.configure(sourceSize, formats::NV12, stride);
+
+		const std::vector<Span<const uint8_t>> planes = { luma, chroma };
+		std::vector<unsigned char> thumbnail;
+
+		/*
+		 * Downscaling by 8 averages each 8x8 block of the checkerboard
+		 * to its mean value.
+		 */
+		const Size targetSize{ 80, 60 };
+		thumbnailer.createThumbnail(planes, targetSize, &thumbnail);
+
+		const unsigned int lumaSize = targetSize.width * targetSize.height;
+		if (thumbnail.size() != lumaSize * 3 / 2) {
+			cerr << "Invalid thumbnail size " << thumbnail.size() << endl;
+			return TestFail;
+		}
+
+		for (unsigned int i = 0; i < lumaSize; ++i) {
+			if (thumbnail[i] != 120) {
+				cerr << "Invalid luma value " << static_cast<int>(thumbnail[i])
+				     << " at offset " << i << endl;
+				return TestFail;
+			}
+		}
+
+		for (unsigned int i = lumaSize; i < thumbnail.size(); i += 2) {
+			if (thumbnail[i] != 64 || thumbnail[i + 1] != 192) {
+				cerr << "Invalid chroma value at offset " << i << endl;
+				return TestFail;
+			}
+		}
+
+		/* The thumbnail buffer shall be reused for smaller sizes. */
+		const unsigned char *data = thumbnail.data();
+		thumbnailer.createThumbnail(planes, { 64, 48 }, &thumbnail);
+		if (thumbnail.data() != data || thumbnail.size() != 64 * 48 * 3 / 2) {
+			cerr << "Thumbnail buffer not reused" << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+};
+
+TEST_REGISTER(ThumbnailerTest)
@@ -0,0 +1,267 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2022, Google Inc.
+ *
+ * dng_writer_benchmark.cpp - DNG writer benchmark
+ *
+ * Write a synthetic 12-bit CSI-2 packed frame to DNG files with a single
+ * thread, with all CPUs and with deflate compression, verify that the RAW
+ * image of all files matches the input frame pixel for pixel, and report the
+ * writing time and file size.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <tiffio.h>
+
+#include <libcamera/formats.h>
+#include <libcamera/stream.h>
+
+#include "common/dng_writer.h"
+
+#include "camera_test.h"
+#include "test.h"
+
+using namespace libcamera;
+using namespace std;
+
+namespace {
+
+constexpr unsigned int kIterations = 5;
+
+/* Unpack a 12-bit CSI-2 packed frame to one sample per pixel. */
+std::vector<uint16_t> unpackFrame(const StreamConfiguration &config,
+				  const std::vector<uint8_t> &frame)
+{
+	const Size &size = config.size;
+	std::vector<uint16_t> pixels(size.width * size.height);
+
+	for (unsigned int y = 0; y < size.height; ++y) {
+		const uint8_t *in = frame.data() + y * config.stride;
+		uint16_t *out = pixels.data() + y * size.width;
+
+		for (unsigned int x = 0; x < size.width; x += 2) {
+			out[x] = in[0] << 4 | (in[2] & 0x0f);
+			out[x + 1] = in[1] << 4 | in[2] >> 4;
+			in += 3;
+		}
+	}
+
+	return pixels;
+}
+
+/*
+ * Read the 12-bit RAW image stored in the tiles of the first SubIFD, and
+ * unpack it to one sample per pixel.
+ */
+bool readRaw(const std::string &filename, std::vector<uint16_t> *pixels)
+{
+	TIFF *tif = TIFFOpen(filename.c_str(), "r");
+	if (!tif)
+		return false;
+
+	uint16_t count;
+	toff_t *offsets;
+	if (!TIFFGetField(tif, TIFFTAG_SUBIFD, &count, &offsets) || !count ||
+	    !TIFFSetSubDirectory(tif, offsets[0])) {
+		TIFFClose(tif);
+		return false;
+	}
+
+	uint32_t width, height, tileWidth, tileLength;
+	uint16_t bitsPerSample;
+	if (!TIFFGetField(tif, TIFFTAG_IMAGEWIDTH, &width) ||
+	    !TIFFGetField(tif, TIFFTAG_IMAGELENGTH, &height) ||
+	    !TIFFGetField(tif, TIFFTAG_TILEWIDTH, &tileWidth) ||
+	    !TIFFGetField(tif, TIFFTAG_TILELENGTH, &tileLength) ||
+	    !TIFFGetField(tif, TIFFTAG_BITSPERSAMPLE, &bitsPerSample) ||
+	    bitsPerSample != 12) {
+		TIFFClose(tif);
+		return false;
+	}
+
+	const tmsize_t tileSize = TIFFTileSize(tif);
+	const unsigned int tileStride = tileWidth * 3 / 2;
+	std::vector<uint8_t> tile(tileSize);
+
+	pixels->assign(width * height, 0);
+
+	for (uint32_t ty = 0; ty < height; ty += tileLength) {
+		for (uint32_t tx = 0; tx < width; tx += tileWidth) {
+			if (TIFFReadTile(tif, tile.data(), tx, ty, 0, 0) != tileSize) {
+				TIFFClose(tif);
+				return false;
+			}
+
+			const uint32_t rows = std::min(tileLength, height - ty);
+			const uint32_t columns = std::min(tileWidth, width - tx);
+
+			for (uint32_t y = 0; y < rows; ++y) {
+				const uint8_t *in = tile.data() + y * tileStride;
+				uint16_t *out = pixels->data() + (ty + y) * width + tx;
+
+				/* Samples are packed MSB first. */
+				for (uint32_t x = 0; x < columns; ++x) {
+					const uint8_t *p = in + x * 3 / 2;
+
+					if (x % 2)
+						out[x] = (p[0] & 0x0f) << 8 | p[1];
+					else
+						out[x] = p[0] << 4 | p[1] >> 4;
+				}
+			}
+		}
+	}
+
+	TIFFClose(tif);
+	return true;
+}
+
+} /* namespace */
+
+class DNGWriterBenchmark : public CameraTest, public Test
+{
+public:
+	DNGWriterBenchmark()
+		: CameraTest("platform/vimc.0 Sensor B")
+	{
+	}
+
+protected:
+	int init() override
+	{
+		if (status_ != TestPass)
+			return status_;
+
+		char filename[] = "/tmp/libcamera.dng.XXXXXX";
+		int fd = mkstemp(filename);
+		if (fd < 0) {
+			cerr << "Failed to create temporary file" << endl;
+			return TestFail;
+		}
+
+		close(fd);
+		filename_ = filename;
+
+		return TestPass;
+	}
+
+	int write(const char *name, const StreamConfiguration &config,
+		  const ControlList &metadata, const std::vector<uint8_t> &frame,
+		  const DNGWriter::Options &options,
+		  const std::vector<uint16_t> &expected)
+	{
+		std::chrono::steady_clock::duration total{};
+
+		for (unsigned int i = 0; i < kIterations; ++i) {
+			auto start = std::chrono::steady_clock::now();
+
+			int ret = DNGWriter::write(filename_.c_str(), camera_.get(),
+						   config, metadata, nullptr,
+						   frame.data(), options);
+
+			total += std::chrono::steady_clock::now() - start;
+
+			if (ret < 0) {
+				cerr << "Failed to write DNG with " << name << endl;
+				return TestFail;
+			}
+		}
+
+		struct stat st;
+		stat(filename_.c_str(), &st);
+
+		cout << "  " << name << ": " << st.st_size << " bytes, "
+		     << std::chrono::duration_cast<std::chrono::microseconds>(total).count() / kIterations
+		     << " us" << endl;
+
+		std::vector<uint16_t> pixels;
+		if (!readRaw(filename_, &pixels)) {
+			cerr << "Failed to read DNG written with " << name << endl;
+			return TestFail;
+		}
+
+		if (pixels.size() != expected.size()) {
+			cerr << "RAW image size mismatch with " << name << endl;
+			return TestFail;
+		}
+
+		for (size_t i = 0; i < pixels.size(); ++i) {
+			if (pixels[i] == expected[i])
+				continue;
+
+			cerr << "RAW image written with " << name
+			     << " differs from the input frame at ("
+			     << i % config.size.width << ", "
+			     << i / config.size.width << "): " << pixels[i]
+			     << " instead of " << expected[i] << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
+	int run() override
+	{
+		const std::vector<Size> sizes = {
+			{ 1920, 1080 },
+			{ 4056, 3040 },
+		};
+
+		for (const Size &size : sizes) {
+			StreamConfiguration config;
+			config.pixelFormat = formats::SRGGB12_CSI2P;
+			config.size = size;
+			config.stride = size.width * 3 / 2;
+
+			/* Generate a synthetic frame with gradients. */
+			std::vector<uint8_t> frame(config.stride * size.height);
+			for (unsigned int y = 0; y < size.height; ++y) {
+				for (unsigned int x = 0; x < config.stride; ++x)
+					frame[y * config.stride + x] = (x * 7 + y * 3) & 0xff;
+			}
+
+			const std::vector<uint16_t> expected = unpackFrame(config, frame);
+			ControlList metadata;
+
+			cout << size << ":" << endl;
+
+			DNGWriter::Options single;
+			single.threads = 1;
+
+			DNGWriter::Options parallel;
+
+			if (write("1 thread", config, metadata, frame, single, expected) ||
+			    write("all CPUs", config, metadata, frame, parallel, expected))
+				return TestFail;
+
+#ifdef HAVE_ZLIB
+			DNGWriter::Options deflate;
+			deflate.compression = DNGWriter::Compression::Deflate;
+
+			if (write("deflate", config, metadata, frame, deflate, expected))
+				return TestFail;
+#endif
+		}
+
+		return TestPass;
+	}
+
+	void cleanup() override
+	{
+		if (!filename_.empty())
+			unlink(filename_.c_str());
+	}
+
+private:
+	std::string filename_;
+};
+
+TEST_REGISTER(DNGWriterBenchmark)
@@ -0,0 +1,251 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2022, Google Inc.
+ *
+ * multi_camera.cpp - Concurrent capture on multiple cameras
+ *
+ * Capture from all vimc cameras concurrently, with a slow completion handler
+ * on the first camera, in both the shared and per-pipeline handler threading
+ * models. The completion latency of the other cameras is reported to measure
+ * the interference between cameras.
+ */
+
+#include <algorithm>
+#include <iostream>
+#include <thread>
+#include <time.h>
+
+#include <libcamera/camera.h>
+#include <libcamera/camera_manager.h>
+#include <libcamera/control_ids.h>
+#include <libcamera/framebuffer_allocator.h>
+
+#include <libcamera/base/event_dispatcher.h>
+#include <libcamera/base/thread.h>
+#include <libcamera/base/timer.h>
+
+#include "test.h"
+
+using namespace libcamera;
+using namespace std;
+using namespace std::chrono_literals;
+
+namespace {
+
+class CameraContext
+{
+public:
+	CameraContext(std::shared_ptr<Camera> camera, bool slow)
+		: camera_(camera), slow_(slow), completed_(0), thread_(nullptr)
+	{
+	}
+
+	~CameraContext()
+	{
+		stop();
+		requests_.clear();
+		allocator_.reset();
+		camera_->release();
+	}
+
+	int start()
+	{
+		if (camera_->acquire())
+			return TestFail;
+
+		config_ = camera_->generateConfiguration({ StreamRole::VideoRecording });
+		if (!config_ || config_->validate() == CameraConfiguration::Invalid)
+			return TestFail;
+
+		if (camera_->configure(config_.get()))
+			return TestFail;
+
+		Stream *stream = config_->at(0).stream();
+		allocator_ = std::make_unique<FrameBufferAllocator>(camera_);
+		if (allocator_->allocate(stream) < 0)
+			return TestFail;
+
+		for (const std::unique_ptr<FrameBuffer> &buffer : allocator_->buffers(stream)) {
+			std::unique_ptr<Request> request = camera_->createRequest();
+			if (!request || request->addBuffer(stream, buffer.get()))
+				return TestFail;
+
+			requests_.push_back(std::move(request));
+		}
+
+		camera_->requestCompleted.connect(this, &CameraContext::requestComplete);
+
+		if (camera_->start())
+			return TestFail;
+
+		for (std::unique_ptr<Request> &request : requests_) {
+			if (camera_->queueRequest(request.get()))
+				return TestFail;
+		}
+
+		return TestPass;
+	}
+
+	void stop()
+	{
+		camera_->requestCompleted.disconnect(this);
+		camera_->stop();
+	}
+
+	const std::shared_ptr<Camera> &camera() const { return camera_; }
+	bool slow() const { return slow_; }
+	unsigned int completed() const { return completed_; }
+	Thread *thread() const { return thread_; }
+	const std::vector<int64_t> &latencies() const { return latencies_; }
+
+private:
+	void requestComplete(Request *request)
+	{
+		if (request->status() != Request::RequestComplete)
+			return;
+
+		struct timespec now;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		int64_t timestamp = now.tv_sec * 1000000000LL + now.tv_nsec;
+
+		const auto sensorTimestamp = request->metadata().get(controls::SensorTimestamp);
+		if (sensorTimestamp)
+			latencies_.push_back(timestamp - *sensorTimestamp);
+
+		thread_ = Thread::current();
+		completed_++;
+
+		/* Simulate heavy processing in the completion handler. */
+		if (slow_)
+			std::this_thread::sleep_for(20ms);
+
+		request->reuse(Request::ReuseBuffers);
+		camera_->queueRequest(request);
+	}
+
+	std::shared_ptr<Camera> camera_;
+	bool slow_;
+
+	std::unique_ptr<CameraConfiguration> config_;
+	std::unique_ptr<FrameBufferAllocator> allocator_;
+	std::vector<std::unique_ptr<Request>> requests_;
+
+	unsigned int completed_;
+	Thread *thread_;
+	std::vector<int64_t> latencies_;
+};
+
+class MultiCameraTest : public Test
+{
+protected:
+	int capture(CameraManager::ThreadingModel model)
+	{
+		const char *name = model == CameraManager::ThreadingModel::Shared
+				 ? "shared" : "per-pipeline";
+
+		CameraManager cm;
+		if (cm.setThreadingModel(model)) {
+			cerr << "Failed to set threading model" << endl;
+			return TestFail;
+		}
+
+		if (cm.start()) {
+			cerr << "Failed to start camera manager" << endl;
+			return TestFail;
+		}
+
+		std::vector<std::unique_ptr<CameraContext>> contexts;
+		for (const std::shared_ptr<Camera> &camera : cm.cameras()) {
+			if (camera->id().find("vimc") == std::string::npos)
+				continue;
+
+			contexts.push_back(std::make_unique<CameraContext>(camera,
+									   contexts.empty()));
+		}
+
+		if (contexts.empty()) {
+			cout << "No vimc camera found" << endl;
+			return TestSkip;
+		}
+
+		for (std::unique_ptr<CameraContext> &context : contexts) {
+			int ret = context->start();
+			if (ret != TestPass) {
+				cerr << "Failed to start camera "
+				     << context->camera()->id() << endl;
+				return ret;
+			}
+		}
+
+		EventDispatcher *dispatcher = Thread::current()->eventDispatcher();
+
+		Timer timer;
+		timer.start(2000ms);
+		while (timer.isRunning())
+			dispatcher->processEvents();
+
+		for (std::unique_ptr<CameraContext> &context : contexts)
+			context->stop();
+
+		int ret = TestPass;
+
+		for (std::unique_ptr<CameraContext> &context : contexts) {
+			if (!context->completed()) {
+				cerr << "No request completed for camera "
+				     << context->camera()->id() << endl;
+				ret = TestFail;
+				continue;
+			}
+
+			/*
+			 * Requests complete in the thread that the camera lives
+			 * in, which is dedicated to its pipeline handler in the
+			 * per-pipeline handler model.
+			 */
+			if (context->thread() != context->camera()->thread()) {
+				cerr << "Request completed in unexpected thread" << endl;
+				ret = TestFail;
+			}
+
+			std::vector<int64_t> latencies = context->latencies();
+			if (latencies.empty())
+				continue;
+
+			std::sort(latencies.begin(), latencies.end());
+			int64_t median = latencies[latencies.size() / 2];
+			int64_t max = latencies.back();
+
+			cout << "[" << name << "] " << context->camera()->id()
+			     << (context->slow() ? " (slow)" : "") << ": "
+			     << context->completed() << " requests, latency median "
+			     << median / 1000 << "us max " << max / 1000 << "us"
+			     << endl;
+		}
+
+		if (model == CameraManager::ThreadingModel::PerPipelineHandler &&
+		    contexts.size() > 1 &&
+		    contexts[0]->camera()->thread() == contexts[1]->camera()->thread()) {
+			cerr << "Cameras share a thread in per-pipeline handler model"
+			     << endl;
+			ret = TestFail;
+		}
+
+		contexts.clear();
+		cm.stop();
+
+		return ret;
+	}
+
+	int run() override
+	{
+		int ret = capture(CameraManager::ThreadingModel::Shared);
+		if (ret != TestPass)
+			return ret;
+
+		return capture(CameraManager::ThreadingModel::PerPipelineHandler);
+	}
+};
+
+} /* namespace */
+
+TEST_REGISTER(MultiCameraTest)
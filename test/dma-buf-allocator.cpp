@@ -0,0 +1,150 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2022, Google Inc.
+ *
+ * dma-buf-allocator.cpp - DmaBufAllocator test
+ */
+
+#include <iostream>
+#include <sys/stat.h>
+
+#include <libcamera/dma_buf_allocator.h>
+#include <libcamera/framebuffer.h>
+
+#include "test.h"
+
+using namespace libcamera;
+using namespace std;
+
+namespace {
+
+ino_t inode(int fd)
+{
+	struct stat st;
+	if (fstat(fd, &st))
+		return 0;
+
+	return st.st_ino;
+}
+
+} /* namespace */
+
+class DmaBufAllocatorTest : public Test
+{
+protected:
+	int init() override
+	{
+		allocator_ = std::make_unique<DmaBufAllocator>(
+			DmaBufAllocator::DmaBufAllocatorFlag::CmaHeap |
+			DmaBufAllocator::DmaBufAllocatorFlag::SystemHeap |
+			DmaBufAllocator::DmaBufAllocatorFlag::UDmaBuf);
+		if (!allocator_->isValid()) {
+			cout << "No dma-buf provider available" << endl;
+			return TestSkip;
+		}
+
+		return TestPass;
+	}
+
+	int run() override
+	{
+		/* Allocate, release and allocate again with a close size. */
+		UniqueFD fd = allocator_->alloc("test", 640 * 480 * 3 / 2);
+		if (!fd.isValid()) {
+			cerr << "Failed to allocate buffer" << endl;
+			return TestFail;
+		}
+
+		ino_t ino = inode(fd.get());
+
+		allocator_->release(std::move(fd));
+		if (!allocator_->pooledBytes()) {
+			cerr << "Released buffer not pooled" << endl;
+			return TestFail;
+		}
+
+		fd = allocator_->alloc("test", 640 * 480 * 3 / 2 - 100);
+		if (!fd.isValid() || inode(fd.get()) != ino) {
+			cerr << "Pooled buffer not reused" << endl;
+			return TestFail;
+		}
+
+		if (allocator_->pooledBytes()) {
+			cerr << "Pool not empty after reuse" << endl;
+			return TestFail;
+		}
+
+		/* A buffer of a different size class shall not be reused. */
+		allocator_->release(std::move(fd));
+
+		fd = allocator_->alloc("test", 1920 * 1080 * 2);
+		if (!fd.isValid() || inode(fd.get()) == ino) {
+			cerr << "Pooled buffer reused for wrong size" << endl;
+			return TestFail;
+		}
+
+		allocator_->release(std::move(fd));
+
+		/* Frame buffers shall be recycled through the pool. */
+		std::vector<std::unique_ptr<FrameBuffer>> buffers;
+		int ret = allocator_->exportBuffers(2, { 640 * 480, 640 * 480 / 2 },
+						    &buffers);
+		if (ret != 2) {
+			cerr << "Failed to export buffers" << endl;
+			return TestFail;
+		}
+
+		const FrameBuffer::Plane &plane = buffers[0]->planes()[1];
+		if (plane.offset != 640 * 480 || plane.length != 640 * 480 / 2) {
+			cerr << "Invalid plane layout" << endl;
+			return TestFail;
+		}
+
+		size_t pooled = allocator_->pooledBytes();
+		for (std::unique_ptr<FrameBuffer> &buffer : buffers)
+			allocator_->recycle(std::move(buffer));
+
+		if (allocator_->pooledBytes() <= pooled) {
+			cerr << "Frame buffers not recycled" << endl;
+			return TestFail;
+		}
+
+		/* Buffers not allocated by the allocator shall not be pooled. */
+		DmaBufAllocator other(DmaBufAllocator::DmaBufAllocatorFlag::CmaHeap |
+				      DmaBufAllocator::DmaBufAllocatorFlag::SystemHeap |
+				      DmaBufAllocator::DmaBufAllocatorFlag::UDmaBuf);
+		fd = other.alloc("foreign", 4096);
+		if (!fd.isValid()) {
+			cerr << "Failed to allocate foreign buffer" << endl;
+			return TestFail;
+		}
+
+		pooled = allocator_->pooledBytes();
+		allocator_->release(std::move(fd));
+		if (allocator_->pooledBytes() != pooled) {
+			cerr << "Foreign buffer pooled" << endl;
+			return TestFail;
+		}
+
+		/* Lowering the limit shall free pooled buffers. */
+		allocator_->setPoolLimit(0);
+		if (allocator_->pooledBytes()) {
+			cerr << "Pool not trimmed" << endl;
+			return TestFail;
+		}
+
+		fd = allocator_->alloc("test", 4096);
+		allocator_->release(std::move(fd));
+		if (allocator_->pooledBytes()) {
+			cerr << "Buffer pooled beyond limit" << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
+private:
+	std::unique_ptr<DmaBufAllocator> allocator_;
+};
+
+TEST_REGISTER(DmaBufAllocatorTest)
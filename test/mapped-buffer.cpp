@@ -5,10 +5,13 @@
  * libcamera internal MappedBuffer tests
  */
 
+#include <atomic>
 #include <iostream>
+#include <thread>
 
 #include <libcamera/framebuffer_allocator.h>
 
+#include "libcamera/internal/framebuffer.h"
 #include "libcamera/internal/mapped_framebuffer.h"
 
 #include "camera_test.h"
@@ -103,6 +106,49 @@ protected:
 			return TestFail;
 		}
 
+		/* Test CPU access synchronization. */
+		if (rw_map.beginAccess(MappedFrameBuffer::MapFlag::Read) ||
+		    rw_map.beginAccess(0, MappedFrameBuffer::MapFlag::ReadWrite) ||
+		    rw_map.endAccess(0) || rw_map.endAccess()) {
+			cout << "Failed to synchronize CPU access" << endl;
+			return TestFail;
+		}
+
+		/* Test that cached mappings are persistent. */
+		MappedFrameBuffer *cached =
+			buffer->_d()->mapping(MappedFrameBuffer::MapFlag::Read);
+		if (!cached || !cached->isValid()) {
+			cout << "Failed to retrieve cached mapping" << endl;
+			return TestFail;
+		}
+
+		if (buffer->_d()->mapping(MappedFrameBuffer::MapFlag::Read) != cached) {
+			cout << "Cached mapping not reused" << endl;
+			return TestFail;
+		}
+
+		/*
+		 * Test concurrent CPU access to the cached mapping, as done by
+		 * post-processors running in different threads.
+		 */
+		std::atomic<bool> failed = false;
+		auto access = [&]() {
+			for (unsigned int i = 0; i < 1000; ++i) {
+				if (cached->beginAccess(MappedFrameBuffer::MapFlag::Read) ||
+				    cached->endAccess())
+					failed = true;
+			}
+		};
+
+		std::thread thread(access);
+		access();
+		thread.join();
+
+		if (failed) {
+			cout << "Failed to synchronize concurrent CPU access" << endl;
+			return TestFail;
+		}
+
 		return TestPass;
 	}
 
@@ -4,15 +4,22 @@
 # Copyright (C) 2022, Tomi Valkeinen <tomi.valkeinen@ideasonboard.com>
 
 from collections import defaultdict
+import asyncio
 import errno
 import gc
 import libcamera as libcam
+import libcamera.utils
 import selectors
 import time
 import typing
 import unittest
 import weakref
 
+try:
+    import numpy as np
+except ImportError:
+    np = None
+
 
 class BaseTestCase(unittest.TestCase):
     def assertZero(self, a, msg=None):
@@ -306,6 +313,183 @@ class SimpleCaptureMethods(CameraTesterBase):
         ret = cam.stop()
         self.assertZero(ret)
 
+    def test_asyncio(self):
+        cam = self.cam
+
+        camconfig = cam.generate_configuration([libcam.StreamRole.StillCapture])
+        self.assertTrue(camconfig.size == 1)
+
+        streamconfig = camconfig.at(0)
+
+        ret = cam.configure(camconfig)
+        self.assertZero(ret)
+
+        stream = streamconfig.stream
+
+        allocator = libcam.FrameBufferAllocator(cam)
+        ret = allocator.allocate(stream)
+        self.assertTrue(ret > 0)
+
+        num_bufs = len(allocator.buffers(stream))
+
+        reqs = []
+        for i in range(num_bufs):
+            req = cam.create_request(i)
+            self.assertIsNotNone(req)
+
+            buffer = allocator.buffers(stream)[i]
+            ret = req.add_buffer(stream, buffer)
+            self.assertZero(ret)
+
+            reqs.append(req)
+
+        buffer = None
+
+        async def capture():
+            async with libcamera.utils.RequestStream(self.cm) as req_stream:
+                ret = cam.start()
+                self.assertZero(ret)
+
+                for req in reqs:
+                    ret = cam.queue_request(req)
+                    self.assertZero(ret)
+
+                ready_reqs = []
+                async for req in req_stream:
+                    ready_reqs.append(req)
+                    if len(ready_reqs) == num_bufs:
+                        break
+
+                return ready_reqs
+
+        ready_reqs = asyncio.run(asyncio.wait_for(capture(), 5))
+
+        for i, req in enumerate(ready_reqs):
+            self.assertTrue(i == req.cookie)
+
+        reqs = None
+        ready_reqs = None
+        gc.collect()
+
+        ret = cam.stop()
+        self.assertZero(ret)
+
+
+class ImageTestMethods(CameraTesterBase):
+    def setUp(self):
+        if np is None:
+            self.skipTest('NumPy not available')
+
+        super().setUp()
+
+        camconfig = self.cam.generate_configuration([libcam.StreamRole.StillCapture])
+        self.camconfig = camconfig
+        self.cfg = camconfig.at(0)
+        self.rng = np.random.default_rng(0)
+
+    def tearDown(self):
+        self.cfg = None
+        self.camconfig = None
+        super().tearDown()
+
+    def configure(self, fmt, width, height, stride, color_space=None):
+        self.cfg.pixel_format = fmt
+        self.cfg.size = libcam.Size(width, height)
+        self.cfg.stride = stride
+        self.cfg.color_space = color_space
+
+    def random_plane(self, rows, stride):
+        return bytearray(self.rng.integers(0, 256, rows * stride, dtype=np.uint8).tobytes())
+
+    def test_plane_arrays(self):
+        # Interleaved formats are shaped per pixel, and share the memory
+        self.configure(libcam.formats.BGR888, 7, 3, 32)
+        plane = self.random_plane(3, 32)
+        data = libcam.plane_arrays([plane], self.cfg)[0]
+        self.assertEqual(data.shape, (3, 7, 3))
+        plane[32 + 3] = 42
+        self.assertEqual(data[1, 1, 0], 42)
+
+        # Horizontally subsampled formats are exposed as lines of bytes
+        self.configure(libcam.formats.YUYV, 8, 3, 32)
+        data = libcam.plane_arrays([self.random_plane(3, 32)], self.cfg)[0]
+        self.assertEqual(data.shape, (3, 16))
+
+        self.configure(libcam.formats.NV12, 7, 5, 16)
+        y, uv = libcam.plane_arrays([self.random_plane(5, 16),
+                                     self.random_plane(3, 16)], self.cfg)
+        self.assertEqual(y.shape, (5, 7))
+        self.assertEqual(uv.shape, (3, 8))
+
+    def test_unpack_csi2p(self):
+        width, height = 44, 5
+
+        for fmt, bits, stride in [(libcam.formats.SRGGB10_CSI2P, 10, 64),
+                                  (libcam.formats.SRGGB12_CSI2P, 12, 80)]:
+            self.configure(fmt, width, height, stride)
+            plane = self.random_plane(height, stride)
+
+            raw = np.frombuffer(plane, dtype=np.uint8).reshape(height, stride)
+            raw = raw[:, :width * bits // 8].astype(np.uint16)
+
+            if bits == 10:
+                groups = raw.reshape(-1, 5)
+                lsbs = (groups[:, 4:5] >> np.array([0, 2, 4, 6])) & 0x03
+                ref = (groups[:, :4] << 2) | lsbs
+            else:
+                groups = raw.reshape(-1, 3)
+                lsbs = (groups[:, 2:3] >> np.array([0, 4])) & 0x0f
+                ref = (groups[:, :2] << 4) | lsbs
+
+            data = libcam.unpack_csi2p(plane, self.cfg)
+            self.assertEqual(data.dtype, np.uint16)
+            np.testing.assert_array_equal(data, ref.reshape(height, width))
+
+    def nv_to_rgb_reference(self, y, uv, width, height, cb_first, limited):
+        kr, kb = 0.299, 0.114
+        kg = 1.0 - kr - kb
+
+        luma = y[:height, :width].astype(np.float64)
+        chroma = uv.astype(np.float64).repeat(2, axis=0)[:height]
+        cb = chroma[:, 0::2] if cb_first else chroma[:, 1::2]
+        cr = chroma[:, 1::2] if cb_first else chroma[:, 0::2]
+        cb = cb.repeat(2, axis=1)[:, :width] - 128
+        cr = cr.repeat(2, axis=1)[:, :width] - 128
+
+        if limited:
+            luma = (luma - 16) * 255 / 219
+            cb *= 255 / 224
+            cr *= 255 / 224
+
+        r = luma + 2 * (1 - kr) * cr
+        g = luma - 2 * kb * (1 - kb) / kg * cb - 2 * kr * (1 - kr) / kg * cr
+        b = luma + 2 * (1 - kb) * cb
+
+        return np.clip(np.stack([r, g, b], axis=2), 0, 255)
+
+    def test_nv12_to_rgb(self):
+        # Odd sizes to exercise the SIMD and scalar code paths
+        width, height, stride = 37, 11, 48
+
+        for fmt, cb_first in [(libcam.formats.NV12, True),
+                              (libcam.formats.NV21, False)]:
+            for color_space, limited in [(libcam.ColorSpace.Sycc(), False),
+                                         (libcam.ColorSpace.Smpte170m(), True)]:
+                self.configure(fmt, width, height, stride, color_space)
+                y_plane = self.random_plane(height, stride)
+                uv_plane = self.random_plane((height + 1) // 2, stride)
+
+                y = np.frombuffer(y_plane, dtype=np.uint8).reshape(-1, stride)
+                uv = np.frombuffer(uv_plane, dtype=np.uint8).reshape(-1, stride)
+                uv = uv[:, :(width + 1) // 2 * 2]
+
+                ref = self.nv_to_rgb_reference(y, uv, width, height, cb_first, limited)
+                rgb = libcam.nv12_to_rgb(y_plane, uv_plane, self.cfg)
+
+                self.assertEqual(rgb.shape, (height, width, 3))
+                # Allow for the rounding of the fixed-point coefficients
+                self.assertLessEqual(np.abs(rgb - ref).max(), 1.0)
+
 
 # Recursively expand slist's objects into olist, using seen to track already
 # processed objects.
@@ -0,0 +1,142 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2022, Google Inc.
+ *
+ * libcamera V4L2 Subdevice persistent format cache test
+ */
+
+#include <dirent.h>
+#include <iostream>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "libcamera/internal/format_cache.h"
+#include "libcamera/internal/media_device.h"
+#include "libcamera/internal/v4l2_subdevice.h"
+
+#include "v4l2_subdevice_test.h"
+
+using namespace std;
+using namespace libcamera;
+
+/*
+ * Enumerate formats on the "Scaler" subdevice with the format cache enabled,
+ * and verify that only formats retrieved through the cache are stored, and that
+ * a new media device instance retrieves the same formats from the cache.
+ */
+
+class FormatCacheTest : public V4L2SubdeviceTest
+{
+protected:
+	int init() override
+	{
+		int ret = V4L2SubdeviceTest::init();
+		if (ret != TestPass)
+			return ret;
+
+		/*
+		 * The format cache is created on first use, after the media
+		 * device has been populated by the base class.
+		 */
+		char dir[] = "/tmp/libcamera.test.XXXXXX";
+		if (!mkdtemp(dir)) {
+			cerr << "Failed to create temporary directory" << endl;
+			return TestFail;
+		}
+
+		dir_ = dir;
+		setenv("LIBCAMERA_CACHE_DIR", dir_.c_str(), 1);
+
+		return TestPass;
+	}
+
+	int run() override
+	{
+		V4L2Subdevice::Formats formats = scaler_->formats(0);
+		if (formats.empty()) {
+			cerr << "Failed to list formats on pad 0" << endl;
+			return TestFail;
+		}
+
+		if (!cacheFiles().empty()) {
+			cerr << "Uncached formats stored in cache" << endl;
+			return TestFail;
+		}
+
+		if (scaler_->cachedFormats(0) != formats) {
+			cerr << "Cached formats differ from enumerated formats" << endl;
+			return TestFail;
+		}
+
+		if (cacheFiles().size() != 1) {
+			cerr << "Cache file not created" << endl;
+			return TestFail;
+		}
+
+		MediaDevice media(media_->deviceNode());
+		if (media.populate()) {
+			cerr << "Failed to populate media device" << endl;
+			return TestFail;
+		}
+
+		FormatCache *cache = media.formatCache();
+		if (!cache) {
+			cerr << "Format cache not enabled" << endl;
+			return TestFail;
+		}
+
+		FormatCache::Formats cached;
+		if (!cache->lookup(scaler_->entity()->name(), 0, &cached)) {
+			cerr << "Formats not found in cache" << endl;
+			return TestFail;
+		}
+
+		if (cached != formats) {
+			cerr << "Cached formats differ from enumerated formats" << endl;
+			return TestFail;
+		}
+
+		if (cache->lookup(scaler_->entity()->name(), 1, &cached)) {
+			cerr << "Unexpected formats for pad 1 in cache" << endl;
+			return TestFail;
+		}
+
+		return TestPass;
+	}
+
+	void cleanup() override
+	{
+		V4L2SubdeviceTest::cleanup();
+
+		unsetenv("LIBCAMERA_CACHE_DIR");
+
+		for (const std::string &file : cacheFiles())
+			unlink((dir_ + "/" + file).c_str());
+		rmdir(dir_.c_str());
+	}
+
+private:
+	std::vector<std::string> cacheFiles() const
+	{
+		std::vector<std::string> files;
+
+		DIR *dir = opendir(dir_.c_str());
+		if (!dir)
+			return files;
+
+		struct dirent *ent;
+		while ((ent = readdir(dir)) != nullptr) {
+			if (ent->d_name[0] != '.')
+				files.push_back(ent->d_name);
+		}
+
+		closedir(dir);
+
+		return files;
+	}
+
+	std::string dir_;
+};
+
+TEST_REGISTER(FormatCacheTest)